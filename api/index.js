@@ -20,6 +20,16 @@ try {
   console.error('Azalea runtime not available:', e.message);
 }
 
+// site.az is read once per warm instance, not once per request
+let cachedSiteSource;
+function loadSiteSource() {
+  if (cachedSiteSource === undefined) {
+    const siteAzPath = pathModule.join(__dirname, '../site.az');
+    cachedSiteSource = fs.existsSync(siteAzPath) ? fs.readFileSync(siteAzPath, 'utf8') : null;
+  }
+  return cachedSiteSource;
+}
+
 module.exports = async (req, res) => {
   // CRITICAL: Set headers FIRST - before ANY other code
   res.setHeader('Content-Type', 'text/html; charset=utf-8');
@@ -76,9 +86,9 @@ module.exports = async (req, res) => {
     // Execute site.az - Pure Azalea, no JavaScript needed
     if (AzaleaRuntime) {
       try {
-        const siteAzPath = pathModule.join(__dirname, '../site.az');
-        if (fs.existsSync(siteAzPath)) {
-          let siteCode = fs.readFileSync(siteAzPath, 'utf8');
+        const siteSource = loadSiteSource();
+        if (siteSource !== null) {
+          let siteCode = siteSource;
           
           // Get code from POST body (form-encoded)
           let codeFromBody = '';
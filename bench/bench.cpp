@@ -0,0 +1,447 @@
+// Micro and macro benchmarks: the lexer, the parser, both engines, the
+// markdown and view renderers, and whole scripts; make bench runs them
+// over site.az and examples/ and diffs against bench/baseline.tsv
+//
+//   make bench
+//   bin/bench [--filter TEXT] [--min-ms N] [--baseline FILE] [--save FILE]
+//             [--threshold PERCENT] [--check] file.az...
+//
+// Each benchmark reports time and heap allocations per operation and the
+// peak resident set while it ran. --save writes the results as a baseline;
+// --baseline marks each result that moved by more than --threshold percent
+// (10 by default), and with --check a slower one fails the run.
+
+#include "azalea.h"
+#include "dom.h"
+#include "markdown.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <new>
+#include <sstream>
+#include <streambuf>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten/heap.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using namespace azalea;
+
+// Every allocation in the process goes through these, so an operation's
+// allocations are the difference in the count across it
+static std::atomic<uint64_t> allocations{0};
+
+void* operator new(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+namespace {
+
+// Peak resident set in KB. On Linux the peak is reset before each
+// benchmark, so it is that benchmark's; elsewhere it is the process's so far
+void resetPeak() {
+#ifdef __linux__
+    std::ofstream clear("/proc/self/clear_refs");
+    if (clear) clear << "5";
+#endif
+}
+
+size_t peakKb() {
+#ifdef __EMSCRIPTEN__
+    return emscripten_get_heap_size() / 1024;
+#else
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.rfind("VmHWM:", 0) == 0) return static_cast<size_t>(std::strtoull(line.c_str() + 6, nullptr, 10));
+    }
+#endif
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss) / 1024; // bytes there
+#else
+    return static_cast<size_t>(usage.ru_maxrss);
+#endif
+#endif
+}
+
+// What scripts say while they are measured
+class Discard : public output::Sink {
+public:
+    void line(std::string_view) override {}
+};
+
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+class Silence {
+private:
+    NullBuffer null;
+    std::streambuf* saved;
+
+public:
+    Silence() : saved(std::cout.rdbuf(&null)) {}
+    ~Silence() { std::cout.rdbuf(saved); }
+};
+
+bool readFile(const std::string& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    out = buffer.str();
+    return true;
+}
+
+std::string baseName(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+struct Benchmark {
+    std::string name;
+    std::function<void()> op;
+};
+
+struct Result {
+    double nsPerOp = 0;
+    double allocsPerOp = 0;
+    size_t peakKb = 0;
+};
+
+// Runs op in doubling batches until one takes at least minMs, and reports
+// that batch
+bool measure(const Benchmark& bench, double minMs, Result& result, std::string& error) {
+    Silence silence;
+    try {
+        bench.op(); // warm caches, and fail here rather than mid-batch
+        resetPeak();
+        for (uint64_t iterations = 1;; iterations *= 2) {
+            uint64_t allocated = allocations.load(std::memory_order_relaxed);
+            auto start = std::chrono::steady_clock::now();
+            for (uint64_t i = 0; i < iterations; i++) bench.op();
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (ns >= minMs * 1e6 || iterations >= (1ull << 40)) {
+                result.nsPerOp = ns / static_cast<double>(iterations);
+                result.allocsPerOp = static_cast<double>(allocations.load(std::memory_order_relaxed) - allocated) /
+                                     static_cast<double>(iterations);
+                result.peakKb = peakKb();
+                return true;
+            }
+        }
+    } catch (const std::exception& e) {
+        error = e.what();
+        return false;
+    }
+}
+
+// Baselines are "name<TAB>ns/op<TAB>allocs/op<TAB>peak KB" lines
+std::map<std::string, Result> loadBaseline(const std::string& path) {
+    std::map<std::string, Result> baseline;
+    std::ifstream file(path);
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') continue;
+        std::istringstream fields(line);
+        std::string name;
+        Result result;
+        if (std::getline(fields, name, '\t') && fields >> result.nsPerOp >> result.allocsPerOp >> result.peakKb) {
+            baseline[name] = result;
+        }
+    }
+    return baseline;
+}
+
+std::string change(double now, double before) {
+    if (before <= 0) return now > 0 ? "new" : "=";
+    std::ostringstream out;
+    out << std::showpos << std::fixed << std::setprecision(1) << (now - before) / before * 100.0 << "%";
+    return out.str();
+}
+
+// Evaluator microbenchmarks. Each op runs the script again in the same
+// runtime, so after the first it comes from the program cache and only
+// evaluation is measured
+const std::pair<const char*, const char*> SCRIPTS[] = {
+    {"arithmetic", R"(form num total from 0
+loop 2000 do
+    put total plus step times 2 minus 1 over 3 to total
+end
+)"},
+    {"scopes", R"(form num a1 from 1
+form num a2 from 2
+form num a3 from 3
+loop 500 do
+    put a1 plus a2 to b1
+    put b1 plus a3 to b2
+    if b2 over 0 do
+        put b1 times b2 to c1
+        put c1 minus a1 to c2
+        loop 2 do
+            put c2 plus step to d1
+        end
+    end
+end
+)"},
+    {"calls", R"(act add x y do
+    give x plus y
+end
+loop 1000 do
+    call add step 1 put n
+end
+)"},
+    {"tailcalls", R"(act countdown n do
+    if n over 0 do
+        call countdown n minus 1
+    end
+end
+loop 1 do
+    call countdown 1000
+end
+)"},
+    {"strings", R"(form text s from "azalea"
+loop 500 do
+    put s plus " " plus step plus ", " plus s plus "!" to t
+end
+)"},
+};
+
+std::string markdownDocument() {
+    std::string doc;
+    for (int section = 0; section < 50; section++) {
+        doc += "# Section " + std::to_string(section) + "\n";
+        doc += "Some **bold** text and a paragraph that goes on for a while, **twice**.\n";
+        doc += "- first item\n- second item\n* third item\n";
+        doc += "```\ncode <kept> as is\n```\n";
+    }
+    return doc;
+}
+
+Value viewTree() {
+    std::vector<Value> items;
+    for (int i = 0; i < 200; i++) {
+        ValueMap item;
+        item["tag"] = Value("li");
+        item["key"] = Value(std::to_string(i));
+        item["class"] = Value(i % 2 ? "odd" : "even");
+        item["text"] = Value("Item " + std::to_string(i) + " & <more>");
+        items.emplace_back(std::move(item));
+    }
+    ValueMap list;
+    list["tag"] = Value("ul");
+    list["items"] = Value(std::move(items));
+    ValueMap title;
+    title["tag"] = Value("h1");
+    title["content"] = Value("Title");
+    ValueMap root;
+    root["tag"] = Value("div");
+    root["class"] = Value("page");
+    root["content"] = Value(std::vector<Value>{Value(std::move(title)), Value(std::move(list))});
+    return Value(std::move(root));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string filter, baselinePath, savePath;
+    double minMs = 200;
+    double threshold = 10;
+    bool check = false;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (arg == "--min-ms" && i + 1 < argc) {
+            minMs = std::max(1.0, std::atof(argv[++i]));
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--save" && i + 1 < argc) {
+            savePath = argv[++i];
+        } else if (arg == "--threshold" && i + 1 < argc) {
+            threshold = std::max(0.0, std::atof(argv[++i]));
+        } else if (arg == "--check") {
+            check = true;
+        } else if (arg.rfind("--", 0) == 0) {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--filter TEXT] [--min-ms N] [--baseline FILE] [--save FILE] [--threshold PERCENT] [--check] file.az..."
+                      << std::endl;
+            return 1;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    std::vector<std::pair<std::string, std::string>> sources; // name, text
+    for (const std::string& path : files) {
+        std::string source;
+        if (!readFile(path, source)) {
+            std::cerr << "Error: Could not open file " << path << std::endl;
+            return 1;
+        }
+        sources.emplace_back(baseName(path), std::move(source));
+    }
+
+    std::vector<Benchmark> benchmarks;
+    // The front end over the largest script given, site.az under make bench
+    if (!sources.empty()) {
+        auto largest = std::max_element(sources.begin(), sources.end(), [](const auto& a, const auto& b) {
+            return a.second.size() < b.second.size();
+        });
+        const std::string& text = largest->second;
+        benchmarks.push_back({"lex/" + largest->first, [&text]() { Lexer(text).tokenize(); }});
+        benchmarks.push_back({"parse/" + largest->first, [&text]() {
+            SymbolTable symbols;
+            Lexer lexer(text);
+            Program program;
+            Parser parser(lexer, program, symbols);
+            program.root = parser.parse();
+        }});
+        // Loading it again after a one-line edit halfway down, as --watch
+        // and the playground do, which parses only around the edit
+        size_t middle = text.find('\n', text.size() / 2);
+        middle = middle == std::string::npos ? text.size() : middle + 1;
+        auto editor = std::make_shared<Runtime>();
+        editor->compile(text);
+        benchmarks.push_back({"edit/" + largest->first, [&text, editor, middle, version = uint64_t(0)]() mutable {
+            std::string edited = text;
+            edited.insert(middle, "// edit " + std::to_string(++version) + "\n");
+            editor->compile(edited);
+        }});
+    }
+
+    auto discard = std::make_shared<Discard>();
+    std::map<std::string, std::unique_ptr<Runtime>> runtimes;
+    for (const auto& [name, script] : SCRIPTS) {
+        for (Engine engine : {Engine::VM, Engine::TREE}) {
+            std::string label = std::string("eval/") + name + (engine == Engine::VM ? "/vm" : "/tree");
+            Runtime& runtime = *(runtimes[label] = std::make_unique<Runtime>());
+            runtime.setEngine(engine);
+            runtime.setOutput(discard);
+            std::string source = script;
+            benchmarks.push_back({label, [&runtime, source]() { runtime.execute(source); }});
+        }
+    }
+
+    std::string document = markdownDocument();
+    benchmarks.push_back({"markdown/render", [&document]() { renderMarkdown(document); }});
+    Value view = viewTree();
+    benchmarks.push_back({"view/render", [&view]() {
+        dom::Tree tree(view);
+        std::string html;
+        dom::render(tree.root(), html);
+    }});
+
+    // A game step and frame over 10000 bouncing sprites in four textures
+    auto world = std::make_shared<play::World>();
+    auto frame = std::make_shared<play::Frame>();
+    world->bounds(640, 480);
+    for (uint32_t i = 0; i < 10000; i++) {
+        uint32_t id = world->add(i % 640, i % 480, 8, 8, i % 4);
+        world->vx[world->slot(id)] = double(i % 97) - 48;
+        world->vy[world->slot(id)] = double(i % 89) - 44;
+    }
+    benchmarks.push_back({"play/frame", [world, frame]() {
+        world->step(1.0 / 60);
+        world->render(0.5, *frame);
+    }});
+
+    // Whole scripts from a fresh runtime: parse, compile and run
+    for (const auto& [name, text] : sources) {
+        const std::string& source = text;
+        benchmarks.push_back({"run/" + name, [&source, discard]() {
+            Runtime runtime;
+            runtime.setOutput(discard);
+            runtime.execute(source);
+        }});
+    }
+
+    std::map<std::string, Result> baseline;
+    if (!baselinePath.empty()) {
+        baseline = loadBaseline(baselinePath);
+        if (baseline.empty()) std::cerr << "No baseline in " << baselinePath << "; make bench-baseline writes one" << std::endl;
+    }
+
+    std::cout << std::left << std::setw(28) << "benchmark" << std::right << std::setw(14) << "ns/op"
+              << std::setw(12) << "allocs/op" << std::setw(11) << "peak KB";
+    if (!baseline.empty()) std::cout << std::setw(10) << "time" << std::setw(10) << "allocs";
+    std::cout << std::endl;
+
+    std::ofstream save;
+    if (!savePath.empty()) {
+        save.open(savePath);
+        if (!save) {
+            std::cerr << "Error: Cannot write " << savePath << std::endl;
+            return 1;
+        }
+        save << "# benchmark\tns/op\tallocs/op\tpeak KB\n";
+    }
+
+    int failed = 0, slower = 0;
+    for (const Benchmark& bench : benchmarks) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) continue;
+        Result result;
+        std::string error;
+        if (!measure(bench, minMs, result, error)) {
+            std::cout << std::left << std::setw(28) << bench.name << " error: " << error << std::endl;
+            failed++;
+            continue;
+        }
+        std::cout << std::left << std::setw(28) << bench.name << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << result.nsPerOp << std::setw(12) << result.allocsPerOp << std::setw(11)
+                  << result.peakKb;
+        auto before = baseline.find(bench.name);
+        if (before != baseline.end()) {
+            const Result& old = before->second;
+            std::cout << std::setw(10) << change(result.nsPerOp, old.nsPerOp) << std::setw(10)
+                      << change(result.allocsPerOp, old.allocsPerOp);
+            bool worse = result.nsPerOp > old.nsPerOp * (1 + threshold / 100) ||
+                         result.allocsPerOp > old.allocsPerOp * (1 + threshold / 100) + 0.5;
+            bool better = result.nsPerOp < old.nsPerOp * (1 - threshold / 100);
+            if (worse) slower++;
+            std::cout << (worse ? "  slower" : better ? "  faster" : "");
+        }
+        std::cout << std::endl;
+        if (save) {
+            save << bench.name << '\t' << std::fixed << std::setprecision(1) << result.nsPerOp << '\t'
+                 << result.allocsPerOp << '\t' << result.peakKb << '\n';
+        }
+    }
+
+    if (!baseline.empty()) {
+        std::cout << slower << " slower than " << baselinePath << " by more than " << threshold << "%" << std::endl;
+    }
+    if (failed) return 1;
+    return check && slower ? 1 : 0;
+}
@@ -0,0 +1,77 @@
+// Parse throughput over a corpus of .az files; make bench-parse runs examples/
+//
+//   make bench-parse
+//   bin/bench_parse [--iterations N] file.az...
+
+#include "azalea.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+using namespace azalea;
+
+static bool readFile(const std::string& path, std::string& out) {
+    std::ifstream file(path);
+    if (!file.is_open()) return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    out = buffer.str();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 200;
+    std::vector<std::string> sources;
+    size_t bytes = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::max(1, std::atoi(argv[++i]));
+            continue;
+        }
+        std::string source;
+        if (!readFile(arg, source)) {
+            std::cerr << "Error: Could not open file " << arg << std::endl;
+            return 1;
+        }
+        bytes += source.size();
+        sources.push_back(std::move(source));
+    }
+    if (sources.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--iterations N] file.az..." << std::endl;
+        return 1;
+    }
+
+    // Count tokens once so throughput can be reported per token too
+    size_t tokens = 0;
+    for (const auto& source : sources) {
+        tokens += Lexer(source).tokenize().size();
+    }
+
+    SymbolTable symbols;
+    size_t nodes = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int it = 0; it < iterations; it++) {
+        for (const auto& source : sources) {
+            Lexer lexer(source);
+            Program program;
+            Parser parser(lexer, program, symbols);
+            program.root = parser.parse();
+            nodes += program.root->children.size();
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    double totalBytes = static_cast<double>(bytes) * iterations;
+    double totalTokens = static_cast<double>(tokens) * iterations;
+    std::cout << sources.size() << " files, " << bytes << " bytes, " << tokens << " tokens, "
+              << (nodes / iterations) << " statements, " << iterations << " iterations" << std::endl;
+    std::cout << "parse: " << (seconds * 1000.0) << " ms, "
+              << (totalBytes / seconds / (1024.0 * 1024.0)) << " MB/s, "
+              << (totalTokens / seconds / 1e6) << " Mtokens/s" << std::endl;
+    return 0;
+}
@@ -20,9 +20,10 @@ mkdir -p build bin web
 
 # Build native interpreter
 echo "Building native interpreter..."
-g++ -std=c++17 -Wall -Wextra -O2 -c src/azalea.cpp -o build/azalea.o
-g++ -std=c++17 -Wall -Wextra -O2 -c src/main.cpp -o build/main.o
-g++ build/azalea.o build/main.o -o bin/azalea
+for src in src/*.cpp; do
+    g++ -std=c++17 -Wall -Wextra -O2 -c "$src" -o "build/$(basename "${src%.cpp}").o"
+done
+g++ build/*.o -o bin/azalea
 
 echo "✓ Native build complete: bin/azalea"
 
@@ -37,7 +38,7 @@ if [ "$HAS_EMSCRIPTEN" = true ]; then
          -s MODULARIZE=1 \
          -s EXPORT_NAME="'AzaleaModule'" \
          --bind \
-         src/azalea.cpp src/main.cpp \
+         src/*.cpp \
          -o web/azalea.js
     
     echo "✓ WASM build complete: web/azalea.js"
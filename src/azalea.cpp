@@ -1,10 +1,33 @@
 #include "azalea.h"
+#include "vm.h"
+#include "csv.h"
+#include "dom.h"
+#include "image.h"
+#include "kernels.h"
+#include "markdown.h"
+#include "outline.h"
+#include "database.h"
+#include "files.h"
+#include "process.h"
+#include "profile.h"
+#include "query.h"
+#include "scheduler.h"
+#include "hash.h"
+#include <cerrno>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <thread>
 #include <chrono>
 #include <future>
 #include <mutex>
 #include <map>
+#include <unordered_set>
+#include <sys/stat.h>
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
@@ -14,7 +37,7 @@
 namespace azalea {
 
 // Number word mappings
-std::map<std::string, double> numberWords = {
+FlatMap<double> numberWords = {
     {"zero", 0}, {"one", 1}, {"two", 2}, {"three", 3}, {"four", 4},
     {"five", 5}, {"six", 6}, {"seven", 7}, {"eight", 8}, {"nine", 9},
     {"ten", 10}, {"eleven", 11}, {"twelve", 12}, {"thirteen", 13},
@@ -26,17 +49,26 @@ std::map<std::string, double> numberWords = {
     {"four_g", 4 * 1024 * 1024 * 1024}
 };
 
+// As std::stod, without the exceptions: false when text does not start
+// with a number or it is out of range
+static bool parseNumber(const std::string& text, double& out) {
+    const char* start = text.c_str();
+    char* end = nullptr;
+    errno = 0;
+    double num = std::strtod(start, &end);
+    if (end == start || errno == ERANGE) return false;
+    out = num;
+    return true;
+}
+
 double wordToNumber(const std::string& word) {
     auto it = numberWords.find(word);
     if (it != numberWords.end()) {
         return it->second;
     }
     // Try to parse as number
-    try {
-        return std::stod(word);
-    } catch (...) {
-        return 0.0;
-    }
+    double num;
+    return parseNumber(word, num) ? num : 0.0;
 }
 
 std::string numberToWord(double num) {
@@ -49,55 +81,295 @@ std::string numberToWord(double num) {
 }
 
 // Value implementation
+void Value::destroy() {
+    switch (type) {
+        case ValueType::TEXT: delete static_cast<TextObject*>(object); break;
+        case ValueType::LIST: delete static_cast<ListObject*>(object); break;
+        case ValueType::MAP: delete static_cast<MapObject*>(object); break;
+        case ValueType::FUNC: delete static_cast<FuncObject*>(object); break;
+        default: break;
+    }
+}
+
 std::string Value::toString() const {
+    if (type == ValueType::TEXT) {
+        return std::string(textView());
+    }
+    std::string result;
+    appendTo(result);
+    return result;
+}
+
+void Value::appendTo(std::string& out) const {
     switch (type) {
-        case ValueType::NUM:
-            return std::to_string(std::get<double>(data));
-        case ValueType::TEXT:
-            return std::get<std::string>(data);
+        case ValueType::NUM: {
+            // Same digits as std::to_string, without its temporary
+            char buffer[64];
+            int length = std::snprintf(buffer, sizeof(buffer), "%f", num);
+            if (length > 0 && static_cast<size_t>(length) < sizeof(buffer)) {
+                out.append(buffer, static_cast<size_t>(length));
+            } else {
+                out += std::to_string(num);
+            }
+            break;
+        }
+        case ValueType::TEXT: {
+            const TextObject* text = static_cast<const TextObject*>(object);
+            if (text->isRope()) {
+                for (const Value& piece : text->pieces) {
+                    piece.appendTo(out);
+                }
+            } else if (text->view) {
+                out.append(text->view, text->size);
+            } else {
+                out += text->text;
+            }
+            break;
+        }
         case ValueType::BOOL:
-            return std::get<bool>(data) ? "true" : "false";
+            out += boolean ? "true" : "false";
+            break;
         case ValueType::VOID:
-            return "void";
+            out += "void";
+            break;
         case ValueType::LIST: {
-            std::string result = "[";
-            auto& list = std::get<std::vector<ValuePtr>>(data);
+            out += '[';
+            if (const std::vector<double>* numbers = asNumbers()) {
+                for (size_t i = 0; i < numbers->size(); i++) {
+                    if (i > 0) out += ", ";
+                    Value((*numbers)[i]).appendTo(out);
+                }
+                out += ']';
+                break;
+            }
+            if (const std::vector<uint8_t>* flags = asBools()) {
+                for (size_t i = 0; i < flags->size(); i++) {
+                    if (i > 0) out += ", ";
+                    out += (*flags)[i] ? "true" : "false";
+                }
+                out += ']';
+                break;
+            }
+            auto& list = asList();
             for (size_t i = 0; i < list.size(); i++) {
-                if (i > 0) result += ", ";
-                result += list[i]->toString();
+                if (i > 0) out += ", ";
+                list[i].appendTo(out);
             }
-            result += "]";
-            return result;
+            out += ']';
+            break;
         }
         case ValueType::MAP: {
-            std::string result = "{";
-            auto& map = std::get<std::map<std::string, ValuePtr>>(data);
+            out += '{';
             bool first = true;
-            for (const auto& pair : map) {
-                if (!first) result += ", ";
-                result += pair.first + ": " + pair.second->toString();
+            for (const auto& pair : asMap()) {
+                if (!first) out += ", ";
+                out += pair.first;
+                out += ": ";
+                pair.second.appendTo(out);
                 first = false;
             }
-            result += "}";
-            return result;
+            out += '}';
+            break;
         }
         default:
-            return "unknown";
+            out += "unknown";
+            break;
+    }
+}
+
+namespace {
+
+// Shorter results are copied flat; a rope's bookkeeping isn't worth it
+constexpr size_t ROPE_MIN_SIZE = 256;
+// Deeper ropes are flattened as they are built, which bounds the recursion
+// in appendTo and in freeing them
+constexpr uint32_t ROPE_MAX_DEPTH = 256;
+
+} // namespace
+
+Value Value::concat(std::initializer_list<Value> parts) {
+    size_t total = 0;
+    for (const Value& part : parts) {
+        total += part.type == ValueType::TEXT ? static_cast<const TextObject*>(part.object)->size : 16;
+    }
+    if (total < ROPE_MIN_SIZE) {
+        std::string flat;
+        flat.reserve(total);
+        for (const Value& part : parts) {
+            part.appendTo(flat);
+        }
+        return Value(std::move(flat));
+    }
+
+    std::vector<Value> pieces;
+    pieces.reserve(parts.size());
+    total = 0;
+    uint32_t depth = 0;
+    for (const Value& part : parts) {
+        if (part.type == ValueType::TEXT) {
+            const TextObject* text = static_cast<const TextObject*>(part.object);
+            if (text->size == 0) continue;
+            total += text->size;
+            depth = std::max(depth, text->depth);
+            pieces.push_back(part);
+        } else {
+            pieces.emplace_back(part.toString());
+            total += pieces.back().asText().size();
+        }
+    }
+    Value result;
+    result.type = ValueType::TEXT;
+    TextObject* rope = new TextObject(std::move(pieces), total, depth + 1);
+    result.object = rope;
+    if (rope->depth > ROPE_MAX_DEPTH) {
+        rope->flatten();
+    }
+    return result;
+}
+
+Value Value::numbers(std::vector<double> items) {
+    ListObject* list = new ListObject(std::vector<Value>());
+    list->numbers = std::move(items);
+    list->packing = ListObject::Packing::NUMBERS;
+    Value result;
+    result.type = ValueType::LIST;
+    result.object = list;
+    return result;
+}
+
+Value Value::bools(std::vector<uint8_t> items) {
+    ListObject* list = new ListObject(std::vector<Value>());
+    list->flags = std::move(items);
+    list->packing = ListObject::Packing::BOOLS;
+    Value result;
+    result.type = ValueType::LIST;
+    result.object = list;
+    return result;
+}
+
+Value Value::pack(std::vector<Value> items) {
+    if (items.empty()) return Value(std::move(items));
+    ValueType itemType = items[0].type;
+    for (const Value& item : items) {
+        if (item.type != itemType) return Value(std::move(items));
+    }
+    if (itemType == ValueType::NUM) {
+        std::vector<double> packed(items.size());
+        for (size_t i = 0; i < items.size(); i++) packed[i] = items[i].num;
+        return numbers(std::move(packed));
+    }
+    if (itemType == ValueType::BOOL) {
+        std::vector<uint8_t> packed(items.size());
+        for (size_t i = 0; i < items.size(); i++) packed[i] = items[i].boolean;
+        return bools(std::move(packed));
+    }
+    return Value(std::move(items));
+}
+
+FuncObject::FuncObject(ActPtr a) : act(std::move(a)) {
+    fn = [act = this->act](const std::vector<Value>& args, Runtime& runtime) {
+        return runtime.call(*act, args.data(), args.size());
+    };
+}
+
+void ListObject::box() {
+    if (packing == Packing::NUMBERS) {
+        items.reserve(numbers.size());
+        for (double number : numbers) {
+            items.emplace_back(number);
+        }
+        numbers.clear();
+        numbers.shrink_to_fit();
+    } else if (packing == Packing::BOOLS) {
+        items.reserve(flags.size());
+        for (uint8_t flag : flags) {
+            items.emplace_back(flag != 0);
+        }
+        flags.clear();
+        flags.shrink_to_fit();
+    }
+    packing = Packing::BOXED;
+}
+
+size_t ListObject::size() const {
+    switch (packing) {
+        case Packing::NUMBERS: return numbers.size();
+        case Packing::BOOLS: return flags.size();
+        case Packing::BOXED: break;
+    }
+    return items.size();
+}
+
+Value ListObject::get(size_t index) const {
+    switch (packing) {
+        case Packing::NUMBERS: return Value(numbers[index]);
+        case Packing::BOOLS: return Value(flags[index] != 0);
+        case Packing::BOXED: break;
+    }
+    return items[index];
+}
+
+void ListObject::set(size_t index, Value value) {
+    if (packing == Packing::NUMBERS && value.type == ValueType::NUM) {
+        numbers[index] = value.num;
+    } else if (packing == Packing::BOOLS && value.type == ValueType::BOOL) {
+        flags[index] = value.boolean;
+    } else {
+        box();
+        items[index] = std::move(value);
+    }
+}
+
+void ListObject::push(Value value) {
+    // An empty list packs for the type of its first item
+    if (packing == Packing::BOXED && items.empty()) {
+        if (value.type == ValueType::NUM) packing = Packing::NUMBERS;
+        if (value.type == ValueType::BOOL) packing = Packing::BOOLS;
+    }
+    if (packing == Packing::NUMBERS && value.type == ValueType::NUM) {
+        numbers.push_back(value.num);
+    } else if (packing == Packing::BOOLS && value.type == ValueType::BOOL) {
+        flags.push_back(value.boolean);
+    } else {
+        box();
+        items.push_back(std::move(value));
     }
 }
 
+Value Value::view(std::string_view chars, std::shared_ptr<const void> owner) {
+    Value result;
+    result.type = ValueType::TEXT;
+    result.object = new TextObject(chars, std::move(owner));
+    return result;
+}
+
+void TextObject::flatten() {
+    if (view) {
+        text.assign(view, size);
+        view = nullptr;
+        owner.reset();
+        return;
+    }
+    std::string flat;
+    flat.reserve(size);
+    for (const Value& piece : pieces) {
+        piece.appendTo(flat);
+    }
+    text = std::move(flat);
+    pieces.clear();
+    pieces.shrink_to_fit();
+    depth = 0;
+}
+
 double Value::toNumber() const {
     switch (type) {
         case ValueType::NUM:
-            return std::get<double>(data);
+            return num;
         case ValueType::BOOL:
-            return std::get<bool>(data) ? 1.0 : 0.0;
+            return boolean ? 1.0 : 0.0;
         case ValueType::TEXT: {
-            try {
-                return std::stod(std::get<std::string>(data));
-            } catch (...) {
-                return wordToNumber(std::get<std::string>(data));
-            }
+            double num;
+            return parseNumber(asText(), num) ? num : wordToNumber(asText());
         }
         default:
             return 0.0;
@@ -107,49 +379,301 @@ double Value::toNumber() const {
 bool Value::toBool() const {
     switch (type) {
         case ValueType::BOOL:
-            return std::get<bool>(data);
+            return boolean;
         case ValueType::NUM:
-            return std::get<double>(data) != 0.0;
+            return num != 0.0;
         case ValueType::TEXT:
-            return !std::get<std::string>(data).empty();
+            return static_cast<const TextObject*>(object)->size != 0;
         default:
             return false;
     }
 }
 
+Value Value::clone() const {
+    switch (type) {
+        case ValueType::TEXT: {
+            // A view's owner is shared safely; its characters are read-only
+            const TextObject* text = static_cast<const TextObject*>(object);
+            if (text->view) return view(textView(), text->owner);
+            return Value(asText());
+        }
+        case ValueType::LIST: {
+            if (const std::vector<double>* numbers = asNumbers()) {
+                return Value::numbers(*numbers);
+            }
+            if (const std::vector<uint8_t>* flags = asBools()) {
+                return Value::bools(*flags);
+            }
+            std::vector<Value> items;
+            items.reserve(asList().size());
+            for (const Value& item : asList()) {
+                items.push_back(item.clone());
+            }
+            return Value(std::move(items));
+        }
+        case ValueType::MAP: {
+            ValueMap entries;
+            for (const auto& pair : asMap()) {
+                entries.emplace_hint(entries.end(), pair.first, pair.second.clone());
+            }
+            return Value(std::move(entries));
+        }
+        case ValueType::FUNC: {
+            // Closures capture only AST nodes and compiled code, which are
+            // shared read-only
+            const FuncObject* func = static_cast<const FuncObject*>(object);
+            if (func->act) return Value(func->act);
+            return Value(asFunc());
+        }
+        default:
+            return *this;
+    }
+}
+
+// Arena implementation
+void* Arena::grow(size_t bytes, size_t align) {
+    size_t size = std::max(nextBlockSize, bytes + align);
+    blocks.emplace_back(new char[size]);
+    cursor = blocks.back().get();
+    limit = cursor + size;
+    if (nextBlockSize < 1024 * 1024) nextBlockSize *= 2;
+    return allocate(bytes, align);
+}
+
+std::string_view Arena::copy(std::string_view text) {
+    if (text.empty()) return std::string_view();
+    char* data = allocArray<char>(text.size());
+    std::memcpy(data, text.data(), text.size());
+    return std::string_view(data, text.size());
+}
+
+void Arena::reset() {
+    blocks.clear();
+    cursor = nullptr;
+    limit = nullptr;
+    nextBlockSize = 4096;
+}
+
+// SymbolTable implementation
+SymbolTable::SymbolTable(const SymbolTable& other)
+    : copied(other.storages()), ids(other.ids), names(other.names) {}
+
+SymbolTable::Storages SymbolTable::storages() const {
+    Storages all = copied;
+    all.push_back(storage);
+    return all;
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+    auto it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+    storage->emplace_back(name);
+    std::string_view stored = storage->back();
+    Symbol symbol = static_cast<Symbol>(names.size());
+    names.push_back(stored);
+    ids.emplace(stored, symbol);
+    return symbol;
+}
+
 // Lexer implementation
-const std::vector<std::string> Lexer::keywords = {
-    "form", "act", "call", "give", "say", "do", "end", "if", "loop",
-    "over", "under", "same", "not", "and", "or", "from", "to", "with",
-    "as", "num", "text", "list", "map", "bool", "void", "put", "make",
-    "on", "serve", "view", "read", "write", "net", "file", "vm", "play",
-    "else", "plus", "minus", "times", "div", "show", "render", "style",
-    "button", "btn", "input", "field", "image", "img", "label", "pane",
-    "div", "box", "ul", "start", "route", "post", "delete", "del",
-    "static", "files", "json", "send", "css", "link", "head", "body",
-    "title", "h1", "h2", "h3", "p", "span", "a", "form", "select",
-    "option", "table", "tr", "td", "th", "header", "footer", "nav",
-    "section", "article", "aside", "main", "grid", "row", "col", "card",
+namespace {
+
+// Character classes for the lexer's dispatch, one table lookup per byte
+enum CharClass : uint8_t {
+    CC_SPACE = 1 << 0,
+    CC_DIGIT = 1 << 1,
+    CC_ALPHA = 1 << 2, // letters and '_': may start an identifier
+    CC_SYMBOL = 1 << 3
+};
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> table{};
+    for (char c : {' ', '\t', '\n', '\v', '\f', '\r'}) table[static_cast<uint8_t>(c)] |= CC_SPACE;
+    for (int c = '0'; c <= '9'; c++) table[c] |= CC_DIGIT;
+    for (int c = 'a'; c <= 'z'; c++) table[c] |= CC_ALPHA;
+    for (int c = 'A'; c <= 'Z'; c++) table[c] |= CC_ALPHA;
+    table['_'] |= CC_ALPHA;
+    for (char c : {'.', ',', '/', '?', '!', ';'}) table[static_cast<uint8_t>(c)] |= CC_SYMBOL;
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> charClasses = makeCharClasses();
+
+inline bool hasClass(char c, uint8_t cls) {
+    return (charClasses[static_cast<uint8_t>(c)] & cls) != 0;
+}
+
+// What the parser does with a keyword, so each token is classified once
+enum class Stmt : uint8_t {
+    NONE, FORM, ACT, CALL, IF, LOOP, GIVE, SAY, PUT
+};
+
+enum KeywordFlag : uint8_t {
+    KW_HTML = 1 << 0,      // HTML element usable as a bare statement ("h1 Title")
+    KW_MODULE = 1 << 1,    // module name usable without "call" ("view h1 Title")
+    KW_ENDS_ARGS = 1 << 2, // ends the arguments of a bare element or module call
+    KW_ENDS_CALL = 1 << 3, // may end the arguments of "call"
+    KW_LINE_ARGS = 1 << 4  // "call" into this module takes the rest of its line only
+};
+
+struct KeywordInfo {
+    std::string_view word;
+    Stmt stmt;
+    uint8_t precedence; // binary operator precedence, 0 if not an operator
+    uint8_t flags;
+};
+
+// Entry 0 is the non-keyword sentinel; Token::keyword indexes this table
+constexpr KeywordInfo keywordList[] = {
+    {"", Stmt::NONE, 0, 0},
+    {"form", Stmt::FORM, 0, KW_ENDS_ARGS | KW_HTML}, {"act", Stmt::ACT, 0, KW_ENDS_ARGS},
+    {"call", Stmt::CALL, 0, KW_ENDS_ARGS}, {"give", Stmt::GIVE, 0, KW_ENDS_ARGS | KW_ENDS_CALL},
+    {"say", Stmt::SAY, 0, KW_ENDS_ARGS}, {"do", Stmt::NONE, 0, KW_ENDS_ARGS},
+    {"end", Stmt::NONE, 0, KW_ENDS_ARGS}, {"if", Stmt::IF, 0, KW_ENDS_ARGS},
+    {"loop", Stmt::LOOP, 0, KW_ENDS_ARGS},
+    {"over", Stmt::NONE, 4, 0}, {"under", Stmt::NONE, 4, 0},
+    {"same", Stmt::NONE, 3, 0}, {"not", Stmt::NONE, 3, 0},
+    {"and", Stmt::NONE, 2, 0}, {"or", Stmt::NONE, 1, 0},
+    {"from", Stmt::NONE, 0, 0}, {"to", Stmt::NONE, 0, KW_ENDS_CALL},
+    {"with", Stmt::NONE, 0, KW_ENDS_CALL}, {"as", Stmt::NONE, 0, 0},
+    {"num", Stmt::NONE, 0, 0}, {"text", Stmt::NONE, 0, 0},
+    {"list", Stmt::NONE, 0, KW_LINE_ARGS}, {"map", Stmt::NONE, 0, 0},
+    {"bool", Stmt::NONE, 0, 0}, {"void", Stmt::NONE, 0, 0},
+    {"put", Stmt::PUT, 0, KW_ENDS_ARGS | KW_ENDS_CALL}, {"make", Stmt::FORM, 0, 0},
+    {"on", Stmt::NONE, 0, KW_ENDS_CALL}, {"serve", Stmt::NONE, 0, KW_MODULE | KW_LINE_ARGS},
+    {"view", Stmt::NONE, 0, KW_MODULE}, {"read", Stmt::NONE, 0, 0},
+    {"write", Stmt::SAY, 0, 0}, {"net", Stmt::NONE, 0, KW_MODULE | KW_LINE_ARGS},
+    {"file", Stmt::NONE, 0, KW_MODULE | KW_LINE_ARGS}, {"vm", Stmt::NONE, 0, 0},
+    {"play", Stmt::NONE, 0, KW_MODULE | KW_LINE_ARGS}, {"else", Stmt::NONE, 0, 0},
+    {"go", Stmt::NONE, 0, KW_LINE_ARGS}, {"channel", Stmt::NONE, 0, KW_LINE_ARGS},
+    {"plus", Stmt::NONE, 5, 0}, {"minus", Stmt::NONE, 5, 0},
+    {"times", Stmt::NONE, 6, 0}, {"div", Stmt::NONE, 6, KW_HTML},
+    {"show", Stmt::SAY, 0, 0}, {"render", Stmt::NONE, 0, 0},
+    {"style", Stmt::NONE, 0, 0}, {"button", Stmt::NONE, 0, KW_HTML},
+    {"btn", Stmt::NONE, 0, 0}, {"input", Stmt::NONE, 0, KW_HTML},
+    {"field", Stmt::NONE, 0, 0}, {"image", Stmt::NONE, 0, 0},
+    {"img", Stmt::NONE, 0, KW_HTML}, {"label", Stmt::NONE, 0, 0},
+    {"pane", Stmt::NONE, 0, 0}, {"box", Stmt::NONE, 0, 0},
+    {"ul", Stmt::NONE, 0, KW_HTML}, {"start", Stmt::NONE, 0, 0},
+    {"route", Stmt::NONE, 0, 0}, {"post", Stmt::NONE, 0, 0},
+    {"query", Stmt::NONE, 0, KW_LINE_ARGS}, {"csv", Stmt::NONE, 0, KW_LINE_ARGS},
+    {"database", Stmt::NONE, 0, KW_LINE_ARGS}, {"run", Stmt::NONE, 0, KW_LINE_ARGS},
+    {"delete", Stmt::NONE, 0, 0}, {"del", Stmt::NONE, 0, 0},
+    {"static", Stmt::NONE, 0, 0}, {"files", Stmt::NONE, 0, 0},
+    {"json", Stmt::NONE, 0, 0}, {"send", Stmt::GIVE, 0, 0},
+    {"css", Stmt::NONE, 0, 0}, {"link", Stmt::NONE, 0, 0},
+    {"head", Stmt::NONE, 0, 0}, {"body", Stmt::NONE, 0, 0},
+    {"title", Stmt::NONE, 0, 0}, {"h1", Stmt::NONE, 0, KW_HTML},
+    {"h2", Stmt::NONE, 0, KW_HTML}, {"h3", Stmt::NONE, 0, KW_HTML},
+    {"p", Stmt::NONE, 0, KW_HTML}, {"span", Stmt::NONE, 0, KW_HTML},
+    {"a", Stmt::NONE, 0, KW_HTML}, {"select", Stmt::NONE, 0, 0},
+    {"option", Stmt::NONE, 0, 0}, {"table", Stmt::NONE, 0, KW_HTML},
+    {"tr", Stmt::NONE, 0, KW_HTML}, {"td", Stmt::NONE, 0, KW_HTML},
+    {"th", Stmt::NONE, 0, 0}, {"header", Stmt::NONE, 0, KW_HTML},
+    {"footer", Stmt::NONE, 0, KW_HTML}, {"nav", Stmt::NONE, 0, KW_HTML},
+    {"section", Stmt::NONE, 0, KW_HTML}, {"article", Stmt::NONE, 0, KW_HTML},
+    {"aside", Stmt::NONE, 0, KW_HTML}, {"main", Stmt::NONE, 0, KW_HTML},
+    {"grid", Stmt::NONE, 0, 0}, {"row", Stmt::NONE, 0, 0},
+    {"col", Stmt::NONE, 0, 0}, {"card", Stmt::NONE, 0, 0},
     // Flexible syntax keywords
-    "let", "var", "const", "set", "create", "new", "def", "fn", "func",
-    "return", "print", "output", "display", "when", "then", "while", "for",
-    "each", "repeat", "until", "break", "continue", "switch", "case",
-    "equals", "is", "are", "has", "have", "contains", "include",
-    "add", "subtract", "multiply", "divide", "mod", "power", "sqrt",
-    "greater", "less", "equal", "notequal", "andalso", "orelse",
+    {"let", Stmt::FORM, 0, 0}, {"var", Stmt::FORM, 0, 0},
+    {"const", Stmt::FORM, 0, 0}, {"set", Stmt::FORM, 0, 0},
+    {"create", Stmt::FORM, 0, 0}, {"new", Stmt::FORM, 0, 0},
+    {"def", Stmt::ACT, 0, 0}, {"fn", Stmt::ACT, 0, 0},
+    {"func", Stmt::ACT, 0, 0}, {"return", Stmt::GIVE, 0, 0},
+    {"print", Stmt::SAY, 0, 0}, {"output", Stmt::SAY, 0, 0},
+    {"display", Stmt::SAY, 0, 0}, {"when", Stmt::IF, 0, KW_ENDS_CALL},
+    {"then", Stmt::NONE, 0, KW_ENDS_ARGS | KW_ENDS_CALL}, {"while", Stmt::LOOP, 0, 0},
+    {"for", Stmt::LOOP, 0, 0}, {"each", Stmt::LOOP, 0, 0},
+    {"repeat", Stmt::LOOP, 0, 0}, {"until", Stmt::NONE, 0, 0},
+    {"break", Stmt::NONE, 0, 0}, {"continue", Stmt::NONE, 0, 0},
+    {"switch", Stmt::NONE, 0, 0}, {"case", Stmt::NONE, 0, 0},
+    {"equals", Stmt::NONE, 0, 0}, {"is", Stmt::NONE, 0, 0},
+    {"are", Stmt::NONE, 0, 0}, {"has", Stmt::NONE, 0, 0},
+    {"have", Stmt::NONE, 0, 0}, {"contains", Stmt::NONE, 0, 0},
+    {"include", Stmt::NONE, 0, 0},
+    {"add", Stmt::NONE, 0, 0}, {"subtract", Stmt::NONE, 0, 0},
+    {"multiply", Stmt::NONE, 0, 0}, {"divide", Stmt::NONE, 0, 0},
+    {"mod", Stmt::NONE, 0, 0}, {"power", Stmt::NONE, 0, 0},
+    {"sqrt", Stmt::NONE, 0, 0},
+    {"greater", Stmt::NONE, 0, 0}, {"less", Stmt::NONE, 0, 0},
+    {"equal", Stmt::NONE, 0, 0}, {"notequal", Stmt::NONE, 0, 0},
+    {"andalso", Stmt::NONE, 0, 0}, {"orelse", Stmt::NONE, 0, 0},
     // CSS and styling
-    "color", "background", "bg", "width", "height", "margin", "padding",
-    "border", "radius", "shadow", "font", "size", "weight", "family",
-    "align", "center", "left", "right", "justify", "flex", "grid",
-    "display", "position", "absolute", "relative", "fixed", "sticky",
-    "top", "bottom", "left", "right", "zindex", "opacity", "transform",
-    "transition", "animation", "hover", "active", "focus", "visited"
+    {"color", Stmt::NONE, 0, 0}, {"background", Stmt::NONE, 0, 0},
+    {"bg", Stmt::NONE, 0, 0}, {"width", Stmt::NONE, 0, 0},
+    {"height", Stmt::NONE, 0, 0}, {"margin", Stmt::NONE, 0, 0},
+    {"padding", Stmt::NONE, 0, 0}, {"border", Stmt::NONE, 0, 0},
+    {"radius", Stmt::NONE, 0, 0}, {"shadow", Stmt::NONE, 0, 0},
+    {"font", Stmt::NONE, 0, 0}, {"size", Stmt::NONE, 0, 0},
+    {"weight", Stmt::NONE, 0, 0}, {"family", Stmt::NONE, 0, 0},
+    {"align", Stmt::NONE, 0, 0}, {"center", Stmt::NONE, 0, 0},
+    {"left", Stmt::NONE, 0, 0}, {"right", Stmt::NONE, 0, 0},
+    {"justify", Stmt::NONE, 0, 0}, {"flex", Stmt::NONE, 0, 0},
+    {"position", Stmt::NONE, 0, 0}, {"absolute", Stmt::NONE, 0, 0},
+    {"relative", Stmt::NONE, 0, 0}, {"fixed", Stmt::NONE, 0, 0},
+    {"sticky", Stmt::NONE, 0, 0}, {"top", Stmt::NONE, 0, 0},
+    {"bottom", Stmt::NONE, 0, 0}, {"zindex", Stmt::NONE, 0, 0},
+    {"opacity", Stmt::NONE, 0, 0}, {"transform", Stmt::NONE, 0, 0},
+    {"transition", Stmt::NONE, 0, 0}, {"animation", Stmt::NONE, 0, 0},
+    {"hover", Stmt::NONE, 0, 0}, {"active", Stmt::NONE, 0, 0},
+    {"focus", Stmt::NONE, 0, 0}, {"visited", Stmt::NONE, 0, 0}
+};
+
+constexpr size_t KEYWORD_COUNT = sizeof(keywordList) / sizeof(keywordList[0]);
+constexpr size_t KEYWORD_TABLE_BITS = 12;
+constexpr size_t KEYWORD_TABLE_SIZE = size_t(1) << KEYWORD_TABLE_BITS;
+static_assert(KEYWORD_COUNT <= 256, "keyword ids must fit in a uint8_t");
+
+constexpr uint32_t keywordHash(std::string_view word, uint32_t seed) {
+    uint32_t h = seed;
+    for (char c : word) {
+        h = (h ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+    return (h ^ (h >> 15)) & (KEYWORD_TABLE_SIZE - 1);
+}
+
+// Perfect hash over the keyword set: the first seed for which no two
+// keywords share a slot. Slots hold a keyword id, 0 when empty
+struct KeywordTable {
+    uint32_t seed = 0;
+    std::array<uint8_t, KEYWORD_TABLE_SIZE> slots{};
 };
 
-const std::string Lexer::symbols = ".,/?!;";
+constexpr KeywordTable makeKeywordTable() {
+    for (uint32_t seed = 2166136261u;; seed++) {
+        KeywordTable table;
+        table.seed = seed;
+        bool perfect = true;
+        for (size_t i = 1; i < KEYWORD_COUNT && perfect; i++) {
+            uint8_t& slot = table.slots[keywordHash(keywordList[i].word, seed)];
+            if (slot != 0) {
+                perfect = false;
+            } else {
+                slot = static_cast<uint8_t>(i);
+            }
+        }
+        if (perfect) return table;
+    }
+}
+
+constexpr KeywordTable keywordTable = makeKeywordTable();
+
+inline const KeywordInfo& keywordOf(const Token& tok) {
+    return keywordList[tok.keyword];
+}
+
+} // namespace
+
+uint8_t Lexer::keywordId(std::string_view word) {
+    uint8_t id = keywordTable.slots[keywordHash(word, keywordTable.seed)];
+    return id != 0 && keywordList[id].word == word ? id : 0;
+}
 
 void Lexer::skipWhitespace() {
-    while (pos < source.length() && std::isspace(source[pos])) {
+    while (pos < source.length() && hasClass(source[pos], CC_SPACE)) {
         if (source[pos] == '\n') {
             line++;
             col = 1;
@@ -189,7 +713,7 @@ void Lexer::skipComment() {
 Token Lexer::readNumber() {
     size_t start = pos;
     bool hasDot = false;
-    while (pos < source.length() && (std::isdigit(source[pos]) || source[pos] == '.')) {
+    while (pos < source.length() && (hasClass(source[pos], CC_DIGIT) || source[pos] == '.')) {
         if (source[pos] == '.') {
             if (hasDot) break;
             hasDot = true;
@@ -197,6 +721,7 @@ Token Lexer::readNumber() {
         pos++;
         col++;
     }
+    // "5say" lexes as NUMBER 5 followed by the keyword
     return Token(TokenType::NUMBER, source.substr(start, pos - start), line, col);
 }
 
@@ -213,7 +738,7 @@ Token Lexer::readString() {
             col++;
         }
     }
-    std::string value = source.substr(start, pos - start);
+    std::string_view value = source.substr(start, pos - start);
     pos++;
     col++;
     return Token(TokenType::STRING, value, line, col);
@@ -221,98 +746,73 @@ Token Lexer::readString() {
 
 Token Lexer::readIdentifier() {
     size_t start = pos;
-    // Check if we start with a number (for "5say" style tokens)
-    bool startsWithNumber = std::isdigit(source[pos]);
-    size_t numberEnd = pos;
-    
-    if (startsWithNumber) {
-        // Read the number part
-        while (numberEnd < source.length() && std::isdigit(source[numberEnd])) {
-            numberEnd++;
-        }
-        // Check if there's a keyword/identifier after the number
-        if (numberEnd < source.length() && (std::isalpha(source[numberEnd]) || source[numberEnd] == '_')) {
-            // This is a number+keyword combination like "5say"
-            // We'll handle this in tokenize() by splitting it
-            pos = numberEnd;
-            col += (numberEnd - start);
-            // Continue reading the identifier part
-        }
-    }
-    
-    while (pos < source.length() && 
-           (std::isalnum(source[pos]) || source[pos] == '_')) {
+    while (pos < source.length() && hasClass(source[pos], CC_ALPHA | CC_DIGIT)) {
         pos++;
         col++;
     }
-    std::string value = source.substr(start, pos - start);
-    
-    // Split number+keyword if needed (e.g., "5say" -> we need to handle this specially)
-    if (startsWithNumber && pos > numberEnd) {
-        // Return the number part first, the identifier will be read next
-        std::string numberPart = source.substr(start, numberEnd - start);
-        pos = numberEnd; // Reset to read identifier separately
-        col = col - (pos - numberEnd);
-        return Token(TokenType::NUMBER, numberPart, line, col);
-    }
-    
-    TokenType type = std::find(keywords.begin(), keywords.end(), value) != keywords.end()
-                     ? TokenType::KEYWORD : TokenType::IDENTIFIER;
-    return Token(type, value, line, col);
+    std::string_view value = source.substr(start, pos - start);
+    uint8_t keyword = keywordId(value);
+    return Token(keyword ? TokenType::KEYWORD : TokenType::IDENTIFIER, value, line, col, keyword);
 }
 
 Token Lexer::readSymbol() {
-    char sym = source[pos];
+    std::string_view sym = source.substr(pos, 1);
     pos++;
     col++;
-    return Token(TokenType::SYMBOL, std::string(1, sym), line, col);
+    return Token(TokenType::SYMBOL, sym, line, col);
 }
 
-std::vector<Token> Lexer::tokenize() {
-    std::vector<Token> tokens;
+Token Lexer::next() {
     while (pos < source.length()) {
         skipWhitespace();
         if (pos >= source.length()) break;
 
-        if (source[pos] == '/' && pos + 1 < source.length() && 
+        char c = source[pos];
+        if (c == '/' && pos + 1 < source.length() &&
             (source[pos + 1] == '/' || source[pos + 1] == '*')) {
             skipComment();
             continue;
         }
 
-        if (std::isdigit(source[pos])) {
-            tokens.push_back(readNumber());
-        } else if (source[pos] == '"') {
-            tokens.push_back(readString());
-        } else if (std::isalpha(source[pos]) || source[pos] == '_') {
-            tokens.push_back(readIdentifier());
-        } else if (symbols.find(source[pos]) != std::string::npos) {
-            tokens.push_back(readSymbol());
-        } else {
-            pos++;
-            col++;
+        uint8_t cls = charClasses[static_cast<uint8_t>(c)];
+        if (cls & CC_DIGIT) {
+            return readNumber();
+        } else if (c == '"') {
+            return readString();
+        } else if (cls & CC_ALPHA) {
+            return readIdentifier();
+        } else if (cls & CC_SYMBOL) {
+            return readSymbol();
         }
+        pos++;
+        col++;
     }
-    tokens.push_back(Token(TokenType::EOF_TOKEN, "", line, col));
-    return tokens;
+    return Token(TokenType::EOF_TOKEN, std::string_view(), line, col);
 }
 
-// Parser implementation
-Token Parser::current() {
-    if (pos >= tokens.size()) {
-        return Token(TokenType::EOF_TOKEN, "");
+std::vector<Token> Lexer::tokenize() {
+    std::vector<Token> tokens;
+    Token tok = next();
+    while (tok.type != TokenType::EOF_TOKEN) {
+        tokens.push_back(tok);
+        tok = next();
     }
-    return tokens[pos];
+    tokens.push_back(tok);
+    return tokens;
 }
 
-Token Parser::advance() {
-    if (pos < tokens.size()) {
-        pos++;
-    }
-    return current();
+// Parser implementation
+const Token& Parser::advance() {
+    if (token.type != TokenType::EOF_TOKEN) {
+        token = lookahead;
+        tokenMark = lookaheadMark;
+        lookaheadMark = lexer.mark();
+        lookahead = lexer.next();
+    }
+    return token;
 }
 
-bool Parser::match(const std::string& value) {
+bool Parser::match(std::string_view value) {
     if (current().type == TokenType::KEYWORD && current().value == value) {
         advance();
         return true;
@@ -324,36 +824,55 @@ bool Parser::check(TokenType type) {
     return current().type == type;
 }
 
-std::shared_ptr<ASTNode> Parser::parseForm() {
+ASTNode* Parser::makeNode(NodeType type, const Token& tok) {
+    // String literals are program data, everything else is a name
+    if (tok.type == TokenType::STRING) {
+        return program.arena.make<ASTNode>(type, tok.type, NO_SYMBOL,
+            program.arena.copy(tok.value), tok.line, tok.col);
+    }
+    Symbol symbol = symbols.intern(tok.value);
+    return program.arena.make<ASTNode>(type, tok.type, symbol,
+        symbols.name(symbol), tok.line, tok.col);
+}
+
+void Parser::endChildren(ASTNode* node, size_t mark) {
+    size_t count = scratch.size() - mark;
+    if (count > 0) {
+        ASTNode** items = program.arena.allocArray<ASTNode*>(count);
+        std::copy(scratch.begin() + mark, scratch.end(), items);
+        node->children.items = items;
+        node->children.count = static_cast<uint32_t>(count);
+    }
+    scratch.resize(mark);
+}
+
+ASTNode* Parser::parseForm() {
     Token tok = current();
-    std::string keyword = tok.value;
     
     // SUPER FLEXIBLE: accept many variations
-    if (keyword == "form" || keyword == "let" || keyword == "var" || 
-        keyword == "const" || keyword == "set" || keyword == "create" ||
-        keyword == "make" || keyword == "declare" || keyword == "define" ||
-        keyword == "init" || keyword == "new") {
+    if (keywordOf(tok).stmt == Stmt::FORM) {
         advance();
     } else {
         return nullptr;
     }
     
-    auto node = std::make_shared<ASTNode>(NodeType::FORM, tok);
+    ASTNode* node = makeNode(NodeType::FORM, tok);
+    size_t mark = beginChildren();
     
     // Type (optional) - flexible
     if (check(TokenType::IDENTIFIER) || check(TokenType::KEYWORD)) {
-        std::string first = current().value;
+        std::string_view first = current().value;
         // Check if it's a type keyword
         if (first == "num" || first == "text" || first == "bool" || 
             first == "list" || first == "map" || first == "void") {
-            node->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
+            addChild(makeNode(NodeType::IDENTIFIER, current()));
             advance();
         }
     }
     
     // Variable name
     if (check(TokenType::IDENTIFIER)) {
-        node->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
+        addChild(makeNode(NodeType::IDENTIFIER, current()));
         advance();
     }
     
@@ -364,34 +883,35 @@ std::shared_ptr<ASTNode> Parser::parseForm() {
         if (current().type == TokenType::SYMBOL && current().value == "=") {
             advance(); // consume "="
         }
-        node->children.push_back(parseExpression());
+        addChild(parseExpression());
     } else if (!check(TokenType::EOF_TOKEN) && 
                current().value != "end" && current().value != "do") {
         // Try to parse as expression anyway (flexible)
-        node->children.push_back(parseExpression());
+        addChild(parseExpression());
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseAct() {
+ASTNode* Parser::parseAct() {
     Token tok = current();
-    std::string keyword = tok.value;
     
     // SUPER FLEXIBLE: accept many variations
-    if (keyword == "act" || keyword == "def" || keyword == "fn" || 
-        keyword == "func" || keyword == "function" || keyword == "method" ||
-        keyword == "procedure") {
+    if (keywordOf(tok).stmt == Stmt::ACT) {
         advance();
     } else {
         return nullptr;
     }
     
-    auto node = std::make_shared<ASTNode>(NodeType::ACT, tok);
+    ASTNode* node = makeNode(NodeType::ACT, tok);
+    size_t mark = beginChildren();
     
-    // Function name
-    if (check(TokenType::IDENTIFIER)) {
-        node->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
+    // Function name, which may be a keyword (act main ...) as long as it
+    // does not start the block
+    if (check(TokenType::IDENTIFIER) ||
+        (check(TokenType::KEYWORD) && current().value != "then" && current().value != "when")) {
+        addChild(makeNode(NodeType::IDENTIFIER, current()));
         advance();
     }
     
@@ -403,7 +923,7 @@ std::shared_ptr<ASTNode> Parser::parseAct() {
         inParens = true;
     }
     
-    while (pos < tokens.size() && current().type != TokenType::EOF_TOKEN) {
+    while (current().type != TokenType::EOF_TOKEN) {
         if (match("do") || match("then") || match("when") || match("begin")) {
             break;
         }
@@ -420,7 +940,7 @@ std::shared_ptr<ASTNode> Parser::parseAct() {
         }
         
         if (check(TokenType::IDENTIFIER)) {
-            node->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
+            addChild(makeNode(NodeType::IDENTIFIER, current()));
             advance();
         } else {
             break;
@@ -429,189 +949,192 @@ std::shared_ptr<ASTNode> Parser::parseAct() {
     
     // SUPER FLEXIBLE block start: many variations
     if (match("do") || match("then") || match("when") || match("begin")) {
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
     } else if (current().type == TokenType::SYMBOL && current().value == "{") {
         advance(); // consume "{"
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
         if (current().type == TokenType::SYMBOL && current().value == "}") {
             advance(); // consume "}"
         }
     } else {
         // Try to parse block anyway
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseCall() {
+ASTNode* Parser::parseCall() {
     Token tok = current();
     advance(); // consume "call"
     
-    auto node = std::make_shared<ASTNode>(NodeType::CALL, tok);
+    ASTNode* node = makeNode(NodeType::CALL, tok);
+    size_t mark = beginChildren();
     
+    bool lineArgs = false;
     if (check(TokenType::IDENTIFIER) || check(TokenType::KEYWORD)) {
-        node->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
+        lineArgs = keywordOf(current()).flags & KW_LINE_ARGS;
+        addChild(makeNode(NodeType::IDENTIFIER, current()));
         advance();
     }
     
     // Flexible argument parsing - accept many styles
-    while (pos < tokens.size() && current().type != TokenType::EOF_TOKEN) {
+    while (current().type != TokenType::EOF_TOKEN) {
         // Stop conditions - but be flexible
         if (current().value == "end" || current().value == "else") break;
+        // Calls into line-oriented modules (serve) end with their line
+        if (lineArgs && current().line > tok.line) break;
         
         // Flexible keywords that might end the call
-        if (current().type == TokenType::KEYWORD) {
-            std::string kw = current().value;
-            if (kw == "put" || kw == "with" || kw == "to" || kw == "on" || 
-                kw == "give" || kw == "then" || kw == "when") {
-                // Check if it's part of expression or end marker
-                if (pos + 1 < tokens.size()) {
-                    Token next = tokens[pos + 1];
-                    // If followed by identifier or value, it's part of expression
-                    if (next.type == TokenType::IDENTIFIER || 
-                        next.type == TokenType::NUMBER || 
-                        next.type == TokenType::STRING) {
-                        node->children.push_back(parseExpression());
-                        continue;
-                    }
-                }
-                break;
+        if (keywordOf(current()).flags & KW_ENDS_CALL) {
+            // Check if it's part of expression or end marker:
+            // if followed by identifier or value, it's part of expression
+            const Token& next = peek();
+            if (next.type == TokenType::IDENTIFIER || 
+                next.type == TokenType::NUMBER || 
+                next.type == TokenType::STRING) {
+                addChild(parseExpression());
+                continue;
             }
+            break;
         }
         
         // Parse expression - flexible
-        node->children.push_back(parseExpression());
+        addChild(parseExpression());
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseIf() {
+ASTNode* Parser::parseIf() {
     Token tok = current();
-    std::string keyword = tok.value;
     
     // Flexible: accept "if", "when"
-    // SUPER FLEXIBLE: accept many conditional variations
-    if (keyword == "if" || keyword == "when" || keyword == "whenever" ||
-        keyword == "provided" || keyword == "assuming" || keyword == "given") {
+    if (keywordOf(tok).stmt == Stmt::IF) {
         advance();
     } else {
         return nullptr;
     }
     
-    auto node = std::make_shared<ASTNode>(NodeType::IF, tok);
-    node->children.push_back(parseExpression());
+    ASTNode* node = makeNode(NodeType::IF, tok);
+    size_t mark = beginChildren();
+    addChild(parseExpression());
     
     // Flexible block start: "do", "then", "{"
     if (match("do") || match("then") || match("begin")) {
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
     } else if (current().type == TokenType::SYMBOL && current().value == "{") {
         advance(); // consume "{"
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
         if (current().type == TokenType::SYMBOL && current().value == "}") {
             advance(); // consume "}"
         }
     } else {
         // Try to parse block anyway
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
     }
     
     // Flexible else
     if (match("else") || match("otherwise")) {
         if (match("do") || match("then")) {
-            node->children.push_back(parseBlock());
+            addChild(parseBlock());
         } else if (current().type == TokenType::SYMBOL && current().value == "{") {
             advance();
-            node->children.push_back(parseBlock());
+            addChild(parseBlock());
             if (current().type == TokenType::SYMBOL && current().value == "}") {
                 advance();
             }
         } else {
-            node->children.push_back(parseBlock());
+            addChild(parseBlock());
         }
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseLoop() {
+ASTNode* Parser::parseLoop() {
     Token tok = current();
-    std::string keyword = tok.value;
     
     // Flexible: accept "loop", "while", "for", "repeat", "each"
-    // SUPER FLEXIBLE: accept many loop variations
-    if (keyword == "loop" || keyword == "while" || keyword == "for" || 
-        keyword == "repeat" || keyword == "each" || keyword == "foreach" ||
-        keyword == "iterate") {
+    if (keywordOf(tok).stmt == Stmt::LOOP) {
         advance();
     } else {
         return nullptr;
     }
     
-    auto node = std::make_shared<ASTNode>(NodeType::LOOP, tok);
-    node->children.push_back(parseExpression());
+    ASTNode* node = makeNode(NodeType::LOOP, tok);
+    size_t mark = beginChildren();
+    addChild(parseExpression());
+    if (current().value == "in" && peek().value == "parallel") {
+        advance();
+        advance();
+        node->parallel = true;
+    }
     
     // Flexible block start
     if (match("do") || match("then") || match("begin")) {
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
     } else if (current().type == TokenType::SYMBOL && current().value == "{") {
         advance();
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
         if (current().type == TokenType::SYMBOL && current().value == "}") {
             advance();
         }
     } else {
-        node->children.push_back(parseBlock());
+        addChild(parseBlock());
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseGive() {
+ASTNode* Parser::parseGive() {
     Token tok = current();
-    std::string keyword = tok.value;
     
-    // Flexible: accept "give", "return"
-    if (keyword == "give" || keyword == "return") {
+    // Flexible: accept "give", "return", "send"
+    if (keywordOf(tok).stmt == Stmt::GIVE) {
         advance();
     } else {
         return nullptr;
     }
     
-    auto node = std::make_shared<ASTNode>(NodeType::GIVE, tok);
-    node->children.push_back(parseExpression());
+    ASTNode* node = makeNode(NodeType::GIVE, tok);
+    size_t mark = beginChildren();
+    addChild(parseExpression());
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseSay() {
+ASTNode* Parser::parseSay() {
     Token tok = current();
-    std::string keyword = tok.value;
     
     // Check for number before say (e.g., "5 say" or "5say")
     int repeatCount = 1;
-    if (tok.type == TokenType::NUMBER && pos + 1 < tokens.size()) {
+    if (tok.type == TokenType::NUMBER) {
         try {
-            repeatCount = static_cast<int>(std::stod(tok.value));
+            repeatCount = static_cast<int>(std::stod(std::string(tok.value)));
             advance(); // consume number
             tok = current();
-            keyword = tok.value;
         } catch (...) {
             // Not a valid number, continue normally
         }
     }
     
-    // Flexible: accept "say", "print", "output", "display"
-    // SUPER FLEXIBLE: accept many output variations
-    if (keyword == "say" || keyword == "print" || keyword == "output" || 
-        keyword == "display" || keyword == "log" || keyword == "echo" ||
-        keyword == "show" || keyword == "write") {
+    // Flexible: accept "say", "print", "output", "display", "show", "write"
+    if (keywordOf(tok).stmt == Stmt::SAY) {
         advance();
     } else {
         return nullptr;
     }
     
-    auto node = std::make_shared<ASTNode>(NodeType::SAY, tok);
+    ASTNode* node = makeNode(NodeType::SAY, tok);
+    size_t mark = beginChildren();
+    // only set by name'identifier' below
+    node->value = std::string_view();
+    node->symbol = NO_SYMBOL;
     
     // Handle "say." syntax (dot after say)
     if (current().type == TokenType::SYMBOL && current().value == ".") {
@@ -620,12 +1143,12 @@ std::shared_ptr<ASTNode> Parser::parseSay() {
     
     // Parse expression - check if last token is a number (e.g., "say Hello World 5")
     auto exprNode = parseExpression();
-    node->children.push_back(exprNode);
+    addChild(exprNode);
     
     // Check if expression ends with a number for repeat count
-    if (pos < tokens.size() && current().type == TokenType::NUMBER) {
+    if (current().type == TokenType::NUMBER) {
         try {
-            repeatCount = static_cast<int>(std::stod(current().value));
+            repeatCount = static_cast<int>(std::stod(std::string(current().value)));
             advance();
         } catch (...) {
             // Ignore
@@ -634,53 +1157,58 @@ std::shared_ptr<ASTNode> Parser::parseSay() {
     
     // Store repeat count in a special child node
     if (repeatCount > 1) {
-        auto repeatNode = std::make_shared<ASTNode>(NodeType::LITERAL, 
+        ASTNode* repeatNode = makeNode(NodeType::LITERAL, 
             Token(TokenType::NUMBER, std::to_string(repeatCount)));
-        node->children.push_back(repeatNode);
+        addChild(repeatNode);
     }
     
     // Check for name'identifier' syntax
     if (match("name") && current().type == TokenType::STRING) {
-        std::string name = current().value;
+        std::string name(current().value);
         // Remove quotes
         if (name.length() >= 2 && name[0] == '\'' && name[name.length()-1] == '\'') {
             name = name.substr(1, name.length() - 2);
         }
-        node->value = name;
+        node->symbol = symbols.intern(name);
+        node->value = symbols.name(node->symbol);
         advance();
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parsePut() {
+ASTNode* Parser::parsePut() {
     Token tok = current();
     advance(); // consume "put"
     
-    auto node = std::make_shared<ASTNode>(NodeType::PUT, tok);
+    ASTNode* node = makeNode(NodeType::PUT, tok);
+    size_t mark = beginChildren();
     
     // Parse the value expression
-    node->children.push_back(parseExpression());
+    addChild(parseExpression());
     
     // Check for "to" keyword followed by variable name
     if (match("to")) {
         if (check(TokenType::IDENTIFIER)) {
-            node->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
+            addChild(makeNode(NodeType::IDENTIFIER, current()));
             advance();
         }
     } else if (check(TokenType::IDENTIFIER)) {
         // Alternative: "put value variable" (without "to")
-        node->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
+        addChild(makeNode(NodeType::IDENTIFIER, current()));
         advance();
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseBlock() {
-    auto node = std::make_shared<ASTNode>(NodeType::BLOCK, current());
+ASTNode* Parser::parseBlock() {
+    ASTNode* node = makeNode(NodeType::BLOCK, current());
+    size_t mark = beginChildren();
     
-    while (pos < tokens.size() && current().type != TokenType::EOF_TOKEN) {
+    while (current().type != TokenType::EOF_TOKEN) {
         // SUPER FLEXIBLE: accept many end block variations
         if (match("end") || match("finish") || match("done") ||
             (current().type == TokenType::SYMBOL && current().value == "}")) {
@@ -688,371 +1216,945 @@ std::shared_ptr<ASTNode> Parser::parseBlock() {
         }
         
         if (current().type == TokenType::KEYWORD) {
-            std::string kw = current().value;
-            
-            // SUPER FLEXIBLE variable declaration
-            if (kw == "form" || kw == "let" || kw == "var" || kw == "const" || 
-                kw == "set" || kw == "create" || kw == "make" || kw == "declare" ||
-                kw == "define" || kw == "init" || kw == "new") {
-                auto formNode = parseForm();
-                if (formNode) node->children.push_back(formNode);
-            }
-            // SUPER FLEXIBLE function definition
-            else if (kw == "act" || kw == "def" || kw == "fn" || 
-                     kw == "func" || kw == "function" || kw == "method" ||
-                     kw == "procedure") {
-                auto actNode = parseAct();
-                if (actNode) node->children.push_back(actNode);
-            }
-            // Function call
-            else if (kw == "call") {
-                node->children.push_back(parseCall());
-            }
-            // SUPER FLEXIBLE conditionals
-            else if (kw == "if" || kw == "when" || kw == "whenever" ||
-                     kw == "provided" || kw == "assuming" || kw == "given") {
-                auto ifNode = parseIf();
-                if (ifNode) node->children.push_back(ifNode);
-            }
-            // SUPER FLEXIBLE loops
-            else if (kw == "loop" || kw == "while" || kw == "for" || 
-                     kw == "repeat" || kw == "each" || kw == "foreach" ||
-                     kw == "iterate") {
-                auto loopNode = parseLoop();
-                if (loopNode) node->children.push_back(loopNode);
-            }
-            // Return
-            else if (kw == "give" || kw == "return" || kw == "yield" || kw == "send") {
-                auto giveNode = parseGive();
-                if (giveNode) node->children.push_back(giveNode);
-            }
-            // SUPER FLEXIBLE output
-            else if (kw == "say" || kw == "print" || kw == "output" || 
-                     kw == "display" || kw == "log" || kw == "echo" ||
-                     kw == "show" || kw == "write") {
-                auto sayNode = parseSay();
-                if (sayNode) node->children.push_back(sayNode);
-            }
-            // Assignment
-            else if (kw == "put" || kw == "assign" || kw == "update") {
-                node->children.push_back(parsePut());
-            }
-            else {
+            // SUPER FLEXIBLE: every spelling of a statement maps to its Stmt
+            ASTNode* stmt = parseStatement();
+            if (stmt) {
+                addChild(stmt);
+            } else {
                 advance();
             }
         } else {
-            node->children.push_back(parseExpression());
+            addChild(parseExpression());
         }
     }
     
+    endChildren(node, mark);
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parseExpression() {
+ASTNode* Parser::parseExpression() {
     return parseBinaryOp(0);
 }
 
-std::shared_ptr<ASTNode> Parser::parseBinaryOp(int precedence) {
-    std::map<std::string, int> opPrecedence = {
-        {"or", 1},
-        {"and", 2},
-        {"same", 3}, {"not", 3},
-        {"over", 4}, {"under", 4},
-        {"plus", 5}, {"minus", 5},
-        {"times", 6}, {"div", 6}
-    };
-    
+ASTNode* Parser::parseBinaryOp(int precedence) {
     auto left = parsePrimary();
     
-    while (pos < tokens.size()) {
-        if (current().type != TokenType::KEYWORD) break;
-        
-        std::string op = current().value;
-        auto it = opPrecedence.find(op);
-        if (it == opPrecedence.end() || it->second < precedence) break;
+    while (true) {
+        // or < and < same/not < over/under < plus/minus < times/div
+        int opPrec = keywordOf(current()).precedence;
+        if (opPrec == 0 || opPrec < precedence) break;
         
-        int opPrec = it->second;
+        Token op = current();
         advance(); // consume operator
         
         auto right = parseBinaryOp(opPrec + 1);
-        auto node = std::make_shared<ASTNode>(NodeType::BINARY_OP, Token(TokenType::KEYWORD, op));
-        node->value = op;
-        node->children.push_back(left);
-        node->children.push_back(right);
+        ASTNode* node = makeNode(NodeType::BINARY_OP, op);
+        size_t mark = beginChildren();
+        addChild(left);
+        addChild(right);
+        endChildren(node, mark);
         left = node;
     }
     
     return left;
 }
 
-std::shared_ptr<ASTNode> Parser::parsePrimary() {
+ASTNode* Parser::parsePrimary() {
     if (check(TokenType::NUMBER)) {
-        auto node = std::make_shared<ASTNode>(NodeType::LITERAL, current());
+        ASTNode* node = makeNode(NodeType::LITERAL, current());
         advance();
         return node;
     }
     
     if (check(TokenType::STRING)) {
-        auto node = std::make_shared<ASTNode>(NodeType::LITERAL, current());
+        ASTNode* node = makeNode(NodeType::LITERAL, current());
         advance();
         return node;
     }
     
     if (check(TokenType::IDENTIFIER)) {
-        auto node = std::make_shared<ASTNode>(NodeType::IDENTIFIER, current());
+        ASTNode* node = makeNode(NodeType::IDENTIFIER, current());
         advance();
         return node;
     }
     
     if (current().type == TokenType::KEYWORD) {
-        std::string kw = current().value;
+        // Calls into line-oriented modules give their result:
+        // form job from call channel receive jobs
+        if (keywordOf(current()).stmt == Stmt::CALL && (keywordOf(peek()).flags & KW_LINE_ARGS)) {
+            return parseCall();
+        }
+        std::string_view kw = current().value;
         if (kw == "true" || kw == "false") {
-            auto node = std::make_shared<ASTNode>(NodeType::LITERAL, current());
+            ASTNode* node = makeNode(NodeType::LITERAL, current());
             advance();
             return node;
         }
     }
     
     // Default: return identifier
-    auto node = std::make_shared<ASTNode>(NodeType::IDENTIFIER, current());
+    ASTNode* node = makeNode(NodeType::IDENTIFIER, current());
     advance();
     return node;
 }
 
-std::shared_ptr<ASTNode> Parser::parse() {
-    auto program = std::make_shared<ASTNode>(NodeType::PROGRAM, current());
-    
-    while (pos < tokens.size() && current().type != TokenType::EOF_TOKEN) {
-        if (current().type == TokenType::KEYWORD) {
-            std::string kw = current().value;
-            
-            // SUPER FLEXIBLE parsing - try all variations
-            if (kw == "form" || kw == "let" || kw == "var" || kw == "const" || 
-                kw == "set" || kw == "create" || kw == "make" || kw == "declare" ||
-                kw == "define" || kw == "init" || kw == "new") {
-                auto formNode = parseForm();
-                if (formNode) program->children.push_back(formNode);
-            } else if (kw == "act" || kw == "def" || kw == "fn" || 
-                       kw == "func" || kw == "function" || kw == "method" ||
-                       kw == "procedure") {
-                auto actNode = parseAct();
-                if (actNode) program->children.push_back(actNode);
-            } else if (kw == "call") {
-                program->children.push_back(parseCall());
-            } else if (kw == "if" || kw == "when" || kw == "whenever" ||
-                       kw == "provided" || kw == "assuming" || kw == "given") {
-                auto ifNode = parseIf();
-                if (ifNode) program->children.push_back(ifNode);
-            } else if (kw == "loop" || kw == "while" || kw == "for" || 
-                       kw == "repeat" || kw == "each" || kw == "foreach" ||
-                       kw == "iterate") {
-                auto loopNode = parseLoop();
-                if (loopNode) program->children.push_back(loopNode);
-            } else if (kw == "give" || kw == "return" || kw == "yield" || kw == "send") {
-                auto giveNode = parseGive();
-                if (giveNode) program->children.push_back(giveNode);
-            } else if (kw == "say" || kw == "print" || kw == "output" || 
-                       kw == "display" || kw == "log" || kw == "echo" ||
-                       kw == "show" || kw == "write") {
-                auto sayNode = parseSay();
-                if (sayNode) program->children.push_back(sayNode);
-            } else if (kw == "put" || kw == "assign" || kw == "update") {
-                program->children.push_back(parsePut());
-            } else {
-                // ULTRA FLEXIBLE: Check if it's ANY HTML element or module - auto-detect!
-                // Support: h1 Title, button Click, view h1 Title, web fetch url, etc.
-                // Pattern-agnostic: any order works!
-                
-                std::vector<std::string> htmlElements = {
-                    "h1", "h2", "h3", "h4", "h5", "h6", "p", "div", "span", "button", 
-                    "input", "form", "img", "a", "ul", "ol", "li", "table", "tr", "td",
-                    "header", "footer", "nav", "main", "section", "article", "aside"
-                };
-                
-                std::vector<std::string> moduleNames = {
-                    "view", "web", "net", "file", "serve", "play", "markdown",
-                    "query", "database", "csv", "go", "channel", "run"
-                };
-                
-                // Check if current keyword is an HTML element (can be used directly!)
-                bool isHTMLElement = false;
-                for (const auto& elem : htmlElements) {
-                    if (kw == elem) {
-                        isHTMLElement = true;
-                        // Parse as direct HTML element call
-                        auto callNode = std::make_shared<ASTNode>(NodeType::CALL, current());
-                        callNode->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, Token(TokenType::IDENTIFIER, "view", current().line, current().col)));
-                        callNode->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
-                        advance(); // consume element name
-                        
-                        // Get arguments (flexible - can be anywhere)
-                        while (pos < tokens.size() && current().type != TokenType::EOF_TOKEN) {
-                            if (current().type == TokenType::KEYWORD) {
-                                std::string nextKw = current().value;
-                                if (nextKw == "do" || nextKw == "then" || nextKw == "{" || 
-                                    nextKw == "end" || nextKw == "}" || nextKw == "finish" ||
-                                    nextKw == "if" || nextKw == "loop" || nextKw == "form" ||
-                                    nextKw == "act" || nextKw == "call" || nextKw == "say" ||
-                                    nextKw == "give" || nextKw == "put") {
-                                    break;
-                                }
-                            }
-                            if (current().type == TokenType::NEWLINE && pos + 1 < tokens.size()) {
-                                Token peek = tokens[pos + 1];
-                                if (peek.type == TokenType::KEYWORD && 
-                                    (peek.value == "do" || peek.value == "end" || peek.value == "if" ||
-                                     peek.value == "loop" || peek.value == "form" || peek.value == "act")) {
-                                    break;
-                                }
-                            }
-                            auto arg = parseExpression();
-                            if (arg) callNode->children.push_back(arg);
-                            if (pos >= tokens.size() || current().type == TokenType::EOF_TOKEN) break;
-                        }
-                        
-                        program->children.push_back(callNode);
-                        break;
-                    }
-                }
-                
-                // Check if it's a module name
-                if (!isHTMLElement) {
-                    bool isModule = false;
-                    for (const auto& mod : moduleNames) {
-                        if (kw == mod) {
-                            isModule = true;
-                            // Parse as module call without "call" keyword
-                            auto callNode = std::make_shared<ASTNode>(NodeType::CALL, current());
-                            callNode->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
-                            advance(); // consume module name
-                            
-                            // Get method name (flexible - can be HTML element or method)
-                            if (check(TokenType::IDENTIFIER) || check(TokenType::KEYWORD)) {
-                                callNode->children.push_back(std::make_shared<ASTNode>(NodeType::IDENTIFIER, current()));
-                                advance();
-                            }
-                            
-                            // Get arguments (ULTRA FLEXIBLE - any order)
-                            while (pos < tokens.size() && current().type != TokenType::EOF_TOKEN) {
-                                if (current().type == TokenType::KEYWORD) {
-                                    std::string nextKw = current().value;
-                                    if (nextKw == "do" || nextKw == "then" || nextKw == "{" || 
-                                        nextKw == "end" || nextKw == "}" || nextKw == "finish" ||
-                                        nextKw == "if" || nextKw == "loop" || nextKw == "form" ||
-                                        nextKw == "act" || nextKw == "call" || nextKw == "say" ||
-                                        nextKw == "give" || nextKw == "put") {
-                                        break;
-                                    }
-                                }
-                                if (current().type == TokenType::NEWLINE && pos + 1 < tokens.size()) {
-                                    Token peek = tokens[pos + 1];
-                                    if (peek.type == TokenType::KEYWORD && 
-                                        (peek.value == "do" || peek.value == "end" || peek.value == "if" ||
-                                         peek.value == "loop" || peek.value == "form" || peek.value == "act")) {
-                                        break;
-                                    }
-                                }
-                                auto arg = parseExpression();
-                                if (arg) callNode->children.push_back(arg);
-                                if (pos >= tokens.size() || current().type == TokenType::EOF_TOKEN) break;
-                            }
-                            
-                            program->children.push_back(callNode);
-                            break;
-                        }
-                    }
-                    if (!isModule && !isHTMLElement) {
-                        advance();
-                    }
-                }
-            }
-        } else {
+ASTNode* Parser::parseStatement() {
+    switch (keywordOf(current()).stmt) {
+        case Stmt::FORM: return parseForm();
+        case Stmt::ACT: return parseAct();
+        case Stmt::CALL: return parseCall();
+        case Stmt::IF: return parseIf();
+        case Stmt::LOOP: return parseLoop();
+        case Stmt::GIVE: return parseGive();
+        case Stmt::SAY: return parseSay();
+        case Stmt::PUT: return parsePut();
+        case Stmt::NONE: break;
+    }
+    return nullptr;
+}
+
+ASTNode* Parser::parseBareCall(bool element) {
+    ASTNode* callNode = makeNode(NodeType::CALL, current());
+    size_t mark = beginChildren();
+    if (element) {
+        // "h1 Title" is "call view h1 Title"
+        addChild(makeNode(NodeType::IDENTIFIER, Token(TokenType::IDENTIFIER, "view", current().line, current().col)));
+        addChild(makeNode(NodeType::IDENTIFIER, current()));
+        advance(); // consume element name
+    } else {
+        addChild(makeNode(NodeType::IDENTIFIER, current()));
+        advance(); // consume module name
+        
+        // Get method name (flexible - can be HTML element or method)
+        if (check(TokenType::IDENTIFIER) || check(TokenType::KEYWORD)) {
+            addChild(makeNode(NodeType::IDENTIFIER, current()));
             advance();
         }
     }
     
-    return program;
-}
-
-// Runtime implementation
-void Runtime::pushScope() {
-    scopes.push_back({});
-}
-
-void Runtime::popScope() {
-    if (!scopes.empty()) {
-        scopes.pop_back();
+    // Get arguments (ULTRA FLEXIBLE - any order) up to the next block or statement keyword
+    while (current().type != TokenType::EOF_TOKEN &&
+           !(keywordOf(current()).flags & KW_ENDS_ARGS)) {
+        auto arg = parseExpression();
+        if (arg) addChild(arg);
     }
+    
+    endChildren(callNode, mark);
+    return callNode;
 }
 
-ValuePtr Runtime::getVariable(const std::string& name) {
-    // Check scopes from innermost to outermost
-    for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
-        auto varIt = it->find(name);
-        if (varIt != it->end()) {
-            return varIt->second;
-        }
-    }
-    // Check global variables
-    auto varIt = variables.find(name);
-    if (varIt != variables.end()) {
-        return varIt->second;
+ASTNode* Parser::parse() {
+    ASTNode* program = begin();
+    size_t mark = beginChildren();
+    
+    while (!done()) {
+        if (ASTNode* stmt = parseTopLevel()) addChild(stmt);
     }
-    return std::make_shared<Value>();
+    
+    endChildren(program, mark);
+    return program;
 }
 
-void Runtime::setVariable(const std::string& name, ValuePtr value) {
-    if (!scopes.empty()) {
-        scopes.back()[name] = value;
-    } else {
-        variables[name] = value;
+ASTNode* Parser::parseTopLevel() {
+    if (current().type == TokenType::KEYWORD) {
+        // SUPER FLEXIBLE parsing - try all variations, then
+        // ULTRA FLEXIBLE: any HTML element or module works without "call"
+        const KeywordInfo& kw = keywordOf(current());
+        if (ASTNode* stmt = parseStatement()) return stmt;
+        if (kw.flags & KW_HTML) return parseBareCall(true);
+        if (kw.flags & KW_MODULE) return parseBareCall(false);
     }
+    advance();
+    return nullptr;
 }
 
-Runtime::Runtime() {
-    // Register built-in modules
-    registerModule("net", std::make_shared<NetModule>());
-    registerModule("file", std::make_shared<FileModule>());
-    registerModule("vm", std::make_shared<VMModule>());
-    registerModule("serve", std::make_shared<ServeModule>());
-    registerModule("view", std::make_shared<ViewModule>());
-    registerModule("play", std::make_shared<PlayModule>());
-    registerModule("markdown", std::make_shared<MarkdownModule>());
-    registerModule("web", std::make_shared<WebModule>());
-    registerModule("query", std::make_shared<QueryModule>());
-    registerModule("database", std::make_shared<DatabaseModule>());
-    registerModule("csv", std::make_shared<CSVModule>());
-    registerModule("go", std::make_shared<GoModule>());
-    registerModule("channel", std::make_shared<ChannelModule>());
-    registerModule("run", std::make_shared<RunModule>());
+// Resolver implementation
+void Resolver::bind(ASTNode* node) {
+    if (!node) return;
+    // String literals can land in a name position (form x "a" ...)
+    Symbol symbol = node->symbol != NO_SYMBOL ? node->symbol : runtime.own().symbols.intern(node->value);
+    node->slot = runtime.slotFor(symbol);
 }
 
-void Runtime::registerModule(const std::string& name, ModulePtr module) {
-    modules[name] = module;
-}
+void Resolver::resolve(ASTNode* node) {
+    if (!node) return;
 
-ValuePtr Runtime::evaluate(std::shared_ptr<ASTNode> node) {
-    if (!node) return std::make_shared<Value>();
-    
+    auto& children = node->children;
     switch (node->type) {
-        case NodeType::PROGRAM: {
-            ValuePtr result;
-            for (auto& child : node->children) {
-                result = evaluate(child);
+        case NodeType::IDENTIFIER:
+            bind(node);
+            break;
+        case NodeType::LITERAL:
+            // Barewords that are not number words read a variable
+            if (node->tokenType != TokenType::NUMBER && node->tokenType != TokenType::STRING) {
+                bind(node);
             }
-            return result;
-        }
-        
-        case NodeType::FORM: {
-            if (node->children.size() >= 2) {
-                std::string name = node->children[1]->value;
-                ValuePtr value;
-                if (node->children.size() > 2) {
-                    value = evaluate(node->children[2]);
+            break;
+        case NodeType::FORM:
+            if (children.size() >= 2) bind(children[1]);
+            break;
+        case NodeType::PUT:
+            if (children.size() >= 2) bind(children[1]);
+            break;
+        case NodeType::ACT:
+            // The act's name and its parameters
+            for (size_t i = 0; i < children.size() && children[i]->type != NodeType::BLOCK; i++) {
+                bind(children[i]);
+            }
+            break;
+        case NodeType::LOOP:
+            node->slot = runtime.slotFor(runtime.own().symbols.intern("step"));
+            break;
+        case NodeType::SAY:
+            if (node->symbol != NO_SYMBOL) node->slot = runtime.slotFor(node->symbol);
+            break;
+        default:
+            break;
+    }
+
+    for (ASTNode* child : children) {
+        resolve(child);
+    }
+}
+
+// Every ACT node under node
+static void collectActs(const ASTNode* node, std::vector<const ASTNode*>& acts) {
+    if (!node) return;
+    if (node->type == NodeType::ACT && !node->children.empty()) acts.push_back(node);
+    for (const ASTNode* child : node->children) {
+        collectActs(child, acts);
+    }
+}
+
+// Whether a loop's iterations can run at once, each on a fork of the
+// runtime. Their variables are already their own: every write a body makes
+// is scoped to its iteration. What is left to rule out is what reaches
+// outside the runtime or into the program state forks share, so the body
+// may not define acts, and may only call module methods bound as pure and
+// acts (also those it names, which it may pass to one) whose bodies pass
+// the same test. An act that program does not define is not known to.
+bool Resolver::parallelSafe(const ASTNode* body, const std::vector<const ASTNode*>& acts) const {
+    std::vector<std::string_view> checked; // acts whose bodies are queued
+    // Queues the bodies of the acts called name; false if it could be an
+    // act defined somewhere else
+    auto reach = [&](std::string_view name, std::vector<const ASTNode*>& pending) {
+        if (std::find(checked.begin(), checked.end(), name) != checked.end()) return true;
+        checked.push_back(name);
+        bool found = false;
+        for (const ASTNode* act : acts) {
+            if (act->children[0]->type != NodeType::IDENTIFIER || act->children[0]->value != name) continue;
+            found = true;
+            for (const ASTNode* child : act->children) {
+                if (child->type == NodeType::BLOCK) pending.push_back(child);
+            }
+        }
+        return found || runtime.state->functions.count(name) == 0;
+    };
+
+    std::vector<const ASTNode*> pending{body};
+    while (!pending.empty()) {
+        const ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) continue;
+        const auto& children = node->children;
+        size_t first = 0;
+        switch (node->type) {
+            case NodeType::ACT:
+                return false;
+            case NodeType::CALL: {
+                if (children.empty()) continue;
+                auto module = runtime.state->modules.find(children[0]->value);
+                if (children.size() > 1 && module != runtime.state->modules.end()) {
+                    if (!module->second->isPure(std::string(children[1]->value))) return false;
+                    first = 2;
                 } else {
-                    value = std::make_shared<Value>();
+                    if (!reach(children[0]->value, pending)) return false;
+                    first = 1;
+                }
+                break;
+            }
+            case NodeType::LITERAL:
+                if (node->tokenType == TokenType::NUMBER || node->tokenType == TokenType::STRING) break;
+                [[fallthrough]]; // a bareword reads a variable
+            case NodeType::IDENTIFIER:
+                if (!reach(node->value, pending)) return false;
+                break;
+            default:
+                break;
+        }
+        for (size_t i = first; i < children.size(); i++) {
+            pending.push_back(children[i]);
+        }
+    }
+    return true;
+}
+
+void Resolver::checkParallel(ASTNode* node, const ASTNode* program) {
+    std::vector<const ASTNode*> acts;
+    bool collected = false;
+    std::vector<ASTNode*> pending{node};
+    while (!pending.empty()) {
+        ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) continue;
+        if (node->type == NodeType::LOOP && node->parallel) {
+            if (!collected) collectActs(program, acts);
+            collected = true;
+            node->parallel = node->children.size() >= 2 && parallelSafe(node->children[1], acts);
+        }
+        for (ASTNode* child : node->children) {
+            pending.push_back(child);
+        }
+    }
+}
+
+// Whether running node as part of an act's body can bind a variable that
+// is still bound when the body ends. What a loop body binds goes with its
+// iteration, and what another act's body binds with its call, but an act
+// binds its own name where it is defined.
+static bool bindsOutsideLoops(const ASTNode* node) {
+    if (!node) return false;
+    const auto& children = node->children;
+    switch (node->type) {
+        case NodeType::FORM:
+        case NodeType::ACT:
+            return true;
+        case NodeType::PUT:
+            if (children.size() >= 2 && children[1]->type == NodeType::IDENTIFIER) return true;
+            break;
+        case NodeType::SAY:
+            if (!node->value.empty()) return true;
+            break;
+        case NodeType::LOOP:
+            return !children.empty() && bindsOutsideLoops(children[0]);
+        default:
+            break;
+    }
+    for (const ASTNode* child : children) {
+        if (bindsOutsideLoops(child)) return true;
+    }
+    return false;
+}
+
+// Marks the act calls node ends with, when an act's body ends with node
+void Resolver::markTail(ASTNode* node) {
+    if (!node) return;
+    auto& children = node->children;
+    switch (node->type) {
+        case NodeType::BLOCK:
+            if (!children.empty()) markTail(children[children.size() - 1]);
+            break;
+        case NodeType::IF:
+            if (children.size() >= 2) markTail(children[1]);
+            if (children.size() > 2) markTail(children[2]);
+            break;
+        case NodeType::GIVE:
+            if (!children.empty()) markTail(children[0]);
+            break;
+        case NodeType::CALL:
+            if (!children.empty()) {
+                bool module = children.size() > 1 &&
+                    runtime.state->modules.find(children[0]->value) != runtime.state->modules.end();
+                node->tail = !module;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// A call an act ends with can only take over the act's frame if the frame
+// holds nothing the callee could read instead of its own bindings, so only
+// acts that bind no variables but their parameters get tail calls; the
+// callee must bind the same ones (Runtime::reusesFrame)
+void Resolver::markTailCalls(ASTNode* program) {
+    std::vector<ASTNode*> pending{program};
+    while (!pending.empty()) {
+        ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) continue;
+        if (node->type == NodeType::ACT && !node->children.empty()) {
+            ASTNode* body = node->children[node->children.size() - 1];
+            for (size_t i = 1; i < node->children.size(); i++) {
+                if (node->children[i]->type == NodeType::BLOCK) {
+                    body = node->children[i];
+                    break;
                 }
-                setVariable(name, value);
+            }
+            if (!bindsOutsideLoops(body)) markTail(body);
+        }
+        for (ASTNode* child : node->children) {
+            pending.push_back(child);
+        }
+    }
+}
+
+// An operator on two values, as the tree engine applies it; void for an
+// operator it does not know
+static Value binaryOp(std::string_view op, const Value& left, const Value& right) {
+    double lnum = left.toNumber();
+    double rnum = right.toNumber();
+
+    // Arithmetic - flexible operators
+    if (op == "plus" || op == "add" || op == "+") {
+        return Value(lnum + rnum);
+    } else if (op == "minus" || op == "subtract" || op == "-") {
+        return Value(lnum - rnum);
+    } else if (op == "times" || op == "multiply" || op == "*") {
+        return Value(lnum * rnum);
+    } else if (op == "div" || op == "divide" || op == "/") {
+        if (rnum == 0.0) return Value(0.0);
+        return Value(lnum / rnum);
+    } else if (op == "mod" || op == "%") {
+        if (rnum == 0.0) return Value(0.0);
+        return Value(std::fmod(lnum, rnum));
+    } else if (op == "power" || op == "^" || op == "**") {
+        return Value(std::pow(lnum, rnum));
+    }
+    // Comparison - flexible operators
+    else if (op == "over" || op == "greater" || op == ">") {
+        return Value(lnum > rnum);
+    } else if (op == "under" || op == "less" || op == "<") {
+        return Value(lnum < rnum);
+    } else if (op == ">=") {
+        return Value(lnum >= rnum);
+    } else if (op == "<=") {
+        return Value(lnum <= rnum);
+    } else if (op == "same" || op == "equals" || op == "is" ||
+               op == "are" || op == "==" || op == "=") {
+        if (left.type == ValueType::TEXT && right.type == ValueType::TEXT) {
+            return Value(left.toString() == right.toString());
+        }
+        return Value(std::abs(lnum - rnum) < 0.0001);
+    } else if (op == "not" || op == "notequal" || op == "!=") {
+        if (left.type == ValueType::TEXT && right.type == ValueType::TEXT) {
+            return Value(left.toString() != right.toString());
+        }
+        return Value(std::abs(lnum - rnum) >= 0.0001);
+    }
+    // Logical - flexible operators
+    else if (op == "and" || op == "andalso" || op == "&&") {
+        return Value(left.toBool() && right.toBool());
+    } else if (op == "or" || op == "orelse" || op == "||") {
+        return Value(left.toBool() || right.toBool());
+    }
+    return Value();
+}
+
+bool literalValue(const ASTNode& node, Value& out) {
+    if (node.tokenType == TokenType::NUMBER) {
+        std::string text(node.value);
+        double num;
+        out = Value(parseNumber(text, num) ? num : wordToNumber(text));
+    } else if (node.tokenType == TokenType::STRING) {
+        out = Value(node.value);
+    } else if (node.value == "true") {
+        out = Value(true);
+    } else if (node.value == "false") {
+        out = Value(false);
+    } else {
+        // Number words (e.g. "ten", "five"); anything else is a variable
+        double num = wordToNumber(std::string(node.value));
+        if (num == 0.0 && node.value != "zero") {
+            return false;
+        }
+        out = Value(num);
+    }
+    return true;
+}
+
+// Optimizer implementation
+
+// The value of a node that is the same every time it runs: a CONSTANT or
+// a text literal
+static bool constantOf(const ASTNode* node, Value& out) {
+    if (node->type == NodeType::CONSTANT) {
+        out = node->constantValue();
+        return true;
+    }
+    if (node->type == NodeType::LITERAL && node->tokenType == TokenType::STRING) {
+        out = Value(node->value);
+        return true;
+    }
+    return false;
+}
+
+// Slots a subtree can set while it runs, acts and nested loops included
+static void collectWrites(const ASTNode* node, std::vector<size_t>& written) {
+    if (!node) return;
+    auto& children = node->children;
+    switch (node->type) {
+        case NodeType::FORM:
+            if (children.size() >= 2) written.push_back(children[1]->slot);
+            break;
+        case NodeType::PUT:
+            if (children.size() >= 2 && children[1]->type == NodeType::IDENTIFIER) written.push_back(children[1]->slot);
+            break;
+        case NodeType::ACT:
+            if (!children.empty() && children[0]->type == NodeType::IDENTIFIER) written.push_back(children[0]->slot);
+            break;
+        case NodeType::LOOP:
+            written.push_back(node->slot);
+            break;
+        case NodeType::SAY:
+            if (!node->value.empty()) written.push_back(node->slot);
+            break;
+        default:
+            break;
+    }
+    for (const ASTNode* child : children) {
+        collectWrites(child, written);
+    }
+}
+
+// Whether a subtree only reads variables that are not in written, so it
+// gives the same value on every pass of the loop
+static bool invariant(const ASTNode* node, const std::vector<size_t>& written) {
+    auto unwritten = [&](size_t slot) { return std::find(written.begin(), written.end(), slot) == written.end(); };
+    switch (node->type) {
+        case NodeType::CONSTANT:
+            return true;
+        case NodeType::IDENTIFIER:
+            return unwritten(node->slot);
+        case NodeType::LITERAL:
+            return node->tokenType == TokenType::STRING || unwritten(node->slot);
+        case NodeType::BINARY_OP:
+            return node->children.size() >= 2 && invariant(node->children[0], written) &&
+                   invariant(node->children[1], written);
+        default:
+            return false;
+    }
+}
+
+ASTNode* Optimizer::constantNode(const ASTNode* from, const Value& value) {
+    // Keeps the name and slot, for anything that reads them positionally
+    ASTNode* node = program.arena.make<ASTNode>(*from);
+    node->type = NodeType::CONSTANT;
+    node->children = Span<ASTNode*>();
+    node->constantType = value.type;
+    node->constant = value.toNumber();
+    return node;
+}
+
+ASTNode* Optimizer::optimize(ASTNode* node) {
+    if (!node) return node;
+    auto& children = node->children;
+    switch (node->type) {
+        case NodeType::LITERAL: {
+            Value value;
+            if (node->tokenType != TokenType::STRING && literalValue(*node, value)) return constantNode(node, value);
+            return node;
+        }
+
+        case NodeType::BINARY_OP: {
+            for (ASTNode*& child : children) child = optimize(child);
+            Value left, right;
+            if (children.size() >= 2 && constantOf(children[0], left) && constantOf(children[1], right)) {
+                return constantNode(node, binaryOp(node->value, left, right));
+            }
+            return node;
+        }
+
+        case NodeType::IF: {
+            for (ASTNode*& child : children) child = optimize(child);
+            Value condition;
+            if (children.size() >= 2 && constantOf(children[0], condition)) {
+                if (condition.toBool()) return children[1];
+                if (children.size() > 2) return children[2];
+                return constantNode(node, Value());
+            }
+            return node;
+        }
+
+        case NodeType::LOOP:
+            for (ASTNode*& child : children) child = optimize(child);
+            return children.size() >= 2 ? hoist(node) : node;
+
+        // Names and the repeat count of say are read from their nodes
+        case NodeType::FORM:
+            if (children.size() > 2) children[2] = optimize(children[2]);
+            return node;
+        case NodeType::PUT:
+            if (!children.empty()) children[0] = optimize(children[0]);
+            return node;
+        case NodeType::SAY:
+            if (!children.empty()) children[0] = optimize(children[0]);
+            return node;
+        case NodeType::ACT:
+            if (!children.empty()) {
+                for (ASTNode*& child : children) {
+                    if (child->type == NodeType::BLOCK) child = optimize(child);
+                }
+            }
+            return node;
+        case NodeType::CALL:
+            for (size_t i = 1; i < children.size(); i++) children[i] = optimize(children[i]);
+            return node;
+
+        case NodeType::PROGRAM:
+        case NodeType::BLOCK:
+        case NodeType::GIVE:
+            for (ASTNode*& child : children) child = optimize(child);
+            return node;
+
+        default:
+            return node;
+    }
+}
+
+ASTNode* Optimizer::hoist(ASTNode* loop) {
+    std::vector<size_t> written{loop->slot};
+    collectWrites(loop->children[1], written);
+    std::vector<ASTNode*> before;
+    loop->children[1] = hoistInvariants(loop->children[1], written, before);
+    if (before.empty()) return loop;
+
+    // { put <invariant> to <hidden> ... loop }, so the hidden variables end
+    // with the loop
+    before.push_back(loop);
+    ASTNode* block = program.arena.make<ASTNode>(NodeType::BLOCK, loop->tokenType, NO_SYMBOL, loop->value, loop->line, loop->col);
+    block->children.items = program.arena.allocArray<ASTNode*>(before.size());
+    block->children.count = static_cast<uint32_t>(before.size());
+    std::copy(before.begin(), before.end(), block->children.items);
+    return block;
+}
+
+ASTNode* Optimizer::hoistInvariants(ASTNode* node, const std::vector<size_t>& written, std::vector<ASTNode*>& before) {
+    if (!node) return node;
+    auto& children = node->children;
+    if (node->type == NodeType::BINARY_OP && invariant(node, written)) {
+        std::string name = " invariant " + std::to_string(hoisted++); // not a name a script can write
+        SymbolTable& symbols = runtime.own().symbols;
+        Symbol symbol = symbols.intern(name);
+        ASTNode* read = program.arena.make<ASTNode>(NodeType::IDENTIFIER, TokenType::IDENTIFIER, symbol,
+                                                    symbols.name(symbol), node->line, node->col);
+        read->slot = runtime.slotFor(symbol);
+
+        ASTNode* target = program.arena.make<ASTNode>(*read);
+        ASTNode* put = program.arena.make<ASTNode>(NodeType::PUT, TokenType::KEYWORD, NO_SYMBOL, "put", node->line, node->col);
+        put->children.items = program.arena.allocArray<ASTNode*>(2);
+        put->children.count = 2;
+        put->children[0] = node;
+        put->children[1] = target;
+        before.push_back(put);
+        return read;
+    }
+
+    // Only into what runs on every pass: not act bodies, names or say's
+    // repeat count
+    size_t first = 0, last = children.size();
+    switch (node->type) {
+        case NodeType::ACT:
+        case NodeType::LIST_LIT:
+        case NodeType::MAP_LIT:
+        case NodeType::UNARY_OP:
+            return node;
+        case NodeType::FORM:
+            first = 2;
+            break;
+        case NodeType::PUT:
+        case NodeType::SAY:
+            last = std::min<size_t>(last, 1);
+            break;
+        case NodeType::CALL:
+            first = 1;
+            break;
+        default:
+            break;
+    }
+    for (size_t i = first; i < last; i++) {
+        children[i] = hoistInvariants(children[i], written, before);
+    }
+    return node;
+}
+
+// ProgramCache implementation
+ProgramCache::ProgramCache(const ProgramCache& other) {
+    std::lock_guard<std::mutex> lock(const_cast<std::mutex&>(other.mutex));
+    for (const auto& item : other.order) {
+        order.push_back(item);
+        index.emplace(item.first, std::prev(order.end()));
+    }
+}
+
+std::shared_ptr<const ProgramCache::Entry> ProgramCache::find(uint64_t key, const std::string& source) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it == index.end() || it->second->second->source != source) {
+        return nullptr;
+    }
+    order.splice(order.begin(), order, it->second);
+    return order.front().second;
+}
+
+void ProgramCache::insert(uint64_t key, std::shared_ptr<const Entry> entry) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = index.find(key);
+    if (it != index.end()) {
+        order.erase(it->second);
+        index.erase(it);
+    } else if (order.size() >= CAPACITY) {
+        index.erase(order.back().first);
+        order.pop_back();
+    }
+    order.emplace_front(key, std::move(entry));
+    index.emplace(key, order.begin());
+}
+
+std::shared_ptr<const ProgramCache::Entry> ProgramCache::latest(uint64_t kind) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (const auto& item : order) {
+        if (item.second->kind == kind && item.second->outline) return item.second;
+    }
+    return nullptr;
+}
+
+void ProgramCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex);
+    order.clear();
+    index.clear();
+}
+
+// Runtime implementation
+static uint64_t newIsolate() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+Runtime::Runtime(ForkTag) : isolate(newIsolate()) {}
+
+Runtime::ProgramState& Runtime::own() {
+    // Only this runtime can hand out new references (by forking), so a
+    // count of one is exact; a stale higher count just costs a copy
+    if (state.use_count() > 1) {
+        state = std::make_shared<ProgramState>(*state);
+    }
+    return *state;
+}
+
+std::unique_ptr<Runtime> Runtime::forkEmpty() const {
+    std::unique_ptr<Runtime> task(new Runtime(ForkTag{}));
+    task->engine = engine;
+    state->share();
+    task->state = state;
+    task->sink = sink;
+    task->program = program;
+    task->bindings.resize(bindings.size());
+    return task;
+}
+
+std::unique_ptr<Runtime> Runtime::fork() const {
+    std::unique_ptr<Runtime> task = forkEmpty();
+    for (size_t i = 0; i < bindings.size(); i++) {
+        if (bindings[i].depth != UNBOUND) {
+            task->bindings[i].value = bindings[i].value.clone();
+            task->bindings[i].depth = 0;
+        }
+    }
+    return task;
+}
+
+std::unique_ptr<Runtime> Runtime::fork(const Expression& expression) const {
+    std::unique_ptr<Runtime> task = forkEmpty();
+    for (size_t slot : expression.code->reads) {
+        if (slot < bindings.size() && bindings[slot].depth != UNBOUND) {
+            task->bindings[slot].value = bindings[slot].value.clone();
+            task->bindings[slot].depth = 0;
+        }
+    }
+    return task;
+}
+
+Value Runtime::loopParallel(double iterations, size_t stepSlot, const std::function<Value(Runtime&)>& body) {
+    // Counted as the loop counts them: 0, 1, ... while under iterations
+    size_t count = 0;
+    bool counted = iterations > 0 && iterations < 9007199254740992.0; // 2^53
+    if (counted) count = static_cast<size_t>(std::ceil(iterations));
+    size_t parts = counted ? std::min(count, Scheduler::instance().workerCount()) : 0;
+    // Profiles follow one thread, so loops being profiled stay on it
+    if (parts < 2 || profile::current) {
+        Value result;
+        for (double i = 0; i < iterations; i++) {
+            pushScope();
+            setSlot(stepSlot, Value(i));
+            result = body(*this);
+            popScope();
+        }
+        return result;
+    }
+
+    // Forked here, as everything the forks copy is this thread's
+    std::vector<std::unique_ptr<Runtime>> forks;
+    std::vector<std::shared_ptr<output::Capture>> said;
+    for (size_t part = 0; part < parts; part++) {
+        forks.push_back(fork());
+        said.push_back(std::make_shared<output::Capture>());
+        forks.back()->setOutput(said.back());
+    }
+    Value last;
+    std::exception_ptr error;
+    try {
+        Scheduler::instance().parallel(parts, [&](size_t part) {
+            Runtime& runtime = *forks[part];
+            Value result;
+            for (size_t i = count * part / parts; i < count * (part + 1) / parts; i++) {
+                runtime.pushScope();
+                runtime.setSlot(stepSlot, Value(static_cast<double>(i)));
+                result = body(runtime);
+                runtime.popScope();
+            }
+            if (part + 1 == parts) last = result.clone();
+        });
+    } catch (...) {
+        error = std::current_exception();
+    }
+    for (const auto& capture : said) {
+        std::string text = capture->take();
+        if (text.empty()) continue;
+        text.pop_back(); // the last line's newline, which line() adds back
+        sink->line(text);
+    }
+    if (error) std::rethrow_exception(error);
+    return last;
+}
+
+std::shared_ptr<const Runtime::Snapshot> Runtime::snapshot() const {
+    auto frozen = std::make_shared<Snapshot>();
+    frozen->engine = engine;
+    frozen->isolate = isolate;
+    state->share();
+    frozen->state = state; // shared from here on, so our next write copies it
+    frozen->globals = bindings;
+    frozen->sink = sink;
+    for (Binding& binding : frozen->globals) {
+        if (binding.depth != UNBOUND) binding.depth = 0;
+        if (binding.value.type == ValueType::LIST || binding.value.type == ValueType::MAP) {
+            binding.value = binding.value.clone(); // ours still change in place
+        }
+    }
+    return frozen;
+}
+
+Runtime::Runtime(const Snapshot& snapshot) : isolate(snapshot.isolate), sink(snapshot.sink) {
+    reset(snapshot);
+}
+
+void Runtime::reset(const Snapshot& snapshot) {
+    engine = snapshot.engine;
+    isolate = snapshot.isolate;
+    state = snapshot.state;
+    bindings = snapshot.globals;
+    // Lists and maps change in place, so each runtime gets its own
+    for (Binding& binding : bindings) {
+        if (binding.value.type == ValueType::LIST || binding.value.type == ValueType::MAP) {
+            binding.value = binding.value.clone();
+        }
+    }
+    saved.clear();
+    scopeMarks.clear();
+    stack.clear();
+    frames.clear();
+    running = nullptr;
+    tailAct.reset();
+    tailArgs.clear();
+    program.reset();
+}
+
+void RuntimePool::Return::operator()(Runtime* runtime) const {
+    if (pool->idle.size() < pool->maxIdle) {
+        runtime->reset(*pool->snapshot); // drop the request's values now
+        pool->idle.emplace_back(runtime);
+    } else {
+        delete runtime;
+    }
+}
+
+RuntimePool::Lease RuntimePool::acquire() {
+    if (idle.empty()) {
+        return Lease(new Runtime(*snapshot), Return{this});
+    }
+    Runtime* runtime = idle.back().release();
+    idle.pop_back();
+    return Lease(runtime, Return{this});
+}
+
+size_t Runtime::slotFor(Symbol symbol) {
+    std::vector<size_t>& symbolSlots = own().symbolSlots;
+    if (symbol >= symbolSlots.size()) {
+        symbolSlots.resize(symbol + 1, UNBOUND);
+    }
+    size_t& slot = symbolSlots[symbol];
+    if (slot == UNBOUND) {
+        slot = bindings.size();
+        bindings.emplace_back();
+    }
+    return slot;
+}
+
+void Runtime::popScope() {
+    if (scopeMarks.empty()) return;
+    size_t mark = scopeMarks.back();
+    scopeMarks.pop_back();
+    while (saved.size() > mark) {
+        SavedBinding& entry = saved.back();
+        bindings[entry.slot] = std::move(entry.previous);
+        saved.pop_back();
+    }
+}
+
+Runtime::Runtime() : state(std::make_shared<ProgramState>()), isolate(newIsolate()), sink(output::standard()) {
+    // Register built-in modules
+    registerModule("net", std::make_shared<NetModule>());
+    registerModule("file", std::make_shared<FileModule>());
+    registerModule("vm", std::make_shared<VMModule>());
+    registerModule("serve", std::make_shared<ServeModule>());
+    registerModule("view", std::make_shared<ViewModule>());
+    registerModule("play", std::make_shared<PlayModule>());
+    registerModule("markdown", std::make_shared<MarkdownModule>());
+    registerModule("web", std::make_shared<WebModule>());
+    registerModule("list", std::make_shared<ListModule>());
+    registerModule("query", std::make_shared<QueryModule>());
+    registerModule("database", std::make_shared<DatabaseModule>());
+    registerModule("csv", std::make_shared<CSVModule>());
+    registerModule("go", std::make_shared<GoModule>());
+    registerModule("channel", std::make_shared<ChannelModule>());
+    registerModule("run", std::make_shared<RunModule>());
+}
+
+void Runtime::registerModule(const std::string& name, ModulePtr module) {
+    module->registerMethods();
+    ProgramState& owned = own();
+    owned.modules[name] = module;
+    owned.cache.clear(); // cached chunks resolved their module calls without it
+}
+
+ModulePtr Runtime::module(const std::string& name) const {
+    auto found = state->modules.find(name);
+    return found == state->modules.end() ? nullptr : found->second;
+}
+
+Value Runtime::evaluate(ASTNode* node) {
+    if (!node) return Value();
+    profile::hit(node->line, node->col, static_cast<uint8_t>(node->type));
+    
+    switch (node->type) {
+        case NodeType::PROGRAM: {
+            Value result = Value();
+            for (ASTNode* child : node->children) {
+                result = evaluate(child);
+            }
+            return result;
+        }
+        
+        case NodeType::FORM: {
+            if (node->children.size() >= 2) {
+                Value value;
+                if (node->children.size() > 2) {
+                    value = evaluate(node->children[2]);
+                } else {
+                    value = Value();
+                }
+                setSlot(node->children[1]->slot, value);
                 return value;
             }
             break;
@@ -1060,9 +2162,10 @@ ValuePtr Runtime::evaluate(std::shared_ptr<ASTNode> node) {
         
         case NodeType::ACT: {
             if (!node->children.empty()) {
-                std::string name = node->children[0]->value;
-                std::vector<std::string> params;
-                size_t paramStart = 1;
+                // An act without a name (its first child is the body) binds nothing
+                bool named = node->children[0]->type == NodeType::IDENTIFIER;
+                std::string name(named ? node->children[0]->value : std::string_view());
+                std::vector<size_t> params;
                 size_t bodyIdx = node->children.size() - 1;
                 
                 for (size_t i = 1; i < node->children.size(); i++) {
@@ -1070,50 +2173,67 @@ ValuePtr Runtime::evaluate(std::shared_ptr<ASTNode> node) {
                         bodyIdx = i;
                         break;
                     }
-                    params.push_back(node->children[i]->value);
+                    params.push_back(node->children[i]->slot);
                 }
                 
-                Function func = [params, bodyIdx, node](const std::vector<ValuePtr>& args, Runtime& rt) {
-                    rt.pushScope();
-                    for (size_t i = 0; i < params.size() && i < args.size(); i++) {
-                        rt.setVariable(params[i], args[i]);
-                    }
-                    ValuePtr result = rt.evaluate(node->children[bodyIdx]);
-                    rt.popScope();
-                    return result;
-                };
+                auto act = std::make_shared<Act>();
+                act->name = name;
+                act->params = std::move(params);
+                act->body = node->children[bodyIdx];
+                act->owner = program; // keeps the arena alive for the body
                 
-                functions[name] = func;
-                return std::make_shared<Value>(func);
+                if (!named) return Value(ActPtr(std::move(act)));
+                own().functions[name] = act;
+                // Also a variable, so an act can be passed by name (route handlers)
+                Value value(ActPtr(std::move(act)));
+                setSlot(node->children[0]->slot, value);
+                return value;
             }
             break;
         }
         
         case NodeType::CALL: {
             if (!node->children.empty()) {
-                std::string name = node->children[0]->value;
+                MapKey name(node->children[0]->value);
                 
                 // Check if it's a module call (e.g., "call net get")
                 if (node->children.size() > 1) {
-                    auto moduleIt = modules.find(name);
-                    if (moduleIt != modules.end()) {
-                        std::string method = node->children[1]->value;
-                        std::vector<ValuePtr> args;
+                    auto moduleIt = state->modules.find(name);
+                    if (moduleIt != state->modules.end()) {
+                        std::string method(node->children[1]->value);
+                        std::vector<Value> args;
                         for (size_t i = 2; i < node->children.size(); i++) {
                             args.push_back(evaluate(node->children[i]));
                         }
+                        profile::Scope scope(node, *moduleIt->second, method);
                         return moduleIt->second->call(method, args, *this);
                     }
                 }
                 
                 // Regular function call
-                auto funcIt = functions.find(name);
-                if (funcIt != functions.end()) {
-                    std::vector<ValuePtr> args;
+                const ActPtr* found = state->functions.lookup(name, node->cache);
+                if (found) {
+                    ActPtr act = *found; // the arguments may redefine it
+                    // The arguments go on the value stack, for the act to
+                    // bind from there
+                    struct Arguments {
+                        std::vector<Value>& stack;
+                        size_t base;
+                        ~Arguments() { stack.resize(base); }
+                    } arguments{stack, stack.size()};
                     for (size_t i = 1; i < node->children.size(); i++) {
-                        args.push_back(evaluate(node->children[i]));
+                        Value arg = evaluate(node->children[i]);
+                        stack.push_back(std::move(arg));
+                    }
+                    size_t count = stack.size() - arguments.base;
+                    Value* args = stack.data() + arguments.base;
+                    if (node->tail && act->body && reusesFrame(running, *act, count)) {
+                        // Made by Runtime::call once the caller's body returns
+                        tailArgs.assign(std::make_move_iterator(args), std::make_move_iterator(args + count));
+                        tailAct = std::move(act);
+                        return Value();
                     }
-                    return funcIt->second(args, *this);
+                    return call(*act, args, count);
                 }
             }
             break;
@@ -1121,8 +2241,8 @@ ValuePtr Runtime::evaluate(std::shared_ptr<ASTNode> node) {
         
         case NodeType::IF: {
             if (node->children.size() >= 2) {
-                ValuePtr condition = evaluate(node->children[0]);
-                if (condition->toBool()) {
+                Value condition = evaluate(node->children[0]);
+                if (condition.toBool()) {
                     return evaluate(node->children[1]);
                 } else if (node->children.size() > 2) {
                     return evaluate(node->children[2]);
@@ -1130,1108 +2250,2348 @@ ValuePtr Runtime::evaluate(std::shared_ptr<ASTNode> node) {
             }
             break;
         }
-        
-        case NodeType::LOOP: {
-            if (node->children.size() >= 2) {
-                ValuePtr count = evaluate(node->children[0]);
-                double iterations = count->toNumber();
-                ValuePtr result;
-                for (double i = 0; i < iterations; i++) {
-                    pushScope();
-                    setVariable("step", std::make_shared<Value>(i));
-                    result = evaluate(node->children[1]);
-                    popScope();
-                }
-                return result;
+        
+        case NodeType::LOOP: {
+            if (node->children.size() >= 2) {
+                Value count = evaluate(node->children[0]);
+                double iterations = count.toNumber();
+                if (node->parallel) {
+                    ASTNode* body = node->children[1];
+                    return loopParallel(iterations, node->slot, [body](Runtime& runtime) {
+                        return runtime.evaluate(body);
+                    });
+                }
+                Value result = Value();
+                for (double i = 0; i < iterations; i++) {
+                    pushScope();
+                    setSlot(node->slot, Value(i));
+                    result = evaluate(node->children[1]);
+                    popScope();
+                }
+                return result;
+            }
+            break;
+        }
+        
+        case NodeType::GIVE: {
+            if (!node->children.empty()) {
+                return evaluate(node->children[0]);
+            }
+            break;
+        }
+        
+        case NodeType::SAY: {
+            if (!node->children.empty()) {
+                Value value = evaluate(node->children[0]);
+                int repeatCount = 1;
+                
+                // Check for repeat count (second child or in value)
+                if (node->children.size() > 1 && node->children[1]->type == NodeType::LITERAL) {
+                    repeatCount = static_cast<int>(evaluate(node->children[1]).toNumber());
+                }
+                
+                for (int i = 0; i < repeatCount; i++) {
+                    print(value.toString());
+                }
+                
+                // Store named output if name is provided
+                if (!node->value.empty()) {
+                    setSlot(node->slot, value);
+                }
+                
+                return value;
+            }
+            break;
+        }
+        
+        case NodeType::PUT: {
+            if (node->children.size() >= 2) {
+                Value value = evaluate(node->children[0]);
+                if (node->children[1]->type == NodeType::IDENTIFIER) {
+                    setSlot(node->children[1]->slot, value);
+                }
+                return value;
+            } else if (node->children.size() == 1) {
+                // Just "put value" - return the value
+                return evaluate(node->children[0]);
+            }
+            break;
+        }
+        
+        case NodeType::BINARY_OP: {
+            if (node->children.size() >= 2) {
+                Value left = evaluate(node->children[0]);
+                Value right = evaluate(node->children[1]);
+                return binaryOp(node->value, left, right);
+            }
+            break;
+        }
+        
+        case NodeType::IDENTIFIER: {
+            return getSlot(node->slot);
+        }
+        
+        case NodeType::LITERAL: {
+            Value value;
+            if (literalValue(*node, value)) return value;
+            return getSlot(node->slot);
+        }
+        
+        case NodeType::CONSTANT:
+            return node->constantValue();
+        
+        case NodeType::BLOCK: {
+            pushScope();
+            Value result = Value();
+            for (ASTNode* child : node->children) {
+                result = evaluate(child);
+            }
+            popScope();
+            return result;
+        }
+        
+        default:
+            break;
+    }
+    
+    return Value();
+}
+
+// Slots an expression reads, and whether reading them is all it does
+static void collectReads(const ASTNode* node, std::vector<size_t>& reads, bool& pure) {
+    if (!node) return;
+    switch (node->type) {
+        case NodeType::IDENTIFIER:
+            reads.push_back(node->slot);
+            return;
+        case NodeType::LITERAL:
+            if (node->tokenType != TokenType::NUMBER && node->tokenType != TokenType::STRING) {
+                reads.push_back(node->slot);
+            }
+            return;
+        case NodeType::CONSTANT:
+            return;
+        case NodeType::BINARY_OP:
+            break;
+        default:
+            pure = false;
+            break;
+    }
+    for (const ASTNode* child : node->children) {
+        collectReads(child, reads, pure);
+    }
+}
+
+std::shared_ptr<const ProgramCache::Entry> Runtime::load(const std::string& source, bool expression,
+                                                         const ProgramCache::Entry* base) {
+    uint64_t kind = static_cast<uint64_t>(engine) | (optimizing ? 1ull << 62 : 0) | (expression ? 1ull << 63 : 0);
+    uint64_t key = hashBytes(source, kind);
+    std::shared_ptr<const ProgramCache::Entry> cached = state->cache.find(key, source);
+    if (cached) {
+        if (bindings.size() < cached->slots) bindings.resize(cached->slots);
+        return cached;
+    }
+    auto entry = std::make_shared<ProgramCache::Entry>();
+    entry->source = source;
+    entry->kind = kind;
+    std::shared_ptr<Program> prog;
+    std::shared_ptr<Outline> outline;
+    if (expression) {
+        Lexer lexer(source);
+        prog = std::make_shared<Program>();
+        Parser parser(lexer, *prog, own().symbols);
+        prog->root = parser.parseExpression();
+        Resolver resolver(*this);
+        resolver.resolve(prog->root);
+        resolver.checkParallel(prog->root);
+        resolver.markTailCalls(prog->root);
+        if (optimizing) prog->root = Optimizer(*this, *prog).optimize(prog->root);
+        entry->pure = true;
+        collectReads(prog->root, entry->reads, entry->pure);
+    } else {
+        // Sources are mostly edits of the one before, as in the playground
+        std::shared_ptr<const ProgramCache::Entry> latest;
+        if (!base) {
+            latest = state->cache.latest(kind);
+            base = latest.get();
+        }
+        if (base && (base->kind != kind || !base->outline)) base = nullptr;
+        if (base && bindings.size() < base->slots) bindings.resize(base->slots);
+        outline = std::make_shared<Outline>();
+        outline->parse(*this, source, base);
+        prog = outline->program;
+    }
+    if (engine == Engine::TREE) {
+        entry->program = prog;
+    } else {
+        // Compiled chunks copy everything they need out of the AST
+        Compiler compiler(*this);
+        if (outline) compiler.reuseActs(&outline->protos);
+        entry->chunk = compiler.compile(prog->root);
+    }
+    entry->outline = std::move(outline);
+    entry->slots = bindings.size();
+    own().cache.insert(key, entry);
+    return entry;
+}
+
+Value Runtime::runEntry(const ProgramCache::Entry& entry) {
+    // By what it was compiled for, which a held Compiled may no longer match
+    if (!entry.chunk) {
+        std::shared_ptr<Program> outer = program;
+        program = entry.program;
+        Value result = evaluate(program->root);
+        program = outer;
+        return result;
+    }
+    return VM::run(*this, *entry.chunk);
+}
+
+Value Runtime::execute(const std::string& source) {
+    std::shared_ptr<const ProgramCache::Entry> entry = load(source, false);
+    return runEntry(*entry);
+}
+
+Value Runtime::execute(const Compiled& compiled) {
+    // Slots other programs compiled since then may have grown bindings,
+    // but a reset to a snapshot can have shrunk them
+    if (bindings.size() < compiled->slots) bindings.resize(compiled->slots);
+    return runEntry(*compiled);
+}
+
+Runtime::Compiled Runtime::reload(const Compiled& running, const std::string& source, size_t& acts, size_t& others) {
+    acts = 0;
+    others = 0;
+    Compiled next = load(source, false, running.get());
+    if (!next->outline || !running->outline) return next;
+
+    // A statement changed unless the same text was one before
+    const Outline& before = *running->outline;
+    std::unordered_set<std::string_view> unchanged;
+    for (size_t i = 0; i < before.statements.size(); i++) {
+        unchanged.insert(before.text(running->source, i));
+    }
+    const Outline& outline = *next->outline;
+    std::vector<ASTNode*> defined;
+    for (size_t i = 0; i < outline.statements.size(); i++) {
+        if (unchanged.count(outline.text(next->source, i))) continue;
+        ASTNode* node = outline.statements[i].node;
+        if (node->type == NodeType::ACT) {
+            defined.push_back(node);
+        } else {
+            others++;
+        }
+    }
+    acts = defined.size();
+    if (defined.empty()) return next;
+
+    // A program of just those acts, run as the new version would run them
+    Program definitions;
+    ASTNode* root = definitions.arena.make<ASTNode>(*outline.program->root);
+    root->children.items = definitions.arena.allocArray<ASTNode*>(defined.size());
+    root->children.count = static_cast<uint32_t>(defined.size());
+    std::copy(defined.begin(), defined.end(), root->children.items);
+    if (!next->chunk) {
+        std::shared_ptr<Program> outer = program;
+        program = outline.program; // the acts' owner
+        evaluate(root);
+        program = outer;
+    } else {
+        ActProtos protos = outline.protos;
+        Compiler compiler(*this);
+        compiler.reuseActs(&protos);
+        VM::run(*this, *compiler.compile(root));
+    }
+    for (auto& [name, module] : state->modules) {
+        module->reload(*this);
+    }
+    return next;
+}
+
+struct Runtime::Watch {
+    std::string path;
+    Compiled running;
+    int64_t modified = 0; // of the version running
+    int64_t size = 0;
+    int64_t seenModified = 0, seenSize = 0; // at the last poll
+};
+
+// When the file at path last changed, in nanoseconds, and its size
+static bool fileState(const std::string& path, int64_t& modified, int64_t& size) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) return false;
+#ifdef __APPLE__
+    modified = static_cast<int64_t>(info.st_mtimespec.tv_sec) * 1000000000 + info.st_mtimespec.tv_nsec;
+#else
+    modified = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000 + info.st_mtim.tv_nsec;
+#endif
+    size = static_cast<int64_t>(info.st_size);
+    return true;
+}
+
+void Runtime::watch(const std::string& path, Compiled running) {
+    watching = std::make_shared<Watch>();
+    watching->path = path;
+    watching->running = std::move(running);
+    fileState(path, watching->modified, watching->size);
+    watching->seenModified = watching->modified;
+    watching->seenSize = watching->size;
+}
+
+void Runtime::pollWatch() {
+    if (!watching) return;
+    Watch& watch = *watching;
+    int64_t modified = 0, size = 0;
+    if (!fileState(watch.path, modified, size) || (modified == watch.modified && size == watch.size)) return;
+    // Only once it has stayed the same for a poll, so a save still being
+    // written is not loaded half done
+    bool settled = modified == watch.seenModified && size == watch.seenSize;
+    watch.seenModified = modified;
+    watch.seenSize = size;
+    if (!settled) return;
+    watch.modified = modified;
+    watch.size = size;
+
+    std::ifstream file(watch.path, std::ios::binary);
+    if (!file) return;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string source = buffer.str();
+    flush();
+    try {
+        size_t acts = 0, others = 0;
+        watch.running = reload(watch.running, source, acts, others);
+        flush();
+        std::cerr << "Reloaded " << watch.path << ": " << acts << (acts == 1 ? " act" : " acts");
+        if (others > 0) {
+            std::cerr << "; " << others << (others == 1 ? " other statement changed" : " other statements changed")
+                      << ", restart for " << (others == 1 ? "it" : "them");
+        }
+        std::cerr << std::endl;
+    } catch (const std::exception& e) {
+        flush();
+        std::cerr << "Error: Cannot reload " << watch.path << ": " << e.what() << std::endl;
+    }
+}
+
+ActPtr Runtime::getAct(const std::string& name) const {
+    auto found = state->functions.find(name);
+    return found == state->functions.end() ? nullptr : found->second;
+}
+
+bool Runtime::reusesFrame(const Act* caller, const Act& callee, size_t count) {
+    if (!caller || count < callee.params.size()) return false;
+    if (caller == &callee) return true;
+    for (size_t slot : caller->params) {
+        if (std::find(callee.params.begin(), callee.params.end(), slot) == callee.params.end()) return false;
+    }
+    return true;
+}
+
+Value Runtime::call(const Act& act, const Value* args, size_t count) {
+    if (Scheduler::stackLow()) throw std::runtime_error("Recursion too deep in act " + act.name);
+    if (act.code) return VM::call(*this, act, args, count);
+    struct Restore {
+        const Act*& running;
+        const Act* caller;
+        ~Restore() { running = caller; }
+    } restore{running, running};
+    const Act* current = &act;
+    ActPtr held; // a tail call's act, which the table may no longer hold
+    enterAct(act, args, count);
+    Value result;
+    for (;;) {
+        running = current;
+        {
+            profile::Scope scope(current, current->name);
+            result = evaluate(const_cast<ASTNode*>(current->body));
+        }
+        if (!tailAct) break;
+        // The body ended in a tail call: the callee's scope replaces its
+        // own, so C++ frames do not pile up
+        held = std::move(tailAct);
+        current = held.get();
+        popScope();
+        enterAct(*current, tailArgs.data(), tailArgs.size());
+        tailArgs.clear();
+    }
+    popScope();
+    return result;
+}
+
+Runtime::Expression Runtime::compileExpression(const std::string& source, const std::vector<std::string>& names) {
+    Expression expression;
+    expression.code = load(source, true);
+    const std::vector<size_t>& reads = expression.code->reads;
+    for (const std::string& name : names) {
+        size_t slot = slotFor(own().symbols.intern(name));
+        bool read = std::find(reads.begin(), reads.end(), slot) != reads.end();
+        expression.slots.push_back(read ? slot : Expression::UNUSED);
+    }
+    return expression;
+}
+
+Value Runtime::evaluate(const Expression& expression, const Value* values) {
+    pushScope();
+    for (size_t i = 0; i < expression.slots.size(); i++) {
+        if (expression.uses(i)) setSlot(expression.slots[i], values[i]);
+    }
+    Value result;
+    try {
+        result = runEntry(*expression.code);
+    } catch (...) {
+        popScope();
+        throw;
+    }
+    popScope();
+    return result;
+}
+
+std::string Runtime::compileImage(const std::string& source) {
+    Lexer lexer(source);
+    Program prog;
+    Parser parser(lexer, prog, own().symbols);
+    prog.root = parser.parse();
+    Resolver resolver(*this);
+    resolver.resolve(prog.root);
+    resolver.checkParallel(prog.root);
+    resolver.markTailCalls(prog.root);
+    if (optimizing) prog.root = Optimizer(*this, prog).optimize(prog.root);
+    Compiler compiler(*this);
+    std::shared_ptr<Chunk> chunk = compiler.compile(prog.root);
+    return ProgramImage::write(*this, *chunk);
+}
+
+Value Runtime::executeImage(const char* data, size_t size) {
+    std::shared_ptr<Chunk> chunk = ProgramImage::read(*this, data, size);
+    return VM::run(*this, *chunk);
+}
+
+void Runtime::run() {
+    for (auto& [name, module] : state->modules) {
+        module->run(*this);
+    }
+}
+
+void Runtime::print(const std::string& msg) {
+    sink->line(msg);
+}
+
+// Module method registration
+void Module::bind(std::initializer_list<const char*> names, size_t minArgs, ModuleMethod handler, bool pure) {
+    for (const char* name : names) {
+        methods[name].push_back({minArgs, handler, pure});
+    }
+}
+
+void Module::registerMethods() {
+    methods.clear();
+    bindMethods();
+}
+
+ModuleMethod Module::resolve(const std::string& method, size_t argc) const {
+    auto it = methods.find(method);
+    if (it == methods.end()) return nullptr;
+    for (const Binding& binding : it->second) {
+        if (argc >= binding.minArgs) return binding.handler;
+    }
+    return nullptr;
+}
+
+bool Module::isPure(const std::string& method) const {
+    auto it = methods.find(method);
+    if (it == methods.end()) return true; // calls give unhandled and do nothing
+    for (const Binding& binding : it->second) {
+        if (!binding.pure) return false;
+    }
+    return true;
+}
+
+Value Module::call(const std::string& method, const std::vector<Value>& args, Runtime& runtime) {
+    ModuleMethod handler = resolve(method, args.size());
+    if (!handler) return unhandled;
+    return handler(MethodCall{*this, method, args, runtime});
+}
+
+// NetModule implementation - HTTP client (see net.h)
+
+// A map of header names to values
+static void netHeaders(const Value& value, net::Headers& headers) {
+    if (value.type != ValueType::MAP) return;
+    for (const auto& entry : value.asMap()) {
+        headers.emplace_back(entry.first, entry.second.toString());
+    }
+}
+
+// Maps and lists go as JSON, anything else as text
+static void netBody(const Value& value, net::Request& request) {
+    const char* type = "text/plain; charset=utf-8";
+    if (value.type == ValueType::MAP || value.type == ValueType::LIST) {
+        appendJson(request.body, value);
+        type = "application/json";
+    } else {
+        request.body = value.toString();
+    }
+    bool typed = std::any_of(request.headers.begin(), request.headers.end(), [](const auto& header) {
+        std::string name = header.first;
+        for (char& c : name) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        return name == "content-type";
+    });
+    if (!typed) request.headers.emplace_back("Content-Type", type);
+}
+
+// A URL, or a map with url and optional method, body and headers
+static net::Request netRequest(const Value& value) {
+    net::Request request;
+    if (value.type != ValueType::MAP) {
+        request.url = value.toString();
+        return request;
+    }
+    const auto& spec = value.asMap();
+    auto field = [&](const char* name) {
+        auto found = spec.find(name);
+        return found == spec.end() ? Value() : found->second;
+    };
+    request.url = field("url").toString();
+    if (field("method").type != ValueType::VOID) request.method = field("method").toString();
+    for (char& c : request.method) c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    netHeaders(field("headers"), request.headers);
+    if (field("body").type != ValueType::VOID) netBody(field("body"), request);
+    return request;
+}
+
+static std::string netFailure(const net::Response& response) {
+    if (response.status == 0) return response.error;
+    return "HTTP " + std::to_string(response.status) + " from " + response.url;
+}
+
+void NetModule::fail(const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    lastError = error;
+}
+
+// The body of a 2xx response, or false
+Value NetModule::send(const MethodCall& call, net::Request request) {
+    net::Response response = net::fetch(request);
+    if (response.ok()) return Value(std::move(response.body));
+    static_cast<NetModule&>(call.module).fail(netFailure(response));
+    return Value(false);
+}
+
+void NetModule::bindMethods() {
+    // get url [headers]
+    bind({"get"}, 1, [](const MethodCall& call) {
+        net::Request request;
+        request.url = call.args[0].toString();
+        if (call.args.size() > 1) netHeaders(call.args[1], request.headers);
+        return send(call, std::move(request));
+    });
+    // post url body [headers]
+    bind({"post"}, 2, [](const MethodCall& call) {
+        net::Request request;
+        request.method = "POST";
+        request.url = call.args[0].toString();
+        if (call.args.size() > 2) netHeaders(call.args[2], request.headers);
+        netBody(call.args[1], request);
+        return send(call, std::move(request));
+    });
+    // request method url [body] [headers]: the whole response as
+    // {status, headers, body, url}, whatever its status
+    bind({"request", "fetch"}, 2, [](const MethodCall& call) {
+        ValueMap spec;
+        spec["method"] = call.args[0];
+        spec["url"] = call.args[1];
+        if (call.args.size() > 2) spec["body"] = call.args[2];
+        if (call.args.size() > 3) spec["headers"] = call.args[3];
+        net::Response response = net::fetch(netRequest(Value(std::move(spec))));
+        if (response.status == 0) {
+            static_cast<NetModule&>(call.module).fail(response.error);
+            return Value(false);
+        }
+        ValueMap headers;
+        for (auto& header : response.headers) {
+            Value& value = headers[header.first];
+            value = value.type == ValueType::VOID ? Value(header.second) : Value(value.toString() + ", " + header.second);
+        }
+        ValueMap result;
+        result["status"] = Value(static_cast<double>(response.status));
+        result["headers"] = Value(std::move(headers));
+        result["body"] = Value(std::move(response.body));
+        result["url"] = Value(response.url);
+        return Value(std::move(result));
+    });
+    // all url...: every request at once; each body, or false, in order.
+    // Lists spread, and a map stands for a request {url, method, body, headers}
+    bind({"all"}, 1, [](const MethodCall& call) {
+        std::vector<net::Request> requests;
+        for (const Value& arg : call.args) {
+            if (arg.type == ValueType::LIST) {
+                for (const Value& item : arg.asList()) requests.push_back(netRequest(item));
+            } else {
+                requests.push_back(netRequest(arg));
+            }
+        }
+        std::vector<net::Response> responses = net::fetchAll(requests);
+        std::vector<Value> bodies;
+        for (net::Response& response : responses) {
+            if (response.ok()) {
+                bodies.emplace_back(std::move(response.body));
+            } else {
+                static_cast<NetModule&>(call.module).fail(netFailure(response));
+                bodies.emplace_back(false);
+            }
+        }
+        return Value(std::move(bodies));
+    });
+    // stream url act: calls act with each piece of the body as it arrives,
+    // stopping early if it gives false; the status, or false
+    bind({"stream"}, 2, [](const MethodCall& call) {
+        net::Request request = netRequest(call.args[0]);
+        if (call.args[1].type != ValueType::FUNC) return Value(false);
+        const Function& act = call.args[1].asFunc();
+        net::Response response = net::fetch(request, [&](std::string_view data) {
+            Value result = act({Value(data)}, call.runtime);
+            return !(result.type == ValueType::BOOL && !result.boolean);
+        });
+        if (response.status == 0) {
+            static_cast<NetModule&>(call.module).fail(response.error);
+            return Value(false);
+        }
+        return Value(static_cast<double>(response.status));
+    });
+    bind({"error"}, 0, [](const MethodCall& call) {
+        auto& net = static_cast<NetModule&>(call.module);
+        std::lock_guard<std::mutex> lock(net.mutex);
+        return Value(net.lastError);
+    });
+}
+
+// FileModule implementation
+FileModule::FileModule() = default;
+
+FileModule::~FileModule() = default; // each appender writes out what it holds
+
+bool FileModule::flush(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = appenders.find(path);
+    return found == appenders.end() || found->second->flush();
+}
+
+static std::string_view fileData(const Value& value, std::string& scratch) {
+    if (value.type == ValueType::TEXT) return value.textView();
+    scratch = value.toString();
+    return scratch;
+}
+
+void FileModule::bindMethods() {
+    unhandled = Value(false);
+    // read path: large files come back as a view over their mapping
+    bind({"read"}, 1, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        static_cast<FileModule&>(call.module).flush(path);
+        return files::read(path);
+    });
+    bind({"write"}, 2, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        static_cast<FileModule&>(call.module).flush(path);
+        std::string scratch;
+        return Value(files::write(path, fileData(call.args[1], scratch)));
+    });
+    bind({"append"}, 2, [](const MethodCall& call) {
+        auto& module = static_cast<FileModule&>(call.module);
+        std::string path = call.args[0].toString();
+        std::string scratch;
+        std::string_view data = fileData(call.args[1], scratch);
+        std::lock_guard<std::mutex> lock(module.mutex);
+        auto& appender = module.appenders[path];
+        if (!appender) appender = std::make_unique<files::Appender>(path);
+        if (!appender->isOpen()) {
+            module.appenders.erase(path);
+            return Value(false);
+        }
+        return Value(appender->append(data));
+    });
+    // lines path [act]: calls act with each line, stopping early if it
+    // gives false, and returns how many it saw; without an act, the lines
+    bind({"lines"}, 1, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        static_cast<FileModule&>(call.module).flush(path);
+        if (call.args.size() > 1 && call.args[1].type == ValueType::FUNC) {
+            const Function& act = call.args[1].asFunc();
+            long long count = files::lines(path, [&](std::string_view line) {
+                Value result = act({Value(line)}, call.runtime);
+                return !(result.type == ValueType::BOOL && !result.boolean);
+            });
+            return count < 0 ? Value(false) : Value(static_cast<double>(count));
+        }
+        std::vector<Value> lines;
+        long long count = files::lines(path, [&](std::string_view line) {
+            lines.emplace_back(line);
+            return true;
+        });
+        return count < 0 ? Value(false) : Value(std::move(lines));
+    });
+    // chunks path [size] act: the same, with pieces of up to size bytes
+    bind({"chunks"}, 2, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        const Value& last = call.args.back();
+        if (last.type != ValueType::FUNC) return Value(false);
+        size_t size = files::STREAM_BUFFER;
+        if (call.args.size() > 2 && call.args[1].type == ValueType::NUM && call.args[1].num >= 1) {
+            size = static_cast<size_t>(call.args[1].num);
+        }
+        static_cast<FileModule&>(call.module).flush(path);
+        const Function& act = last.asFunc();
+        long long count = files::chunks(path, size, [&](std::string_view chunk) {
+            Value result = act({Value(chunk)}, call.runtime);
+            return !(result.type == ValueType::BOOL && !result.boolean);
+        });
+        return count < 0 ? Value(false) : Value(static_cast<double>(count));
+    });
+    // readall path...: every file, or false, in order; lists spread
+    bind({"readall"}, 1, [](const MethodCall& call) {
+        auto& module = static_cast<FileModule&>(call.module);
+        std::vector<std::string> paths;
+        for (const Value& arg : call.args) {
+            if (arg.type == ValueType::LIST) {
+                for (const Value& item : arg.asList()) paths.push_back(item.toString());
+            } else {
+                paths.push_back(arg.toString());
             }
-            break;
         }
-        
-        case NodeType::GIVE: {
-            if (!node->children.empty()) {
-                return evaluate(node->children[0]);
+        for (const std::string& path : paths) module.flush(path);
+        return Value(files::readAll(paths));
+    });
+    // flush [path] / close [path]: writes out pending appends; close also
+    // lets go of the file
+    bind({"flush", "close"}, 0, [](const MethodCall& call) {
+        auto& module = static_cast<FileModule&>(call.module);
+        bool closing = call.method == "close";
+        std::lock_guard<std::mutex> lock(module.mutex);
+        bool ok = true;
+        for (auto it = module.appenders.begin(); it != module.appenders.end();) {
+            if (!call.args.empty() && it->first != call.args[0].toString()) {
+                ++it;
+                continue;
             }
-            break;
+            ok = it->second->flush() && ok;
+            it = closing ? module.appenders.erase(it) : std::next(it);
         }
-        
-        case NodeType::SAY: {
-            if (!node->children.empty()) {
-                ValuePtr value = evaluate(node->children[0]);
-                int repeatCount = 1;
-                
-                // Check for repeat count (second child or in value)
-                if (node->children.size() > 1 && node->children[1]->type == NodeType::LITERAL) {
-                    repeatCount = static_cast<int>(evaluate(node->children[1])->toNumber());
-                }
-                
-                for (int i = 0; i < repeatCount; i++) {
-                    print(value->toString());
-                }
-                
-                // Store named output if name is provided
-                if (!node->value.empty()) {
-                    setVariable(node->value, value);
-                }
-                
-                return value;
+        return Value(ok);
+    });
+}
+
+// VMModule implementation
+void VMModule::bindMethods() {
+    // Create a virtual machine instance
+    // This is a placeholder - actual VM implementation would go here
+    bind({"make"}, 0, [](const MethodCall&) { return Value("VM created"); });
+}
+
+// ServeModule implementation
+
+void appendJson(std::string& out, const Value& value) {
+    switch (value.type) {
+        case ValueType::NUM: {
+            if (!std::isfinite(value.num)) {
+                out += "null";
+                break;
             }
+            char buffer[32];
+            std::snprintf(buffer, sizeof(buffer), "%.15g", value.num);
+            out += buffer;
             break;
         }
-        
-        case NodeType::PUT: {
-            if (node->children.size() >= 2) {
-                ValuePtr value = evaluate(node->children[0]);
-                if (node->children[1]->type == NodeType::IDENTIFIER) {
-                    std::string name = node->children[1]->value;
-                    setVariable(name, value);
+        case ValueType::BOOL:
+            out += value.boolean ? "true" : "false";
+            break;
+        case ValueType::TEXT:
+            out += '"';
+            for (char c : value.asText()) {
+                switch (c) {
+                    case '"': out += "\\\""; break;
+                    case '\\': out += "\\\\"; break;
+                    case '\n': out += "\\n"; break;
+                    case '\r': out += "\\r"; break;
+                    case '\t': out += "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            char escape[8];
+                            std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+                            out += escape;
+                        } else {
+                            out += c;
+                        }
                 }
-                return value;
-            } else if (node->children.size() == 1) {
-                // Just "put value" - return the value
-                return evaluate(node->children[0]);
             }
+            out += '"';
             break;
-        }
-        
-        case NodeType::BINARY_OP: {
-            if (node->children.size() >= 2) {
-                ValuePtr left = evaluate(node->children[0]);
-                ValuePtr right = evaluate(node->children[1]);
-                
-                std::string op = node->value;
-                double lnum = left->toNumber();
-                double rnum = right->toNumber();
-                
-                // Arithmetic - flexible operators
-                if (op == "plus" || op == "add" || op == "+") {
-                    return std::make_shared<Value>(lnum + rnum);
-                } else if (op == "minus" || op == "subtract" || op == "-") {
-                    return std::make_shared<Value>(lnum - rnum);
-                } else if (op == "times" || op == "multiply" || op == "*") {
-                    return std::make_shared<Value>(lnum * rnum);
-                } else if (op == "div" || op == "divide" || op == "/") {
-                    if (rnum == 0.0) return std::make_shared<Value>(0.0);
-                    return std::make_shared<Value>(lnum / rnum);
-                } else if (op == "mod" || op == "%") {
-                    if (rnum == 0.0) return std::make_shared<Value>(0.0);
-                    return std::make_shared<Value>(std::fmod(lnum, rnum));
-                } else if (op == "power" || op == "^" || op == "**") {
-                    return std::make_shared<Value>(std::pow(lnum, rnum));
-                }
-                // Comparison - flexible operators
-                else if (op == "over" || op == "greater" || op == ">") {
-                    return std::make_shared<Value>(lnum > rnum);
-                } else if (op == "under" || op == "less" || op == "<") {
-                    return std::make_shared<Value>(lnum < rnum);
-                } else if (op == ">=") {
-                    return std::make_shared<Value>(lnum >= rnum);
-                } else if (op == "<=") {
-                    return std::make_shared<Value>(lnum <= rnum);
-                } else if (op == "same" || op == "equals" || op == "is" || 
-                           op == "are" || op == "==" || op == "=") {
-                    if (left->type == ValueType::TEXT && right->type == ValueType::TEXT) {
-                        return std::make_shared<Value>(left->toString() == right->toString());
-                    }
-                    return std::make_shared<Value>(std::abs(lnum - rnum) < 0.0001);
-                } else if (op == "not" || op == "notequal" || op == "!=") {
-                    if (left->type == ValueType::TEXT && right->type == ValueType::TEXT) {
-                        return std::make_shared<Value>(left->toString() != right->toString());
-                    }
-                    return std::make_shared<Value>(std::abs(lnum - rnum) >= 0.0001);
+        case ValueType::LIST: {
+            out += '[';
+            bool first = true;
+            if (const std::vector<double>* numbers = value.asNumbers()) {
+                for (double number : *numbers) {
+                    if (!first) out += ',';
+                    appendJson(out, Value(number));
+                    first = false;
                 }
-                // Logical - flexible operators
-                else if (op == "and" || op == "andalso" || op == "&&") {
-                    return std::make_shared<Value>(left->toBool() && right->toBool());
-                } else if (op == "or" || op == "orelse" || op == "||") {
-                    return std::make_shared<Value>(left->toBool() || right->toBool());
+                out += ']';
+                break;
+            }
+            if (const std::vector<uint8_t>* flags = value.asBools()) {
+                for (uint8_t flag : *flags) {
+                    if (!first) out += ',';
+                    out += flag ? "true" : "false";
+                    first = false;
                 }
+                out += ']';
+                break;
             }
+            for (const Value& item : value.asList()) {
+                if (!first) out += ',';
+                appendJson(out, item);
+                first = false;
+            }
+            out += ']';
             break;
         }
-        
-        case NodeType::IDENTIFIER: {
-            return getVariable(node->value);
-        }
-        
-        case NodeType::LITERAL: {
-            if (node->token.type == TokenType::NUMBER) {
-                // Parse numeric literal directly
-                try {
-                    double num = std::stod(node->value);
-                    return std::make_shared<Value>(num);
-                } catch (...) {
-                    // Fallback to word conversion
-                    double num = wordToNumber(node->value);
-                    return std::make_shared<Value>(num);
-                }
-            } else if (node->token.type == TokenType::STRING) {
-                return std::make_shared<Value>(node->value);
-            } else if (node->value == "true") {
-                return std::make_shared<Value>(true);
-            } else if (node->value == "false") {
-                return std::make_shared<Value>(false);
-            } else {
-                // Try as number word (e.g., "ten", "five")
-                double num = wordToNumber(node->value);
-                if (num != 0.0 || node->value == "zero") {
-                    return std::make_shared<Value>(num);
-                }
-                // If not a number word, treat as identifier
-                return getVariable(node->value);
+        case ValueType::MAP: {
+            out += '{';
+            bool first = true;
+            for (const auto& pair : value.asMap()) {
+                if (!first) out += ',';
+                appendJson(out, Value(pair.first));
+                out += ':';
+                appendJson(out, pair.second);
+                first = false;
             }
+            out += '}';
+            break;
         }
-        
-        case NodeType::BLOCK: {
-            pushScope();
-            ValuePtr result;
-            for (auto& child : node->children) {
-                result = evaluate(child);
+        default:
+            out += "null";
+    }
+}
+
+// Response descriptors are maps with a status and a body or file, as built
+// by `serve json` and `serve file`; other lists and maps go out as JSON
+static http::Response toResponse(const Value& value) {
+    http::Response response;
+    if (value.type == ValueType::MAP) {
+        // Handlers build these the same way every time, so the lookups cache
+        static const MapKey statusKey("status"), bodyKey("body"), fileKey("file"), typeKey("type");
+        static MapCache statusCache, bodyCache, fileCache, typeCache;
+        auto& map = value.asMap();
+        if (const Value* status = map.lookup(statusKey, statusCache)) {
+            const Value* body = map.lookup(bodyKey, bodyCache);
+            const Value* file = map.lookup(fileKey, fileCache);
+            const Value* type = map.lookup(typeKey, typeCache);
+            response.status = static_cast<int>(status->toNumber());
+            if (body) body->appendTo(response.body);
+            if (file) {
+                response.file = file->toString();
+                response.contentType.clear(); // from the file's extension
             }
-            popScope();
-            return result;
+            if (type) response.contentType = type->toString();
+            return response;
         }
-        
-        default:
-            break;
     }
-    
-    return std::make_shared<Value>();
+    if (value.type == ValueType::LIST || value.type == ValueType::MAP) {
+        response.contentType = "application/json";
+        appendJson(response.body, value);
+    } else if (value.type == ValueType::VOID) {
+        response.status = 204;
+    } else {
+        value.appendTo(response.body);
+    }
+    return response;
 }
 
-ValuePtr Runtime::execute(const std::string& source) {
-    Lexer lexer(source);
-    std::vector<Token> tokens = lexer.tokenize();
-    Parser parser(tokens);
-    std::shared_ptr<ASTNode> ast = parser.parse();
-    return evaluate(ast);
+static Value requestValue(const http::Request& request) {
+    ValueMap headers;
+    for (const auto& [name, value] : request.headers) {
+        std::string key(name);
+        std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+        headers[key] = Value(value);
+    }
+    ValueMap params;
+    for (const auto& [name, value] : request.params) {
+        params[std::string(name)] = Value(value);
+    }
+    ValueMap map;
+    map["method"] = Value(request.methodText);
+    map["path"] = Value(request.path);
+    map["query"] = Value(request.query);
+    map["body"] = Value(request.body);
+    map["headers"] = Value(std::move(headers));
+    map["params"] = Value(std::move(params));
+    return Value(std::move(map));
 }
 
-void Runtime::print(const std::string& msg) {
-    std::cout << msg << std::endl;
+// `serve get PATH [give] handler args...`: the first act after the path
+// handles the route; without one the last argument is a fixed response
+Value ServeModule::addRoute(const MethodCall& call, http::Method method) {
+    auto& serve = static_cast<ServeModule&>(call.module);
+    std::string path = call.args[0].toString();
+    Route route;
+    size_t i = 1;
+    while (i < call.args.size() && call.args[i].type != ValueType::FUNC) i++;
+    if (i < call.args.size()) {
+        route.handler = call.args[i];
+        route.args.assign(call.args.begin() + i + 1, call.args.end());
+    } else {
+        route.handler = call.args.back();
+    }
+    serve.server.router.add(method, path, serve.routes.size());
+    serve.routes.push_back(std::move(route));
+    return Value("Route " + std::string(http::methodName(method)) + " " + path);
 }
 
-// NetModule implementation
-ValuePtr NetModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "get") {
-        if (!args.empty()) {
-            std::string url = args[0]->toString();
-            // In browser, use fetch API via Emscripten
-            // In Node/server, use HTTP client
-            return std::make_shared<Value>("GET " + url);
-        }
-    } else if (method == "post") {
-        if (args.size() >= 2) {
-            std::string url = args[0]->toString();
-            std::string data = args[1]->toString();
-            return std::make_shared<Value>("POST " + url);
-        }
+http::Response ServeModule::handle(size_t index, const http::Request& request) {
+    const Route& route = routes[index];
+    if (route.handler.type != ValueType::FUNC) {
+        return toResponse(route.handler);
+    }
+    std::vector<Value> args = route.args;
+    args.push_back(requestValue(request));
+    RuntimePool::Lease runtime = pool->acquire();
+    http::Response response = toResponse(route.handler.asFunc()(args, *runtime));
+    runtime->flush(); // a server's log shows each request as it is handled
+    return response;
+}
+
+void ServeModule::reload(Runtime& runtime) {
+    for (Route& route : routes) {
+        const Act* act = route.handler.asAct();
+        if (!act) continue;
+        ActPtr current = runtime.getAct(act->name);
+        if (current && current.get() != act) route.handler = Value(std::move(current));
+    }
+    // Requests from here on start from the reloaded acts
+    if (pool) pool = std::make_unique<RuntimePool>(runtime.snapshot());
+}
+
+void ServeModule::run(Runtime& runtime) {
+    if (port == 0) return;
+    int listening = port;
+    port = 0;
+    std::string error;
+    pool = std::make_unique<RuntimePool>(runtime.snapshot());
+    auto handler = [this](size_t index, const http::Request& request) {
+        return handle(index, request);
+    };
+    // Reloads happen between requests, on the thread handling them
+    if (runtime.watched()) server.tick = [&runtime]() { runtime.pollWatch(); };
+    runtime.flush();
+    if (!server.run(listening, handler, error)) {
+        std::cerr << "Error: Cannot serve on port " << listening << ": " << error << std::endl;
     }
-    return std::make_shared<Value>();
 }
 
-// FileModule implementation
-ValuePtr FileModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "read") {
-        if (!args.empty()) {
-            std::string path = args[0]->toString();
-            std::ifstream file(path);
-            if (file.is_open()) {
-                std::string content((std::istreambuf_iterator<char>(file)),
-                                   std::istreambuf_iterator<char>());
-                return std::make_shared<Value>(content);
+void ServeModule::bindMethods() {
+    // Records the port; the server starts once the script has finished
+    // registering routes (see Runtime::run)
+    bind({"on", "start"}, 1, [](const MethodCall& call) {
+        int port = static_cast<int>(call.args[0].toNumber());
+        static_cast<ServeModule&>(call.module).port = port;
+        return Value("Server on port " + std::to_string(port));
+    });
+    bind({"get", "route"}, 2, [](const MethodCall& call) { return addRoute(call, http::Method::GET); });
+    bind({"post"}, 2, [](const MethodCall& call) { return addRoute(call, http::Method::POST); });
+    bind({"put"}, 2, [](const MethodCall& call) { return addRoute(call, http::Method::PUT); });
+    bind({"delete", "del"}, 2, [](const MethodCall& call) { return addRoute(call, http::Method::DELETE); });
+    // Serve static files - auto-detects markdown. `serve static "/public"`
+    // maps /public/... onto ./public; a second argument names the directory
+    bind({"static", "files"}, 1, [](const MethodCall& call) {
+        std::string dir = call.args[0].toString();
+        std::string prefix = dir.empty() || dir[0] != '/' ? "/" + dir : dir;
+        std::string directory = call.args.size() > 1 ? call.args[1].toString() : prefix.substr(1);
+        if (directory.empty()) directory = ".";
+        static_cast<ServeModule&>(call.module).server.mounts.push_back({prefix, directory});
+        return Value("Serving static files from " + dir + " (markdown auto-rendered)");
+    });
+    // Several arguments go out as one JSON array; void ones are the
+    // separators of a list written inline
+    bind({"json", "send"}, 1, [](const MethodCall& call) {
+        std::string body;
+        if (call.args.size() == 1) {
+            appendJson(body, call.args[0]);
+        } else {
+            std::vector<Value> items;
+            for (const Value& arg : call.args) {
+                if (arg.type != ValueType::VOID) items.push_back(arg);
             }
+            appendJson(body, Value(std::move(items)));
         }
-    } else if (method == "write") {
-        if (args.size() >= 2) {
-            std::string path = args[0]->toString();
-            std::string data = args[1]->toString();
-            std::ofstream file(path);
-            if (file.is_open()) {
-                file << data;
-                return std::make_shared<Value>(true);
+        ValueMap response;
+        response["status"] = Value(200.0);
+        response["type"] = Value("application/json");
+        response["body"] = Value(std::move(body));
+        return Value(std::move(response));
+    });
+    // Auto-detect and serve file (markdown auto-rendered if .md)
+    bind({"file", "page"}, 1, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        if (path.find(".md") != std::string::npos) {
+            std::string html;
+            if (renderMarkdownFile(path, html)) {
+                return Value(std::move(html));
             }
+            return Value("Auto-rendered markdown from " + path);
         }
-    }
-    return std::make_shared<Value>(false);
+        if (std::ifstream(path).is_open()) {
+            ValueMap response;
+            response["status"] = Value(200.0);
+            response["file"] = Value(std::move(path));
+            return Value(std::move(response));
+        }
+        return Value("Serving file " + path);
+    });
 }
 
-// VMModule implementation
-ValuePtr VMModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "make") {
-        // Create a virtual machine instance
-        // This is a placeholder - actual VM implementation would go here
-        return std::make_shared<Value>("VM created");
-    }
-    return std::make_shared<Value>();
-}
+// ViewModule implementation - COMPLETE HTML REPLACEMENT - ALL ELEMENTS SUPPORTED
 
-// ServeModule implementation
-ValuePtr ServeModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "on" || method == "start") {
-        if (!args.empty()) {
-            double port = args[0]->toNumber();
-            // Server implementation would go here
-            // For browser, this would use WebSocket or similar
-            return std::make_shared<Value>("Server on port " + std::to_string(static_cast<int>(port)));
-        }
-    } else if (method == "get" || method == "route") {
-        // Define GET route
-        if (args.size() >= 2) {
-            std::string path = args[0]->toString();
-            // Handler would be in args[1]
-            return std::make_shared<Value>("Route GET " + path);
-        }
-    } else if (method == "post") {
-        // Define POST route
-        if (args.size() >= 2) {
-            std::string path = args[0]->toString();
-            return std::make_shared<Value>("Route POST " + path);
-        }
-    } else if (method == "put") {
-        // Define PUT route
-        if (args.size() >= 2) {
-            std::string path = args[0]->toString();
-            return std::make_shared<Value>("Route PUT " + path);
-        }
-    } else if (method == "delete" || method == "del") {
-        // Define DELETE route
-        if (args.size() >= 2) {
-            std::string path = args[0]->toString();
-            return std::make_shared<Value>("Route DELETE " + path);
-        }
-    } else if (method == "static" || method == "files") {
-        // Serve static files - auto-detects markdown
-        if (!args.empty()) {
-            std::string dir = args[0]->toString();
-            // Auto-detect .md files and render them
-            return std::make_shared<Value>("Serving static files from " + dir + " (markdown auto-rendered)");
-        }
-    } else if (method == "json" || method == "send") {
-        // Send JSON response
-        if (!args.empty()) {
-            return std::make_shared<Value>("JSON response");
-        }
-    } else if (method == "file" || method == "page") {
-        // Auto-detect and serve file (markdown auto-rendered if .md)
-        if (!args.empty()) {
-            std::string path = args[0]->toString();
-            if (path.find(".md") != std::string::npos) {
-                return std::make_shared<Value>("Auto-rendered markdown from " + path);
-            }
-            return std::make_shared<Value>("Serving file " + path);
+// Key/value pairs from args[start..]; a trailing single arg becomes content
+static void pairProps(ValueMap& props, const std::vector<Value>& args, size_t start, bool trailingContent) {
+    for (size_t i = start; i < args.size(); i += 2) {
+        if (i + 1 < args.size()) {
+            props[args[i].toString()] = args[i + 1];
+        } else if (trailingContent) {
+            props["content"] = args[i];
         }
     }
-    return std::make_shared<Value>();
 }
 
-// ViewModule implementation - COMPLETE HTML REPLACEMENT - ALL ELEMENTS SUPPORTED
-ValuePtr ViewModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    // Support ALL HTML elements - complete replacement
-    std::map<std::string, ValuePtr> props;
-    
+// Element whose first arg is its content
+static Value viewContentElement(const MethodCall& call) {
+    ValueMap props;
+    if (!call.args.empty()) {
+        props["content"] = call.args[0];
+    }
+    props["tag"] = Value(call.method);
+    return Value(props);
+}
+
+static Value viewFormElement(const MethodCall& call) {
+    ValueMap props;
+    props["tag"] = Value(call.method);
+    pairProps(props, call.args, 0, true);
+    return Value(props);
+}
+
+static Value viewMediaElement(const MethodCall& call) {
+    ValueMap props;
+    props["tag"] = Value(call.method);
+    if (!call.args.empty()) {
+        props["src"] = call.args[0];
+    }
+    pairProps(props, call.args, 1, false);
+    return Value(props);
+}
+
+void ViewModule::bindMethods() {
     // ALL HTML5 semantic elements
-    std::vector<std::string> semanticElements = {
-        "header", "footer", "nav", "main", "article", "section", "aside",
-        "details", "summary", "figure", "figcaption", "mark", "time",
-        "address", "blockquote", "cite", "q", "abbr", "dfn", "code", "pre",
-        "kbd", "samp", "var", "sub", "sup", "small", "strong", "em", "b", "i",
-        "u", "s", "del", "ins", "ruby", "rt", "rp", "bdi", "bdo", "wbr"
-    };
-    
-    for (const auto& elem : semanticElements) {
-        if (method == elem) {
-            if (!args.empty()) {
-                props["content"] = args[0];
-            }
-            props["tag"] = std::make_shared<Value>(elem);
-            return std::make_shared<Value>(props);
-        }
-    }
-    
+    bind({"header", "footer", "nav", "main", "article", "section", "aside",
+          "details", "summary", "figure", "figcaption", "mark", "time",
+          "address", "blockquote", "cite", "q", "abbr", "dfn", "code", "pre",
+          "kbd", "samp", "var", "sub", "sup", "small", "strong", "em", "b", "i",
+          "u", "s", "del", "ins", "ruby", "rt", "rp", "bdi", "bdo", "wbr"}, 0, viewContentElement);
+
     // ALL form elements
-    std::vector<std::string> formElements = {
-        "form", "input", "textarea", "select", "option", "optgroup",
-        "button", "label", "fieldset", "legend", "datalist", "output",
-        "progress", "meter"
-    };
-    
-    for (const auto& elem : formElements) {
-        if (method == elem) {
-            props["tag"] = std::make_shared<Value>(elem);
-            for (size_t i = 0; i < args.size(); i += 2) {
-                if (i + 1 < args.size()) {
-                    props[args[i]->toString()] = args[i + 1];
-                } else if (i < args.size()) {
-                    props["content"] = args[i];
-                }
-            }
-            return std::make_shared<Value>(props);
-        }
-    }
-    
+    bind({"form", "input", "textarea", "select", "option", "optgroup",
+          "button", "label", "fieldset", "legend", "datalist", "output",
+          "progress", "meter"}, 0, viewFormElement);
+
     // ALL table elements
-    std::vector<std::string> tableElements = {
-        "table", "caption", "thead", "tbody", "tfoot", "tr", "th", "td",
-        "colgroup", "col"
-    };
-    
-    for (const auto& elem : tableElements) {
-        if (method == elem) {
-            props["tag"] = std::make_shared<Value>(elem);
-            if (!args.empty()) {
-                props["content"] = args[0];
-            }
-            return std::make_shared<Value>(props);
-        }
-    }
-    
+    bind({"table", "caption", "thead", "tbody", "tfoot", "tr", "th", "td",
+          "colgroup", "col"}, 0, viewContentElement);
+
     // ALL media elements
-    std::vector<std::string> mediaElements = {
-        "video", "audio", "source", "track", "embed", "object", "param",
-        "iframe", "picture", "img"
-    };
-    
-    for (const auto& elem : mediaElements) {
-        if (method == elem) {
-            props["tag"] = std::make_shared<Value>(elem);
-            if (!args.empty()) {
-                props["src"] = args[0];
-            }
-            for (size_t i = 1; i < args.size(); i += 2) {
-                if (i + 1 < args.size()) {
-                    props[args[i]->toString()] = args[i + 1];
-                }
-            }
-            return std::make_shared<Value>(props);
-        }
-    }
-    
+    bind({"video", "audio", "source", "track", "embed", "object", "param",
+          "iframe", "picture", "img"}, 0, viewMediaElement);
+
     // ALL interactive elements
-    std::vector<std::string> interactiveElements = {
-        "a", "area", "map", "canvas", "svg", "math"
-    };
-    
-    for (const auto& elem : interactiveElements) {
-        if (method == elem) {
-            props["tag"] = std::make_shared<Value>(elem);
-            if (!args.empty()) {
-                props["content"] = args[0];
-            }
-            return std::make_shared<Value>(props);
-        }
-    }
-    
-    // Ultra-simple UI components - just pass content directly
-    
+    bind({"a", "area", "map", "canvas", "svg", "math"}, 0, viewContentElement);
+
+    // Ultra-simple UI components - just pass content directly.
+    // Names already bound above (button, label, input, img, a, col,
+    // header, ...) keep the element behaviour
+
     // HTML-like components for maximum simplicity
-    if (method == "h1" || method == "h2" || method == "h3" || method == "h4" || method == "h5" || method == "h6") {
-        if (!args.empty()) {
-            props["tag"] = std::make_shared<Value>(method);
-            props["content"] = args[0];
+    bind({"h1", "h2", "h3", "h4", "h5", "h6"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (!call.args.empty()) {
+            props["tag"] = Value(call.method);
+            props["content"] = call.args[0];
         }
-        return std::make_shared<Value>(props);
-    }
-    
+        return Value(props);
+    });
+
     // Container components
-    if (method == "pane" || method == "div" || method == "box" || method == "section" || method == "main" || method == "article") {
-        for (size_t i = 0; i < args.size(); i += 2) {
-            if (i + 1 < args.size()) {
-                props[args[i]->toString()] = args[i + 1];
-            } else if (i < args.size()) {
-                // Single arg = content
-                props["content"] = args[i];
-            }
-        }
-        props["tag"] = std::make_shared<Value>(method == "pane" ? "div" : method);
-        return std::make_shared<Value>(props);
-    }
-    
+    bind({"pane", "div", "box"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        pairProps(props, call.args, 0, true);
+        props["tag"] = Value(call.method == "pane" ? "div" : call.method);
+        return Value(props);
+    });
+
     // Button - super simple: just text, or text + action
-    if (method == "button" || method == "btn") {
-        if (!args.empty()) {
-            props["text"] = args[0];
+    bind({"btn"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (!call.args.empty()) {
+            props["text"] = call.args[0];
             // If second arg is a function/block, it's the action
-            if (args.size() > 1) {
-                props["action"] = args[1];
+            if (call.args.size() > 1) {
+                props["action"] = call.args[1];
             }
         }
-        props["tag"] = std::make_shared<Value>("button");
-        return std::make_shared<Value>(props);
-    }
-    
+        props["tag"] = Value("button");
+        return Value(props);
+    });
+
     // Text components - just pass the text
-    if (method == "text" || method == "label" || method == "p" || method == "span") {
-        if (!args.empty()) {
-            props["content"] = args[0];
-            props["tag"] = std::make_shared<Value>(method == "text" ? "span" : method);
+    bind({"text", "p", "span"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (!call.args.empty()) {
+            props["content"] = call.args[0];
+            props["tag"] = Value(call.method == "text" ? "span" : call.method);
         }
-        return std::make_shared<Value>(props);
-    }
-    
+        return Value(props);
+    });
+
     // Input - name is first arg, optional props after
-    if (method == "input" || method == "field") {
-        if (!args.empty()) {
-            props["name"] = args[0];
-            for (size_t i = 1; i < args.size(); i += 2) {
-                if (i + 1 < args.size()) {
-                    props[args[i]->toString()] = args[i + 1];
-                }
-            }
+    bind({"field"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (!call.args.empty()) {
+            props["name"] = call.args[0];
+            pairProps(props, call.args, 1, false);
         }
-        props["tag"] = std::make_shared<Value>("input");
-        return std::make_shared<Value>(props);
-    }
-    
+        props["tag"] = Value("input");
+        return Value(props);
+    });
+
     // Image - just URL
-    if (method == "image" || method == "img") {
-        if (!args.empty()) {
-            props["src"] = args[0];
-            props["tag"] = std::make_shared<Value>("img");
+    bind({"image"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (!call.args.empty()) {
+            props["src"] = call.args[0];
+            props["tag"] = Value("img");
         }
-        return std::make_shared<Value>(props);
-    }
-    
+        return Value(props);
+    });
+
     // Link
-    if (method == "link" || method == "a") {
-        if (args.size() >= 2) {
-            props["href"] = args[0];
-            props["content"] = args[1];
-            props["tag"] = std::make_shared<Value>("a");
+    bind({"link"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (call.args.size() >= 2) {
+            props["href"] = call.args[0];
+            props["content"] = call.args[1];
+            props["tag"] = Value("a");
         }
-        return std::make_shared<Value>(props);
-    }
-    
+        return Value(props);
+    });
+
     // List - just pass items
-    if (method == "list" || method == "ul" || method == "ol") {
-        if (!args.empty() && args[0]->type == ValueType::LIST) {
-            props["items"] = args[0];
-            props["tag"] = std::make_shared<Value>(method == "list" ? "ul" : method);
+    bind({"list", "ul", "ol"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (!call.args.empty() && call.args[0].type == ValueType::LIST) {
+            props["items"] = call.args[0];
+            props["tag"] = Value(call.method == "list" ? "ul" : call.method);
         }
-        return std::make_shared<Value>(props);
-    }
-    
+        return Value(props);
+    });
+
     // Card - container with automatic styling
-    if (method == "card") {
-        if (!args.empty()) {
-            props["content"] = args[0];
+    bind({"card"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        if (!call.args.empty()) {
+            props["content"] = call.args[0];
         }
-        props["tag"] = std::make_shared<Value>("div");
-        props["class"] = std::make_shared<Value>("card");
-        return std::make_shared<Value>(props);
-    }
-    
+        props["tag"] = Value("div");
+        props["class"] = Value("card");
+        return Value(props);
+    });
+
     // Grid layout
-    if (method == "grid" || method == "row") {
-        props["tag"] = std::make_shared<Value>("div");
-        props["class"] = std::make_shared<Value>(method);
-        if (!args.empty() && args[0]->type == ValueType::LIST) {
-            props["items"] = args[0];
-        }
-        return std::make_shared<Value>(props);
-    }
-    
-    // Column
-    if (method == "col") {
-        props["tag"] = std::make_shared<Value>("div");
-        props["class"] = std::make_shared<Value>("col");
-        if (!args.empty()) {
-            props["content"] = args[0];
-        }
-        return std::make_shared<Value>(props);
-    }
-    
-    // Header/Footer/Nav
-    if (method == "header" || method == "footer" || method == "nav") {
-        if (!args.empty()) {
-            props["content"] = args[0];
+    bind({"grid", "row"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        props["tag"] = Value("div");
+        props["class"] = Value(call.method);
+        if (!call.args.empty() && call.args[0].type == ValueType::LIST) {
+            props["items"] = call.args[0];
         }
-        props["tag"] = std::make_shared<Value>(method);
-        return std::make_shared<Value>(props);
-    }
-    
-    // Show/Render - display component
-    if (method == "show" || method == "render") {
-        if (!args.empty()) {
-            std::string component = args[0]->toString();
-            return std::make_shared<Value>("Rendered: " + component);
-        }
-    }
-    
+        return Value(props);
+    });
+
+    // Show/Render - the component's HTML (see dom.h)
+    bind({"show", "render", "html"}, 1, [](const MethodCall& call) {
+        dom::Tree tree(call.args[0]);
+        std::string html;
+        dom::render(tree.root(), html);
+        return Value(std::move(html));
+    });
+
+    // Diff - the patches turning one component's DOM into another's
+    bind({"diff", "patch"}, 2, [](const MethodCall& call) {
+        dom::Tree before(call.args[0]);
+        dom::Tree after(call.args[1]);
+        return dom::patchesValue(dom::diff(before, after));
+    });
+
     // Style - apply CSS
-    if (method == "style" || method == "css") {
-        for (size_t i = 0; i < args.size(); i += 2) {
-            if (i + 1 < args.size()) {
-                props[args[i]->toString()] = args[i + 1];
-            }
+    bind({"style", "css"}, 0, [](const MethodCall& call) {
+        ValueMap props;
+        pairProps(props, call.args, 0, false);
+        return Value(props);
+    });
+}
+
+// PlayModule implementation - sprites as columns and a fixed-step clock
+// (see play.h)
+uint32_t PlayModule::slot(const MethodCall& call) {
+    double id = call.args[0].toNumber();
+    if (!(id >= 0) || id >= play::NONE) return play::NONE;
+    return world.slot(static_cast<uint32_t>(id));
+}
+
+uint32_t PlayModule::textureNamed(std::string name) {
+    auto found = std::find(textures.begin(), textures.end(), name);
+    if (found == textures.end()) found = textures.insert(found, std::move(name));
+    return static_cast<uint32_t>(found - textures.begin() + 1);
+}
+
+int PlayModule::tick(Runtime& runtime, double seconds) {
+    int steps;
+    double dt;
+    Value act;
+    std::vector<Value> args;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        steps = clock.advance(seconds);
+        dt = clock.step;
+        act = update;
+        args.swap(stepArgs);
+    }
+    args.assign(1, Value(dt));
+    for (int i = 0; i < steps; i++) {
+        // Unlocked, as the act may well call the module
+        if (act.type == ValueType::FUNC) act.asFunc()(args, runtime);
+        std::lock_guard<std::mutex> lock(mutex);
+        world.step(dt);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    stepArgs.swap(args);
+    return steps;
+}
+
+const play::Frame& PlayModule::render() {
+    std::lock_guard<std::mutex> lock(mutex);
+    world.render(clock.alpha(), drawn);
+    return drawn;
+}
+
+std::string PlayModule::texture(uint32_t id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return id >= 1 && id <= textures.size() ? textures[id - 1] : std::string();
+}
+
+void PlayModule::bindMethods() {
+    // game [rate]: a new game, with no sprites, stepped rate times a second
+    // (60 unless given)
+    bind({"game", "start"}, 0, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        double rate = call.args.empty() ? 60 : call.args[0].toNumber();
+        if (!(rate > 0 && rate <= 1000)) rate = 60;
+        std::lock_guard<std::mutex> lock(play.mutex);
+        play.world.clear();
+        play.clock.step = 1 / rate;
+        play.clock.reset();
+        play.update = Value();
+        play.drawn = play::Frame();
+        return Value(true);
+    });
+    // texture name: the id of the texture the page loads from name (an
+    // image URL), the same for the same name
+    bind({"texture", "image"}, 1, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        std::lock_guard<std::mutex> lock(play.mutex);
+        return Value(static_cast<double>(play.textureNamed(call.args[0].toString())));
+    });
+    // sprite x y [w h [texture]]: a new sprite's id. Sprites are drawn
+    // centred on x y, 16 by 16 unless given; texture is an id from
+    // `play texture` or a name to register
+    bind({"sprite", "add"}, 2, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        const std::vector<Value>& args = call.args;
+        double w = args.size() > 3 ? args[2].toNumber() : 16;
+        double h = args.size() > 3 ? args[3].toNumber() : 16;
+        std::lock_guard<std::mutex> lock(play.mutex);
+        uint32_t texture = 0;
+        if (args.size() > 4 && args[4].type == ValueType::TEXT) {
+            texture = play.textureNamed(args[4].toString());
+        } else if (args.size() > 4 && args[4].toNumber() >= 1 && args[4].toNumber() <= play.textures.size()) {
+            texture = static_cast<uint32_t>(args[4].toNumber());
         }
-        return std::make_shared<Value>(props);
-    }
-    
-    return std::make_shared<Value>();
-}
-
-// PlayModule implementation
-ValuePtr PlayModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "game" || method == "sprite" || method == "render") {
-        // Game logic implementation
-        return std::make_shared<Value>("Play: " + method);
-    }
-    return std::make_shared<Value>();
-}
-
-// MarkdownModule implementation - ULTRA SIMPLE syntax
-ValuePtr MarkdownModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "parse" || method == "render" || method == "convert") {
-        if (!args.empty()) {
-            std::string markdown = args[0]->toString();
-            std::string html = markdown;
-            
-            // ULTRA FLEXIBLE HEADERS - many ways
-            // big Title, BIG TITLE, big: Title
-            size_t pos = 0;
-            while ((pos = html.find("big ", pos)) != std::string::npos || 
-                   (pos = html.find("BIG ", pos)) != std::string::npos) {
-                size_t start = pos;
-                size_t end = html.find("\n", pos);
-                if (end == std::string::npos) end = html.length();
-                std::string text = html.substr(pos + 4, end - pos - 4);
-                html.replace(pos, end - pos, "<h1>" + text + "</h1>");
-                pos += text.length() + 5;
-            }
-            
-            pos = 0;
-            while ((pos = html.find("medium ", pos)) != std::string::npos ||
-                   (pos = html.find("MEDIUM ", pos)) != std::string::npos) {
-                size_t end = html.find("\n", pos);
-                if (end == std::string::npos) end = html.length();
-                std::string text = html.substr(pos + 7, end - pos - 7);
-                html.replace(pos, end - pos, "<h2>" + text + "</h2>");
-                pos += text.length() + 6;
-            }
-            
-            pos = 0;
-            while ((pos = html.find("small ", pos)) != std::string::npos ||
-                   (pos = html.find("SMALL ", pos)) != std::string::npos) {
-                size_t end = html.find("\n", pos);
-                if (end == std::string::npos) end = html.length();
-                std::string text = html.substr(pos + 6, end - pos - 6);
-                html.replace(pos, end - pos, "<h3>" + text + "</h3>");
-                pos += text.length() + 7;
-            }
-            
-            // Traditional headers
-            pos = 0;
-            while ((pos = html.find("### ", pos)) != std::string::npos) {
-                size_t end = html.find("\n", pos);
-                if (end == std::string::npos) end = html.length();
-                std::string text = html.substr(pos + 4, end - pos - 4);
-                html.replace(pos, end - pos, "<h3>" + text + "</h3>");
-                pos += text.length() + 7;
-            }
-            
-            pos = 0;
-            while ((pos = html.find("## ", pos)) != std::string::npos) {
-                size_t end = html.find("\n", pos);
-                if (end == std::string::npos) end = html.length();
-                std::string text = html.substr(pos + 3, end - pos - 3);
-                html.replace(pos, end - pos, "<h2>" + text + "</h2>");
-                pos += text.length() + 6;
-            }
-            
-            pos = 0;
-            while ((pos = html.find("# ", pos)) != std::string::npos) {
-                size_t end = html.find("\n", pos);
-                if (end == std::string::npos) end = html.length();
-                std::string text = html.substr(pos + 2, end - pos - 2);
-                html.replace(pos, end - pos, "<h1>" + text + "</h1>");
-                pos += text.length() + 5;
-            }
-            
-            // Bold - flexible
-            pos = 0;
-            while ((pos = html.find("**", pos)) != std::string::npos) {
-                size_t end = html.find("**", pos + 2);
-                if (end != std::string::npos) {
-                    std::string text = html.substr(pos + 2, end - pos - 2);
-                    html.replace(pos, end - pos + 2, "<strong>" + text + "</strong>");
-                    pos += text.length() + 15;
-                } else {
-                    break;
-                }
-            }
-            
-            // Code blocks
-            pos = 0;
-            while ((pos = html.find("```", pos)) != std::string::npos) {
-                size_t end = html.find("```", pos + 3);
-                if (end != std::string::npos) {
-                    std::string code = html.substr(pos + 3, end - pos - 3);
-                    html.replace(pos, end - pos + 3, "<pre><code>" + code + "</code></pre>");
-                    pos += code.length() + 21;
-                } else {
-                    break;
-                }
-            }
-            
-            // Lists - flexible
-            pos = 0;
-            while ((pos = html.find("\n- ", pos)) != std::string::npos ||
-                   (pos = html.find("\n* ", pos)) != std::string::npos) {
-                size_t start = pos + 1;
-                size_t end = html.find("\n", start + 2);
-                if (end == std::string::npos) end = html.length();
-                std::string text = html.substr(start + 2, end - start - 2);
-                html.replace(start, end - start, "<li>" + text + "</li>");
-                pos = start + text.length() + 7;
+        uint32_t id = play.world.add(args[0].toNumber(), args[1].toNumber(), w, h, texture);
+        return Value(static_cast<double>(id));
+    });
+    // speed id vx vy: units a second; false if there is no such sprite
+    bind({"speed", "velocity"}, 3, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        std::lock_guard<std::mutex> lock(play.mutex);
+        uint32_t at = play.slot(call);
+        if (at == play::NONE) return Value(false);
+        play.world.vx[at] = call.args[1].toNumber();
+        play.world.vy[at] = call.args[2].toNumber();
+        return Value(true);
+    });
+    // place id x y: there from the next frame on, without being drawn on
+    // the way
+    bind({"place", "position"}, 3, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        std::lock_guard<std::mutex> lock(play.mutex);
+        uint32_t at = play.slot(call);
+        if (at == play::NONE) return Value(false);
+        play.world.x[at] = play.world.lastX[at] = call.args[1].toNumber();
+        play.world.y[at] = play.world.lastY[at] = call.args[2].toNumber();
+        return Value(true);
+    });
+    // where id: {x, y, vx, vy}, or false
+    bind({"where", "get"}, 1, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        std::lock_guard<std::mutex> lock(play.mutex);
+        uint32_t at = play.slot(call);
+        if (at == play::NONE) return Value(false);
+        const play::World& world = play.world;
+        return Value(ValueMap{{"x", Value(world.x[at])}, {"y", Value(world.y[at])},
+                              {"vx", Value(world.vx[at])}, {"vy", Value(world.vy[at])}});
+    });
+    bind({"remove", "delete"}, 1, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        std::lock_guard<std::mutex> lock(play.mutex);
+        uint32_t at = play.slot(call);
+        return Value(at != play::NONE && play.world.remove(play.world.ids[at]));
+    });
+    bind({"count", "sprites"}, 0, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        std::lock_guard<std::mutex> lock(play.mutex);
+        return Value(static_cast<double>(play.world.size()));
+    });
+    // bounds w h: sprites bounce off the edges of 0..w by 0..h
+    bind({"bounds", "edges"}, 2, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        std::lock_guard<std::mutex> lock(play.mutex);
+        play.world.bounds(call.args[0].toNumber(), call.args[1].toNumber());
+        return Value(true);
+    });
+    // update act: called with the step's length in seconds before each
+    // step; without an act, no longer
+    bind({"update", "every"}, 0, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        bool given = !call.args.empty() && call.args[0].type == ValueType::FUNC;
+        std::lock_guard<std::mutex> lock(play.mutex);
+        play.update = given ? call.args[0] : Value();
+        return Value(given);
+    });
+    // tick seconds: the steps due once that much game time has passed;
+    // gives how many ran
+    bind({"tick", "advance"}, 1, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        return Value(static_cast<double>(play.tick(call.runtime, call.args[0].toNumber())));
+    });
+    // render: draws the sprites where they are between the last two steps;
+    // gives the draw calls, one per texture
+    bind({"render", "draw"}, 0, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        return Value(static_cast<double>(play.render().batches.size()));
+    });
+    // frame: the steps due since the last frame, then a render
+    bind({"frame"}, 0, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        double seconds;
+        {
+            std::lock_guard<std::mutex> lock(play.mutex);
+            seconds = play.clock.elapsed();
+        }
+        play.tick(call.runtime, seconds);
+        return Value(static_cast<double>(play.render().batches.size()));
+    });
+    // run frames: that many frames, one per step's time; gives the steps
+    // run. In the browser the page runs frames as the display wants them
+    // (see azalea_play_frame), so this runs none
+    bind({"run", "loop"}, 1, [](const MethodCall& call) {
+        auto& play = static_cast<PlayModule&>(call.module);
+        double steps = 0;
+#ifndef __EMSCRIPTEN__
+        double frames = call.args[0].toNumber();
+        auto next = std::chrono::steady_clock::now();
+        for (double i = 0; i < frames; i++) {
+            double seconds;
+            std::chrono::nanoseconds period;
+            {
+                std::lock_guard<std::mutex> lock(play.mutex);
+                period = std::chrono::nanoseconds(static_cast<int64_t>(play.clock.step * 1e9));
+                seconds = play.clock.elapsed();
             }
-            
-            return std::make_shared<Value>(html);
+            steps += play.tick(call.runtime, seconds);
+            play.render();
+            // A frame that ran long starts the next one now instead of
+            // making up for it
+            next = std::max(next + period, std::chrono::steady_clock::now());
+            std::this_thread::sleep_until(next);
         }
-    } else if (method == "serve" || method == "render" || method == "load") {
-        if (!args.empty()) {
-            std::string path = args[0]->toString();
-            // In browser, this would fetch and render markdown
-            return std::make_shared<Value>("Rendered markdown from " + path);
+#else
+        (void)play;
+#endif
+        return Value(steps);
+    });
+}
+
+// MarkdownModule implementation - ULTRA SIMPLE syntax (see markdown.h)
+void MarkdownModule::bindMethods() {
+    bind({"parse", "render", "convert"}, 1, [](const MethodCall& call) {
+        return Value(renderMarkdown(call.args[0].toString()));
+    });
+    bind({"serve", "load"}, 1, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        std::string html;
+        if (renderMarkdownFile(path, html)) {
+            return Value(std::move(html));
         }
-    }
-    return std::make_shared<Value>();
+        // In browser, this would fetch and render markdown
+        return Value("Rendered markdown from " + path);
+    });
+}
+
+// WebModule implementation - FULL HTML/CSS/JS REPLACEMENT - DO ANYTHING POSSIBLE
+
+// open + content + close; long content is shared, not copied, so nesting
+// elements costs the same however much HTML they wrap
+static Value wrapText(const char* open, const Value& content, const char* close) {
+    return Value::concat({Value(open), content, Value(close)});
 }
 
-// WebModule implementation - FULL HTML/CSS/JS REPLACEMENT - DO ANYTHING POSSIBLE
-ValuePtr WebModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    // DOM Manipulation - query, create, update, delete
-    if (method == "query" || method == "select" || method == "find" || method == "get") {
-        if (!args.empty()) {
-            std::string selector = args[0]->toString();
-            return std::make_shared<Value>("Query: " + selector);
-        }
-    }
-    
-    if (method == "create" || method == "element" || method == "tag" || method == "make") {
-        if (!args.empty()) {
-            std::string tag = args[0]->toString();
-            return std::make_shared<Value>("Created: <" + tag + ">");
+void WebModule::bindMethods() {
+    // Handlers taking arguments only accept calls that pass enough of
+    // them; other calls fall through to later bindings of the same name
+    // ("select" with no selector is the <select> element)
+
+    // DOM Manipulation - query, create, update, delete
+    bind({"query", "select", "find", "get"}, 1, [](const MethodCall& call) {
+        return wrapText("Query: ", call.args[0], "");
+    });
+    bind({"create", "element", "tag", "make"}, 1, [](const MethodCall& call) {
+        return wrapText("Created: <", call.args[0], ">");
+    });
+    bind({"append", "add", "insert"}, 2, [](const MethodCall&) { return Value("Appended element"); });
+    bind({"remove", "delete", "del", "clear"}, 1, [](const MethodCall&) { return Value("Removed element"); });
+    bind({"update", "set", "change", "modify"}, 2, [](const MethodCall&) { return Value("Updated element"); });
+    bind({"text", "content", "innerHTML"}, 2, [](const MethodCall&) { return Value("Set text content"); });
+
+    // Events - ALL event types
+    bind({"on", "listen", "event", "addEventListener"}, 2, [](const MethodCall& call) {
+        return wrapText("Listening: ", call.args[0], "");
+    });
+    bind({"click", "clicked", "onclick"}, 0, [](const MethodCall&) { return Value("Click handler"); });
+    bind({"input", "change", "oninput", "onchange"}, 0, [](const MethodCall&) { return Value("Input handler"); });
+    bind({"keydown", "keyup", "keypress"}, 0, [](const MethodCall&) { return Value("Keyboard handler"); });
+    bind({"mouse", "mousedown", "mouseup", "mousemove"}, 0, [](const MethodCall&) { return Value("Mouse handler"); });
+    bind({"scroll", "onscroll"}, 0, [](const MethodCall&) { return Value("Scroll handler"); });
+    bind({"load", "onload"}, 0, [](const MethodCall&) { return Value("Load handler"); });
+
+    // Web APIs - fetch, storage, websocket, etc.
+    bind({"fetch", "request", "http"}, 1, [](const MethodCall& call) {
+        return wrapText("Fetch: ", call.args[0], "");
+    });
+    bind({"post", "send", "submit"}, 2, [](const MethodCall& call) {
+        return wrapText("POST: ", call.args[0], "");
+    });
+    bind({"storage", "localStorage", "store", "save"}, 2, [](const MethodCall& call) {
+        return wrapText("Stored: ", call.args[0], "");
+    });
+    bind({"getStorage", "retrieve"}, 1, [](const MethodCall& call) {
+        return wrapText("Loaded: ", call.args[0], "");
+    });
+    bind({"socket", "websocket", "ws", "connect"}, 1, [](const MethodCall& call) {
+        return wrapText("WebSocket: ", call.args[0], "");
+    });
+
+    // Page rendering - complete HTML pages
+    bind({"page", "html", "render", "document"}, 1, [](const MethodCall&) { return Value("Rendered page"); });
+    bind({"title"}, 1, [](const MethodCall& call) {
+        return wrapText("Title: ", call.args[0], "");
+    });
+    bind({"head", "header"}, 0, [](const MethodCall&) { return Value("<head>"); });
+    bind({"body"}, 0, [](const MethodCall&) { return Value("<body>"); });
+
+    // Canvas/Graphics - drawing, animations
+    bind({"canvas", "draw", "graphics"}, 2, [](const MethodCall& call) {
+        double width = call.args[0].toNumber();
+        double height = call.args[1].toNumber();
+        return Value("Canvas: " + std::to_string(static_cast<int>(width)) + "x" + std::to_string(static_cast<int>(height)));
+    });
+    bind({"svg", "vector", "graphic"}, 0, [](const MethodCall&) { return Value("<svg>"); });
+    bind({"circle", "rect", "line", "path"}, 0, [](const MethodCall&) { return Value("Shape drawn"); });
+
+    // CSS - full styling support
+    bind({"style", "css"}, 2, [](const MethodCall& call) {
+        return Value::concat({call.args[0], Value(": "), call.args[1]});
+    });
+    bind({"class", "className", "addClass"}, 1, [](const MethodCall& call) {
+        return wrapText("class=\"", call.args[0], "\"");
+    });
+    bind({"id"}, 1, [](const MethodCall& call) {
+        return wrapText("id=\"", call.args[0], "\"");
+    });
+
+    // Animation
+    bind({"animate", "animation", "transition"}, 0, [](const MethodCall&) { return Value("Animation"); });
+
+    // Media - video, audio
+    bind({"video"}, 1, [](const MethodCall& call) {
+        return wrapText("<video src=\"", call.args[0], "\">");
+    });
+    bind({"audio", "sound"}, 1, [](const MethodCall& call) {
+        return wrapText("<audio src=\"", call.args[0], "\">");
+    });
+
+    // Forms - all form elements
+    bind({"form"}, 0, [](const MethodCall&) { return Value("<form>"); });
+    bind({"textarea", "textbox"}, 0, [](const MethodCall&) { return Value("<textarea>"); });
+    bind({"select", "dropdown"}, 0, [](const MethodCall&) { return Value("<select>"); });
+    bind({"option"}, 1, [](const MethodCall& call) {
+        return wrapText("<option>", call.args[0], "</option>");
+    });
+    bind({"checkbox", "check"}, 0, [](const MethodCall&) { return Value("<input type=\"checkbox\">"); });
+    bind({"radio"}, 0, [](const MethodCall&) { return Value("<input type=\"radio\">"); });
+
+    // Tables - full table support
+    bind({"table"}, 0, [](const MethodCall&) { return Value("<table>"); });
+    bind({"tr", "row"}, 0, [](const MethodCall&) { return Value("<tr>"); });
+    bind({"td", "cell"}, 0, [](const MethodCall& call) {
+        if (!call.args.empty()) {
+            return wrapText("<td>", call.args[0], "</td>");
         }
-    }
-    
-    if (method == "append" || method == "add" || method == "insert") {
-        if (args.size() >= 2) {
-            return std::make_shared<Value>("Appended element");
+        return Value("<td>");
+    });
+    bind({"th"}, 0, [](const MethodCall& call) {
+        if (!call.args.empty()) {
+            return wrapText("<th>", call.args[0], "</th>");
         }
-    }
-    
-    if (method == "remove" || method == "delete" || method == "del" || method == "clear") {
-        if (!args.empty()) {
-            return std::make_shared<Value>("Removed element");
+        return Value("<th>");
+    });
+
+    // Lists
+    bind({"ul", "unordered"}, 0, [](const MethodCall&) { return Value("<ul>"); });
+    bind({"ol", "ordered"}, 0, [](const MethodCall&) { return Value("<ol>"); });
+    bind({"li", "item"}, 0, [](const MethodCall& call) {
+        if (!call.args.empty()) {
+            return wrapText("<li>", call.args[0], "</li>");
         }
-    }
-    
-    if (method == "update" || method == "set" || method == "change" || method == "modify") {
-        if (args.size() >= 2) {
-            return std::make_shared<Value>("Updated element");
+        return Value("<li>");
+    });
+
+    // Meta tags
+    bind({"meta"}, 0, [](const MethodCall&) { return Value("<meta>"); });
+    bind({"link"}, 2, [](const MethodCall& call) {
+        std::string rel = call.args[0].toString();
+        std::string href = call.args[1].toString();
+        return Value("<link rel=\"" + rel + "\" href=\"" + href + "\">");
+    });
+    bind({"script"}, 0, [](const MethodCall& call) {
+        if (!call.args.empty()) {
+            return wrapText("<script src=\"", call.args[0], "\">");
         }
-    }
-    
-    if (method == "text" || method == "content" || method == "innerHTML") {
-        if (args.size() >= 2) {
-            return std::make_shared<Value>("Set text content");
+        return Value("<script>");
+    });
+
+    // Advanced features
+    bind({"worker", "webworker"}, 0, [](const MethodCall&) { return Value("Web Worker"); });
+    bind({"share", "shareAPI"}, 0, [](const MethodCall&) { return Value("Share API"); });
+    bind({"geolocation", "location"}, 0, [](const MethodCall&) { return Value("Geolocation"); });
+    bind({"camera", "media"}, 0, [](const MethodCall&) { return Value("Media API"); });
+}
+
+// ListModule implementation - packed lists and the kernels over them (see
+// kernels.h)
+
+// The items of a list as numbers: a packed list's own array, or every
+// item's toNumber() gathered into scratch. n is 0 for values other than lists
+static const double* listNumbers(const Value& list, std::vector<double>& scratch, size_t& n) {
+    if (const std::vector<double>* numbers = list.asNumbers()) {
+        n = numbers->size();
+        return numbers->data();
+    }
+    scratch.clear();
+    if (const std::vector<uint8_t>* flags = list.asBools()) {
+        scratch.assign(flags->begin(), flags->end());
+    } else if (list.type == ValueType::LIST) {
+        for (const Value& item : list.asList()) scratch.push_back(item.toNumber());
+    }
+    n = scratch.size();
+    return scratch.data();
+}
+
+static size_t listSize(const Value& list) {
+    return list.type == ValueType::LIST ? static_cast<const ListObject*>(list.object)->size() : 0;
+}
+
+// Position args[at] in list, or false if it is not one
+static bool listIndex(const MethodCall& call, size_t at, size_t& index) {
+    double position = call.args[at].toNumber();
+    if (!(position >= 0) || position >= static_cast<double>(listSize(call.args[0]))) return false;
+    index = static_cast<size_t>(position);
+    return true;
+}
+
+// The act called on every item, its results packed if they can be
+static Value listApply(const MethodCall& call, const Function& act) {
+    size_t n = listSize(call.args[0]);
+    const ListObject* list = static_cast<const ListObject*>(call.args[0].object);
+    std::vector<Value> results;
+    results.reserve(n);
+    std::vector<Value> args(1);
+    for (size_t i = 0; i < n; i++) {
+        args[0] = list->get(i);
+        results.push_back(act(args, call.runtime));
+    }
+    return Value::pack(std::move(results));
+}
+
+void ListModule::bindMethods() {
+    // range n: 0 .. n-1; range from to [by]: from up to, not including, to
+    bind({"range", "numbers"}, 1, [](const MethodCall& call) {
+        double from = 0, to = call.args[0].toNumber(), by = 1;
+        if (call.args.size() > 1) {
+            from = to;
+            to = call.args[1].toNumber();
         }
-    }
-    
-    // Events - ALL event types
-    if (method == "on" || method == "listen" || method == "event" || method == "addEventListener") {
-        if (args.size() >= 2) {
-            std::string event = args[0]->toString();
-            return std::make_shared<Value>("Listening: " + event);
+        if (call.args.size() > 2) by = call.args[2].toNumber();
+        std::vector<double> numbers;
+        if (by > 0 && from < to) {
+            numbers.reserve(static_cast<size_t>(std::ceil((to - from) / by)));
+            for (double x = from; x < to; x += by) numbers.push_back(x);
+        } else if (by < 0 && from > to) {
+            for (double x = from; x > to; x += by) numbers.push_back(x);
         }
-    }
-    
-    if (method == "click" || method == "clicked" || method == "onclick") {
-        return std::make_shared<Value>("Click handler");
-    }
-    
-    if (method == "input" || method == "change" || method == "oninput" || method == "onchange") {
-        return std::make_shared<Value>("Input handler");
-    }
-    
-    if (method == "keydown" || method == "keyup" || method == "keypress") {
-        return std::make_shared<Value>("Keyboard handler");
-    }
-    
-    if (method == "mouse" || method == "mousedown" || method == "mouseup" || method == "mousemove") {
-        return std::make_shared<Value>("Mouse handler");
-    }
-    
-    if (method == "scroll" || method == "onscroll") {
-        return std::make_shared<Value>("Scroll handler");
-    }
-    
-    if (method == "load" || method == "onload") {
-        return std::make_shared<Value>("Load handler");
-    }
-    
-    // Web APIs - fetch, storage, websocket, etc.
-    if (method == "fetch" || method == "get" || method == "request" || method == "http") {
-        if (!args.empty()) {
-            std::string url = args[0]->toString();
-            return std::make_shared<Value>("Fetch: " + url);
+        return Value::numbers(std::move(numbers));
+    }, true);
+    // of items...: a new list of them
+    bind({"of", "new"}, 0, [](const MethodCall& call) {
+        return Value::pack(call.args);
+    }, true);
+    bind({"size", "length", "len"}, 1, [](const MethodCall& call) {
+        return Value(static_cast<double>(listSize(call.args[0])));
+    }, true);
+    // numbers, bools or values: how the list holds its items
+    bind({"packing", "kind"}, 1, [](const MethodCall& call) {
+        if (call.args[0].asNumbers()) return Value("numbers");
+        if (call.args[0].asBools()) return Value("bools");
+        return Value("values");
+    }, true);
+    bind({"get", "at", "item"}, 2, [](const MethodCall& call) {
+        size_t index;
+        if (!listIndex(call, 1, index)) return Value();
+        return static_cast<const ListObject*>(call.args[0].object)->get(index);
+    }, true);
+    // set list i value, push list value: in place; they give the list
+    bind({"set", "put"}, 3, [](const MethodCall& call) {
+        size_t index;
+        if (!listIndex(call, 1, index)) return Value(false);
+        static_cast<ListObject*>(call.args[0].object)->set(index, call.args[2]);
+        return call.args[0];
+    });
+    bind({"push", "append", "add"}, 2, [](const MethodCall& call) {
+        if (call.args[0].type != ValueType::LIST) return Value(false);
+        for (size_t i = 1; i < call.args.size(); i++) {
+            static_cast<ListObject*>(call.args[0].object)->push(call.args[i]);
         }
-    }
-    
-    if (method == "post" || method == "send" || method == "submit") {
-        if (args.size() >= 2) {
-            std::string url = args[0]->toString();
-            return std::make_shared<Value>("POST: " + url);
+        return call.args[0];
+    });
+
+    bind({"sum", "total"}, 1, [](const MethodCall& call) {
+        std::vector<double> scratch;
+        size_t n;
+        const double* x = listNumbers(call.args[0], scratch, n);
+        return Value(kernels::sum(x, n));
+    }, true);
+    bind({"mean", "average", "avg"}, 1, [](const MethodCall& call) {
+        std::vector<double> scratch;
+        size_t n;
+        const double* x = listNumbers(call.args[0], scratch, n);
+        if (n == 0) return Value();
+        return Value(kernels::sum(x, n) / static_cast<double>(n));
+    }, true);
+    // min and max of an empty list are void
+    bind({"min", "least"}, 1, [](const MethodCall& call) {
+        std::vector<double> scratch;
+        size_t n;
+        const double* x = listNumbers(call.args[0], scratch, n);
+        return n == 0 ? Value() : Value(kernels::min(x, n));
+    }, true);
+    bind({"max", "most"}, 1, [](const MethodCall& call) {
+        std::vector<double> scratch;
+        size_t n;
+        const double* x = listNumbers(call.args[0], scratch, n);
+        return n == 0 ? Value() : Value(kernels::max(x, n));
+    }, true);
+    // count flags: how many are true
+    bind({"count"}, 1, [](const MethodCall& call) {
+        if (const std::vector<uint8_t>* flags = call.args[0].asBools()) {
+            return Value(static_cast<double>(kernels::count(flags->data(), flags->size())));
         }
-    }
-    
-    if (method == "storage" || method == "localStorage" || method == "store" || method == "save") {
-        if (args.size() >= 2) {
-            std::string key = args[0]->toString();
-            return std::make_shared<Value>("Stored: " + key);
+        double total = 0;
+        if (call.args[0].type == ValueType::LIST) {
+            for (const Value& item : call.args[0].asList()) total += item.toBool() ? 1 : 0;
         }
-    }
-    
-    if (method == "load" || method == "getStorage" || method == "get" || method == "retrieve") {
-        if (!args.empty()) {
-            std::string key = args[0]->toString();
-            return std::make_shared<Value>("Loaded: " + key);
+        return Value(total);
+    }, true);
+
+    // map list "times" 2      - each item and a number
+    // map list "plus" other   - item by item with a list as long
+    // map list act            - the act given each item
+    bind({"map", "each"}, 2, [](const MethodCall& call) {
+        if (call.args[0].type != ValueType::LIST) return Value(false);
+        if (call.args[1].type == ValueType::FUNC) return listApply(call, call.args[1].asFunc());
+        kernels::Arith op;
+        if (call.args.size() < 3 || !kernels::arithFrom(call.args[1].toString(), op)) return Value(false);
+        std::vector<double> scratch, otherScratch;
+        size_t n;
+        const double* x = listNumbers(call.args[0], scratch, n);
+        std::vector<double> out(n);
+        const Value& operand = call.args[2];
+        if (operand.type == ValueType::LIST) {
+            size_t m;
+            const double* y = listNumbers(operand, otherScratch, m);
+            if (m != n) return Value(false);
+            kernels::zip(x, y, n, op, out.data());
+        } else {
+            kernels::map(x, n, op, operand.toNumber(), out.data());
         }
-    }
-    
-    if (method == "socket" || method == "websocket" || method == "ws" || method == "connect") {
-        if (!args.empty()) {
-            std::string url = args[0]->toString();
-            return std::make_shared<Value>("WebSocket: " + url);
+        return Value::numbers(std::move(out));
+    }, true);
+    // test list "over" 10: a list of bools, true where the item passes
+    bind({"test", "mask"}, 3, [](const MethodCall& call) {
+        kernels::Compare op;
+        if (call.args[0].type != ValueType::LIST || !kernels::compareFrom(call.args[1].toString(), op)) {
+            return Value(false);
         }
-    }
-    
-    // Page rendering - complete HTML pages
-    if (method == "page" || method == "html" || method == "render" || method == "document") {
-        if (!args.empty()) {
-            return std::make_shared<Value>("Rendered page");
+        std::vector<double> scratch;
+        size_t n;
+        const double* x = listNumbers(call.args[0], scratch, n);
+        std::vector<uint8_t> flags(n);
+        kernels::compare(x, n, op, call.args[2].toNumber(), flags.data());
+        return Value::bools(std::move(flags));
+    }, true);
+    // filter list "over" 10   - the items that compare so
+    // filter list flags       - the items whose flag in a list as long is true
+    // filter list act         - the items the act gives true for
+    bind({"filter", "where", "keep"}, 2, [](const MethodCall& call) {
+        const Value& list = call.args[0];
+        const Value& how = call.args[1];
+        if (list.type != ValueType::LIST) return Value(false);
+        Value tests = how;
+        if (how.type == ValueType::FUNC) {
+            tests = listApply(call, how.asFunc());
+        } else if (how.type != ValueType::LIST) {
+            kernels::Compare op;
+            if (call.args.size() < 3 || !kernels::compareFrom(how.toString(), op)) return Value(false);
+            const std::vector<double>* numbers = list.asNumbers();
+            if (numbers) {
+                std::vector<double> out(numbers->size());
+                out.resize(kernels::filter(numbers->data(), numbers->size(), op, call.args[2].toNumber(), out.data()));
+                return Value::numbers(std::move(out));
+            }
+            std::vector<double> scratch;
+            size_t n;
+            const double* x = listNumbers(list, scratch, n);
+            std::vector<uint8_t> flags(n);
+            kernels::compare(x, n, op, call.args[2].toNumber(), flags.data());
+            tests = Value::bools(std::move(flags));
         }
-    }
-    
-    if (method == "title") {
-        if (!args.empty()) {
-            std::string title = args[0]->toString();
-            return std::make_shared<Value>("Title: " + title);
+        if (tests.type != ValueType::LIST || listSize(tests) != listSize(list)) return Value(false);
+        const std::vector<uint8_t>* flags = tests.asBools();
+        const std::vector<double>* numbers = list.asNumbers();
+        if (flags && numbers) {
+            std::vector<double> out(numbers->size());
+            out.resize(kernels::select(numbers->data(), flags->data(), numbers->size(), out.data()));
+            return Value::numbers(std::move(out));
         }
-    }
-    
-    if (method == "head" || method == "header") {
-        return std::make_shared<Value>("<head>");
-    }
-    
-    if (method == "body") {
-        return std::make_shared<Value>("<body>");
-    }
-    
-    // Canvas/Graphics - drawing, animations
-    if (method == "canvas" || method == "draw" || method == "graphics") {
-        if (args.size() >= 2) {
-            double width = args[0]->toNumber();
-            double height = args[1]->toNumber();
-            return std::make_shared<Value>("Canvas: " + std::to_string(static_cast<int>(width)) + "x" + std::to_string(static_cast<int>(height)));
+        // Values, or tests an act gave that were not all truth values
+        const ListObject* items = static_cast<const ListObject*>(list.object);
+        const ListObject* results = static_cast<const ListObject*>(tests.object);
+        std::vector<Value> kept;
+        for (size_t i = 0; i < items->size(); i++) {
+            if (results->get(i).toBool()) kept.push_back(items->get(i));
         }
-    }
-    
-    if (method == "svg" || method == "vector" || method == "graphic") {
-        return std::make_shared<Value>("<svg>");
-    }
-    
-    if (method == "circle" || method == "rect" || method == "line" || method == "path") {
-        return std::make_shared<Value>("Shape drawn");
-    }
-    
-    // CSS - full styling support
-    if (method == "style" || method == "css") {
-        if (args.size() >= 2) {
-            std::string property = args[0]->toString();
-            std::string value = args[1]->toString();
-            return std::make_shared<Value>(property + ": " + value);
+        return Value::pack(std::move(kept));
+    }, true);
+    // The instruction set the kernels use
+    bind({"simd", "isa"}, 0, [](const MethodCall&) {
+        return Value(kernels::isa());
+    }, true);
+}
+
+// QueryModule implementation - columnar queries (see query.h) over csv
+// tables, maps of lists and lists of row maps. Results come back in the
+// shape the table was given in, or false if the query cannot run.
+
+// Column names from args[from..]; lists of names are spread out
+static std::vector<std::string> queryNames(const MethodCall& call, size_t from) {
+    std::vector<std::string> names;
+    for (size_t i = from; i < call.args.size(); i++) {
+        const Value& arg = call.args[i];
+        if (arg.type == ValueType::LIST) {
+            for (const Value& name : arg.asList()) names.push_back(name.toString());
+        } else {
+            names.push_back(arg.toString());
         }
     }
-    
-    if (method == "class" || method == "className" || method == "addClass") {
-        if (!args.empty()) {
-            std::string className = args[0]->toString();
-            return std::make_shared<Value>("class=\"" + className + "\"");
+    return names;
+}
+
+void QueryModule::bindMethods() {
+    // select table col... (every column if none are named)
+    bind({"select", "query", "from"}, 1, [](const MethodCall& call) {
+        query::Table table;
+        if (!query::readTable(call.args[0], table)) {
+            return Value("Query: SELECT * FROM " + call.args[0].toString());
         }
-    }
-    
-    if (method == "id") {
-        if (!args.empty()) {
-            std::string id = args[0]->toString();
-            return std::make_shared<Value>("id=\"" + id + "\"");
+        std::vector<std::string> names = queryNames(call, 1);
+        if (names.empty()) return table.toValue();
+        query::Table projected;
+        if (!query::select(table, names, projected)) return Value(false);
+        return projected.toValue();
+    });
+    // where table "price over 10"        - an expression of the columns
+    // where table "price" "over" 10      - column, comparison, value
+    // where table "city" "Oslo"          - column equals value
+    // where table check "price" "qty"    - an act given the columns
+    bind({"where", "filter"}, 2, [](const MethodCall& call) {
+        query::Table table;
+        if (!query::readTable(call.args[0], table)) return Value(false);
+        query::Selection rows;
+        if (call.args[1].type == ValueType::FUNC) {
+            std::vector<const query::Column*> arguments;
+            std::vector<std::string> names = queryNames(call, 2);
+            for (const std::string& name : names) {
+                const query::Column* column = table.find(name);
+                if (!column) return Value(false);
+                arguments.push_back(column);
+            }
+            if (names.empty()) {
+                for (const query::Column& column : table.columns) arguments.push_back(&column);
+            }
+            rows = query::filter(table, call.args[1].asFunc(), arguments, call.runtime);
+        } else if (call.args.size() == 2) {
+            rows = query::filter(table, call.args[1].toString(), call.runtime);
+        } else {
+            const query::Column* column = table.find(call.args[1].toString());
+            if (!column) return Value(false);
+            query::Compare op = query::Compare::EQ;
+            size_t operand = 2;
+            if (call.args.size() > 3) {
+                if (!query::compareFrom(call.args[2].toString(), op)) return Value(false);
+                operand = 3;
+            }
+            rows = query::filter(table, *column, op, call.args[operand]);
         }
-    }
-    
-    // Animation
-    if (method == "animate" || method == "animation" || method == "transition") {
-        return std::make_shared<Value>("Animation");
-    }
-    
-    // Media - video, audio
-    if (method == "video") {
-        if (!args.empty()) {
-            std::string src = args[0]->toString();
-            return std::make_shared<Value>("<video src=\"" + src + "\">");
+        return query::gather(table, rows).toValue();
+    });
+    // order table col [asc|desc] ...
+    bind({"order", "sort"}, 2, [](const MethodCall& call) {
+        query::Table table;
+        if (!query::readTable(call.args[0], table)) return Value(false);
+        std::vector<query::SortKey> keys;
+        for (const std::string& name : queryNames(call, 1)) {
+            if (name == "desc" || name == "descending" || name == "asc" || name == "ascending") {
+                if (keys.empty()) return Value(false);
+                keys.back().descending = name[0] == 'd';
+                continue;
+            }
+            const query::Column* column = table.find(name);
+            if (!column) return Value(false);
+            keys.push_back({column});
         }
-    }
-    
-    if (method == "audio" || method == "sound") {
-        if (!args.empty()) {
-            std::string src = args[0]->toString();
-            return std::make_shared<Value>("<audio src=\"" + src + "\">");
+        return query::gather(table, query::order(table, keys)).toValue();
+    });
+    // join left right key [rightKey]
+    bind({"join"}, 3, [](const MethodCall& call) {
+        query::Table left, right;
+        if (!query::readTable(call.args[0], left) || !query::readTable(call.args[1], right)) {
+            return Value(false);
         }
-    }
-    
-    // Forms - all form elements
-    if (method == "form") {
-        return std::make_shared<Value>("<form>");
-    }
-    
-    if (method == "textarea" || method == "textbox") {
-        return std::make_shared<Value>("<textarea>");
-    }
-    
-    if (method == "select" || method == "dropdown") {
-        return std::make_shared<Value>("<select>");
-    }
-    
-    if (method == "option") {
-        if (!args.empty()) {
-            std::string text = args[0]->toString();
-            return std::make_shared<Value>("<option>" + text + "</option>");
+        std::string key = call.args[2].toString();
+        const query::Column* leftKey = left.find(key);
+        const query::Column* rightKey = right.find(call.args.size() > 3 ? call.args[3].toString() : key);
+        if (!leftKey || !rightKey) return Value(false);
+        return query::join(left, right, *leftKey, *rightKey).toValue();
+    });
+    bind({"where", "filter"}, 0, [](const MethodCall&) { return Value("Filter applied"); });
+    bind({"order", "sort"}, 0, [](const MethodCall&) { return Value("Sorted"); });
+    bind({"join"}, 0, [](const MethodCall&) { return Value("Joined"); });
+}
+
+// DatabaseModule implementation - Database operations (see database.h)
+
+// The URL calls go to, or "" with the error recorded if none was given
+std::string DatabaseModule::current() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (url.empty()) lastError = "no database; use database connect first";
+    return url;
+}
+
+Value DatabaseModule::run(const MethodCall& call) {
+    auto& database = static_cast<DatabaseModule&>(call.module);
+    std::string url = database.current();
+    if (url.empty()) return Value(false);
+    std::string sql = call.args[0].toString();
+    std::vector<Value> params;
+    for (size_t i = 1; i < call.args.size(); i++) {
+        const Value& arg = call.args[i];
+        if (arg.type == ValueType::LIST && !arg.asNumbers()) {
+            const std::vector<Value>& list = arg.asList();
+            params.insert(params.end(), list.begin(), list.end());
+        } else if (const std::vector<double>* numbers = arg.asNumbers()) {
+            params.insert(params.end(), numbers->begin(), numbers->end());
+        } else {
+            params.push_back(arg);
         }
     }
-    
-    if (method == "checkbox" || method == "check") {
-        return std::make_shared<Value>("<input type=\"checkbox\">");
-    }
-    
-    if (method == "radio") {
-        return std::make_shared<Value>("<input type=\"radio\">");
-    }
-    
-    // Tables - full table support
-    if (method == "table") {
-        return std::make_shared<Value>("<table>");
-    }
-    
-    if (method == "tr" || method == "row") {
-        return std::make_shared<Value>("<tr>");
-    }
-    
-    if (method == "td" || method == "cell") {
-        if (!args.empty()) {
-            std::string content = args[0]->toString();
-            return std::make_shared<Value>("<td>" + content + "</td>");
+
+    std::string error;
+    db::Pool::Lease connection = db::Pool::instance().acquire(url, error);
+    db::Result result;
+    if (connection && connection->execute(sql, params, result)) {
+        if (result.hasColumns()) return result.table();
+        return Value(static_cast<double>(result.changes));
+    }
+    std::lock_guard<std::mutex> lock(database.mutex);
+    database.lastError = connection ? connection->error() : error;
+    return Value(false);
+}
+
+Value DatabaseModule::insert(const MethodCall& call) {
+    auto& database = static_cast<DatabaseModule&>(call.module);
+    std::string url = database.current();
+    if (url.empty()) return Value(false);
+    std::string error;
+    db::Pool::Lease connection = db::Pool::instance().acquire(url, error);
+    int64_t count = connection ? connection->insert(call.args[0].toString(), call.args[1]) : -1;
+    if (count >= 0) return Value(static_cast<double>(count));
+    std::lock_guard<std::mutex> lock(database.mutex);
+    database.lastError = connection ? connection->error() : error;
+    return Value(false);
+}
+
+void DatabaseModule::bindMethods() {
+    // connect url: true once a connection opens, which is then pooled
+    bind({"connect", "open"}, 1, [](const MethodCall& call) {
+        auto& database = static_cast<DatabaseModule&>(call.module);
+        std::string url = call.args[0].toString();
+        std::string error;
+        bool connected = static_cast<bool>(db::Pool::instance().acquire(url, error));
+        std::lock_guard<std::mutex> lock(database.mutex);
+        if (!connected) {
+            database.lastError = error;
+            return Value(false);
         }
-        return std::make_shared<Value>("<td>");
-    }
-    
-    if (method == "th" || method == "header") {
-        if (!args.empty()) {
-            std::string content = args[0]->toString();
-            return std::make_shared<Value>("<th>" + content + "</th>");
+        database.url = url;
+        return Value(true);
+    });
+    // query sql params...: ? placeholders take the params in order, and a
+    // list param spreads into several
+    bind({"query", "execute"}, 1, run);
+    bind({"insert", "add"}, 2, insert);
+    bind({"update", "modify"}, 1, run);
+    bind({"delete", "remove"}, 1, run);
+    bind({"close", "disconnect"}, 0, [](const MethodCall& call) {
+        auto& database = static_cast<DatabaseModule&>(call.module);
+        std::string url;
+        {
+            std::lock_guard<std::mutex> lock(database.mutex);
+            url.swap(database.url);
         }
-        return std::make_shared<Value>("<th>");
-    }
-    
-    // Lists
-    if (method == "ul" || method == "unordered") {
-        return std::make_shared<Value>("<ul>");
-    }
-    
-    if (method == "ol" || method == "ordered") {
-        return std::make_shared<Value>("<ol>");
-    }
-    
-    if (method == "li" || method == "item") {
-        if (!args.empty()) {
-            std::string content = args[0]->toString();
-            return std::make_shared<Value>("<li>" + content + "</li>");
+        if (!url.empty()) db::Pool::instance().close(url);
+        return Value(true);
+    });
+    bind({"error"}, 0, [](const MethodCall& call) {
+        auto& database = static_cast<DatabaseModule&>(call.module);
+        std::lock_guard<std::mutex> lock(database.mutex);
+        return Value(database.lastError);
+    });
+    bind({"insert", "add"}, 0, [](const MethodCall&) { return Value("Inserted"); });
+    bind({"update", "modify"}, 0, [](const MethodCall&) { return Value("Updated"); });
+    bind({"delete", "remove"}, 0, [](const MethodCall&) { return Value("Deleted"); });
+}
+
+// CSVModule implementation - CSV processing (see csv.h)
+
+// args[index] if given ("tab" for a tab), else tab for .tsv paths and a
+// comma otherwise
+static char csvDelimiter(const MethodCall& call, size_t index, const std::string& path) {
+    if (call.args.size() > index) {
+        std::string delimiter = call.args[index].toString();
+        if (delimiter == "tab" || delimiter == "\\t") return '\t';
+        if (!delimiter.empty()) return delimiter[0];
+    }
+    bool tsv = path.size() >= 4 && path.compare(path.size() - 4, 4, ".tsv") == 0;
+    return tsv ? '\t' : ',';
+}
+
+void CSVModule::bindMethods() {
+    bind({"read", "load", "open"}, 1, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        Value table;
+        if (!readCsvFile(path, csvDelimiter(call, 1, path), table)) {
+            return Value(false);
         }
-        return std::make_shared<Value>("<li>");
-    }
-    
-    // Meta tags
-    if (method == "meta") {
-        return std::make_shared<Value>("<meta>");
+        return table;
+    });
+    // CSV text already in hand
+    bind({"parse"}, 1, [](const MethodCall& call) {
+        std::string text = call.args[0].toString();
+        return parseCsv(text.data(), text.size(), csvDelimiter(call, 1, ""));
+    });
+    bind({"write", "save"}, 2, [](const MethodCall& call) {
+        std::string path = call.args[0].toString();
+        return Value(writeCsvFile(path, call.args[1], csvDelimiter(call, 2, path)));
+    });
+    bind({"parse", "convert"}, 0, [](const MethodCall&) { return Value("CSV parsed"); });
+}
+
+// GoModule implementation - Go-like concurrency
+struct GoModule::TaskState {
+    const Runtime* spawner; // nullptr once the spawner itself has finished
+    bool done = false;
+    Value result;           // cloned off the task's runtime
+    std::string error;
+    std::vector<Waiter*> joiners;
+};
+
+Value GoModule::spawn(const MethodCall& call) {
+    auto& go = static_cast<GoModule&>(call.module);
+    auto state = std::make_shared<TaskState>();
+    state->spawner = &call.runtime;
+
+    // Everything the task touches is copied here, on the spawning thread
+    std::shared_ptr<Runtime> runtime = call.runtime.fork();
+    Function fn = call.args[0].asFunc();
+    std::vector<Value> args;
+    for (size_t i = 1; i < call.args.size(); i++) {
+        args.push_back(call.args[i].clone());
     }
-    
-    if (method == "link") {
-        if (args.size() >= 2) {
-            std::string rel = args[0]->toString();
-            std::string href = args[1]->toString();
-            return std::make_shared<Value>("<link rel=\"" + rel + "\" href=\"" + href + "\">");
-        }
+
+    uint64_t id;
+    {
+        std::lock_guard<std::mutex> lock(go.mutex);
+        id = go.nextId++;
+        go.tasks[id] = state;
     }
-    
-    if (method == "script") {
-        if (!args.empty()) {
-            std::string src = args[0]->toString();
-            return std::make_shared<Value>("<script src=\"" + src + "\">");
+
+    // The forked runtime keeps this module alive until the task is done
+    Scheduler::instance().spawn([&go, state, runtime, fn, args]() mutable {
+        Value result;
+        std::string error;
+        try {
+            result = fn(args, *runtime).clone();
+        } catch (const std::exception& e) {
+            error = e.what();
         }
-        return std::make_shared<Value>("<script>");
-    }
-    
-    // Advanced features
-    if (method == "worker" || method == "webworker") {
-        return std::make_shared<Value>("Web Worker");
-    }
-    
-    if (method == "share" || method == "shareAPI") {
-        return std::make_shared<Value>("Share API");
-    }
-    
-    if (method == "geolocation" || method == "location") {
-        return std::make_shared<Value>("Geolocation");
-    }
-    
-    if (method == "camera" || method == "media") {
-        return std::make_shared<Value>("Media API");
-    }
-    
-    return std::make_shared<Value>();
-}
+        args.clear();
 
-// QueryModule implementation - SQL-like queries
-ValuePtr QueryModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "select" || method == "query" || method == "from") {
-        if (!args.empty()) {
-            std::string table = args[0]->toString();
-            return std::make_shared<Value>("Query: SELECT * FROM " + table);
+        std::lock_guard<std::mutex> lock(go.mutex);
+        go.orphan(runtime.get());
+        state->result = std::move(result);
+        state->error = std::move(error);
+        state->done = true;
+        for (Waiter* joiner : state->joiners) {
+            Scheduler::instance().wake(*joiner);
         }
-    }
-    
-    if (method == "where" || method == "filter") {
-        return std::make_shared<Value>("Filter applied");
-    }
-    
-    if (method == "order" || method == "sort") {
-        return std::make_shared<Value>("Sorted");
-    }
-    
-    if (method == "join") {
-        return std::make_shared<Value>("Joined");
-    }
-    
-    return std::make_shared<Value>();
+        state->joiners.clear();
+    });
+    return Value(static_cast<double>(id));
 }
 
-// DatabaseModule implementation - Database operations
-ValuePtr DatabaseModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "connect" || method == "open") {
-        if (!args.empty()) {
-            std::string url = args[0]->toString();
-            return std::make_shared<Value>("Connected to " + url);
-        }
-    }
-    
-    if (method == "query" || method == "execute") {
-        if (!args.empty()) {
-            std::string sql = args[0]->toString();
-            return std::make_shared<Value>("Executed: " + sql);
+void GoModule::orphan(const Runtime* spawner) {
+    for (auto it = tasks.begin(); it != tasks.end();) {
+        if (it->second->spawner != spawner) {
+            ++it;
+        } else if (it->second->done) {
+            it = tasks.erase(it); // nobody is left to join it
+        } else {
+            it->second->spawner = nullptr;
+            ++it;
         }
     }
-    
-    if (method == "insert" || method == "add") {
-        return std::make_shared<Value>("Inserted");
-    }
-    
-    if (method == "update" || method == "modify") {
-        return std::make_shared<Value>("Updated");
-    }
-    
-    if (method == "delete" || method == "remove") {
-        return std::make_shared<Value>("Deleted");
-    }
-    
-    return std::make_shared<Value>();
 }
 
-// CSVModule implementation - CSV processing
-ValuePtr CSVModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "read" || method == "parse") {
-        if (!args.empty()) {
-            std::string path = args[0]->toString();
-            return std::make_shared<Value>("CSV read from " + path);
+Value GoModule::join(const MethodCall& call) {
+    auto& go = static_cast<GoModule&>(call.module);
+    std::unique_lock<std::mutex> lock(go.mutex);
+
+    std::vector<std::shared_ptr<TaskState>> joining;
+    if (call.args.empty()) {
+        for (auto it = go.tasks.begin(); it != go.tasks.end();) {
+            if (it->second->spawner == &call.runtime) {
+                joining.push_back(it->second);
+                it = go.tasks.erase(it);
+            } else {
+                ++it;
+            }
         }
+    } else {
+        auto it = go.tasks.find(static_cast<uint64_t>(call.args[0].toNumber()));
+        if (it == go.tasks.end()) return Value();
+        joining.push_back(it->second);
+        go.tasks.erase(it);
     }
-    
-    if (method == "write" || method == "save") {
-        if (args.size() >= 2) {
-            std::string path = args[0]->toString();
-            return std::make_shared<Value>("CSV written to " + path);
+
+    std::vector<Value> results;
+    std::string error;
+    for (auto& task : joining) {
+        while (!task->done) {
+            Waiter waiter;
+            task->joiners.push_back(&waiter);
+            Scheduler::instance().wait(waiter, lock);
+            lock.lock();
         }
+        if (error.empty()) error = task->error;
+        results.push_back(std::move(task->result));
     }
-    
-    if (method == "parse" || method == "convert") {
-        return std::make_shared<Value>("CSV parsed");
-    }
-    
-    return std::make_shared<Value>();
+    if (!error.empty()) throw std::runtime_error(error);
+    if (call.args.empty()) return Value(std::move(results));
+    return results[0];
 }
 
-// GoModule implementation - Go-like concurrency
-ValuePtr GoModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "go" || method == "goroutine" || method == "async" || method == "spawn") {
-        return std::make_shared<Value>("Goroutine started");
-    }
-    
-    if (method == "wait" || method == "sync") {
-        return std::make_shared<Value>("Waited");
-    }
-    
-    return std::make_shared<Value>();
+void GoModule::bindMethods() {
+    bind({"go", "goroutine", "async", "spawn"}, 1, [](const MethodCall& call) {
+        if (call.args[0].type != ValueType::FUNC) return Value("Goroutine started");
+        return spawn(call);
+    });
+    bind({"go", "goroutine", "async", "spawn"}, 0, [](const MethodCall&) { return Value("Goroutine started"); });
+    bind({"wait", "sync", "join"}, 0, join);
 }
 
 // ChannelModule implementation - Go-like channels
-ValuePtr ChannelModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "create" || method == "make" || method == "new") {
-        return std::make_shared<Value>("Channel created");
-    }
-    
-    if (method == "send" || method == "push") {
-        if (args.size() >= 2) {
-            return std::make_shared<Value>("Sent to channel");
+class Channel {
+private:
+    struct ChannelWaiter : Waiter {
+        Value value;
+        bool ok = false;
+    };
+
+    std::mutex mutex;
+    std::deque<Value> items;
+    size_t capacity;
+    bool closed = false;
+    std::deque<ChannelWaiter*> senders;   // blocked on a full channel
+    std::deque<ChannelWaiter*> receivers; // blocked on an empty one
+
+public:
+    explicit Channel(size_t size) : capacity(std::max<size_t>(size, 1)) {}
+
+    // False once the channel is closed
+    bool send(Value value) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (closed) return false;
+        if (!receivers.empty()) {
+            ChannelWaiter* receiver = receivers.front();
+            receivers.pop_front();
+            receiver->value = std::move(value);
+            receiver->ok = true;
+            Scheduler::instance().wake(*receiver);
+            return true;
+        }
+        if (items.size() < capacity) {
+            items.push_back(std::move(value));
+            return true;
         }
+        ChannelWaiter self;
+        self.value = std::move(value);
+        senders.push_back(&self);
+        Scheduler::instance().wait(self, lock);
+        return self.ok;
     }
-    
-    if (method == "receive" || method == "recv" || method == "get") {
-        if (!args.empty()) {
-            return std::make_shared<Value>("Received from channel");
+
+    // False once the channel is closed and drained
+    bool receive(Value& out) {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!items.empty()) {
+            out = std::move(items.front());
+            items.pop_front();
+            if (!senders.empty()) {
+                ChannelWaiter* sender = senders.front();
+                senders.pop_front();
+                items.push_back(std::move(sender->value));
+                sender->ok = true;
+                Scheduler::instance().wake(*sender);
+            }
+            return true;
         }
+        if (closed) return false;
+        ChannelWaiter self;
+        receivers.push_back(&self);
+        Scheduler::instance().wait(self, lock);
+        if (self.ok) out = std::move(self.value);
+        return self.ok;
     }
-    
-    if (method == "close") {
-        return std::make_shared<Value>("Channel closed");
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        for (ChannelWaiter* waiter : receivers) Scheduler::instance().wake(*waiter);
+        for (ChannelWaiter* waiter : senders) Scheduler::instance().wake(*waiter);
+        receivers.clear();
+        senders.clear();
     }
-    
-    return std::make_shared<Value>();
+};
+
+std::shared_ptr<Channel> ChannelModule::find(const Value& id) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = channels.find(static_cast<uint64_t>(id.toNumber()));
+    return it == channels.end() ? nullptr : it->second;
+}
+
+void ChannelModule::bindMethods() {
+    // `channel make [capacity]`; a channel holds at least one value
+    bind({"create", "make", "new"}, 0, [](const MethodCall& call) {
+        auto& module = static_cast<ChannelModule&>(call.module);
+        size_t capacity = call.args.empty() ? 1 : static_cast<size_t>(std::max(0.0, call.args[0].toNumber()));
+        std::lock_guard<std::mutex> lock(module.mutex);
+        uint64_t id = module.nextId++;
+        module.channels[id] = std::make_shared<Channel>(capacity);
+        return Value(static_cast<double>(id));
+    });
+    bind({"send", "push"}, 2, [](const MethodCall& call) {
+        std::shared_ptr<Channel> channel = static_cast<ChannelModule&>(call.module).find(call.args[0]);
+        return Value(channel && channel->send(call.args[1].clone()));
+    });
+    // Void once the channel is closed and drained
+    bind({"receive", "recv", "get"}, 1, [](const MethodCall& call) {
+        auto& module = static_cast<ChannelModule&>(call.module);
+        std::shared_ptr<Channel> channel = module.find(call.args[0]);
+        Value value;
+        if (channel && !channel->receive(value)) {
+            std::lock_guard<std::mutex> lock(module.mutex);
+            module.channels.erase(static_cast<uint64_t>(call.args[0].toNumber()));
+        }
+        return value;
+    });
+    bind({"close"}, 1, [](const MethodCall& call) {
+        std::shared_ptr<Channel> channel = static_cast<ChannelModule&>(call.module).find(call.args[0]);
+        if (channel) channel->close();
+        return Value(channel != nullptr);
+    });
+    bind({"close"}, 0, [](const MethodCall&) { return Value(false); });
 }
 
 // RunModule implementation - Shell-like commands
-ValuePtr RunModule::call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) {
-    if (method == "run" || method == "exec" || method == "execute" || method == "shell") {
-        if (!args.empty()) {
-            std::string command = args[0]->toString();
-            return std::make_shared<Value>("Executed: " + command);
+
+void RunModule::fail(const std::string& error) {
+    std::lock_guard<std::mutex> lock(mutex);
+    lastError = error;
+}
+
+// Text runs through sh; a list is the program and its arguments
+static process::Command runCommand(const Value& value) {
+    if (value.type != ValueType::LIST) return process::shell(value.toString());
+    process::Command command;
+    for (const Value& arg : value.asList()) command.argv.push_back(arg.toString());
+    return command;
+}
+
+static std::string runFailure(const process::Command& command, int status, const std::string& errors) {
+    std::string name = command.argv.size() == 3 && command.argv[0] == "/bin/sh" ? command.argv[2] : command.argv[0];
+    std::string reason = name + " exited with " + std::to_string(status);
+    size_t end = errors.find_last_not_of("\r\n");
+    if (end != std::string::npos) reason += ": " + errors.substr(0, end + 1);
+    return reason;
+}
+
+static const char* runStream(process::Stream stream) {
+    return stream == process::Stream::OUT ? "out" : "err";
+}
+
+void RunModule::bindMethods() {
+    // run cmd [act]: without an act, stdout once the command succeeds, or
+    // false with its stderr in `run error`. With one, the act gets each
+    // piece of output and its stream ("out" or "err") as it arrives, can
+    // give false to stop the command, and the call gives the exit status.
+    bind({"run", "exec", "execute", "shell"}, 1, [](const MethodCall& call) {
+        std::vector<process::Command> commands{runCommand(call.args[0])};
+        if (call.args.size() > 1 && call.args[1].type == ValueType::FUNC) {
+            const Function& act = call.args[1].asFunc();
+            std::vector<int> statuses = process::runAll(commands, 1, [&](size_t, process::Stream stream, std::string_view data) {
+                Value result = act({Value(data), Value(runStream(stream))}, call.runtime);
+                return !(result.type == ValueType::BOOL && !result.boolean);
+            });
+            return Value(static_cast<double>(statuses[0]));
         }
-    }
-    
-    if (method == "system" || method == "cmd") {
-        if (!args.empty()) {
-            std::string command = args[0]->toString();
-            return std::make_shared<Value>("System: " + command);
+        std::string out, errors;
+        std::vector<int> statuses = process::runAll(commands, 1, [&](size_t, process::Stream stream, std::string_view data) {
+            (stream == process::Stream::OUT ? out : errors).append(data);
+            return true;
+        });
+        if (statuses[0] != 0) {
+            static_cast<RunModule&>(call.module).fail(runFailure(commands[0], statuses[0], errors));
+            return Value(false);
         }
-    }
-    
-    return std::make_shared<Value>();
+        return Value(std::move(out));
+    });
+    // system cmd: runs it on this terminal; the exit status
+    bind({"system", "cmd"}, 1, [](const MethodCall& call) {
+        call.runtime.flush(); // what was said comes before the command's output
+        return Value(static_cast<double>(process::system(runCommand(call.args[0]))));
+    });
+    // parallel cmds [jobs N] [act]: every command, at most N at a time
+    // (one per core by default). Without an act, each one's stdout, or
+    // false, in order; with one, the act gets each piece of output with
+    // its command's position and stream, and the call gives the statuses.
+    bind({"parallel", "batch"}, 1, [](const MethodCall& call) {
+        std::vector<process::Command> commands;
+        size_t jobs = std::max(1u, std::thread::hardware_concurrency());
+        const Function* act = nullptr;
+        for (const Value& arg : call.args) {
+            if (arg.type == ValueType::LIST) {
+                for (const Value& item : arg.asList()) commands.push_back(runCommand(item));
+            } else if (arg.type == ValueType::NUM && arg.num >= 1) {
+                jobs = static_cast<size_t>(arg.num);
+            } else if (arg.type == ValueType::FUNC) {
+                act = &arg.asFunc();
+            } else if (arg.type == ValueType::TEXT && arg.textView() != "jobs") {
+                commands.push_back(runCommand(arg));
+            }
+        }
+        std::vector<Value> results;
+        if (act) {
+            std::vector<int> statuses = process::runAll(commands, jobs, [&](size_t index, process::Stream stream, std::string_view data) {
+                Value result = (*act)({Value(data), Value(static_cast<double>(index)), Value(runStream(stream))}, call.runtime);
+                return !(result.type == ValueType::BOOL && !result.boolean);
+            });
+            for (int status : statuses) results.emplace_back(static_cast<double>(status));
+            return Value(std::move(results));
+        }
+        std::vector<std::string> outs(commands.size()), errors(commands.size());
+        std::vector<int> statuses = process::runAll(commands, jobs, [&](size_t index, process::Stream stream, std::string_view data) {
+            (stream == process::Stream::OUT ? outs : errors)[index].append(data);
+            return true;
+        });
+        for (size_t i = 0; i < commands.size(); i++) {
+            if (statuses[i] == 0) {
+                results.emplace_back(std::move(outs[i]));
+            } else {
+                static_cast<RunModule&>(call.module).fail(runFailure(commands[i], statuses[i], errors[i]));
+                results.emplace_back(false);
+            }
+        }
+        return Value(std::move(results));
+    });
+    bind({"error"}, 0, [](const MethodCall& call) {
+        auto& run = static_cast<RunModule&>(call.module);
+        std::lock_guard<std::mutex> lock(run.mutex);
+        return Value(run.lastError);
+    });
 }
 
 } // namespace azalea
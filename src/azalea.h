@@ -5,7 +5,7 @@
 #include <vector>
 #include <map>
 #include <memory>
-#include <variant>
+#include <cstdint>
 #include <functional>
 #include <sstream>
 #include <iostream>
@@ -13,6 +13,18 @@
 #include <regex>
 #include <algorithm>
 #include <cctype>
+#include <deque>
+#include <list>
+#include <string_view>
+#include <unordered_map>
+#include <type_traits>
+#include <new>
+#include <mutex>
+#include "flat_map.h"
+#include "http.h"
+#include "net.h"
+#include "output.h"
+#include "play.h"
 
 namespace azalea {
 
@@ -20,81 +32,402 @@ namespace azalea {
 class Value;
 class Runtime;
 class Module;
+class ASTNode;
+struct Program;
+struct Chunk;
+struct Act;
 
 // Type definitions
-using ValuePtr = std::shared_ptr<Value>;
 using ModulePtr = std::shared_ptr<Module>;
-using Function = std::function<ValuePtr(const std::vector<ValuePtr>&, Runtime&)>;
+using Function = std::function<Value(const std::vector<Value>&, Runtime&)>;
+using ActPtr = std::shared_ptr<const Act>;
+using ValueMap = FlatMap<Value>; // MAP values; iterates in key order
 
-// Value types
-enum class ValueType {
-    NUM, TEXT, BOOL, LIST, MAP, VOID, FUNC
+// Value types - heap-backed types come last (see Value::isHeap)
+enum class ValueType : uint8_t {
+    NUM, BOOL, VOID, TEXT, LIST, MAP, FUNC
 };
 
-// Value class
+// Payload for TEXT/LIST/MAP/FUNC values. The refcount is intrusive and
+// non-atomic: a Runtime and its values stay on one thread.
+struct HeapObject {
+    uint32_t refs = 1;
+};
+
+// Value - 16-byte tagged handle; NUM/BOOL/VOID are stored inline
 class Value {
 public:
     ValueType type;
-    std::variant<double, std::string, bool, std::vector<ValuePtr>, 
-                 std::map<std::string, ValuePtr>, Function> data;
+    union {
+        double num;
+        bool boolean;
+        HeapObject* object;
+        uint64_t bits;
+    };
+
+    Value() : type(ValueType::VOID), num(0) {}
+    Value(double n) : type(ValueType::NUM), num(n) {}
+    Value(bool b) : type(ValueType::BOOL), num(0) { boolean = b; }
+    Value(const char* s);
+    Value(const std::string& s);
+    Value(std::string&& s);
+    Value(std::string_view s);
+    Value(const std::vector<Value>& l);
+    Value(std::vector<Value>&& l);
+    Value(const ValueMap& m);
+    Value(ValueMap&& m);
+    Value(Function f);
+    Value(ActPtr act);
+
+    Value(const Value& other) : type(other.type), bits(other.bits) {
+        if (isHeap()) object->refs++;
+    }
+    Value(Value&& other) noexcept : type(other.type), bits(other.bits) {
+        other.type = ValueType::VOID;
+    }
+    Value& operator=(const Value& other) {
+        if (other.isHeap()) other.object->refs++;
+        release();
+        type = other.type;
+        bits = other.bits;
+        return *this;
+    }
+    Value& operator=(Value&& other) noexcept {
+        if (this != &other) {
+            release();
+            type = other.type;
+            bits = other.bits;
+            other.type = ValueType::VOID;
+        }
+        return *this;
+    }
+    ~Value() { release(); }
 
-    Value() : type(ValueType::VOID) {}
-    Value(double n) : type(ValueType::NUM), data(n) {}
-    Value(const std::string& s) : type(ValueType::TEXT), data(s) {}
-    Value(bool b) : type(ValueType::BOOL), data(b) {}
-    Value(const std::vector<ValuePtr>& l) : type(ValueType::LIST), data(l) {}
-    Value(const std::map<std::string, ValuePtr>& m) : type(ValueType::MAP), data(m) {}
-    Value(Function f) : type(ValueType::FUNC), data(f) {}
+    bool isHeap() const { return type >= ValueType::TEXT; }
+
+    const std::string& asText() const;
+    // The characters without flattening a view (ropes are flattened)
+    std::string_view textView() const;
+    // Boxes a packed list's numbers on first use
+    std::vector<Value>& asList() const;
+    // A packed list's numbers; nullptr for other values and once boxed
+    const std::vector<double>* asNumbers() const;
+    // A list packed as truth values, one byte each; nullptr otherwise
+    const std::vector<uint8_t>* asBools() const;
+    ValueMap& asMap() const;
+    const Function& asFunc() const;
+    // The act a FUNC value calls; nullptr for native functions and others
+    const Act* asAct() const;
 
     std::string toString() const;
+    // Appends what toString() returns to out, building no temporaries
+    void appendTo(std::string& out) const;
     double toNumber() const;
     bool toBool() const;
+    // Deep copy that shares no heap objects with this value, so it can be
+    // handed to a runtime on another thread
+    Value clone() const;
+    // TEXT joining the toString() forms of parts. Long results are ropes
+    // that share the parts' text instead of copying it
+    static Value concat(std::initializer_list<Value> parts);
+    // LIST of NUM kept as one contiguous array of doubles until something
+    // needs it as Values (see asList)
+    static Value numbers(std::vector<double> items);
+    // LIST of BOOL kept as bytes in the same way
+    static Value bools(std::vector<uint8_t> items);
+    // LIST of items, packed if it has some and they are all numbers or
+    // all truth values
+    static Value pack(std::vector<Value> items);
+    // TEXT reading chars in place, such as a mapped file's, while owner
+    // keeps them alive; copied out only if something needs a std::string
+    static Value view(std::string_view chars, std::shared_ptr<const void> owner);
+
+private:
+    void release() {
+        if (isHeap() && --object->refs == 0) destroy();
+    }
+    void destroy();
+};
+
+static_assert(sizeof(Value) == 16, "Value must stay a 16-byte handle");
+
+// TEXT payload. A rope (see Value::concat) keeps its pieces and a view
+// (see Value::view) borrows its characters; either is only flattened into
+// text when something needs them in a std::string. appendTo and toString
+// copy the characters out directly.
+struct TextObject : HeapObject {
+    std::string text;          // the characters, once flat
+    std::vector<Value> pieces; // rope: TEXT values in order; empty once flat
+    size_t size;
+    uint32_t depth = 0;        // rope nesting, kept bounded by concat
+    const char* view = nullptr;       // view: the borrowed characters
+    std::shared_ptr<const void> owner; // view: keeps them alive
+
+    explicit TextObject(std::string s) : text(std::move(s)), size(text.size()) {}
+    TextObject(std::vector<Value> parts, size_t total, uint32_t nesting)
+        : pieces(std::move(parts)), size(total), depth(nesting) {}
+    TextObject(std::string_view chars, std::shared_ptr<const void> keep)
+        : size(chars.size()), view(chars.data()), owner(std::move(keep)) {}
+    bool isRope() const { return !pieces.empty(); }
+    bool isFlat() const { return pieces.empty() && !view; }
+    void flatten();
+};
+
+// LIST payload. A list of only numbers or only truth values can be packed
+// into one array of them (see Value::pack) until something needs its items
+// as Values; writing an item of another type boxes it for good.
+struct ListObject : HeapObject {
+    enum class Packing : uint8_t { BOXED, NUMBERS, BOOLS };
+    std::vector<Value> items;    // BOXED
+    std::vector<double> numbers; // NUMBERS: the items
+    std::vector<uint8_t> flags;  // BOOLS: the items, 1 for true
+    Packing packing = Packing::BOXED;
+    explicit ListObject(std::vector<Value> l) : items(std::move(l)) {}
+    void box();
+    size_t size() const;
+    Value get(size_t index) const; // index < size()
+    // Packed lists stay packed while values are of their type
+    void set(size_t index, Value value); // index < size()
+    void push(Value value);
+};
+
+struct MapObject : HeapObject {
+    ValueMap entries;
+    explicit MapObject(ValueMap m) : entries(std::move(m)) {}
+};
+
+// An act the program defined. Calls bind its parameters straight from the
+// caller's values, with no Function in between, and run its body on the
+// engine that defined it (see Runtime::call)
+struct Act {
+    std::string name;
+    std::vector<size_t> params; // parameter slots, in order
+    // Tree engine: the body, and the program whose arena holds it
+    const ASTNode* body = nullptr;
+    std::shared_ptr<Program> owner;
+    // VM: the compiled body (a FunctionProto's chunk)
+    const Chunk* code = nullptr;
+};
+
+// Native functions, and acts as values; fn calls the act for callers that
+// only know Functions
+struct FuncObject : HeapObject {
+    Function fn;
+    ActPtr act; // nullptr for native functions
+    explicit FuncObject(Function f) : fn(std::move(f)) {}
+    explicit FuncObject(ActPtr a);
 };
 
+inline Value::Value(const char* s) : type(ValueType::TEXT) { object = new TextObject(s); }
+inline Value::Value(const std::string& s) : type(ValueType::TEXT) { object = new TextObject(s); }
+inline Value::Value(std::string&& s) : type(ValueType::TEXT) { object = new TextObject(std::move(s)); }
+inline Value::Value(std::string_view s) : type(ValueType::TEXT) { object = new TextObject(std::string(s)); }
+inline Value::Value(const std::vector<Value>& l) : type(ValueType::LIST) { object = new ListObject(l); }
+inline Value::Value(std::vector<Value>&& l) : type(ValueType::LIST) { object = new ListObject(std::move(l)); }
+inline Value::Value(const ValueMap& m) : type(ValueType::MAP) { object = new MapObject(m); }
+inline Value::Value(ValueMap&& m) : type(ValueType::MAP) { object = new MapObject(std::move(m)); }
+inline Value::Value(Function f) : type(ValueType::FUNC) { object = new FuncObject(std::move(f)); }
+inline Value::Value(ActPtr act) : type(ValueType::FUNC) { object = new FuncObject(std::move(act)); }
+
+inline const std::string& Value::asText() const {
+    TextObject* text = static_cast<TextObject*>(object);
+    if (!text->isFlat()) text->flatten();
+    return text->text;
+}
+inline std::string_view Value::textView() const {
+    const TextObject* text = static_cast<const TextObject*>(object);
+    if (text->view) return std::string_view(text->view, text->size);
+    return asText();
+}
+inline std::vector<Value>& Value::asList() const {
+    ListObject* list = static_cast<ListObject*>(object);
+    if (list->packing != ListObject::Packing::BOXED) list->box();
+    return list->items;
+}
+inline const std::vector<double>* Value::asNumbers() const {
+    if (type != ValueType::LIST) return nullptr;
+    const ListObject* list = static_cast<const ListObject*>(object);
+    return list->packing == ListObject::Packing::NUMBERS ? &list->numbers : nullptr;
+}
+inline const std::vector<uint8_t>* Value::asBools() const {
+    if (type != ValueType::LIST) return nullptr;
+    const ListObject* list = static_cast<const ListObject*>(object);
+    return list->packing == ListObject::Packing::BOOLS ? &list->flags : nullptr;
+}
+inline ValueMap& Value::asMap() const { return static_cast<MapObject*>(object)->entries; }
+inline const Function& Value::asFunc() const { return static_cast<FuncObject*>(object)->fn; }
+inline const Act* Value::asAct() const {
+    return type == ValueType::FUNC ? static_cast<FuncObject*>(object)->act.get() : nullptr;
+}
+
 // Token types
 enum class TokenType {
-    KEYWORD, IDENTIFIER, NUMBER, STRING, SYMBOL, EOF_TOKEN
+    KEYWORD, IDENTIFIER, NUMBER, STRING, SYMBOL, NEWLINE, EOF_TOKEN
 };
 
-// Token
+// Token - the value views the lexer's source buffer
 struct Token {
     TokenType type;
-    std::string value;
-    size_t line;
-    size_t col;
+    uint8_t keyword; // id in the lexer's keyword table, 0 if not a keyword
+    std::string_view value;
+    uint32_t line;
+    uint32_t col;
 
-    Token(TokenType t, const std::string& v, size_t l = 0, size_t c = 0)
-        : type(t), value(v), line(l), col(c) {}
+    Token(TokenType t = TokenType::EOF_TOKEN, std::string_view v = std::string_view(),
+          size_t l = 0, size_t c = 0, uint8_t kw = 0)
+        : type(t), keyword(kw), value(v), line(static_cast<uint32_t>(l)), col(static_cast<uint32_t>(c)) {}
 };
 
 // AST Node types
 enum class NodeType {
     PROGRAM, FORM, ACT, CALL, IF, LOOP, GIVE, SAY, PUT, BINARY_OP, UNARY_OP,
-    IDENTIFIER, LITERAL, BLOCK, LIST_LIT, MAP_LIT
+    IDENTIFIER, LITERAL, BLOCK, LIST_LIT, MAP_LIT,
+    CONSTANT // a literal or folded expression, worked out by the Optimizer
+};
+
+// Bump allocator - everything in it is freed at once by reset()
+class Arena {
+private:
+    std::vector<std::unique_ptr<char[]>> blocks;
+    char* cursor = nullptr;
+    char* limit = nullptr;
+    size_t nextBlockSize = 4096;
+
+    void* grow(size_t bytes, size_t align);
+
+public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(cursor) + align - 1) & ~(uintptr_t)(align - 1);
+        if (cursor && p + bytes <= reinterpret_cast<uintptr_t>(limit)) {
+            cursor = reinterpret_cast<char*>(p + bytes);
+            return reinterpret_cast<void*>(p);
+        }
+        return grow(bytes, align);
+    }
+
+    // Arena objects are never destroyed individually
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena types must be trivially destructible");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* allocArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value, "arena types must be trivially destructible");
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    std::string_view copy(std::string_view text);
+    void reset();
+};
+
+// Non-owning view over arena-allocated elements
+template <typename T>
+struct Span {
+    T* items = nullptr;
+    uint32_t count = 0;
+
+    T* begin() const { return items; }
+    T* end() const { return items + count; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T& operator[](size_t i) const { return items[i]; }
+};
+
+// Interned names: identifiers, keywords and operators become 32-bit ids
+using Symbol = uint32_t;
+constexpr Symbol NO_SYMBOL = static_cast<Symbol>(-1);
+
+class SymbolTable {
+public:
+    using Storage = std::deque<std::string>; // stable addresses for the views of names
+    using Storages = std::vector<std::shared_ptr<const Storage>>;
+
+private:
+    std::shared_ptr<Storage> storage = std::make_shared<Storage>();
+    Storages copied; // the storage of the tables this one was copied from
+    std::unordered_map<std::string_view, Symbol> ids;
+    std::vector<std::string_view> names;
+
+public:
+    SymbolTable() = default;
+    // Copies keep the same ids and view the same names, holding on to the
+    // storage they are in; what a copy interns goes into its own
+    SymbolTable(const SymbolTable& other);
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    Symbol intern(std::string_view name);
+    std::string_view name(Symbol symbol) const { return names[symbol]; }
+    size_t size() const { return names.size(); }
+    // Everything the names view, for what outlives the table (Program)
+    Storages storages() const;
 };
 
-// AST Node
+// AST Node - allocated in the owning Program's arena
 class ASTNode {
 public:
     NodeType type;
-    std::string value;
-    std::vector<std::shared_ptr<ASTNode>> children;
-    Token token;
+    TokenType tokenType;   // type of the token the node was built from
+    Symbol symbol;         // interned value; NO_SYMBOL for string literals
+    uint32_t line;
+    uint32_t col;
+    bool parallel = false; // LOOP: `loop N in parallel`, kept if the Resolver finds it safe
+    bool tail = false;     // CALL: the last thing its act does, see Resolver::markTailCalls
+    std::string_view value;
+    Span<ASTNode*> children;
+    size_t slot;           // variable slot assigned by the Resolver
+    // CONSTANT: a number, bool or void; texts stay LITERALs, as nodes are
+    // shared by runtimes on other threads and never destroyed
+    ValueType constantType = ValueType::VOID;
+    double constant = 0; // the number, or 1 for true
+    MapCache cache;      // CALL: where its act was last found in the functions table
+
+    ASTNode(NodeType t, TokenType tt, Symbol sym, std::string_view v, size_t l, size_t c)
+        : type(t), tokenType(tt), symbol(sym), line(static_cast<uint32_t>(l)),
+          col(static_cast<uint32_t>(c)), value(v), slot(0) {}
+
+    Value constantValue() const {
+        if (constantType == ValueType::NUM) return Value(constant);
+        if (constantType == ValueType::BOOL) return Value(constant != 0);
+        return Value();
+    }
+};
 
-    ASTNode(NodeType t, const Token& tok) : type(t), token(tok) {}
+// A parsed program; freeing it releases every node in one arena reset.
+// A program parsed incrementally links to statements kept from earlier
+// versions, whose programs it holds in parts (see Outline).
+struct Program {
+    Arena arena;
+    ASTNode* root = nullptr;
+    std::vector<std::shared_ptr<Program>> parts;
+    // The names its nodes view, which can outlive the runtime state whose
+    // symbol table it was parsed against (ProgramState is copied on write)
+    SymbolTable::Storages symbols;
 };
 
-// Lexer
+// Lexer - a pull stream of tokens over a source buffer that must
+// outlive them
 class Lexer {
+public:
+    // Where the lexer is: the next token is read from pos on. Lines only
+    // count the breaks between tokens, and columns are in bytes.
+    struct Mark {
+        uint32_t pos = 0;
+        uint32_t line = 1;
+        uint32_t col = 1;
+    };
+
 private:
-    std::string source;
+    std::string_view source;
     size_t pos;
     size_t line;
     size_t col;
 
-    static const std::vector<std::string> keywords;
-    static const std::string symbols;
-
     void skipWhitespace();
     void skipComment();
     Token readNumber();
@@ -103,155 +436,681 @@ private:
     Token readSymbol();
 
 public:
-    Lexer(const std::string& src) : source(src), pos(0), line(1), col(1) {}
+    explicit Lexer(std::string_view src) : source(src), pos(0), line(1), col(1) {}
+    // Picks up where a lexer over the same text was at from
+    Lexer(std::string_view src, Mark from) : source(src), pos(from.pos), line(from.line), col(from.col) {}
+    Mark mark() const {
+        return Mark{static_cast<uint32_t>(pos), static_cast<uint32_t>(line), static_cast<uint32_t>(col)};
+    }
+    Token next(); // EOF_TOKEN repeats once the source is exhausted
     std::vector<Token> tokenize();
+    static uint8_t keywordId(std::string_view word); // 0 if not a keyword
 };
 
 // Parser
 class Parser {
 private:
-    std::vector<Token> tokens;
-    size_t pos;
+    Lexer& lexer;
+    Lexer::Mark tokenMark; // where the lexer started on token
+    Token token;           // current token
+    Lexer::Mark lookaheadMark;
+    Token lookahead;       // the token after it
+    Program& program;
+    SymbolTable& symbols;
+    std::vector<ASTNode*> scratch; // children of nodes still being parsed
 
-    Token current();
-    Token advance();
-    bool match(const std::string& value);
+    const Token& current() const { return token; }
+    const Token& peek() const { return lookahead; }
+    const Token& advance();
+    bool match(std::string_view value);
     bool check(TokenType type);
-    std::shared_ptr<ASTNode> parseForm();
-    std::shared_ptr<ASTNode> parseAct();
-    std::shared_ptr<ASTNode> parseCall();
-    std::shared_ptr<ASTNode> parseIf();
-    std::shared_ptr<ASTNode> parseLoop();
-    std::shared_ptr<ASTNode> parseGive();
-    std::shared_ptr<ASTNode> parseSay();
-    std::shared_ptr<ASTNode> parsePut();
-    std::shared_ptr<ASTNode> parseExpression();
-    std::shared_ptr<ASTNode> parseBinaryOp(int precedence);
-    std::shared_ptr<ASTNode> parsePrimary();
-    std::shared_ptr<ASTNode> parseBlock();
+    ASTNode* makeNode(NodeType type, const Token& tok);
+    size_t beginChildren() const { return scratch.size(); }
+    void addChild(ASTNode* child) { scratch.push_back(child); }
+    void endChildren(ASTNode* node, size_t mark);
+    ASTNode* parseStatement(); // nullptr if the keyword starts no statement
+    ASTNode* parseBareCall(bool element);
+    ASTNode* parseForm();
+    ASTNode* parseAct();
+    ASTNode* parseCall();
+    ASTNode* parseIf();
+    ASTNode* parseLoop();
+    ASTNode* parseGive();
+    ASTNode* parseSay();
+    ASTNode* parsePut();
+    ASTNode* parseBinaryOp(int precedence);
+    ASTNode* parsePrimary();
+    ASTNode* parseBlock();
+
+public:
+    Parser(Lexer& lex, Program& prog, SymbolTable& syms)
+        : lexer(lex), tokenMark(lex.mark()), token(lex.next()), lookaheadMark(lex.mark()), lookahead(lex.next()),
+          program(prog), symbols(syms) {
+        program.symbols = symbols.storages();
+    }
+    ASTNode* parse();
+    ASTNode* parseExpression(); // one expression, such as a call argument
+
+    // parse() a statement at a time, for Outline: begin() makes the
+    // PROGRAM node, then each parseTopLevel() gives the next top-level
+    // statement, or nullptr after skipping a token that starts none
+    ASTNode* begin() { return makeNode(NodeType::PROGRAM, current()); }
+    ASTNode* parseTopLevel();
+    bool done() const { return token.type == TokenType::EOF_TOKEN; }
+    Lexer::Mark mark() const { return tokenMark; }
+    // How far into the source the lexer has looked; what the parser has
+    // made so far depends on nothing past it
+    uint32_t scanned() const { return lexer.mark().pos; }
+};
+
+// Resolver - binds every variable name in the AST to a runtime slot
+class Resolver {
+private:
+    Runtime& runtime;
+
+    void bind(ASTNode* node);
+    bool parallelSafe(const ASTNode* body, const std::vector<const ASTNode*>& acts) const;
+    void markTail(ASTNode* node);
+
+public:
+    explicit Resolver(Runtime& rt) : runtime(rt) {}
+    void resolve(ASTNode* node);
+    // Drops `in parallel` from the loops in program whose iterations could
+    // not run at once (see Resolver::parallelSafe)
+    void checkParallel(ASTNode* program) { checkParallel(program, program); }
+    // The same for the loops under node, a part of program
+    void checkParallel(ASTNode* node, const ASTNode* program);
+    // Marks the act calls in program that can reuse their caller's frame
+    // (see Runtime::call)
+    void markTailCalls(ASTNode* program);
+};
+
+// Optimizer - rewrites a resolved AST before either engine sees it.
+// Literals become CONSTANT nodes, so numbers are parsed once, and
+// operators on constants are folded. An if on a constant condition is
+// replaced by the branch it takes. Operators in a loop body that only read
+// variables the loop never sets are worked out once, before the loop, into
+// a hidden variable of a block around it.
+class Optimizer {
+private:
+    Runtime& runtime;
+    Program& program;
+    size_t hoisted = 0; // hidden variables made so far
+
+    ASTNode* constantNode(const ASTNode* from, const Value& value);
+    ASTNode* hoist(ASTNode* loop);
+    ASTNode* hoistInvariants(ASTNode* node, const std::vector<size_t>& written, std::vector<ASTNode*>& before);
 
 public:
-    Parser(const std::vector<Token>& toks) : tokens(toks), pos(0) {}
-    std::shared_ptr<ASTNode> parse();
+    Optimizer(Runtime& rt, Program& prog) : runtime(rt), program(prog) {}
+    ASTNode* optimize(ASTNode* node); // the node to run in its place
+};
+
+// A module method call; method is the alias the script used
+struct MethodCall {
+    Module& module;
+    const std::string& method;
+    const std::vector<Value>& args;
+    Runtime& runtime;
 };
 
-// Module interface
+using ModuleMethod = Value (*)(const MethodCall& call);
+
+// Module interface - modules bind method names (and their aliases) to
+// handlers once, when the runtime registers them
 class Module {
+private:
+    struct Binding {
+        size_t minArgs;
+        ModuleMethod handler;
+        bool pure;
+    };
+    std::unordered_map<std::string, std::vector<Binding>> methods;
+
+protected:
+    Value unhandled; // result of calls no handler accepts
+
+    // Bind each name to handler for calls with at least minArgs arguments.
+    // A name can be bound more than once; the first binding that accepts
+    // the call wins. Pure handlers only read their arguments and build new
+    // values, so calls to them can run on another thread (see `loop N in
+    // parallel`)
+    void bind(std::initializer_list<const char*> names, size_t minArgs, ModuleMethod handler, bool pure = false);
+    virtual void bindMethods() = 0;
+
 public:
     virtual ~Module() = default;
-    virtual ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) = 0;
     virtual std::string getName() const = 0;
+
+    void registerMethods();
+    // Handler for `method` called with argc arguments, nullptr if none
+    ModuleMethod resolve(const std::string& method, size_t argc) const;
+    // Whether every handler bound to method is pure (see bind)
+    bool isPure(const std::string& method) const;
+    Value getUnhandled() const { return unhandled; }
+    Value call(const std::string& method, const std::vector<Value>& args, Runtime& runtime);
+    // Work the script left running once it finishes, such as a server
+    // loop; returns when there is none left
+    virtual void run(Runtime&) {}
+    // Acts were defined again by Runtime::reload; a module holding acts
+    // takes the new ones
+    virtual void reload(Runtime&) {}
+};
+
+// Execution engines: tree-walking evaluator or bytecode VM
+enum class Engine {
+    TREE, VM
+};
+
+struct Instr;
+class Outline;
+
+namespace profile {
+class Recorder;
+}
+
+// Recently executed sources, parsed and resolved, and compiled for the VM,
+// keyed by a hash of the source text and engine. Entries carry symbol ids
+// and slots, so a cache belongs to the ProgramState that resolved them.
+class ProgramCache {
+public:
+    struct Entry {
+        std::string source;               // checked on every hit
+        std::shared_ptr<Program> program; // tree engine
+        std::shared_ptr<Chunk> chunk;     // VM; holds everything it needs
+        size_t slots = 0;                 // variable slots the program uses
+        uint64_t kind = 0;                // engine and options, as in the key
+        // Programs only: their top-level statements, so that an edited
+        // version of the source can be loaded incrementally
+        std::shared_ptr<const Outline> outline;
+        // Expressions only (see Runtime::compileExpression)
+        std::vector<size_t> reads; // slots of the variables it reads
+        bool pure = false;         // no calls, so it only reads variables
+    };
+    static constexpr size_t CAPACITY = 32;
+
+    ProgramCache() = default;
+    ProgramCache(const ProgramCache& other); // same entries, same order
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    // Entry for source under key, now the most recently used; nullptr if none
+    std::shared_ptr<const Entry> find(uint64_t key, const std::string& source);
+    // Adds or replaces key's entry, evicting the least recently used
+    void insert(uint64_t key, std::shared_ptr<const Entry> entry);
+    // The most recently used program of kind, or nullptr
+    std::shared_ptr<const Entry> latest(uint64_t kind);
+    void clear();
+
+private:
+    using Order = std::list<std::pair<uint64_t, std::shared_ptr<const Entry>>>;
+    std::mutex mutex; // runtimes forked for tasks look up from other threads
+    Order order;      // most recently used first
+    std::unordered_map<uint64_t, Order::iterator> index;
 };
 
 // Runtime
 class Runtime {
 private:
-    std::map<std::string, ValuePtr> variables;
-    std::map<std::string, Function> functions;
-    std::map<std::string, ModulePtr> modules;
-    std::vector<std::map<std::string, ValuePtr>> scopes;
+    friend class Resolver;
+    friend class Optimizer;
+    friend class Compiler;
+    friend class VM;
+    friend class ProgramImage;
+    friend class Outline;
+
+    // Scopes use shallow binding: each slot holds its innermost live
+    // binding, tagged with the scope depth that created it, and the
+    // bindings it shadows are saved until that scope is popped
+    static constexpr size_t UNBOUND = static_cast<size_t>(-1);
+    struct Binding {
+        Value value;
+        size_t depth = UNBOUND; // 0 = global
+    };
+    struct SavedBinding {
+        size_t slot;
+        Binding previous;
+    };
+
+    // Program-wide state. Runtimes forked for tasks share it, so writes go
+    // through own(), which first takes a private copy if it is shared
+    struct ProgramState {
+        SymbolTable symbols;
+        std::vector<size_t> symbolSlots; // Symbol -> slot, filled by the Resolver
+        FlatMap<ActPtr> functions;
+        FlatMap<ModulePtr> modules;
+        ProgramCache cache;
+        // Before the state is shared: runtimes on other threads then only
+        // read its maps, even to iterate them
+        void share() const {
+            functions.sortKeys();
+            modules.sortKeys();
+        }
+    };
+    struct ForkTag {};
+
+    Engine engine = Engine::VM;
+    bool optimizing = true; // run the Optimizer over programs before either engine
+    std::shared_ptr<ProgramState> state;
+    // Runtimes with the same isolate share heap values, so they must stay
+    // on one thread; a fork for a task starts a new one
+    uint64_t isolate;
+    // Per-runtime frames: variables, scopes and VM registers
+    std::vector<Binding> bindings;
+    std::vector<SavedBinding> saved;
+    std::vector<size_t> scopeMarks;
+    std::vector<Value> stack; // VM registers, and the tree engine's call arguments
+    // An act the VM is running in the dispatch loop that called it, rather
+    // than in a loop of its own (see VM::loop)
+    struct CallFrame {
+        const Chunk* chunk;       // the caller's; nullptr if C++ called the act
+        const Instr* ip;          // the caller's CALLFN
+        size_t base;              // where the caller's registers start
+        size_t scopeMark;         // scopeMarks.size() before the act's scope
+        const Act* running;       // what was running in the caller
+        ActPtr act;               // holds the act while it runs
+        profile::Recorder* recorder; // recording its time, if any
+    };
+    std::vector<CallFrame> frames;
+    const Act* running = nullptr; // the act whose body is running, if any
+    // A tail call the running tree act's body ended with, made by
+    // Runtime::call once the body has returned
+    ActPtr tailAct;
+    std::vector<Value> tailArgs;
+    std::shared_ptr<output::Sink> sink; // what say prints to
+
+    std::shared_ptr<Program> program; // program being evaluated
 
-    void pushScope();
+    struct Watch; // see watch()
+    std::shared_ptr<Watch> watching;
+
+    explicit Runtime(ForkTag);
+    std::unique_ptr<Runtime> forkEmpty() const; // fork() without the variables
+    // Source parsed, resolved and compiled for the engine, from the cache
+    // when it was seen recently. A program is parsed incrementally against
+    // base, or else the program last loaded (see Outline).
+    std::shared_ptr<const ProgramCache::Entry> load(const std::string& source, bool expression,
+                                                    const ProgramCache::Entry* base = nullptr);
+    Value runEntry(const ProgramCache::Entry& entry);
+    ProgramState& own();
+    size_t slotFor(Symbol symbol);
+    // Runs body once per iteration, with the step variable bound, split
+    // across the scheduler's workers on forks of this runtime; what they
+    // say is printed in iteration order once all have finished. Gives the
+    // last iteration's result, as an ordinary loop does.
+    Value loopParallel(double iterations, size_t stepSlot, const std::function<Value(Runtime&)>& body);
+    // Whether a tail call from caller to callee with count values can run
+    // in the caller's frame. Resolver::markTailCalls only marks calls whose
+    // act binds nothing but its parameters, so this holds when callee binds
+    // all of those again: no binding the callee could read goes with the
+    // frame.
+    static bool reusesFrame(const Act* caller, const Act& callee, size_t count);
+    void pushScope() { scopeMarks.push_back(saved.size()); }
+    // A new scope with act's parameters bound to the count values at args
+    void enterAct(const Act& act, const Value* args, size_t count) {
+        pushScope();
+        size_t bound = std::min(act.params.size(), count);
+        for (size_t i = 0; i < bound; i++) setSlot(act.params[i], args[i]);
+    }
     void popScope();
-    ValuePtr getVariable(const std::string& name);
-    void setVariable(const std::string& name, ValuePtr value);
+    const Value& getSlot(size_t slot) const { return bindings[slot].value; }
+    void setSlot(size_t slot, Value value) {
+        Binding& binding = bindings[slot];
+        size_t depth = scopeMarks.size();
+        if (depth > 0 && binding.depth != depth) {
+            saved.push_back({slot, std::move(binding)});
+        }
+        binding.value = std::move(value);
+        binding.depth = depth;
+    }
 
 public:
     Runtime();
     void registerModule(const std::string& name, ModulePtr module);
-    ValuePtr evaluate(std::shared_ptr<ASTNode> node);
-    ValuePtr execute(const std::string& source);
+    ModulePtr module(const std::string& name) const; // nullptr if none is registered as name
+    void setEngine(Engine e) { engine = e; }
+    Engine getEngine() const { return engine; }
+    void setOptimize(bool on) { optimizing = on; }
+    bool getOptimize() const { return optimizing; }
+    Value evaluate(ASTNode* node);
+    Value execute(const std::string& source);
+    // Source parsed and compiled once, to be run many times. Holding it
+    // keeps it alive even after the program cache evicts it.
+    using Compiled = std::shared_ptr<const ProgramCache::Entry>;
+    Compiled compile(const std::string& source) { return load(source, false); }
+    Value execute(const Compiled& compiled);
+    // Hot reload: source is an edited version of running's, which is still
+    // running (a server, say). It is loaded against running, and of the
+    // top-level statements that changed only the act definitions are run,
+    // so calls from then on use the new acts; then every module's
+    // Module::reload. Acts the edit removed stay defined. Gives the new
+    // version, with how many acts it defined in acts and how many other
+    // statements changed, which take effect on a restart, in others.
+    Compiled reload(const Compiled& running, const std::string& source, size_t& acts, size_t& others);
+    // Reloads the script at path, which ran as running, each time the file
+    // changes, from when a module's work runs (Module::run) polls for it
+    void watch(const std::string& path, Compiled running);
+    bool watched() const { return watching != nullptr; }
+    // Reloads the watched script if its file changed since the last poll,
+    // reporting on stderr
+    void pollWatch();
+    // The act a program defined under name, or nullptr
+    ActPtr getAct(const std::string& name) const;
+    // Runs act with the count values at args bound to its parameters, as
+    // `call` does: extra values are ignored and missing parameters are left
+    // unbound. The values are bound before anything else runs, so they may
+    // be on this runtime's value stack.
+    Value call(const Act& act, const Value* args, size_t count);
+    // Compiled image of source for the VM, see ProgramImage
+    std::string compileImage(const std::string& source);
+    // Runs an image from compileImage with the VM, whatever the engine
+    Value executeImage(const char* data, size_t size);
+    void run(); // runs each module's pending work, see Module::run
+    // Runtime for a task on another thread. It shares this runtime's
+    // program state and starts from deep copies of the variables visible
+    // here, so the two never touch the same values
+    std::unique_ptr<Runtime> fork() const;
+
+    // One expression compiled once and evaluated many times with names
+    // bound to new values each time, such as a query predicate that is
+    // run per row
+    struct Expression {
+        static constexpr size_t UNUSED = static_cast<size_t>(-1);
+        std::shared_ptr<const ProgramCache::Entry> code;
+        std::vector<size_t> slots; // per name; UNUSED if the source never reads it
+        bool uses(size_t name) const { return slots[name] != UNUSED; }
+    };
+    Expression compileExpression(const std::string& source, const std::vector<std::string>& names);
+    // values[i] is bound to the i-th name (if used) in a scope of its own
+    Value evaluate(const Expression& expression, const Value* values);
+    // fork() copying only the variables expression reads, for evaluating a
+    // pure expression on another thread
+    std::unique_ptr<Runtime> fork(const Expression& expression) const;
+
+    // A runtime frozen after evaluating a program: its functions, modules
+    // and globals. Runtimes started from it share all of them until they
+    // write, so starting one costs a copy of the global slots and of the
+    // lists and maps in them, which change in place. They are in
+    // the snapshot's isolate and must stay on its thread.
+    class Snapshot {
+    private:
+        friend class Runtime;
+        Engine engine;
+        uint64_t isolate;
+        std::shared_ptr<ProgramState> state;
+        std::vector<Binding> globals;
+        std::shared_ptr<output::Sink> sink;
+    };
+    std::shared_ptr<const Snapshot> snapshot() const;
+    explicit Runtime(const Snapshot& snapshot);
+    // Back to the snapshot's state, keeping this runtime's buffers
+    void reset(const Snapshot& snapshot);
+
     void print(const std::string& msg);
+    // Printed lines go to output::standard() unless given another sink;
+    // forks and runtimes started from a snapshot share it. Buffered
+    // output reaches the sink's file at flush().
+    void setOutput(std::shared_ptr<output::Sink> output) { sink = std::move(output); }
+    output::Sink& getOutput() const { return *sink; }
+    void flush() { sink->flush(); }
+};
+
+// Runtimes started from one snapshot and recycled, so serving a request
+// costs a reset instead of building and evaluating a runtime. A lease
+// returns its runtime to the pool when dropped. Not thread-safe; a pool
+// belongs to the snapshot's thread.
+class RuntimePool {
+public:
+    struct Return {
+        RuntimePool* pool;
+        void operator()(Runtime* runtime) const;
+    };
+    using Lease = std::unique_ptr<Runtime, Return>;
+
+    explicit RuntimePool(std::shared_ptr<const Runtime::Snapshot> snapshot, size_t maxIdle = 8)
+        : snapshot(std::move(snapshot)), maxIdle(maxIdle) {}
+    Lease acquire();
+    const Runtime::Snapshot& source() const { return *snapshot; }
+
+private:
+    std::shared_ptr<const Runtime::Snapshot> snapshot;
+    size_t maxIdle;
+    std::vector<std::unique_ptr<Runtime>> idle;
 };
 
 // Built-in modules
+
+// HTTP client (see net.h). `net get url` and `net post url body` give the
+// response body, or false with the reason in `net error`; `net all urls`
+// fetches every URL at once and gives their bodies in order.
 class NetModule : public Module {
+private:
+    std::mutex mutex;
+    std::string lastError;
+
+    void fail(const std::string& error);
+    static Value send(const MethodCall& call, net::Request request);
+
 public:
     std::string getName() const override { return "net"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
+namespace files {
+class Appender;
+}
+
+// Appends go through a buffer per file, written out before that file is
+// next read or written, on flush, and when the script ends
 class FileModule : public Module {
+private:
+    std::mutex mutex;
+    std::map<std::string, std::unique_ptr<files::Appender>> appenders;
+
+    bool flush(const std::string& path);
+
 public:
+    FileModule();
+    ~FileModule() override;
     std::string getName() const override { return "file"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
 class VMModule : public Module {
 public:
     std::string getName() const override { return "vm"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
+// Routes and static mounts registered by the script are served once it
+// finishes, if it called `serve on PORT`
 class ServeModule : public Module {
+private:
+    struct Route {
+        Value handler;           // act called per request, or a fixed response
+        std::vector<Value> args; // passed to the act ahead of the request
+    };
+    http::Server server;
+    std::vector<Route> routes;
+    int port = 0;
+    // Each request runs on a runtime of its own, started from the script
+    // as its top level left it, so globals a handler sets end with it
+    std::unique_ptr<RuntimePool> pool;
+
+    static Value addRoute(const MethodCall& call, http::Method method);
+    http::Response handle(size_t route, const http::Request& request);
+
 public:
     std::string getName() const override { return "serve"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+    void run(Runtime& runtime) override;
+    void reload(Runtime& runtime) override; // routes call the acts now defined
+protected:
+    void bindMethods() override;
 };
 
 class ViewModule : public Module {
 public:
     std::string getName() const override { return "view"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
+// `play game 60` starts a game stepped 60 times a second, `play sprite x y
+// w h texture` adds a sprite and gives its id, and `play speed id vx vy`
+// sets how it moves. Each `play frame` runs the steps due since the last
+// one, calling the act given to `play update` before each, and renders.
+// Sprites are columns of a play::World, not maps (see play.h).
 class PlayModule : public Module {
+private:
+    std::mutex mutex; // modules are shared with the runtimes of tasks
+    play::World world;
+    play::Clock clock;
+    play::Frame drawn;
+    std::vector<std::string> textures; // by id - 1
+    Value update;                      // act run before each step, or void
+    std::vector<Value> stepArgs;       // kept, so a step does not allocate them
+
+    // With the mutex held: the slot of the sprite whose id is args[0], or
+    // play::NONE
+    uint32_t slot(const MethodCall& call);
+    // The id of the texture registered as name, registering it if need be
+    uint32_t textureNamed(std::string name);
+
 public:
     std::string getName() const override { return "play"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+    // Runs the steps due once seconds more have passed; gives how many ran
+    int tick(Runtime& runtime, double seconds);
+    // Draws the sprites between the last two steps; valid until the next
+    // render
+    const play::Frame& render();
+    // The name texture was registered under, or ""
+    std::string texture(uint32_t id);
+protected:
+    void bindMethods() override;
 };
 
 class MarkdownModule : public Module {
 public:
     std::string getName() const override { return "markdown"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
 class WebModule : public Module {
 public:
     std::string getName() const override { return "web"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
+};
+
+// Lists of numbers, packed as arrays of doubles, and the loops over them
+// (see kernels.h): `list range 1000`, `list sum xs`, `list map xs "times"
+// 2`, `list filter xs "over" 10`. Lists given as values are read item by
+// item instead. `list set` and `list push` change a list in place.
+class ListModule : public Module {
+public:
+    std::string getName() const override { return "list"; }
+protected:
+    void bindMethods() override;
 };
 
 class QueryModule : public Module {
 public:
     std::string getName() const override { return "query"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
+// `database connect url` picks the database later calls go to; each call
+// borrows a pooled connection for just its statement. Queries give a table
+// as csv reads one, other statements the number of rows they changed, and
+// failures false with the reason in `database error`.
 class DatabaseModule : public Module {
+private:
+    std::mutex mutex;
+    std::string url;
+    std::string lastError;
+
+    std::string current(); // the URL calls go to, or "" with the error set
+    static Value run(const MethodCall& call);
+    static Value insert(const MethodCall& call);
+
 public:
     std::string getName() const override { return "database"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
 class CSVModule : public Module {
 public:
     std::string getName() const override { return "csv"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
+// `go spawn f args...` runs act f as a task on the scheduler's worker
+// threads, in a runtime forked from the caller, and returns its id.
+// `go wait id` joins one task and gives its result; `go wait` joins every
+// task the caller spawned and gives their results as a list.
 class GoModule : public Module {
+private:
+    struct TaskState;
+    std::mutex mutex;
+    std::map<uint64_t, std::shared_ptr<TaskState>> tasks; // spawned, not yet joined
+    uint64_t nextId = 1;
+
+    static Value spawn(const MethodCall& call);
+    static Value join(const MethodCall& call);
+    void orphan(const Runtime* spawner); // under mutex
+
 public:
     std::string getName() const override { return "go"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
+// Bounded channels between tasks, named by id. Values are deep-copied on
+// send, and a full send or an empty receive parks the task until the
+// other side catches up.
+class Channel;
 class ChannelModule : public Module {
+private:
+    std::mutex mutex;
+    std::map<uint64_t, std::shared_ptr<Channel>> channels;
+    uint64_t nextId = 1;
+
+    std::shared_ptr<Channel> find(const Value& id);
+
 public:
     std::string getName() const override { return "channel"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
 class RunModule : public Module {
+private:
+    std::mutex mutex;
+    std::string lastError;
+
+    void fail(const std::string& error);
+
 public:
     std::string getName() const override { return "run"; }
-    ValuePtr call(const std::string& method, const std::vector<ValuePtr>& args, Runtime& runtime) override;
+protected:
+    void bindMethods() override;
 };
 
+// value as JSON, as `serve json` sends it
+void appendJson(std::string& out, const Value& value);
+
 // Number word conversion
 double wordToNumber(const std::string& word);
 std::string numberToWord(double num);
+// A LITERAL node's value, as both engines read it; false when the literal
+// is really a variable
+bool literalValue(const ASTNode& node, Value& out);
 
 } // namespace azalea
 
@@ -0,0 +1,658 @@
+#include "csv.h"
+#include "mapped_file.h"
+#include "scheduler.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace azalea {
+
+namespace {
+
+// Smaller inputs are parsed on the calling thread
+constexpr size_t CHUNK_MIN_SIZE = 1 << 20;
+constexpr size_t BLOCK_SIZE = 64;
+constexpr size_t WRITE_BUFFER_SIZE = 64 * 1024;
+
+constexpr double NOT_A_NUMBER = std::numeric_limits<double>::quiet_NaN();
+
+// One bit per byte of a 64-byte block
+struct BlockMasks {
+    uint64_t quotes = 0;
+    uint64_t delimiters = 0;
+    uint64_t newlines = 0;
+};
+
+#if defined(__SSE2__)
+inline uint64_t matches(__m128i chunk, __m128i byte) {
+    return static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, byte)));
+}
+#endif
+
+// block must have BLOCK_SIZE readable bytes
+BlockMasks scanBlock(const char* block, char delimiter) {
+    BlockMasks masks;
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i separator = _mm_set1_epi8(delimiter);
+    const __m128i newline = _mm_set1_epi8('\n');
+    for (int i = 0; i < 4; i++) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * i));
+        masks.quotes |= matches(chunk, quote) << (16 * i);
+        masks.delimiters |= matches(chunk, separator) << (16 * i);
+        masks.newlines |= matches(chunk, newline) << (16 * i);
+    }
+#else
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        uint64_t bit = uint64_t(1) << i;
+        char c = block[i];
+        if (c == '"') masks.quotes |= bit;
+        if (c == delimiter) masks.delimiters |= bit;
+        if (c == '\n') masks.newlines |= bit;
+    }
+#endif
+    return masks;
+}
+
+// Block starting at p with only `size` bytes left in the input; the rest
+// reads as zeros, which match nothing
+BlockMasks scanPartialBlock(const char* p, size_t size, char delimiter) {
+    if (size >= BLOCK_SIZE) return scanBlock(p, delimiter);
+    char block[BLOCK_SIZE] = {};
+    std::memcpy(block, p, size);
+    return scanBlock(block, delimiter);
+}
+
+// Bit i set iff an odd number of quotes are at or before i: the bytes
+// from an opening quote up to its closing one
+inline uint64_t prefixXor(uint64_t bits) {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+    return bits;
+}
+
+inline int popcount(uint64_t bits) {
+    return __builtin_popcountll(bits);
+}
+
+inline int lowestBit(uint64_t bits) {
+    return __builtin_ctzll(bits);
+}
+
+size_t countQuotes(const char* data, size_t begin, size_t end) {
+    size_t count = 0;
+    for (size_t pos = begin; pos < end; pos += BLOCK_SIZE) {
+        count += popcount(scanPartialBlock(data + pos, end - pos, ',').quotes);
+    }
+    return count;
+}
+
+// Start of the row after the one containing `from`; inside says whether
+// `from` is within quotes
+size_t nextRow(const char* data, size_t size, size_t from, bool inside) {
+    for (size_t i = from; i < size; i++) {
+        if (data[i] == '"') {
+            inside = !inside;
+        } else if (data[i] == '\n' && !inside) {
+            return i + 1;
+        }
+    }
+    return size;
+}
+
+// Calls field(p, n) with each raw field (quotes included) and row() after
+// each row of [begin, end), which must start a row outside quotes. A
+// trailing \r is dropped from the last field of a row; blank lines are
+// skipped.
+template <typename Field, typename Row>
+void scanRows(const char* data, size_t begin, size_t end, char delimiter, Field&& field, Row&& row) {
+    bool inside = false;
+    bool rowOpen = false;
+    size_t fieldStart = begin;
+    for (size_t pos = begin; pos < end; pos += BLOCK_SIZE) {
+        BlockMasks masks = scanPartialBlock(data + pos, end - pos, delimiter);
+        uint64_t quoted = prefixXor(masks.quotes) ^ (inside ? ~uint64_t(0) : 0);
+        inside = (quoted >> 63) != 0;
+        uint64_t structural = (masks.delimiters | masks.newlines) & ~quoted;
+        while (structural != 0) {
+            int bit = lowestBit(structural);
+            size_t at = pos + static_cast<size_t>(bit);
+            if ((masks.newlines >> bit) & 1) {
+                size_t fieldEnd = at;
+                if (fieldEnd > fieldStart && data[fieldEnd - 1] == '\r') fieldEnd--;
+                if (rowOpen || fieldEnd > fieldStart) {
+                    field(data + fieldStart, fieldEnd - fieldStart);
+                    row();
+                }
+                rowOpen = false;
+            } else {
+                field(data + fieldStart, at - fieldStart);
+                rowOpen = true;
+            }
+            fieldStart = at + 1;
+            structural &= structural - 1;
+        }
+    }
+    if (fieldStart < end || rowOpen) {
+        size_t fieldEnd = end;
+        if (fieldEnd > fieldStart && data[fieldEnd - 1] == '\r') fieldEnd--;
+        if (rowOpen || fieldEnd > fieldStart) {
+            field(data + fieldStart, fieldEnd - fieldStart);
+            row();
+        }
+    }
+}
+
+// A field's text: outer quotes removed and "" turned back into "
+void unquote(const char* p, size_t n, std::string& out) {
+    out.clear();
+    if (n == 0 || p[0] != '"') {
+        out.assign(p, n);
+        return;
+    }
+    for (size_t i = 1; i < n; i++) {
+        if (p[i] != '"') {
+            out += p[i];
+        } else if (i + 1 < n && p[i + 1] == '"') {
+            out += '"';
+            i++;
+        }
+    }
+}
+
+constexpr double POWERS_OF_TEN[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Decimal number with optional sign, fraction and exponent, surrounded by
+// optional spaces. Results are exact when the digits fit in a double and
+// the power of ten is at most 22 either way; anything else goes through
+// strtod.
+bool parseNumber(const char* p, size_t n, double& out) {
+    const char* end = p + n;
+    while (p < end && *p == ' ') p++;
+    while (end > p && end[-1] == ' ') end--;
+    const char* start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;      // significant digits kept in mantissa
+    int exponent = 0;    // applied to mantissa
+    bool anyDigit = false;
+    bool exact = true;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        anyDigit = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+            if (mantissa != 0) digits++;
+        } else {
+            exponent++;
+            if (*p != '0') exact = false;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            anyDigit = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + static_cast<uint64_t>(*p - '0');
+                if (mantissa != 0) digits++;
+                exponent--;
+            } else if (*p != '0') {
+                exact = false;
+            }
+        }
+    }
+    if (!anyDigit) return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        p++;
+        bool negativeExponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negativeExponent = *p == '-';
+            p++;
+        }
+        if (p == end || *p < '0' || *p > '9') return false;
+        int value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            if (value < 100000) value = value * 10 + (*p - '0');
+        }
+        exponent += negativeExponent ? -value : value;
+    }
+    if (p != end) return false;
+
+    if (exact && mantissa <= (uint64_t(1) << 53) && exponent >= -22 && exponent <= 22) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / POWERS_OF_TEN[-exponent] : value * POWERS_OF_TEN[exponent];
+        out = negative ? -value : value;
+        return true;
+    }
+    std::string text(start, end);
+    out = std::strtod(text.c_str(), nullptr);
+    return true;
+}
+
+// Rows [begin, end) of the input and what the first pass found in them
+struct RowChunk {
+    size_t begin;
+    size_t end;
+    size_t rows = 0;
+    size_t firstRow = 0; // index of this chunk's first row in the table
+    std::vector<std::vector<double>> numbers;
+    std::vector<bool> numeric; // false once a field will not parse
+    std::vector<bool> seen;    // a non-empty field was parsed
+
+    RowChunk(size_t from, size_t to) : begin(from), end(to) {}
+};
+
+// Pass one: counts rows and parses every column as numbers until one of
+// its fields is not a number
+void parseNumbers(const char* data, char delimiter, size_t width, RowChunk& chunk) {
+    chunk.numbers.assign(width, {});
+    chunk.numeric.assign(width, true);
+    chunk.seen.assign(width, false);
+    size_t column = 0;
+    scanRows(data, chunk.begin, chunk.end, delimiter,
+        [&](const char* p, size_t n) {
+            if (column < width && chunk.numeric[column]) {
+                double value = NOT_A_NUMBER;
+                const char* text = p;
+                if (n >= 2 && p[0] == '"' && p[n - 1] == '"') {
+                    text = p + 1;
+                    n -= 2;
+                }
+                bool blank = true;
+                for (size_t i = 0; i < n && blank; i++) blank = text[i] == ' ';
+                if (!blank) {
+                    if (parseNumber(text, n, value)) {
+                        chunk.seen[column] = true;
+                    } else {
+                        chunk.numeric[column] = false;
+                        std::vector<double>().swap(chunk.numbers[column]);
+                    }
+                }
+                if (chunk.numeric[column]) chunk.numbers[column].push_back(value);
+            }
+            column++;
+        },
+        [&] {
+            // Short rows: the missing fields are empty
+            for (; column < width; column++) {
+                if (chunk.numeric[column]) chunk.numbers[column].push_back(NOT_A_NUMBER);
+            }
+            column = 0;
+            chunk.rows++;
+        });
+}
+
+// Pass two: the text of the columns that are not numeric, into their
+// final places
+void parseText(const char* data, char delimiter, const std::vector<int64_t>& textIndex,
+               std::vector<std::vector<Value>>& text, const RowChunk& chunk) {
+    size_t width = textIndex.size();
+    size_t column = 0;
+    size_t row = chunk.firstRow;
+    std::string field;
+    scanRows(data, chunk.begin, chunk.end, delimiter,
+        [&](const char* p, size_t n) {
+            if (column < width && textIndex[column] >= 0) {
+                unquote(p, n, field);
+                text[static_cast<size_t>(textIndex[column])][row] = Value(field);
+            }
+            column++;
+        },
+        [&] {
+            for (; column < width; column++) {
+                if (textIndex[column] >= 0) text[static_cast<size_t>(textIndex[column])][row] = Value("");
+            }
+            column = 0;
+            row++;
+        });
+}
+
+// Names for the header's fields, made unique and non-empty
+std::vector<std::string> columnNames(const std::vector<std::string>& header) {
+    std::vector<std::string> names;
+    for (size_t i = 0; i < header.size(); i++) {
+        std::string name = header[i].empty() ? "column " + std::to_string(i + 1) : header[i];
+        std::string unique = name;
+        for (int n = 2; std::find(names.begin(), names.end(), unique) != names.end(); n++) {
+            unique = name + "_" + std::to_string(n);
+        }
+        names.push_back(unique);
+    }
+    return names;
+}
+
+} // namespace
+
+Value parseCsv(const char* data, size_t size, char delimiter) {
+    size_t start = 0;
+    if (size >= 3 && std::memcmp(data, "\xEF\xBB\xBF", 3) == 0) start = 3; // UTF-8 BOM
+
+    // Header: the first row that is not blank
+    std::vector<std::string> header;
+    std::string field;
+    while (header.empty() && start < size) {
+        size_t end = nextRow(data, size, start, false);
+        scanRows(data, start, end, delimiter,
+            [&](const char* p, size_t n) {
+                unquote(p, n, field);
+                header.push_back(field);
+            },
+            [] {});
+        start = end;
+    }
+    std::vector<std::string> names = columnNames(header);
+    size_t width = names.size();
+
+    // Row-aligned chunks: a chunk boundary moves on to the next newline
+    // outside quotes, found from the parity of the quotes before it
+    size_t workers = std::max<size_t>(1, Scheduler::instance().workerCount());
+    size_t count = std::max<size_t>(1, std::min(workers, (size - start) / CHUNK_MIN_SIZE));
+    std::vector<size_t> cuts(count + 1, size);
+    cuts[0] = start;
+    for (size_t i = 1; i < count; i++) {
+        cuts[i] = start + (size - start) / count * i;
+    }
+    std::vector<RowChunk> chunks;
+    if (count > 1) {
+        std::vector<size_t> quotes(count);
+        Scheduler::instance().parallel(count, [&](size_t i) {
+            quotes[i] = countQuotes(data, cuts[i], cuts[i + 1]);
+        });
+        size_t parity = 0;
+        size_t previous = start;
+        for (size_t i = 0; i < count; i++) {
+            size_t begin = previous;
+            size_t end = size;
+            if (i + 1 < count) {
+                parity += quotes[i]; // quotes before cuts[i + 1]
+                end = std::max(begin, nextRow(data, size, cuts[i + 1], parity % 2 != 0));
+            }
+            chunks.emplace_back(begin, end);
+            previous = end;
+        }
+    } else {
+        chunks.emplace_back(start, size);
+    }
+
+    Scheduler::instance().parallel(chunks.size(), [&](size_t i) {
+        parseNumbers(data, delimiter, width, chunks[i]);
+    });
+
+    size_t rows = 0;
+    for (RowChunk& chunk : chunks) {
+        chunk.firstRow = rows;
+        rows += chunk.rows;
+    }
+    std::vector<bool> numeric(width, true);
+    std::vector<bool> seen(width, false);
+    for (const RowChunk& chunk : chunks) {
+        for (size_t c = 0; c < width; c++) {
+            numeric[c] = numeric[c] && chunk.numeric[c];
+            seen[c] = seen[c] || chunk.seen[c];
+        }
+    }
+    std::vector<int64_t> textIndex(width, -1);
+    std::vector<std::vector<double>> numberColumns(width);
+    std::vector<std::vector<Value>> textColumns;
+    for (size_t c = 0; c < width; c++) {
+        if (numeric[c] && seen[c]) {
+            numberColumns[c].resize(rows);
+        } else {
+            textIndex[c] = static_cast<int64_t>(textColumns.size());
+            textColumns.emplace_back(rows);
+        }
+    }
+
+    Scheduler::instance().parallel(chunks.size(), [&](size_t i) {
+        RowChunk& chunk = chunks[i];
+        for (size_t c = 0; c < width; c++) {
+            if (textIndex[c] < 0) {
+                std::copy(chunk.numbers[c].begin(), chunk.numbers[c].end(),
+                          numberColumns[c].begin() + static_cast<ptrdiff_t>(chunk.firstRow));
+            }
+            std::vector<double>().swap(chunk.numbers[c]);
+        }
+        if (!textColumns.empty()) parseText(data, delimiter, textIndex, textColumns, chunk);
+    });
+
+    std::vector<Value> columns;
+    ValueMap columnData;
+    for (size_t c = 0; c < width; c++) {
+        columns.emplace_back(names[c]);
+        if (textIndex[c] < 0) {
+            columnData[names[c]] = Value::numbers(std::move(numberColumns[c]));
+        } else {
+            columnData[names[c]] = Value(std::move(textColumns[static_cast<size_t>(textIndex[c])]));
+        }
+    }
+    ValueMap table;
+    table["columns"] = Value(std::move(columns));
+    table["rows"] = Value(static_cast<double>(rows));
+    table["data"] = Value(std::move(columnData));
+    return Value(std::move(table));
+}
+
+bool readCsvFile(const std::string& path, char delimiter, Value& table) {
+    MappedFile file;
+    if (!file.open(path.c_str(), true)) return false;
+    table = parseCsv(file.data, file.size, delimiter);
+    return true;
+}
+
+// CsvWriter
+
+CsvWriter::CsvWriter(std::FILE* output, char fieldDelimiter)
+    : file(output), delimiter(fieldDelimiter), buffer(WRITE_BUFFER_SIZE) {}
+
+void CsvWriter::put(const char* data, size_t size) {
+    while (size > 0) {
+        if (used == buffer.size()) flush();
+        size_t n = std::min(size, buffer.size() - used);
+        std::memcpy(buffer.data() + used, data, n);
+        used += n;
+        data += n;
+        size -= n;
+    }
+}
+
+void CsvWriter::separate() {
+    if (rowStarted) put(delimiter);
+    rowStarted = true;
+}
+
+void CsvWriter::field(std::string_view text) {
+    separate();
+    bool quote = false;
+    for (char c : text) {
+        if (c == delimiter || c == '"' || c == '\n' || c == '\r') {
+            quote = true;
+            break;
+        }
+    }
+    if (!quote) {
+        put(text.data(), text.size());
+        return;
+    }
+    put('"');
+    for (char c : text) {
+        if (c == '"') put('"');
+        put(c);
+    }
+    put('"');
+}
+
+void CsvWriter::number(double value) {
+    if (std::isnan(value)) {
+        separate();
+        return;
+    }
+    char digits[32];
+    int length = std::snprintf(digits, sizeof(digits), "%.17g", value);
+    // The shortest of %.15g..%.17g that reads back as the same double
+    for (int precision = 15; precision < 17; precision++) {
+        char shorter[32];
+        int n = std::snprintf(shorter, sizeof(shorter), "%.*g", precision, value);
+        if (std::strtod(shorter, nullptr) == value) {
+            std::memcpy(digits, shorter, static_cast<size_t>(n) + 1);
+            length = n;
+            break;
+        }
+    }
+    separate();
+    put(digits, static_cast<size_t>(length));
+}
+
+void CsvWriter::field(const Value& value) {
+    switch (value.type) {
+        case ValueType::NUM:
+            number(value.num);
+            break;
+        case ValueType::VOID:
+            separate();
+            break;
+        case ValueType::TEXT:
+            field(std::string_view(value.asText()));
+            break;
+        default:
+            field(std::string_view(value.toString()));
+    }
+}
+
+void CsvWriter::endRow() {
+    put('\n');
+    rowStarted = false;
+}
+
+bool CsvWriter::flush() {
+    if (used > 0 && std::fwrite(buffer.data(), 1, used, file) != used) failed = true;
+    used = 0;
+    return !failed;
+}
+
+namespace {
+
+// Row `row` of a column list, packed or boxed; void past its end
+void writeCell(CsvWriter& writer, const Value& column, size_t row) {
+    if (const std::vector<double>* numbers = column.asNumbers()) {
+        if (row < numbers->size()) {
+            writer.number((*numbers)[row]);
+        } else {
+            writer.field(Value());
+        }
+        return;
+    }
+    if (column.type == ValueType::LIST && row < column.asList().size()) {
+        writer.field(column.asList()[row]);
+    } else {
+        writer.field(Value());
+    }
+}
+
+size_t columnLength(const Value& column) {
+    if (const std::vector<double>* numbers = column.asNumbers()) return numbers->size();
+    return column.type == ValueType::LIST ? column.asList().size() : 0;
+}
+
+void writeColumns(CsvWriter& writer, const std::vector<std::string>& names, const std::vector<Value>& columns) {
+    size_t rows = 0;
+    for (const Value& column : columns) {
+        rows = std::max(rows, columnLength(column));
+    }
+    for (const std::string& name : names) {
+        writer.field(std::string_view(name));
+    }
+    writer.endRow();
+    for (size_t row = 0; row < rows; row++) {
+        for (const Value& column : columns) {
+            writeCell(writer, column, row);
+        }
+        writer.endRow();
+    }
+}
+
+} // namespace
+
+bool writeCsvFile(const std::string& path, const Value& rows, char delimiter) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+    std::setvbuf(file, nullptr, _IONBF, 0); // the writer does the buffering
+    CsvWriter writer(file, delimiter);
+
+    if (rows.type == ValueType::MAP) {
+        const auto& map = rows.asMap();
+        auto columns = map.find("columns");
+        auto data = map.find("data");
+        std::vector<std::string> names;
+        std::vector<Value> lists;
+        if (columns != map.end() && columns->second.type == ValueType::LIST &&
+            data != map.end() && data->second.type == ValueType::MAP) {
+            // A table, in its column order
+            const auto& byName = data->second.asMap();
+            for (const Value& name : columns->second.asList()) {
+                names.push_back(name.toString());
+                auto column = byName.find(names.back());
+                lists.push_back(column == byName.end() ? Value() : column->second);
+            }
+        } else {
+            for (const auto& column : map) {
+                names.push_back(column.first);
+                lists.push_back(column.second);
+            }
+        }
+        writeColumns(writer, names, lists);
+    } else if (rows.type == ValueType::LIST) {
+        const auto& list = rows.asList();
+        std::vector<std::string> header;
+        if (!list.empty() && list[0].type == ValueType::MAP) {
+            for (const auto& pair : list[0].asMap()) {
+                header.push_back(pair.first);
+                writer.field(std::string_view(pair.first));
+            }
+            writer.endRow();
+        }
+        for (const Value& row : list) {
+            if (row.type == ValueType::MAP) {
+                const auto& fields = row.asMap();
+                for (const std::string& name : header) {
+                    auto found = fields.find(name);
+                    writer.field(found == fields.end() ? Value() : found->second);
+                }
+            } else if (const std::vector<double>* numbers = row.asNumbers()) {
+                for (double number : *numbers) {
+                    writer.number(number);
+                }
+            } else if (row.type == ValueType::LIST) {
+                for (const Value& item : row.asList()) {
+                    writer.field(item);
+                }
+            } else {
+                writer.field(row);
+            }
+            writer.endRow();
+        }
+    } else {
+        writer.field(rows);
+        writer.endRow();
+    }
+
+    bool ok = writer.flush();
+    return std::fclose(file) == 0 && ok;
+}
+
+} // namespace azalea
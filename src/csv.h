@@ -0,0 +1,66 @@
+#ifndef AZALEA_CSV_H
+#define AZALEA_CSV_H
+
+#include "azalea.h"
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace azalea {
+
+// Columnar CSV. A table is the map
+//   {columns: [names in file order], rows: n, data: {name: column}}
+// where a column whose fields are all numbers (or empty, read as NaN) is a
+// packed list of doubles (Value::numbers) and any other column is a list
+// of text. The first row is the header.
+//
+// The input is split into row-aligned chunks that are parsed in parallel
+// on the scheduler's workers. Each chunk is scanned 64 bytes at a time for
+// quotes, delimiters and newlines (SSE2, or a bytewise fallback), and a
+// prefix XOR over the quote bits tells which of them are inside quotes.
+Value parseCsv(const char* data, size_t size, char delimiter);
+
+// Maps the file and parses it; false if it cannot be opened
+bool readCsvFile(const std::string& path, char delimiter, Value& table);
+
+// Streams rows to a file through one fixed buffer, written out whenever it
+// fills. Fields are quoted only when they contain the delimiter, a quote
+// or a line break.
+class CsvWriter {
+private:
+    std::FILE* file;
+    char delimiter;
+    std::vector<char> buffer;
+    size_t used = 0;
+    bool rowStarted = false;
+    bool failed = false;
+
+    void put(const char* data, size_t size);
+    void put(char c) {
+        if (used == buffer.size()) flush();
+        buffer[used++] = c;
+    }
+    void separate();
+
+public:
+    CsvWriter(std::FILE* output, char fieldDelimiter);
+    CsvWriter(const CsvWriter&) = delete;
+    CsvWriter& operator=(const CsvWriter&) = delete;
+
+    void field(std::string_view text);
+    void field(const Value& value); // NaN and void are empty fields
+    void number(double value);
+    void endRow();
+    bool flush(); // false once any write has failed
+};
+
+// rows: a table, a map of column name to list, a list of maps (the first
+// one's keys are the header) or a list of lists (no header). False if the
+// file cannot be written.
+bool writeCsvFile(const std::string& path, const Value& rows, char delimiter);
+
+} // namespace azalea
+
+#endif // AZALEA_CSV_H
@@ -0,0 +1,223 @@
+#include "digest.h"
+#include <cstring>
+
+namespace azalea {
+namespace digest {
+
+namespace {
+
+inline uint32_t rotl(uint32_t x, unsigned n) { return (x << n) | (x >> (32 - n)); }
+inline uint32_t rotr(uint32_t x, unsigned n) { return (x >> n) | (x << (32 - n)); }
+
+// Both digests pad to 64-byte blocks ending in the bit length, little
+// endian for MD5 and big endian for SHA-256
+template <class Block>
+void padded(std::string_view data, bool bigEndian, Block&& block) {
+    size_t whole = data.size() / 64 * 64;
+    for (size_t i = 0; i < whole; i += 64) {
+        block(reinterpret_cast<const uint8_t*>(data.data() + i));
+    }
+    uint8_t tail[128] = {};
+    size_t rest = data.size() - whole;
+    std::memcpy(tail, data.data() + whole, rest);
+    tail[rest] = 0x80;
+    size_t size = rest + 9 <= 64 ? 64 : 128;
+    uint64_t bits = static_cast<uint64_t>(data.size()) * 8;
+    for (size_t i = 0; i < 8; i++) {
+        tail[bigEndian ? size - 1 - i : size - 8 + i] = static_cast<uint8_t>(bits >> (8 * i));
+    }
+    block(tail);
+    if (size == 128) block(tail + 64);
+}
+
+constexpr uint32_t MD5_K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+    0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be, 0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+    0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+    0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c, 0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+    0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+    0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1, 0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391,
+};
+constexpr unsigned MD5_S[16] = {7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21};
+
+constexpr uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+} // namespace
+
+Md5 md5(std::string_view data) {
+    uint32_t h[4] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476};
+    padded(data, false, [&](const uint8_t* p) {
+        uint32_t m[16];
+        for (int i = 0; i < 16; i++) {
+            m[i] = uint32_t(p[4 * i]) | uint32_t(p[4 * i + 1]) << 8 | uint32_t(p[4 * i + 2]) << 16 |
+                   uint32_t(p[4 * i + 3]) << 24;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3];
+        for (int i = 0; i < 64; i++) {
+            uint32_t f;
+            int g;
+            if (i < 16) {
+                f = (b & c) | (~b & d);
+                g = i;
+            } else if (i < 32) {
+                f = (d & b) | (~d & c);
+                g = (5 * i + 1) % 16;
+            } else if (i < 48) {
+                f = b ^ c ^ d;
+                g = (3 * i + 5) % 16;
+            } else {
+                f = c ^ (b | ~d);
+                g = (7 * i) % 16;
+            }
+            uint32_t next = d;
+            d = c;
+            c = b;
+            b = b + rotl(a + f + MD5_K[i] + m[g], MD5_S[(i / 16) * 4 + i % 4]);
+            a = next;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+    });
+    Md5 out;
+    for (int i = 0; i < 16; i++) out[i] = static_cast<uint8_t>(h[i / 4] >> (8 * (i % 4)));
+    return out;
+}
+
+Sha256 sha256(std::string_view data) {
+    uint32_t h[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                     0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    padded(data, true, [&](const uint8_t* p) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = uint32_t(p[4 * i]) << 24 | uint32_t(p[4 * i + 1]) << 16 | uint32_t(p[4 * i + 2]) << 8 |
+                   uint32_t(p[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4], f = h[5], g = h[6], k = h[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t s1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+            uint32_t choice = (e & f) ^ (~e & g);
+            uint32_t t1 = k + s1 + choice + SHA256_K[i] + w[i];
+            uint32_t s0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+            uint32_t majority = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + majority;
+            k = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+        h[5] += f;
+        h[6] += g;
+        h[7] += k;
+    });
+    Sha256 out;
+    for (int i = 0; i < 32; i++) out[i] = static_cast<uint8_t>(h[i / 4] >> (24 - 8 * (i % 4)));
+    return out;
+}
+
+Sha256 hmacSha256(std::string_view key, std::string_view data) {
+    uint8_t block[64] = {};
+    if (key.size() > 64) {
+        Sha256 hashed = sha256(key);
+        std::memcpy(block, hashed.data(), hashed.size());
+    } else {
+        std::memcpy(block, key.data(), key.size());
+    }
+    std::string inner(64, '\0');
+    std::string outer(64, '\0');
+    for (int i = 0; i < 64; i++) {
+        inner[i] = static_cast<char>(block[i] ^ 0x36);
+        outer[i] = static_cast<char>(block[i] ^ 0x5c);
+    }
+    inner.append(data);
+    outer.append(bytes(sha256(inner)));
+    return sha256(outer);
+}
+
+Sha256 pbkdf2Sha256(std::string_view password, std::string_view salt, uint32_t iterations) {
+    std::string first(salt);
+    first.append("\0\0\0\1", 4);
+    Sha256 u = hmacSha256(password, first);
+    Sha256 out = u;
+    for (uint32_t i = 1; i < iterations; i++) {
+        u = hmacSha256(password, bytes(u));
+        for (size_t j = 0; j < out.size(); j++) out[j] ^= u[j];
+    }
+    return out;
+}
+
+std::string hex(const uint8_t* data, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    out.reserve(size * 2);
+    for (size_t i = 0; i < size; i++) {
+        out += digits[data[i] >> 4];
+        out += digits[data[i] & 15];
+    }
+    return out;
+}
+
+std::string base64Encode(std::string_view data) {
+    std::string out;
+    out.reserve((data.size() + 2) / 3 * 4);
+    for (size_t i = 0; i < data.size(); i += 3) {
+        uint32_t n = uint32_t(uint8_t(data[i])) << 16;
+        if (i + 1 < data.size()) n |= uint32_t(uint8_t(data[i + 1])) << 8;
+        if (i + 2 < data.size()) n |= uint8_t(data[i + 2]);
+        out += BASE64[(n >> 18) & 63];
+        out += BASE64[(n >> 12) & 63];
+        out += i + 1 < data.size() ? BASE64[(n >> 6) & 63] : '=';
+        out += i + 2 < data.size() ? BASE64[n & 63] : '=';
+    }
+    return out;
+}
+
+bool base64Decode(std::string_view text, std::string& out) {
+    out.clear();
+    uint32_t bits = 0;
+    int count = 0;
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '=') break;
+        const char* found = std::strchr(BASE64, c);
+        if (!found || c == '\0') return false;
+        bits = (bits << 6) | static_cast<uint32_t>(found - BASE64);
+        count += 6;
+        if (count >= 8) {
+            count -= 8;
+            out += static_cast<char>((bits >> count) & 0xff);
+        }
+    }
+    return true;
+}
+
+} // namespace digest
+} // namespace azalea
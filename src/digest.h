@@ -0,0 +1,36 @@
+#ifndef AZALEA_DIGEST_H
+#define AZALEA_DIGEST_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace azalea {
+namespace digest {
+
+// Message digests for protocols that need them, such as Postgres password
+// authentication. Unlike hashBytes these are the standard algorithms.
+using Md5 = std::array<uint8_t, 16>;
+using Sha256 = std::array<uint8_t, 32>;
+
+Md5 md5(std::string_view data);
+Sha256 sha256(std::string_view data);
+Sha256 hmacSha256(std::string_view key, std::string_view data);
+// PBKDF2-HMAC-SHA-256 for one block of output: SCRAM's Hi()
+Sha256 pbkdf2Sha256(std::string_view password, std::string_view salt, uint32_t iterations);
+
+std::string hex(const uint8_t* data, size_t size); // lowercase
+std::string base64Encode(std::string_view data);
+bool base64Decode(std::string_view text, std::string& out); // false if malformed
+
+template <size_t N>
+std::string_view bytes(const std::array<uint8_t, N>& digest) {
+    return std::string_view(reinterpret_cast<const char*>(digest.data()), N);
+}
+
+} // namespace digest
+} // namespace azalea
+
+#endif // AZALEA_DIGEST_H
@@ -0,0 +1,515 @@
+#include "dom.h"
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace azalea {
+namespace dom {
+
+namespace {
+
+struct TagInfo {
+    const char* name;
+    bool isVoid;
+};
+
+// Indexed by Tag
+constexpr TagInfo tagInfo[] = {
+    {"", false}, {"", false}, {"", false},
+#define AZALEA_DOM_TAG_INFO(tag, name, isVoid) {name, isVoid},
+    AZALEA_DOM_TAGS(AZALEA_DOM_TAG_INFO)
+#undef AZALEA_DOM_TAG_INFO
+};
+
+constexpr size_t TAG_COUNT = sizeof(tagInfo) / sizeof(tagInfo[0]);
+
+bool isVoid(Tag tag) {
+    return tagInfo[static_cast<size_t>(tag)].isVoid;
+}
+
+// Structural props, looked up on every component map rendered. Maps from
+// one component share a shape, so after the first each lookup is a check
+// and an index load (see MapCache).
+struct Prop {
+    MapKey key;
+    MapCache cache;
+
+    Prop(const char* name) : key(name) {}
+    const Value* in(const ValueMap& props) { return props.lookup(key, cache); }
+};
+
+Prop tagProp{"tag"};
+Prop keyProp{"key"};
+Prop contentProps[] = {{"content"}, {"text"}, {"items"}}; // in the order they render
+
+// Props that shape the node rather than becoming attributes
+bool isStructural(const std::string& prop) {
+    return prop == "tag" || prop == "content" || prop == "text" || prop == "items" ||
+           prop == "action" || prop == "key";
+}
+
+bool isTagName(std::string_view name) {
+    if (name.empty() || !std::isalpha(static_cast<unsigned char>(name[0]))) return false;
+    for (char c : name) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-') return false;
+    }
+    return true;
+}
+
+// Rules out what would end the attribute or the tag early
+bool isAttributeName(std::string_view name) {
+    if (name.empty()) return false;
+    for (char c : name) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (u <= ' ' || u == 0x7f || c == '"' || c == '\'' || c == '>' || c == '/' || c == '=' || c == '<') {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* entity(char c) {
+    switch (c) {
+        case '&': return "&amp;";
+        case '<': return "&lt;";
+        case '>': return "&gt;";
+        default: return "&quot;";
+    }
+}
+
+bool needsEscape(char c, bool attribute) {
+    return c == '&' || c == '<' || c == '>' || (attribute && c == '"');
+}
+
+#if !defined(__SSE2__)
+constexpr uint64_t ONES = 0x0101010101010101ull;
+constexpr uint64_t HIGHS = 0x8080808080808080ull;
+
+// Nonzero if any byte of word equals c
+inline uint64_t hasByte(uint64_t word, unsigned char c) {
+    uint64_t x = word ^ (ONES * c);
+    return (x - ONES) & ~x & HIGHS;
+}
+#endif
+
+// Length of the prefix of text needing no escapes, sixteen bytes at a
+// time with SSE2 and eight at a time elsewhere (such as WASM)
+size_t cleanPrefix(const char* text, size_t size, bool attribute) {
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i lt = _mm_set1_epi8('<');
+    const __m128i gt = _mm_set1_epi8('>');
+    const __m128i quote = _mm_set1_epi8(attribute ? '"' : '&');
+    for (; i + 16 <= size; i += 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text + i));
+        __m128i hits = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, amp), _mm_cmpeq_epi8(chunk, lt)),
+                                    _mm_or_si128(_mm_cmpeq_epi8(chunk, gt), _mm_cmpeq_epi8(chunk, quote)));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask != 0) return i + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(mask)));
+    }
+#else
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, text + i, sizeof(word));
+        uint64_t hits = hasByte(word, '&') | hasByte(word, '<') | hasByte(word, '>');
+        if (attribute) hits |= hasByte(word, '"');
+        if (hits != 0) break; // the scalar loop finds which byte
+    }
+#endif
+    while (i < size && !needsEscape(text[i], attribute)) i++;
+    return i;
+}
+
+} // namespace
+
+Tag tagFromName(std::string_view name) {
+    static const std::unordered_map<std::string_view, Tag> tags = [] {
+        std::unordered_map<std::string_view, Tag> byName;
+        for (size_t i = static_cast<size_t>(Tag::OTHER) + 1; i < TAG_COUNT; i++) {
+            byName.emplace(tagInfo[i].name, static_cast<Tag>(i));
+        }
+        return byName;
+    }();
+    auto found = tags.find(name);
+    return found == tags.end() ? Tag::OTHER : found->second;
+}
+
+const char* tagName(Tag tag) {
+    return tagInfo[static_cast<size_t>(tag)].name;
+}
+
+void escapeHtml(std::string_view text, std::string& out, bool attribute) {
+    const char* p = text.data();
+    size_t size = text.size();
+    while (size > 0) {
+        size_t clean = cleanPrefix(p, size, attribute);
+        out.append(p, clean);
+        if (clean == size) break;
+        out += entity(p[clean]);
+        p += clean + 1;
+        size -= clean + 1;
+    }
+}
+
+// Tree
+
+Tree::Tree(const Value& view) {
+    std::vector<Node*> nodes;
+    append(nodes, view, Tag::FRAGMENT);
+    rootNode = arena.make<Node>();
+    rootNode->tag = Tag::FRAGMENT;
+    rootNode->children = store(nodes);
+}
+
+Span<Node*> Tree::store(const std::vector<Node*>& nodes) {
+    Span<Node*> span;
+    if (nodes.empty()) return span;
+    span.items = arena.allocArray<Node*>(nodes.size());
+    span.count = static_cast<uint32_t>(nodes.size());
+    std::copy(nodes.begin(), nodes.end(), span.items);
+    return span;
+}
+
+void Tree::append(std::vector<Node*>& out, const Value& value, Tag parent) {
+    switch (value.type) {
+        case ValueType::VOID:
+        case ValueType::FUNC:
+            return;
+        case ValueType::LIST:
+            for (const Value& item : value.asList()) {
+                append(out, item, parent);
+            }
+            return;
+        case ValueType::MAP: {
+            const auto& props = value.asMap();
+            const Value* tag = tagProp.in(props);
+            std::string name = tag ? tag->toString() : "";
+            std::transform(name.begin(), name.end(), name.begin(),
+                           [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+            if (!isTagName(name)) {
+                // A tagless bag, such as a style: only its content shows
+                for (Prop& prop : contentProps) {
+                    if (const Value* found = prop.in(props)) append(out, *found, parent);
+                }
+                return;
+            }
+            Node* node = element(props, name);
+            if ((parent == Tag::UL || parent == Tag::OL) && node->tag != Tag::LI) {
+                Node* item = arena.make<Node>();
+                item->tag = Tag::LI;
+                item->children = store({node});
+                node = item;
+            }
+            out.push_back(node);
+            return;
+        }
+        default:
+            break;
+    }
+    std::string text = value.toString();
+    if (text.empty()) return;
+    if (parent == Tag::UL || parent == Tag::OL) {
+        // List items that are plain values get their own <li>
+        Node* leaf = arena.make<Node>();
+        leaf->tag = Tag::TEXT;
+        leaf->text = arena.copy(text);
+        Node* item = arena.make<Node>();
+        item->tag = Tag::LI;
+        item->children = store({leaf});
+        out.push_back(item);
+        return;
+    }
+    if (!out.empty() && out.back()->tag == Tag::TEXT) {
+        // The browser would parse the two as one text node
+        std::string joined(out.back()->text);
+        joined += text;
+        out.back()->text = arena.copy(joined);
+        return;
+    }
+    Node* leaf = arena.make<Node>();
+    leaf->tag = Tag::TEXT;
+    leaf->text = arena.copy(text);
+    out.push_back(leaf);
+}
+
+Node* Tree::element(const ValueMap& props, std::string_view name) {
+    Node* node = arena.make<Node>();
+    node->tag = tagFromName(name);
+    if (node->tag == Tag::OTHER) node->name = arena.copy(name);
+
+    if (const Value* key = keyProp.in(props)) node->key = arena.copy(key->toString());
+
+    std::vector<Attribute> attributes;
+    for (const auto& prop : props) {
+        if (isStructural(prop.first) || !isAttributeName(prop.first)) continue;
+        const Value& value = prop.second;
+        Attribute attribute{arena.copy(prop.first), std::string_view(), true};
+        switch (value.type) {
+            case ValueType::VOID:
+                attribute.hasValue = false;
+                break;
+            case ValueType::BOOL:
+                if (!value.boolean) continue;
+                attribute.hasValue = false;
+                break;
+            case ValueType::FUNC:
+            case ValueType::LIST:
+                continue;
+            case ValueType::MAP: {
+                // Declarations, as `view style` builds them
+                std::string declarations;
+                for (const auto& declaration : value.asMap()) {
+                    if (!declarations.empty()) declarations += "; ";
+                    declarations += declaration.first;
+                    declarations += ": ";
+                    declaration.second.appendTo(declarations);
+                }
+                attribute.value = arena.copy(declarations);
+                break;
+            }
+            default:
+                attribute.value = arena.copy(value.toString());
+        }
+        attributes.push_back(attribute);
+    }
+    if (!attributes.empty()) {
+        node->attributes.items = arena.allocArray<Attribute>(attributes.size());
+        node->attributes.count = static_cast<uint32_t>(attributes.size());
+        std::copy(attributes.begin(), attributes.end(), node->attributes.items);
+    }
+
+    if (!isVoid(node->tag)) node->children = children(props, node->tag);
+    return node;
+}
+
+Span<Node*> Tree::children(const ValueMap& props, Tag tag) {
+    std::vector<Node*> nodes;
+    for (Prop& prop : contentProps) {
+        if (const Value* found = prop.in(props)) append(nodes, *found, tag);
+    }
+    return store(nodes);
+}
+
+// Rendering
+
+static void renderName(const Node& node, std::string& out) {
+    if (node.tag == Tag::OTHER) {
+        out.append(node.name.data(), node.name.size());
+    } else {
+        out += tagName(node.tag);
+    }
+}
+
+void render(const Node& node, std::string& out) {
+    if (node.tag == Tag::TEXT) {
+        escapeHtml(node.text, out, false);
+        return;
+    }
+    if (node.tag != Tag::FRAGMENT) {
+        out += '<';
+        renderName(node, out);
+        for (const Attribute& attribute : node.attributes) {
+            out += ' ';
+            out.append(attribute.name.data(), attribute.name.size());
+            if (attribute.hasValue) {
+                out += "=\"";
+                escapeHtml(attribute.value, out, true);
+                out += '"';
+            }
+        }
+        if (!node.key.empty()) {
+            out += " data-key=\"";
+            escapeHtml(node.key, out, true);
+            out += '"';
+        }
+        out += '>';
+        if (isVoid(node.tag)) return;
+    }
+    for (const Node* child : node.children) {
+        render(*child, out);
+    }
+    if (node.tag != Tag::FRAGMENT) {
+        out += "</";
+        renderName(node, out);
+        out += '>';
+    }
+}
+
+// Diff
+
+namespace {
+
+class Differ {
+public:
+    std::vector<Patch> patches;
+
+    void node(const Node& before, const Node& after, std::vector<uint32_t>& path) {
+        if (before.tag != after.tag || before.name != after.name) {
+            Patch& patch = add(Patch::REPLACE, path);
+            render(after, patch.value);
+            return;
+        }
+        if (after.tag == Tag::TEXT) {
+            if (before.text != after.text) add(Patch::TEXT, path).value.assign(after.text);
+            return;
+        }
+        attributes(before, after, path);
+        children(before, after, path);
+    }
+
+    void children(const Node& before, const Node& after, std::vector<uint32_t>& path) {
+        // Which child of before, if any, each child of after continues
+        std::unordered_map<std::string, uint32_t> byIdentity;
+        for (uint32_t i = 0, unkeyed = 0; i < before.children.count; i++) {
+            byIdentity.emplace(identity(*before.children[i], unkeyed), i);
+        }
+        std::vector<int64_t> source(after.children.count, -1);
+        std::vector<bool> kept(before.children.count, false);
+        for (uint32_t i = 0, unkeyed = 0; i < after.children.count; i++) {
+            auto found = byIdentity.find(identity(*after.children[i], unkeyed));
+            if (found != byIdentity.end() && !kept[found->second]) {
+                source[i] = found->second;
+                kept[found->second] = true;
+            }
+        }
+
+        // Drop the unmatched from the back so earlier indices hold
+        for (uint32_t i = before.children.count; i-- > 0;) {
+            if (!kept[i]) add(Patch::REMOVE, path).index = i;
+        }
+        // The DOM's children as the patches so far leave them
+        std::vector<int64_t> current;
+        for (uint32_t i = 0; i < before.children.count; i++) {
+            if (kept[i]) current.push_back(i);
+        }
+
+        // Place each child of after in turn; 0..i-1 are already in place
+        for (uint32_t i = 0; i < after.children.count; i++) {
+            const Node& child = *after.children[i];
+            if (source[i] < 0) {
+                Patch& patch = add(Patch::INSERT, path);
+                patch.index = i;
+                render(child, patch.value);
+                current.insert(current.begin() + i, -1);
+                continue;
+            }
+            uint32_t at = i;
+            while (current[at] != source[i]) at++;
+            if (at != i) {
+                Patch& patch = add(Patch::MOVE, path);
+                patch.from = at;
+                patch.index = i;
+                current.erase(current.begin() + at);
+                current.insert(current.begin() + i, source[i]);
+            }
+            path.push_back(i);
+            node(*before.children[static_cast<size_t>(source[i])], child, path);
+            path.pop_back();
+        }
+    }
+
+private:
+    Patch& add(Patch::Op op, const std::vector<uint32_t>& path) {
+        patches.emplace_back();
+        Patch& patch = patches.back();
+        patch.op = op;
+        patch.path = path;
+        return patch;
+    }
+
+    // A child's key, or its place among its unkeyed siblings
+    static std::string identity(const Node& child, uint32_t& unkeyed) {
+        if (!child.key.empty()) return "k" + std::string(child.key);
+        return "#" + std::to_string(unkeyed++);
+    }
+
+    void attributes(const Node& before, const Node& after, const std::vector<uint32_t>& path) {
+        for (const Attribute& attribute : after.attributes) {
+            const Attribute* old = find(before, attribute.name);
+            if (old && old->hasValue == attribute.hasValue && old->value == attribute.value) continue;
+            Patch& patch = add(Patch::SET, path);
+            patch.name.assign(attribute.name);
+            patch.value.assign(attribute.value);
+        }
+        for (const Attribute& attribute : before.attributes) {
+            if (!find(after, attribute.name)) add(Patch::UNSET, path).name.assign(attribute.name);
+        }
+    }
+
+    // Attributes are few per element, so a scan beats building a map
+    static const Attribute* find(const Node& node, std::string_view name) {
+        for (const Attribute& attribute : node.attributes) {
+            if (attribute.name == name) return &attribute;
+        }
+        return nullptr;
+    }
+};
+
+const char* opName(Patch::Op op) {
+    switch (op) {
+        case Patch::REPLACE: return "replace";
+        case Patch::TEXT: return "text";
+        case Patch::SET: return "set";
+        case Patch::UNSET: return "unset";
+        case Patch::INSERT: return "insert";
+        case Patch::REMOVE: return "remove";
+        default: return "move";
+    }
+}
+
+} // namespace
+
+std::vector<Patch> diff(const Tree& before, const Tree& after) {
+    Differ differ;
+    std::vector<uint32_t> path;
+    differ.children(before.root(), after.root(), path);
+    return std::move(differ.patches);
+}
+
+Value patchesValue(const std::vector<Patch>& patches) {
+    std::vector<Value> list;
+    list.reserve(patches.size());
+    for (const Patch& patch : patches) {
+        ValueMap fields;
+        fields["op"] = Value(opName(patch.op));
+        std::vector<Value> path;
+        for (uint32_t index : patch.path) {
+            path.push_back(Value(static_cast<double>(index)));
+        }
+        fields["path"] = Value(std::move(path));
+        switch (patch.op) {
+            case Patch::REPLACE:
+                fields["html"] = Value(patch.value);
+                break;
+            case Patch::TEXT:
+                fields["text"] = Value(patch.value);
+                break;
+            case Patch::SET:
+                fields["name"] = Value(patch.name);
+                fields["value"] = Value(patch.value);
+                break;
+            case Patch::UNSET:
+                fields["name"] = Value(patch.name);
+                break;
+            case Patch::INSERT:
+                fields["index"] = Value(static_cast<double>(patch.index));
+                fields["html"] = Value(patch.value);
+                break;
+            case Patch::REMOVE:
+                fields["index"] = Value(static_cast<double>(patch.index));
+                break;
+            case Patch::MOVE:
+                fields["from"] = Value(static_cast<double>(patch.from));
+                fields["index"] = Value(static_cast<double>(patch.index));
+                break;
+        }
+        list.push_back(Value(std::move(fields)));
+    }
+    return Value(std::move(list));
+}
+
+} // namespace dom
+} // namespace azalea
@@ -0,0 +1,131 @@
+#ifndef AZALEA_DOM_H
+#define AZALEA_DOM_H
+
+#include "azalea.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace azalea {
+namespace dom {
+
+// Tags the view components produce. X(enumerator, name, void element)
+#define AZALEA_DOM_TAGS(X) \
+    X(A, "a", false) X(ABBR, "abbr", false) X(ADDRESS, "address", false) \
+    X(AREA, "area", true) X(ARTICLE, "article", false) X(ASIDE, "aside", false) \
+    X(AUDIO, "audio", false) X(B, "b", false) X(BLOCKQUOTE, "blockquote", false) \
+    X(BR, "br", true) X(BUTTON, "button", false) X(CANVAS, "canvas", false) \
+    X(CAPTION, "caption", false) X(CITE, "cite", false) X(CODE, "code", false) \
+    X(COL, "col", true) X(COLGROUP, "colgroup", false) X(DATALIST, "datalist", false) \
+    X(DEL, "del", false) X(DETAILS, "details", false) X(DIV, "div", false) \
+    X(EM, "em", false) X(EMBED, "embed", true) X(FIELDSET, "fieldset", false) \
+    X(FIGCAPTION, "figcaption", false) X(FIGURE, "figure", false) \
+    X(FOOTER, "footer", false) X(FORM, "form", false) X(H1, "h1", false) \
+    X(H2, "h2", false) X(H3, "h3", false) X(H4, "h4", false) X(H5, "h5", false) \
+    X(H6, "h6", false) X(HEADER, "header", false) X(HR, "hr", true) \
+    X(I, "i", false) X(IFRAME, "iframe", false) X(IMG, "img", true) \
+    X(INPUT, "input", true) X(INS, "ins", false) X(KBD, "kbd", false) \
+    X(LABEL, "label", false) X(LEGEND, "legend", false) X(LI, "li", false) \
+    X(MAIN, "main", false) X(MARK, "mark", false) X(METER, "meter", false) \
+    X(NAV, "nav", false) X(OL, "ol", false) X(OPTION, "option", false) \
+    X(OUTPUT, "output", false) X(P, "p", false) X(PARAM, "param", true) \
+    X(PRE, "pre", false) X(PROGRESS, "progress", false) X(Q, "q", false) \
+    X(SECTION, "section", false) X(SELECT, "select", false) X(SMALL, "small", false) \
+    X(SOURCE, "source", true) X(SPAN, "span", false) X(STRONG, "strong", false) \
+    X(SUB, "sub", false) X(SUMMARY, "summary", false) X(SUP, "sup", false) \
+    X(SVG, "svg", false) X(TABLE, "table", false) X(TBODY, "tbody", false) \
+    X(TD, "td", false) X(TEXTAREA, "textarea", false) X(TFOOT, "tfoot", false) \
+    X(TH, "th", false) X(THEAD, "thead", false) X(TIME, "time", false) \
+    X(TR, "tr", false) X(TRACK, "track", true) X(U, "u", false) X(UL, "ul", false) \
+    X(VIDEO, "video", false) X(WBR, "wbr", true)
+
+enum class Tag : uint8_t {
+    TEXT,     // character data, in Node::text
+    FRAGMENT, // children only; the root of every tree
+    OTHER,    // element named by Node::name
+#define AZALEA_DOM_TAG_ENUM(tag, name, isVoid) tag,
+    AZALEA_DOM_TAGS(AZALEA_DOM_TAG_ENUM)
+#undef AZALEA_DOM_TAG_ENUM
+};
+
+Tag tagFromName(std::string_view name); // OTHER if unknown
+const char* tagName(Tag tag);           // "" for TEXT, FRAGMENT and OTHER
+
+struct Attribute {
+    std::string_view name;
+    std::string_view value;
+    bool hasValue; // false: a bare boolean attribute such as "disabled"
+};
+
+struct Node {
+    Tag tag;
+    std::string_view name; // element name, for OTHER
+    std::string_view text; // TEXT only
+    std::string_view key;  // identity among siblings for diff, "" if none
+    Span<Attribute> attributes;
+    Span<Node*> children;
+};
+
+// Element tree built from the property maps view components return
+// ({tag, content | text | items, key, any other props as attributes}).
+// Nodes and their strings live in the tree's arena.
+class Tree {
+private:
+    Arena arena;
+    Node* rootNode;
+
+    // Nodes for value appended to out; lists and tagless maps are spliced
+    // in, and adjacent text is merged as an HTML parser would merge it
+    void append(std::vector<Node*>& out, const Value& value, Tag parent);
+    Node* element(const ValueMap& props, std::string_view name);
+    Span<Node*> children(const ValueMap& props, Tag tag);
+    Span<Node*> store(const std::vector<Node*>& nodes);
+
+public:
+    explicit Tree(const Value& view);
+    Tree(const Tree&) = delete;
+    Tree& operator=(const Tree&) = delete;
+
+    const Node& root() const { return *rootNode; } // a FRAGMENT
+};
+
+// Appends node's HTML to out in one pass, escaping text and attributes
+void render(const Node& node, std::string& out);
+// &, <, > (and " in attributes) as entities
+void escapeHtml(std::string_view text, std::string& out, bool attribute);
+
+// One step turning the DOM of one tree into the other's. Paths are child
+// indices from the mount point, valid when the patch is applied, so
+// patches must be applied in order.
+struct Patch {
+    enum Op : uint8_t {
+        REPLACE, // the node at path becomes html
+        TEXT,    // the text node at path gets text
+        SET,     // attribute name = value on the element at path
+        UNSET,   // attribute name removed from the element at path
+        INSERT,  // html inserted as child index of the node at path
+        REMOVE,  // child index of the node at path removed
+        MOVE,    // child from of the node at path moved to index
+    };
+    Op op;
+    std::vector<uint32_t> path;
+    uint32_t index = 0;
+    uint32_t from = 0;
+    std::string name;
+    std::string value; // html, text or attribute value
+};
+
+// Keyed diff: siblings are matched by key, or by position among unkeyed
+// siblings, and matched nodes with the same tag are diffed recursively.
+std::vector<Patch> diff(const Tree& before, const Tree& after);
+
+// Patches as a list of maps, such as {op: "insert", path: [0, 2],
+// index: 1, html: "<li>...</li>"}; appendJson turns it into what
+// web/index.html applies
+Value patchesValue(const std::vector<Patch>& patches);
+
+} // namespace dom
+} // namespace azalea
+
+#endif // AZALEA_DOM_H
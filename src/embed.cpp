@@ -0,0 +1,206 @@
+#include "embed.h"
+#include "azalea.h"
+#include <cmath>
+
+namespace azalea {
+namespace embed {
+
+namespace {
+
+// Index + 1 is the handle; freed slots are reused
+struct Handle {
+    bool used = false;
+    Runtime::Compiled program;
+    ActPtr act;
+};
+
+std::vector<Handle> handles;
+std::vector<int> freeHandles;
+double args[MAX_ARGS];
+std::vector<Value> callArgs; // kept, so a call does not allocate them
+Value result;
+std::string resultText;
+bool resultTextReady = false;
+std::string error;
+const play::Frame* frame = nullptr; // the last azalea_play_frame drew
+std::string textureName;
+
+static_assert(sizeof(play::Batch) == 3 * sizeof(uint32_t), "the page reads batches as uint32 triples");
+
+PlayModule* playing() {
+    return static_cast<PlayModule*>(runtime().module("play").get());
+}
+
+int store(Handle handle) {
+    handle.used = true;
+    if (!freeHandles.empty()) {
+        int id = freeHandles.back();
+        freeHandles.pop_back();
+        handles[id - 1] = std::move(handle);
+        return id;
+    }
+    handles.push_back(std::move(handle));
+    return static_cast<int>(handles.size());
+}
+
+Handle* find(int id) {
+    if (id <= 0 || static_cast<size_t>(id) > handles.size() || !handles[id - 1].used) return nullptr;
+    return &handles[id - 1];
+}
+
+void setResult(Value value) {
+    result = std::move(value);
+    resultTextReady = false;
+    error.clear();
+}
+
+} // namespace
+
+const std::shared_ptr<output::Ring>& ring() {
+    static std::shared_ptr<output::Ring> shared = std::make_shared<output::Ring>(RING_CAPACITY);
+    return shared;
+}
+
+Runtime& runtime() {
+    static Runtime* shared = [] {
+        Runtime* created = new Runtime(); // never destroyed, as handles may outlive main
+        created->setOutput(ring());
+        return created;
+    }();
+    return *shared;
+}
+
+} // namespace embed
+} // namespace azalea
+
+using namespace azalea;
+
+extern "C" {
+
+AZALEA_EXPORT int azalea_compile(const char* source) {
+    try {
+        embed::Handle handle;
+        handle.program = embed::runtime().compile(source);
+        embed::error.clear();
+        return embed::store(std::move(handle));
+    } catch (const std::exception& e) {
+        embed::error = e.what();
+        return 0;
+    }
+}
+
+AZALEA_EXPORT int azalea_run(int program) {
+    embed::Handle* handle = embed::find(program);
+    if (!handle || !handle->program) {
+        embed::error = "not a program handle";
+        return 0;
+    }
+    try {
+        embed::setResult(embed::runtime().execute(handle->program));
+        return 1;
+    } catch (const std::exception& e) {
+        embed::setResult(Value());
+        embed::error = e.what();
+        return 0;
+    }
+}
+
+AZALEA_EXPORT int azalea_act(const char* name) {
+    ActPtr act = embed::runtime().getAct(name);
+    if (!act) {
+        embed::error = std::string("no act named ") + name;
+        return 0;
+    }
+    embed::Handle handle;
+    handle.act = std::move(act);
+    embed::error.clear();
+    return embed::store(std::move(handle));
+}
+
+AZALEA_EXPORT void azalea_release(int id) {
+    embed::Handle* handle = embed::find(id);
+    if (!handle) return;
+    *handle = embed::Handle();
+    embed::freeHandles.push_back(id);
+}
+
+AZALEA_EXPORT double* azalea_args() {
+    return embed::args;
+}
+
+AZALEA_EXPORT double azalea_call(int act, int count) {
+    embed::Handle* handle = embed::find(act);
+    if (!handle || !handle->act) {
+        embed::setResult(Value());
+        embed::error = "not an act handle";
+        return NAN;
+    }
+    count = std::max(0, std::min(count, embed::MAX_ARGS));
+    embed::callArgs.resize(static_cast<size_t>(count));
+    for (int i = 0; i < count; i++) embed::callArgs[i] = Value(embed::args[i]);
+    try {
+        embed::setResult(embed::runtime().call(*handle->act, embed::callArgs.data(), embed::callArgs.size()));
+    } catch (const std::exception& e) {
+        embed::setResult(Value());
+        embed::error = e.what();
+        return NAN;
+    }
+    return embed::result.type == ValueType::NUM ? embed::result.num : NAN;
+}
+
+AZALEA_EXPORT int azalea_result_type() {
+    return static_cast<int>(embed::result.type);
+}
+
+AZALEA_EXPORT double azalea_result_number() {
+    return embed::result.toNumber();
+}
+
+AZALEA_EXPORT const char* azalea_result_text() {
+    if (!embed::resultTextReady) {
+        embed::resultText = embed::result.toString();
+        embed::resultTextReady = true;
+    }
+    return embed::resultText.c_str();
+}
+
+AZALEA_EXPORT const char* azalea_error() {
+    return embed::error.c_str();
+}
+
+AZALEA_EXPORT const void* azalea_output_ring() {
+    return embed::ring()->shared();
+}
+
+AZALEA_EXPORT int azalea_play_frame(double seconds) {
+    PlayModule* play = embed::playing();
+    if (!play) {
+        embed::error = "no play module";
+        return -1;
+    }
+    try {
+        play->tick(embed::runtime(), seconds);
+        embed::frame = &play->render();
+        embed::error.clear();
+        return static_cast<int>(embed::frame->batches.size());
+    } catch (const std::exception& e) {
+        embed::error = e.what();
+        return -1;
+    }
+}
+
+AZALEA_EXPORT const uint32_t* azalea_play_batches() {
+    return embed::frame ? reinterpret_cast<const uint32_t*>(embed::frame->batches.data()) : nullptr;
+}
+
+AZALEA_EXPORT const float* azalea_play_instances() {
+    return embed::frame ? embed::frame->instances.data() : nullptr;
+}
+
+AZALEA_EXPORT const char* azalea_play_texture(int texture) {
+    PlayModule* play = embed::playing();
+    embed::textureName = play && texture > 0 ? play->texture(static_cast<uint32_t>(texture)) : std::string();
+    return embed::textureName.c_str();
+}
+
+} // extern "C"
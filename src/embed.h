@@ -0,0 +1,102 @@
+#ifndef AZALEA_EMBED_H
+#define AZALEA_EMBED_H
+
+// C API for hosts that embed the interpreter, above all the WASM page and
+// the serverless handler. Programs are compiled once to a handle and run
+// by handle; acts a program defined are called by handle with numbers
+// read straight from linear memory; say writes into a ring in linear
+// memory that the host reads in place. Nothing returned needs freeing.
+//
+// From JS:
+//   const compile = Module.cwrap('azalea_compile', 'number', ['string'])
+//   const act = Module.cwrap('azalea_act', 'number', ['string'])
+//   const program = compile(source)       // 0: see azalea_error()
+//   Module._azalea_run(program)
+//   const add = act('add')
+//   const args = Module._azalea_args() >> 3
+//   Module.HEAPF64[args] = 2
+//   Module.HEAPF64[args + 1] = 3
+//   const sum = Module._azalea_call(add, 2)
+// and, after any of them, the new output is the bytes between the ring
+// header's read and written counters (see output::Ring); setting read to
+// written marks them read.
+//
+// Every handle belongs to one runtime, shared with azalea_execute and
+// azalea_view, and is only for the thread that made it.
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#define AZALEA_EXPORT EMSCRIPTEN_KEEPALIVE
+#else
+#define AZALEA_EXPORT
+#endif
+
+namespace azalea {
+
+class Runtime;
+namespace output {
+class Ring;
+}
+
+namespace embed {
+
+constexpr int MAX_ARGS = 16;            // numbers azalea_args() holds
+constexpr size_t RING_CAPACITY = 1 << 16; // bytes of output the host can fall behind by
+
+Runtime& runtime(); // created on first use, printing into ring()
+const std::shared_ptr<output::Ring>& ring();
+
+} // namespace embed
+} // namespace azalea
+
+extern "C" {
+
+// Handle for source compiled in the shared runtime, or 0 with the reason
+// in azalea_error()
+AZALEA_EXPORT int azalea_compile(const char* source);
+// Runs a compiled program; 1, with its value as the result, or 0 on error
+AZALEA_EXPORT int azalea_run(int program);
+// Handle for an act a program that ran defined, or 0 if there is none
+AZALEA_EXPORT int azalea_act(const char* name);
+// Frees a program or act handle
+AZALEA_EXPORT void azalea_release(int handle);
+
+// MAX_ARGS doubles the next azalea_call passes to the act
+AZALEA_EXPORT double* azalea_args();
+// Calls the act with the first count numbers from azalea_args(). The
+// result as a number (NaN if it is not one, or on error); the whole
+// result is kept for azalea_result_*
+AZALEA_EXPORT double azalea_call(int act, int count);
+
+// The last result of azalea_run or azalea_call
+AZALEA_EXPORT int azalea_result_type(); // 0 num, 1 bool, 2 void, 3 text, 4 list, 5 map, 6 func
+AZALEA_EXPORT double azalea_result_number();
+// As text, valid until the next call into the API
+AZALEA_EXPORT const char* azalea_result_text();
+// Why the last call failed, or ""
+AZALEA_EXPORT const char* azalea_error();
+
+// The output ring: four uint32 (capacity, written, read, dropped; see
+// output::Ring) followed by capacity bytes
+AZALEA_EXPORT const void* azalea_output_ring();
+
+// The play module's frames (see play.h), for the page to run on
+// requestAnimationFrame: the steps due seconds after the last frame, then
+// a render. Gives how many batches it drew, or -1 with the reason in
+// azalea_error()
+AZALEA_EXPORT int azalea_play_frame(double seconds);
+// The last frame's batches, three uint32 each: texture, first instance and
+// instance count; and its instances, four floats each: x, y, width and
+// height. Both are valid until the next azalea_play_frame
+AZALEA_EXPORT const uint32_t* azalea_play_batches();
+AZALEA_EXPORT const float* azalea_play_instances();
+// The name `play texture` registered texture under (an image URL), or ""
+AZALEA_EXPORT const char* azalea_play_texture(int texture);
+
+} // extern "C"
+
+#endif // AZALEA_EMBED_H
@@ -0,0 +1,374 @@
+#include "files.h"
+#include "mapped_file.h"
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef AZALEA_FILES_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace azalea {
+namespace files {
+
+namespace {
+
+// Files some view still maps, by identity, so writes can avoid changing
+// them under it
+std::mutex mappedMutex;
+std::map<std::pair<dev_t, ino_t>, std::weak_ptr<const MappedFile>> mappedFiles;
+
+bool isMapped(const struct stat& info) {
+    std::lock_guard<std::mutex> lock(mappedMutex);
+    auto found = mappedFiles.find({info.st_dev, info.st_ino});
+    return found != mappedFiles.end() && !found->second.expired();
+}
+
+void remember(const struct stat& info, const std::shared_ptr<const MappedFile>& file) {
+    std::lock_guard<std::mutex> lock(mappedMutex);
+    for (auto it = mappedFiles.begin(); it != mappedFiles.end();) {
+        it = it->second.expired() ? mappedFiles.erase(it) : std::next(it);
+    }
+    mappedFiles[{info.st_dev, info.st_ino}] = file;
+}
+
+Value mapFile(const std::string& path, const struct stat& info) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->open(path.c_str())) return Value(false);
+    remember(info, file);
+    std::string_view chars(file->data ? file->data : "", file->size);
+    return Value::view(chars, std::move(file));
+}
+
+// The rest of fd from offset into out; false on a read error
+bool readRest(int fd, std::string& out, size_t offset) {
+    while (true) {
+        if (out.size() - offset < 4096) out.resize(std::max<size_t>(out.size() * 2, offset + 65536));
+        ssize_t n = ::pread(fd, &out[offset], out.size() - offset, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return false;
+        if (n == 0) break;
+        offset += static_cast<size_t>(n);
+    }
+    out.resize(offset);
+    return true;
+}
+
+bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+    return true;
+}
+
+#ifdef AZALEA_FILES_URING
+
+// Just enough of an io_uring to queue operations and wait for all of them
+class Ring {
+private:
+    int fd = -1;
+    void* sqRing = MAP_FAILED;
+    void* cqRing = MAP_FAILED;
+    size_t sqSize = 0, cqSize = 0;
+    io_uring_sqe* sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t sqesSize = 0;
+    unsigned *sqTail = nullptr, *sqMask = nullptr, *sqArray = nullptr;
+    unsigned *cqHead = nullptr, *cqTail = nullptr, *cqMask = nullptr;
+    io_uring_cqe* cqes = nullptr;
+    unsigned queued = 0;
+
+    template <class T>
+    static T* at(void* base, unsigned offset) {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+
+public:
+    bool open(unsigned entries) {
+        io_uring_params params = {};
+        fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) return false;
+        sqSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single) sqSize = cqSize = std::max(sqSize, cqSize);
+        sqRing = mmap(nullptr, sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) return false;
+        cqRing = single ? sqRing
+                        : mmap(nullptr, cqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) return false;
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe*>(
+            mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES));
+        if (sqes == MAP_FAILED) return false;
+        sqTail = at<unsigned>(sqRing, params.sq_off.tail);
+        sqMask = at<unsigned>(sqRing, params.sq_off.ring_mask);
+        sqArray = at<unsigned>(sqRing, params.sq_off.array);
+        cqHead = at<unsigned>(cqRing, params.cq_off.head);
+        cqTail = at<unsigned>(cqRing, params.cq_off.tail);
+        cqMask = at<unsigned>(cqRing, params.cq_off.ring_mask);
+        cqes = at<io_uring_cqe>(cqRing, params.cq_off.cqes);
+        return true;
+    }
+
+    ~Ring() {
+        if (sqes != MAP_FAILED) munmap(sqes, sqesSize);
+        if (cqRing != MAP_FAILED && cqRing != sqRing) munmap(cqRing, cqSize);
+        if (sqRing != MAP_FAILED) munmap(sqRing, sqSize);
+        if (fd >= 0) ::close(fd);
+    }
+
+    // A cleared entry for the next operation, tagged with tag
+    io_uring_sqe& queue(uint64_t tag) {
+        unsigned tail = *sqTail + queued;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe& sqe = sqes[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.user_data = tag;
+        sqArray[index] = index;
+        queued++;
+        return sqe;
+    }
+
+    // Submits what is queued and calls done(tag, result) as each completes
+    template <class Done>
+    bool run(Done&& done) {
+        unsigned count = queued;
+        __atomic_store_n(sqTail, *sqTail + queued, __ATOMIC_RELEASE);
+        unsigned submit = queued;
+        queued = 0;
+        while (count > 0) {
+            long entered = syscall(__NR_io_uring_enter, fd, submit, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (entered < 0 && errno != EINTR) return false;
+            if (entered > 0) submit -= std::min<unsigned>(submit, static_cast<unsigned>(entered));
+            unsigned head = *cqHead;
+            while (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const io_uring_cqe& cqe = cqes[head & *cqMask];
+                done(cqe.user_data, cqe.res);
+                head++;
+                count--;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+        }
+        return true;
+    }
+};
+
+// Opens, reads and closes up to URING_DEPTH small files at once: one
+// io_uring_enter per step instead of a system call per file per step. A
+// file any step fails for is left void, for the caller to read plainly.
+void ringRead(Ring& ring, const std::vector<std::string>& paths, size_t first, size_t count,
+              std::vector<Value>& out) {
+    std::vector<int> fds(count, -1);
+    for (size_t i = 0; i < count; i++) {
+        io_uring_sqe& sqe = ring.queue(i);
+        sqe.opcode = IORING_OP_OPENAT;
+        sqe.fd = AT_FDCWD;
+        sqe.addr = reinterpret_cast<uint64_t>(paths[first + i].c_str());
+        sqe.open_flags = O_RDONLY | O_CLOEXEC;
+    }
+    if (!ring.run([&](uint64_t i, int result) { fds[i] = result; })) return;
+
+    std::vector<std::string> contents(count);
+    size_t reads = 0;
+    for (size_t i = 0; i < count; i++) {
+        struct stat info;
+        if (fds[i] < 0 || fstat(fds[i], &info) != 0 || !S_ISREG(info.st_mode)) continue;
+        size_t size = static_cast<size_t>(info.st_size);
+        if (size >= MAP_MIN) {
+            out[first + i] = mapFile(paths[first + i], info);
+            continue;
+        }
+        // One byte over, so a file that grew shows up as a full read
+        contents[i].resize(size + 1);
+        io_uring_sqe& sqe = ring.queue(i);
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = fds[i];
+        sqe.addr = reinterpret_cast<uint64_t>(&contents[i][0]);
+        sqe.len = static_cast<uint32_t>(contents[i].size());
+        reads++;
+    }
+    if (reads > 0) {
+        ring.run([&](uint64_t i, int result) {
+            if (result < 0) return;
+            size_t got = static_cast<size_t>(result);
+            bool done = got < contents[i].size() || readRest(fds[i], contents[i], got);
+            if (done && got < contents[i].size()) contents[i].resize(got);
+            if (done) out[first + i] = Value(std::move(contents[i]));
+        });
+    }
+
+    size_t closes = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (fds[i] < 0) continue;
+        io_uring_sqe& sqe = ring.queue(i);
+        sqe.opcode = IORING_OP_CLOSE;
+        sqe.fd = fds[i];
+        closes++;
+    }
+    if (closes > 0) {
+        ring.run([&](uint64_t i, int result) {
+            if (result >= 0) fds[i] = -1; // older kernels cannot close here
+        });
+    }
+    for (int fd : fds) {
+        if (fd >= 0) ::close(fd);
+    }
+}
+
+#endif // AZALEA_FILES_URING
+
+} // namespace
+
+Value read(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return Value(false);
+    struct stat info;
+    if (fstat(fd, &info) != 0 || S_ISDIR(info.st_mode)) {
+        ::close(fd);
+        return Value(false);
+    }
+    if (S_ISREG(info.st_mode) && static_cast<size_t>(info.st_size) >= MAP_MIN) {
+        ::close(fd);
+        return mapFile(path, info);
+    }
+    std::string content(static_cast<size_t>(info.st_size), '\0');
+    bool ok = readRest(fd, content, 0);
+    ::close(fd);
+    return ok ? Value(std::move(content)) : Value(false);
+}
+
+std::vector<Value> readAll(const std::vector<std::string>& paths) {
+    std::vector<Value> out(paths.size());
+#ifdef AZALEA_FILES_URING
+    if (paths.size() > 1) {
+        Ring ring;
+        if (ring.open(static_cast<unsigned>(URING_DEPTH))) {
+            for (size_t first = 0; first < paths.size(); first += URING_DEPTH) {
+                ringRead(ring, paths, first, std::min(URING_DEPTH, paths.size() - first), out);
+            }
+        }
+    }
+#endif
+    for (size_t i = 0; i < paths.size(); i++) {
+        if (out[i].type == ValueType::VOID) out[i] = read(paths[i]);
+    }
+    return out;
+}
+
+bool write(const std::string& path, std::string_view data) {
+    struct stat info;
+    bool replace = stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode) && isMapped(info);
+    std::string target = replace ? path + ".tmp" + std::to_string(getpid()) : path;
+    int fd = ::open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, data);
+    if (replace) fchmod(fd, info.st_mode & 07777);
+    ok = ::close(fd) == 0 && ok;
+    if (replace) {
+        ok = ok && std::rename(target.c_str(), path.c_str()) == 0;
+        if (!ok) ::unlink(target.c_str());
+    }
+    return ok;
+}
+
+long long lines(const std::string& path, const std::function<bool(std::string_view line)>& each) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    std::vector<char> buffer(STREAM_BUFFER);
+    std::string carry; // a line the buffer ended inside of
+    long long count = 0;
+    bool going = true;
+    auto emit = [&](std::string_view line) {
+        if (!line.empty() && line.back() == '\r') line.remove_suffix(1);
+        count++;
+        going = each(line);
+    };
+    while (going) {
+        ssize_t n = ::read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        std::string_view data(buffer.data(), static_cast<size_t>(n));
+        size_t start = 0;
+        while (going) {
+            const void* found = std::memchr(data.data() + start, '\n', data.size() - start);
+            if (!found) break;
+            size_t end = static_cast<size_t>(static_cast<const char*>(found) - data.data());
+            if (carry.empty()) {
+                emit(data.substr(start, end - start));
+            } else {
+                carry.append(data, start, end - start);
+                emit(carry);
+                carry.clear();
+            }
+            start = end + 1;
+        }
+        if (going) carry.append(data, start, std::string_view::npos);
+    }
+    if (going && !carry.empty()) emit(carry);
+    ::close(fd);
+    return count;
+}
+
+long long chunks(const std::string& path, size_t size, const std::function<bool(std::string_view chunk)>& each) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    std::vector<char> buffer(size > 0 ? size : STREAM_BUFFER);
+    long long count = 0;
+    while (true) {
+        size_t used = 0;
+        while (used < buffer.size()) {
+            ssize_t n = ::read(fd, buffer.data() + used, buffer.size() - used);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            used += static_cast<size_t>(n);
+        }
+        if (used == 0) break;
+        count++;
+        if (!each(std::string_view(buffer.data(), used)) || used < buffer.size()) break;
+    }
+    ::close(fd);
+    return count;
+}
+
+Appender::Appender(const std::string& path) {
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0666);
+}
+
+Appender::~Appender() {
+    if (fd < 0) return;
+    flush();
+    ::close(fd);
+}
+
+bool Appender::append(std::string_view data) {
+    if (fd < 0) return false;
+    if (pending.size() + data.size() < STREAM_BUFFER) {
+        pending.append(data);
+        return true;
+    }
+    bool ok = flush();
+    if (data.size() >= STREAM_BUFFER) return writeAll(fd, data) && ok;
+    pending.append(data);
+    return ok;
+}
+
+bool Appender::flush() {
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, pending);
+    pending.clear();
+    return ok;
+}
+
+} // namespace files
+} // namespace azalea
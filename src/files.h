@@ -0,0 +1,64 @@
+#ifndef AZALEA_FILES_H
+#define AZALEA_FILES_H
+
+#include "azalea.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Batch reads go through io_uring where the kernel headers have it; the
+// reader still falls back to plain reads if the kernel refuses a ring
+#if defined(__linux__) && !defined(__EMSCRIPTEN__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define AZALEA_FILES_URING 1
+#endif
+#endif
+
+namespace azalea {
+namespace files {
+
+constexpr size_t MAP_MIN = 64 * 1024;     // files this big are mapped, not read
+constexpr size_t STREAM_BUFFER = 64 * 1024; // for lines and chunks
+constexpr size_t URING_DEPTH = 64;         // files in flight per batch
+
+// The file as TEXT: a view sharing its mapping when it is at least
+// MAP_MIN bytes, read into a string otherwise; false if it cannot be read
+Value read(const std::string& path);
+// Every file, in order, as read gives it. Small files are opened, read
+// and closed in batches of URING_DEPTH with one system call per step.
+std::vector<Value> readAll(const std::vector<std::string>& paths);
+
+// Replaces the file's contents. A file some view still maps is replaced
+// by renaming a new file over it, so the view keeps the old contents.
+bool write(const std::string& path, std::string_view data);
+
+// Calls each with every line (without its line break) or every chunk of
+// up to size bytes, reading through one buffer; stops early when each
+// returns false. The number of calls, or -1 if the file cannot be read.
+long long lines(const std::string& path, const std::function<bool(std::string_view line)>& each);
+long long chunks(const std::string& path, size_t size, const std::function<bool(std::string_view chunk)>& each);
+
+// Appends to a file through a buffer, written out once it holds
+// STREAM_BUFFER bytes, on flush, and when the appender is destroyed
+class Appender {
+private:
+    int fd = -1;
+    std::string pending;
+
+public:
+    explicit Appender(const std::string& path);
+    ~Appender();
+    Appender(const Appender&) = delete;
+    Appender& operator=(const Appender&) = delete;
+
+    bool isOpen() const { return fd >= 0; }
+    bool append(std::string_view data);
+    bool flush();
+};
+
+} // namespace files
+} // namespace azalea
+
+#endif // AZALEA_FILES_H
@@ -0,0 +1,414 @@
+#ifndef AZALEA_FLAT_MAP_H
+#define AZALEA_FLAT_MAP_H
+
+#include "hash.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace azalea {
+
+inline uint32_t hashKey(std::string_view text) {
+    return static_cast<uint32_t>(hashBytes(text.data(), text.size()));
+}
+
+// A key with its hash worked out once, for a lookup made over and over
+// with the same key: a property name in C++, an act name in compiled code
+struct MapKey {
+    std::string_view text;
+    uint32_t hash;
+
+    MapKey(std::string_view key) : text(key), hash(hashKey(key)) {}
+    MapKey(std::string_view key, uint32_t keyHash) : text(key), hash(keyHash) {}
+    MapKey(const char* key) : MapKey(std::string_view(key)) {}
+    MapKey(const std::string& key) : MapKey(std::string_view(key)) {}
+};
+
+// Where a lookup from one place last found its key (an inline cache). It
+// hits when the map had the same keys inserted in the same order as the
+// last one, as maps built by the same component function do; the entry is
+// then loaded by index once its key is checked, so a stale cache only
+// costs the ordinary lookup. Safe to share between threads.
+class MapCache {
+private:
+    friend struct MapShape;
+    std::atomic<uint64_t> packed{0}; // shape << INDEX_BITS | index + 1
+
+public:
+    MapCache() = default;
+    MapCache(const MapCache& other) : packed(other.packed.load(std::memory_order_relaxed)) {}
+    MapCache& operator=(const MapCache& other) {
+        packed.store(other.packed.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        return *this;
+    }
+};
+
+// The part of a map's shape a cache keeps, next to the entry index
+struct MapShape {
+    static constexpr int INDEX_BITS = 24;
+    static constexpr uint64_t INDEX_MASK = (1ull << INDEX_BITS) - 1;
+
+    static uint64_t next(uint64_t shape, uint32_t keyHash) {
+        return hashing::mix(shape ^ keyHash, hashing::P2);
+    }
+    // Index + 1 of the cached entry if the cache was filled for this shape
+    static uint32_t cached(const MapCache& cache, uint64_t shape) {
+        uint64_t packed = cache.packed.load(std::memory_order_relaxed);
+        return (packed >> INDEX_BITS) == (shape >> INDEX_BITS) ? static_cast<uint32_t>(packed & INDEX_MASK) : 0;
+    }
+    static void fill(MapCache& cache, uint64_t shape, size_t index) {
+        if (index >= INDEX_MASK) return;
+        cache.packed.store(((shape >> INDEX_BITS) << INDEX_BITS) | (index + 1), std::memory_order_relaxed);
+    }
+};
+
+// String-keyed map kept in one array of entries in insertion order. Small
+// maps are searched linearly by hash; larger ones through an open-
+// addressing index with linear probing. It iterates in key order, as
+// std::map does, so everything printed from a map comes out the same
+// whatever order it was built in. Erasing leaves the entry behind, marked,
+// until erased entries are half the array, when it is compacted; the key
+// order is sorted when the map is next iterated, so inserts and erases in
+// any order stay cheap. References to entries stay valid until the next
+// insert or erase.
+//
+// Iterating (or ++ on what find returned) can sort the key order, so a
+// map read by several threads at once must have sortKeys() called first.
+// Copies, and maps built from an initializer_list, come sorted.
+template <typename V>
+class FlatMap {
+public:
+    using key_type = std::string;
+    using mapped_type = V;
+    using value_type = std::pair<std::string, V>;
+    static constexpr size_t LINEAR = 8; // entries searched without the index
+
+private:
+    struct Entry {
+        value_type item;
+        uint32_t hash;
+        bool erased = false; // its value is released; the key stays for the key order
+    };
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    std::vector<Entry> entries;
+    size_t erasedCount = 0;
+    // Entry indices, erased ones included: in key order up to sortedUpTo,
+    // then in insertion order
+    mutable std::vector<uint32_t> order;
+    mutable size_t sortedUpTo = 0;
+    std::vector<uint32_t> slots; // entry index + 1, or 0 when free; empty up to LINEAR entries
+    uint64_t shape = hashing::P0; // the keys, in the order they were inserted and erased
+
+    uint32_t locate(std::string_view key, uint32_t hash) const {
+        if (slots.empty()) {
+            for (size_t i = 0; i < entries.size(); i++) {
+                const Entry& entry = entries[i];
+                if (entry.hash == hash && !entry.erased && entry.item.first == key) return static_cast<uint32_t>(i);
+            }
+            return NONE;
+        }
+        size_t mask = slots.size() - 1;
+        for (size_t s = hash & mask;; s = (s + 1) & mask) {
+            uint32_t slot = slots[s];
+            if (slot == 0) return NONE;
+            const Entry& entry = entries[slot - 1];
+            if (entry.hash == hash && !entry.erased && entry.item.first == key) return slot - 1;
+        }
+    }
+
+    void index(uint32_t i) {
+        size_t mask = slots.size() - 1;
+        size_t s = entries[i].hash & mask;
+        while (slots[s] != 0) s = (s + 1) & mask;
+        slots[s] = i + 1;
+    }
+
+    // Erased entries are left out, so their slots are freed
+    void reindex() {
+        slots.clear();
+        if (entries.size() <= LINEAR) return;
+        size_t size = 16;
+        while (size < entries.size() * 2) size <<= 1;
+        slots.assign(size, 0);
+        for (uint32_t i = 0; i < entries.size(); i++) {
+            if (!entries[i].erased) index(i);
+        }
+    }
+
+    bool before(uint32_t a, uint32_t b) const { return entries[a].item.first < entries[b].item.first; }
+
+    uint32_t add(std::string key, uint32_t hash, V value) {
+        if (erasedCount * 2 > entries.size()) compact();
+        uint32_t i = static_cast<uint32_t>(entries.size());
+        entries.push_back(Entry{value_type(std::move(key), std::move(value)), hash});
+        shape = MapShape::next(shape, hash);
+        // Built in key order, as copies of other maps are, this stays sorted
+        if (sortedUpTo == order.size() && (order.empty() || before(order.back(), i))) sortedUpTo++;
+        order.push_back(i);
+        if (entries.size() > LINEAR) {
+            if (slots.size() < entries.size() * 2) {
+                reindex();
+            } else {
+                index(i);
+            }
+        }
+        return i;
+    }
+
+    // compact: false keeps every entry index and order position, for
+    // erase(iterator) to go on from
+    void removeAt(uint32_t i, bool compact) {
+        Entry& entry = entries[i];
+        entry.erased = true;
+        entry.item.second = V();
+        erasedCount++;
+        shape = MapShape::next(shape, ~entry.hash);
+        if (compact && erasedCount * 2 > entries.size()) this->compact();
+    }
+
+    void compact() {
+        std::vector<uint32_t> moved(entries.size(), NONE);
+        size_t kept = 0;
+        shape = hashing::P0;
+        for (size_t i = 0; i < entries.size(); i++) {
+            if (entries[i].erased) continue;
+            if (kept != i) entries[kept] = std::move(entries[i]);
+            moved[i] = static_cast<uint32_t>(kept++);
+            shape = MapShape::next(shape, entries[kept - 1].hash);
+        }
+        entries.resize(kept);
+        erasedCount = 0;
+        // Dropping entries keeps the rest in the order they were in
+        size_t sorted = 0, at = 0;
+        for (size_t i = 0; i < order.size(); i++) {
+            uint32_t e = moved[order[i]];
+            if (e == NONE) continue;
+            if (i < sortedUpTo) sorted++;
+            order[at++] = e;
+        }
+        order.resize(at);
+        sortedUpTo = sorted;
+        reindex();
+    }
+
+    // Sorts what was inserted out of key order into the rest
+    void sortOrder() const {
+        if (sortedUpTo == order.size()) return;
+        auto byKey = [this](uint32_t a, uint32_t b) { return before(a, b); };
+        auto middle = order.begin() + static_cast<std::ptrdiff_t>(sortedUpTo);
+        std::sort(middle, order.end(), byKey);
+        std::inplace_merge(order.begin(), middle, order.end(), byKey);
+        sortedUpTo = order.size();
+    }
+
+    // The first position in the key order from at whose entry is not erased
+    size_t live(size_t at) const {
+        while (at < order.size() && entries[order[at]].erased) at++;
+        return at;
+    }
+
+    // Position of entry i in key order
+    size_t rank(uint32_t i) const {
+        sortOrder();
+        const std::string& key = entries[i].item.first;
+        size_t at = static_cast<size_t>(std::lower_bound(order.begin(), order.end(), key, [this](uint32_t e, const std::string& k) {
+            return entries[e].item.first < k;
+        }) - order.begin());
+        while (order[at] != i) at++; // past erased entries with the same key
+        return at;
+    }
+
+    size_t first() const {
+        sortOrder();
+        return live(0);
+    }
+    uint32_t entryAt(size_t at) const { return at < order.size() ? order[at] : NONE; }
+
+    template <bool Const>
+    class Iterator {
+    private:
+        friend class FlatMap;
+        using Map = std::conditional_t<Const, const FlatMap, FlatMap>;
+        Map* map;
+        uint32_t entry; // NONE at the end
+        size_t at;      // in order; NONE until needed, for what find returns
+
+        Iterator(Map* m, uint32_t e, size_t a) : map(m), entry(e), at(a) {}
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename FlatMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = std::conditional_t<Const, const value_type&, value_type&>;
+        using pointer = std::conditional_t<Const, const value_type*, value_type*>;
+
+        Iterator() : map(nullptr), entry(NONE), at(0) {}
+        operator Iterator<true>() const { return Iterator<true>(map, entry, at); }
+
+        reference operator*() const { return map->entries[entry].item; }
+        pointer operator->() const { return &map->entries[entry].item; }
+        Iterator& operator++() {
+            if (at == NONE) at = map->rank(entry);
+            at = map->live(at + 1);
+            entry = map->entryAt(at);
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator before = *this;
+            ++*this;
+            return before;
+        }
+        bool operator==(const Iterator& other) const { return entry == other.entry; }
+        bool operator!=(const Iterator& other) const { return entry != other.entry; }
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatMap() = default;
+    FlatMap(std::initializer_list<value_type> items) {
+        for (const value_type& item : items) emplace(item.first, item.second);
+        sortOrder();
+    }
+    FlatMap(const FlatMap& other)
+        : entries(other.entries), erasedCount(other.erasedCount), order(other.order), sortedUpTo(other.sortedUpTo),
+          slots(other.slots), shape(other.shape) {
+        sortOrder();
+    }
+    FlatMap(FlatMap&&) = default;
+    FlatMap& operator=(const FlatMap& other) {
+        if (this != &other) {
+            FlatMap copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+    FlatMap& operator=(FlatMap&&) = default;
+
+    // Sorts the key order now, so iterating no longer writes to the map
+    void sortKeys() const { sortOrder(); }
+
+    size_t size() const { return entries.size() - erasedCount; }
+    bool empty() const { return size() == 0; }
+    void clear() {
+        entries.clear();
+        erasedCount = 0;
+        order.clear();
+        sortedUpTo = 0;
+        slots.clear();
+        shape = hashing::P0;
+    }
+    void reserve(size_t count) {
+        entries.reserve(count);
+        order.reserve(count);
+    }
+
+    iterator begin() {
+        size_t at = first();
+        return iterator(this, entryAt(at), at);
+    }
+    iterator end() { return iterator(this, NONE, 0); }
+    const_iterator begin() const {
+        size_t at = first();
+        return const_iterator(this, entryAt(at), at);
+    }
+    const_iterator end() const { return const_iterator(this, NONE, 0); }
+
+    iterator find(const MapKey& key) { return iterator(this, locate(key.text, key.hash), NONE); }
+    const_iterator find(const MapKey& key) const { return const_iterator(this, locate(key.text, key.hash), NONE); }
+    size_t count(const MapKey& key) const { return locate(key.text, key.hash) == NONE ? 0 : 1; }
+
+    // The value under key, or nullptr; the cache remembers where it was
+    // for the next lookup from the same place
+    V* lookup(const MapKey& key, MapCache& cache) {
+        uint32_t cached = MapShape::cached(cache, shape);
+        if (cached != 0 && cached <= entries.size()) {
+            Entry& entry = entries[cached - 1];
+            if (entry.hash == key.hash && !entry.erased && entry.item.first == key.text) return &entry.item.second;
+        }
+        uint32_t i = locate(key.text, key.hash);
+        if (i == NONE) return nullptr;
+        MapShape::fill(cache, shape, i);
+        return &entries[i].item.second;
+    }
+    const V* lookup(const MapKey& key, MapCache& cache) const {
+        return const_cast<FlatMap*>(this)->lookup(key, cache);
+    }
+
+    V& at(const MapKey& key) {
+        uint32_t i = locate(key.text, key.hash);
+        if (i == NONE) throw std::out_of_range("no entry " + std::string(key.text));
+        return entries[i].item.second;
+    }
+    const V& at(const MapKey& key) const { return const_cast<FlatMap*>(this)->at(key); }
+
+    V& operator[](const MapKey& key) {
+        uint32_t i = locate(key.text, key.hash);
+        if (i == NONE) i = add(std::string(key.text), key.hash, V());
+        return entries[i].item.second;
+    }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(std::string key, Args&&... args) {
+        uint32_t hash = hashKey(key);
+        uint32_t i = locate(key, hash);
+        if (i != NONE) return {iterator(this, i, NONE), false};
+        i = add(std::move(key), hash, V(std::forward<Args>(args)...));
+        return {iterator(this, i, NONE), true};
+    }
+    // The hint is ignored; inserts in key order append anyway
+    template <typename... Args>
+    iterator emplace_hint(const_iterator, std::string key, Args&&... args) {
+        return emplace(std::move(key), std::forward<Args>(args)...).first;
+    }
+    std::pair<iterator, bool> insert(value_type item) {
+        return emplace(std::move(item.first), std::move(item.second));
+    }
+    template <typename M>
+    std::pair<iterator, bool> insert_or_assign(std::string key, M&& value) {
+        uint32_t hash = hashKey(key);
+        uint32_t i = locate(key, hash);
+        if (i != NONE) {
+            entries[i].item.second = std::forward<M>(value);
+            return {iterator(this, i, NONE), false};
+        }
+        i = add(std::move(key), hash, V(std::forward<M>(value)));
+        return {iterator(this, i, NONE), true};
+    }
+
+    size_t erase(const MapKey& key) {
+        uint32_t i = locate(key.text, key.hash);
+        if (i == NONE) return 0;
+        removeAt(i, true);
+        return 1;
+    }
+    // Leaves the map uncompacted, so erasing while iterating stays linear;
+    // the next insert or erase by key compacts it
+    iterator erase(const_iterator position) {
+        const_iterator next = position;
+        ++next;
+        removeAt(position.entry, false);
+        return iterator(this, next.entry, next.at);
+    }
+
+    bool operator==(const FlatMap& other) const {
+        if (size() != other.size()) return false;
+        for (auto a = begin(), b = other.begin(); a != end(); ++a, ++b) {
+            if (a->first != b->first || !(a->second == b->second)) return false;
+        }
+        return true;
+    }
+    bool operator!=(const FlatMap& other) const { return !(*this == other); }
+};
+
+} // namespace azalea
+
+#endif // AZALEA_FLAT_MAP_H
@@ -0,0 +1,77 @@
+#ifndef AZALEA_HASH_H
+#define AZALEA_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace azalea {
+
+// Fast non-cryptographic 64-bit hash in the wyhash family: eight bytes at
+// a time, each pair folded with a 64x64->128 multiply. Good enough to key
+// caches on whole source files; not for anything adversarial.
+namespace hashing {
+
+constexpr uint64_t P0 = 0xa0761d6478bd642full;
+constexpr uint64_t P1 = 0xe7037ed1a0b428dbull;
+constexpr uint64_t P2 = 0x8ebc6af09c88c6e3ull;
+
+inline uint64_t mix(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t product = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(product) ^ static_cast<uint64_t>(product >> 64);
+#else
+    // Portable 64x64->128 from 32-bit halves
+    uint64_t ha = a >> 32, la = static_cast<uint32_t>(a);
+    uint64_t hb = b >> 32, lb = static_cast<uint32_t>(b);
+    uint64_t hh = ha * hb, hl = ha * lb, lh = la * hb, ll = la * lb;
+    uint64_t mid = (ll >> 32) + static_cast<uint32_t>(hl) + static_cast<uint32_t>(lh);
+    uint64_t lo = (mid << 32) | static_cast<uint32_t>(ll);
+    uint64_t hi = hh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+    return lo ^ hi;
+#endif
+}
+
+inline uint64_t read64(const unsigned char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Up to eight trailing bytes, zero-padded
+inline uint64_t readTail(const unsigned char* p, size_t n) {
+    uint64_t v = 0;
+    std::memcpy(&v, p, n);
+    return v;
+}
+
+} // namespace hashing
+
+inline uint64_t hashBytes(const void* data, size_t size, uint64_t seed = 0) {
+    using namespace hashing;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ mix(seed ^ P0, P1) ^ size;
+    size_t n = size;
+    while (n >= 16) {
+        h = mix(read64(p) ^ P1, read64(p + 8) ^ h);
+        p += 16;
+        n -= 16;
+    }
+    uint64_t a = 0, b = 0;
+    if (n > 8) {
+        a = read64(p);
+        b = readTail(p + 8, n - 8);
+    } else if (n > 0) {
+        a = readTail(p, n);
+    }
+    return mix(P1 ^ size, mix(a ^ P1, b ^ h) ^ P2);
+}
+
+inline uint64_t hashBytes(std::string_view text, uint64_t seed = 0) {
+    return hashBytes(text.data(), text.size(), seed);
+}
+
+} // namespace azalea
+
+#endif // AZALEA_HASH_H
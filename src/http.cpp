@@ -0,0 +1,728 @@
+#include "http.h"
+#include "markdown.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+
+#ifdef AZALEA_HTTP_SERVER
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#endif
+#ifdef AZALEA_HTTP_EPOLL
+#include <sys/epoll.h>
+#include <sys/sendfile.h>
+#endif
+#ifdef AZALEA_HTTP_KQUEUE
+#include <sys/event.h>
+#include <sys/uio.h>
+#endif
+
+namespace azalea {
+namespace http {
+
+namespace {
+
+constexpr const char* methodNames[METHOD_COUNT] = {
+    "GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS", "OTHER"
+};
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (std::tolower(static_cast<unsigned char>(a[i])) != std::tolower(static_cast<unsigned char>(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+Method methodFromName(std::string_view name) {
+    for (size_t i = 0; i < static_cast<size_t>(Method::OTHER); i++) {
+        if (equalsIgnoreCase(name, methodNames[i])) return static_cast<Method>(i);
+    }
+    return Method::OTHER;
+}
+
+const char* methodName(Method method) {
+    return methodNames[static_cast<size_t>(method)];
+}
+
+std::string_view Request::header(std::string_view name) const {
+    for (const auto& [key, value] : headers) {
+        if (equalsIgnoreCase(key, name)) return value;
+    }
+    return {};
+}
+
+// Router implementation
+void Router::add(Method method, std::string_view pattern, size_t handler) {
+    Node* node = &root;
+    while (!pattern.empty()) {
+        if (pattern[0] == ':' || pattern[0] == '*') {
+            bool wildcard = pattern[0] == '*';
+            size_t end = wildcard ? pattern.size() : std::min(pattern.find('/'), pattern.size());
+            std::unique_ptr<Node>& next = wildcard ? node->wildcard : node->param;
+            if (!next) {
+                next = std::make_unique<Node>();
+                next->paramName = std::string(pattern.substr(1, end - 1));
+            }
+            node = next.get();
+            pattern.remove_prefix(end);
+            continue;
+        }
+
+        // Longest static run, split against the edge that shares its first byte
+        std::string_view run = pattern.substr(0, std::min(pattern.find_first_of(":*"), pattern.size()));
+        auto edge = std::find_if(node->children.begin(), node->children.end(),
+            [&](const std::unique_ptr<Node>& child) { return child->prefix[0] == run[0]; });
+        if (edge == node->children.end()) {
+            node->children.push_back(std::make_unique<Node>());
+            node = node->children.back().get();
+            node->prefix = std::string(run);
+            pattern.remove_prefix(run.size());
+            continue;
+        }
+
+        Node* child = edge->get();
+        size_t common = 0;
+        while (common < run.size() && common < child->prefix.size() && run[common] == child->prefix[common]) {
+            common++;
+        }
+        if (common < child->prefix.size()) {
+            auto split = std::make_unique<Node>();
+            split->prefix = child->prefix.substr(0, common);
+            child->prefix.erase(0, common);
+            split->children.push_back(std::move(*edge));
+            *edge = std::move(split);
+            child = edge->get();
+        }
+        node = child;
+        pattern.remove_prefix(common);
+    }
+    node->handlers[static_cast<size_t>(method)] = static_cast<int>(handler);
+}
+
+bool Router::match(const Node& node, std::string_view path, Method method, Params& params, size_t& handler) const {
+    if (path.empty()) {
+        int id = node.handlers[static_cast<size_t>(method)];
+        if (id < 0 && method == Method::HEAD) id = node.handlers[static_cast<size_t>(Method::GET)];
+        if (id >= 0) {
+            handler = static_cast<size_t>(id);
+            return true;
+        }
+        // An empty tail can still satisfy a wildcard
+        if (!node.wildcard) return false;
+    }
+
+    for (const auto& child : node.children) {
+        if (path.empty()) break;
+        if (child->prefix[0] != path[0]) continue;
+        if (path.compare(0, child->prefix.size(), child->prefix) == 0 &&
+            match(*child, path.substr(child->prefix.size()), method, params, handler)) {
+            return true;
+        }
+        break;
+    }
+    if (node.param && !path.empty()) {
+        size_t end = std::min(path.find('/'), path.size());
+        if (end > 0) {
+            params.emplace_back(node.param->paramName, path.substr(0, end));
+            if (match(*node.param, path.substr(end), method, params, handler)) return true;
+            params.pop_back();
+        }
+    }
+    if (node.wildcard) {
+        params.emplace_back(node.wildcard->paramName, path);
+        if (match(*node.wildcard, std::string_view(), method, params, handler)) return true;
+        params.pop_back();
+    }
+    return false;
+}
+
+bool Router::find(Method method, std::string_view path, Params& params, size_t& handler) const {
+    return match(root, path, method, params, handler);
+}
+
+#ifdef AZALEA_HTTP_SERVER
+
+namespace {
+
+constexpr size_t READ_CHUNK_SIZE = 16 * 1024;
+constexpr size_t MAX_HEADER_SIZE = 64 * 1024;
+constexpr size_t MAX_BODY_SIZE = 16 * 1024 * 1024;
+constexpr int MAX_EVENTS = 256;
+constexpr auto IDLE_TIMEOUT = std::chrono::seconds(60);
+
+struct Event {
+    void* data;
+    bool readable;
+    bool writable;
+};
+
+// Edge-triggered readiness for read and write on each registered fd.
+// Closing an fd removes it from both backends.
+class Poller {
+private:
+    int fd;
+
+public:
+#ifdef AZALEA_HTTP_EPOLL
+    Poller() : fd(epoll_create1(EPOLL_CLOEXEC)) {}
+
+    bool add(int target, void* data) {
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = data;
+        return epoll_ctl(fd, EPOLL_CTL_ADD, target, &ev) == 0;
+    }
+
+    int wait(Event* events, int timeoutMs) {
+        epoll_event raw[MAX_EVENTS];
+        int n = epoll_wait(fd, raw, MAX_EVENTS, timeoutMs);
+        for (int i = 0; i < n; i++) {
+            events[i].data = raw[i].data.ptr;
+            // Hangups and errors surface through the next read
+            events[i].readable = raw[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR);
+            events[i].writable = raw[i].events & EPOLLOUT;
+        }
+        return n;
+    }
+#else
+    Poller() : fd(kqueue()) {}
+
+    bool add(int target, void* data) {
+        struct kevent changes[2];
+        EV_SET(&changes[0], target, EVFILT_READ, EV_ADD | EV_CLEAR, 0, 0, data);
+        EV_SET(&changes[1], target, EVFILT_WRITE, EV_ADD | EV_CLEAR, 0, 0, data);
+        return kevent(fd, changes, 2, nullptr, 0, nullptr) == 0;
+    }
+
+    int wait(Event* events, int timeoutMs) {
+        struct kevent raw[MAX_EVENTS];
+        timespec timeout{timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+        int n = kevent(fd, nullptr, 0, raw, MAX_EVENTS, &timeout);
+        for (int i = 0; i < n; i++) {
+            events[i].data = raw[i].udata;
+            events[i].readable = raw[i].filter == EVFILT_READ || (raw[i].flags & (EV_EOF | EV_ERROR));
+            events[i].writable = raw[i].filter == EVFILT_WRITE;
+        }
+        return n;
+    }
+#endif
+
+    ~Poller() {
+        if (fd >= 0) close(fd);
+    }
+    Poller(const Poller&) = delete;
+    Poller& operator=(const Poller&) = delete;
+
+    bool ok() const { return fd >= 0; }
+};
+
+// Pending output, in response order: bytes, or a byte range of an open file
+struct Segment {
+    std::string data;
+    int file = -1;
+    off_t offset = 0;
+    size_t remaining = 0;
+};
+
+struct Connection {
+    int fd;
+    std::string in;
+    std::deque<Segment> out;
+    size_t sent = 0;      // bytes of out.front().data already written
+    bool closing = false; // close once out drains
+    bool dead = false;
+    std::chrono::steady_clock::time_point lastActive;
+
+    explicit Connection(int socket) : fd(socket), lastActive(std::chrono::steady_clock::now()) {}
+    ~Connection() {
+        for (Segment& segment : out) {
+            if (segment.file >= 0) close(segment.file);
+        }
+        close(fd);
+    }
+};
+
+const char* statusText(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        default: return "Unknown";
+    }
+}
+
+struct MimeType {
+    std::string_view extension;
+    const char* type;
+};
+
+constexpr MimeType mimeTypes[] = {
+    {".html", "text/html; charset=utf-8"}, {".htm", "text/html; charset=utf-8"},
+    {".css", "text/css; charset=utf-8"}, {".js", "text/javascript; charset=utf-8"},
+    {".json", "application/json"}, {".txt", "text/plain; charset=utf-8"},
+    {".az", "text/plain; charset=utf-8"}, {".svg", "image/svg+xml"},
+    {".png", "image/png"}, {".jpg", "image/jpeg"}, {".jpeg", "image/jpeg"},
+    {".gif", "image/gif"}, {".ico", "image/x-icon"}, {".webp", "image/webp"},
+    {".wasm", "application/wasm"}, {".pdf", "application/pdf"}
+};
+
+const char* mimeTypeFor(std::string_view path) {
+    for (const MimeType& mime : mimeTypes) {
+        if (path.size() >= mime.extension.size() &&
+            equalsIgnoreCase(path.substr(path.size() - mime.extension.size()), mime.extension)) {
+            return mime.type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+bool endsWith(std::string_view text, std::string_view suffix) {
+    return text.size() >= suffix.size() && text.substr(text.size() - suffix.size()) == suffix;
+}
+
+// Percent-decodes a URL path; false if it could escape the mount with ".."
+bool decodePath(std::string_view path, std::string& out) {
+    for (size_t i = 0; i < path.size(); i++) {
+        if (path[i] == '%' && i + 2 < path.size() &&
+            std::isxdigit(static_cast<unsigned char>(path[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(path[i + 2]))) {
+            out += static_cast<char>(std::stoi(std::string(path.substr(i + 1, 2)), nullptr, 16));
+            i += 2;
+        } else {
+            out += path[i];
+        }
+    }
+    if (out.find('\0') != std::string::npos) return false;
+    size_t start = 0;
+    while (start <= out.size()) {
+        size_t end = std::min(out.find('/', start), out.size());
+        if (out.compare(start, end - start, "..") == 0 && end - start == 2) return false;
+        start = end + 1;
+    }
+    return true;
+}
+
+bool isRegularFile(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+bool isDirectory(const std::string& path) {
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// Maps a request path onto a mount; .md files render, others go out by sendfile
+bool serveStatic(const std::vector<StaticMount>& mounts, std::string_view path, Response& response) {
+    for (const StaticMount& mount : mounts) {
+        if (path.compare(0, mount.prefix.size(), mount.prefix) != 0) continue;
+        std::string_view rest = path.substr(mount.prefix.size());
+        if (!rest.empty() && rest[0] != '/' && !endsWith(mount.prefix, "/")) continue;
+
+        std::string relative;
+        if (!decodePath(rest, relative)) return false;
+        std::string file = mount.directory + (relative.empty() || relative[0] != '/' ? "/" : "") + relative;
+        if (isDirectory(file)) {
+            if (file.back() != '/') file += '/';
+            file += isRegularFile(file + "index.html") ? "index.html" : "index.md";
+        }
+        if (!isRegularFile(file)) continue;
+
+        if (endsWith(file, ".md")) {
+            response.body.clear();
+            if (!renderMarkdownFile(file, response.body)) continue;
+            response.contentType = "text/html; charset=utf-8";
+        } else {
+            response.file = file;
+            response.contentType = mimeTypeFor(file);
+        }
+        return true;
+    }
+    return false;
+}
+
+Response errorResponse(int status) {
+    Response response;
+    response.status = status;
+    response.contentType = "text/plain; charset=utf-8";
+    response.body = std::to_string(status) + " " + statusText(status) + "\n";
+    return response;
+}
+
+void appendOutput(Connection& conn, std::string&& data) {
+    // Coalesce small pipelined responses into one write
+    if (!conn.out.empty() && conn.out.back().file < 0) {
+        conn.out.back().data += data;
+    } else {
+        conn.out.emplace_back();
+        conn.out.back().data = std::move(data);
+    }
+}
+
+void writeResponse(Connection& conn, const Request& request, Response&& response) {
+    int file = -1;
+    size_t length = response.body.size();
+    if (!response.file.empty()) {
+        struct stat info;
+        file = open(response.file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (file < 0 || fstat(file, &info) != 0 || !S_ISREG(info.st_mode)) {
+            if (file >= 0) close(file);
+            file = -1;
+            response = errorResponse(404);
+            length = response.body.size();
+        } else {
+            length = static_cast<size_t>(info.st_size);
+            if (response.contentType.empty()) response.contentType = mimeTypeFor(response.file);
+        }
+    }
+    bool bodyless = request.method == Method::HEAD || response.status == 204 || response.status == 304;
+
+    std::string head;
+    head.reserve(160 + response.contentType.size() + (bodyless || file >= 0 ? 0 : length));
+    head += "HTTP/1.1 ";
+    head += std::to_string(response.status);
+    head += ' ';
+    head += statusText(response.status);
+    head += "\r\nServer: azalea\r\n";
+    if (response.status != 204) {
+        head += "Content-Type: ";
+        head += response.contentType;
+        head += "\r\nContent-Length: ";
+        head += std::to_string(length);
+        head += "\r\n";
+    }
+    head += request.keepAlive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    if (!bodyless && file < 0) head += response.body;
+    appendOutput(conn, std::move(head));
+
+    if (file >= 0) {
+        if (bodyless || length == 0) {
+            close(file);
+        } else {
+            conn.out.emplace_back();
+            conn.out.back().file = file;
+            conn.out.back().remaining = length;
+        }
+    }
+    if (!request.keepAlive) conn.closing = true;
+}
+
+// Answers a request that could not be read, so none of it is trusted,
+// and closes the connection
+void writeError(Connection& conn, int status) {
+    Request unread;
+    unread.keepAlive = false;
+    writeResponse(conn, unread, errorResponse(status));
+}
+
+// Writes until the socket would block; false on a hard error
+bool flush(Connection& conn) {
+    while (!conn.out.empty()) {
+        Segment& segment = conn.out.front();
+        if (segment.file < 0) {
+#ifdef MSG_NOSIGNAL
+            ssize_t n = send(conn.fd, segment.data.data() + conn.sent, segment.data.size() - conn.sent, MSG_NOSIGNAL);
+#else
+            ssize_t n = send(conn.fd, segment.data.data() + conn.sent, segment.data.size() - conn.sent, 0);
+#endif
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            conn.sent += static_cast<size_t>(n);
+            if (conn.sent < segment.data.size()) continue;
+            conn.sent = 0;
+        } else {
+#if defined(AZALEA_HTTP_EPOLL)
+            ssize_t n = sendfile(conn.fd, segment.file, &segment.offset, segment.remaining);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            if (n == 0) return false; // file shrank underneath us
+            segment.remaining -= static_cast<size_t>(n);
+#elif defined(__APPLE__)
+            off_t len = static_cast<off_t>(segment.remaining);
+            int rc = sendfile(segment.file, conn.fd, segment.offset, &len, nullptr, 0);
+            segment.offset += len;
+            segment.remaining -= static_cast<size_t>(len);
+            if (rc < 0 && errno != EAGAIN && errno != EINTR) return false;
+            if (rc < 0 && errno == EAGAIN) return true;
+#else
+            off_t len = 0;
+            int rc = sendfile(segment.file, conn.fd, segment.offset, segment.remaining, nullptr, &len, 0);
+            segment.offset += len;
+            segment.remaining -= static_cast<size_t>(len);
+            if (rc < 0 && errno != EAGAIN && errno != EINTR) return false;
+            if (rc < 0 && errno == EAGAIN) return true;
+#endif
+            if (segment.remaining > 0) continue;
+            close(segment.file);
+        }
+        conn.out.pop_front();
+    }
+    return true;
+}
+
+// Parses the request head in text (without the blank line); false if malformed
+bool parseHead(std::string_view text, Request& request) {
+    size_t lineEnd = text.find("\r\n");
+    std::string_view line = text.substr(0, lineEnd);
+    size_t sp1 = line.find(' ');
+    size_t sp2 = line.rfind(' ');
+    if (sp1 == std::string_view::npos || sp2 == sp1) return false;
+
+    request.methodText = line.substr(0, sp1);
+    request.method = methodFromName(request.methodText);
+    std::string_view target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+    std::string_view version = line.substr(sp2 + 1);
+    if (target.empty() || version.substr(0, 7) != "HTTP/1.") return false;
+    size_t question = target.find('?');
+    request.path = target.substr(0, question);
+    request.query = question == std::string_view::npos ? std::string_view() : target.substr(question + 1);
+    request.keepAlive = version != "HTTP/1.0";
+
+    request.headers.clear();
+    size_t pos = lineEnd == std::string_view::npos ? text.size() : lineEnd + 2;
+    while (pos < text.size()) {
+        size_t end = std::min(text.find("\r\n", pos), text.size());
+        std::string_view header = text.substr(pos, end - pos);
+        size_t colon = header.find(':');
+        if (colon == std::string_view::npos || colon == 0) return false;
+        std::string_view value = header.substr(colon + 1);
+        while (!value.empty() && (value.front() == ' ' || value.front() == '\t')) value.remove_prefix(1);
+        while (!value.empty() && (value.back() == ' ' || value.back() == '\t')) value.remove_suffix(1);
+        request.headers.emplace_back(header.substr(0, colon), value);
+        pos = end + 2;
+    }
+
+    std::string_view connection = request.header("Connection");
+    if (equalsIgnoreCase(connection, "close")) request.keepAlive = false;
+    if (equalsIgnoreCase(connection, "keep-alive")) request.keepAlive = true;
+    return true;
+}
+
+} // namespace
+
+bool Server::run(int port, const Handler& handler, std::string& error) {
+    // Peers that hang up mid-response must not kill the process
+    std::signal(SIGPIPE, SIG_IGN);
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0) {
+        error = std::strerror(errno);
+        return false;
+    }
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+        listen(listener, SOMAXCONN) != 0) {
+        error = std::strerror(errno);
+        close(listener);
+        return false;
+    }
+    fcntl(listener, F_SETFL, fcntl(listener, F_GETFL) | O_NONBLOCK);
+    fcntl(listener, F_SETFD, FD_CLOEXEC);
+
+    Poller poller;
+    if (!poller.ok() || !poller.add(listener, nullptr)) {
+        error = std::strerror(errno);
+        close(listener);
+        return false;
+    }
+
+    std::unordered_map<int, std::unique_ptr<Connection>> connections;
+    std::vector<char> buffer(READ_CHUNK_SIZE);
+    Event events[MAX_EVENTS];
+    Request request;
+    auto lastSweep = std::chrono::steady_clock::now();
+    auto lastTick = lastSweep;
+
+    // Answers every complete request buffered on conn, in order
+    auto process = [&](Connection& conn) {
+        size_t pos = 0;
+        while (!conn.closing) {
+            size_t headEnd = conn.in.find("\r\n\r\n", pos);
+            if (headEnd == std::string::npos) {
+                if (conn.in.size() - pos > MAX_HEADER_SIZE) writeError(conn, 431);
+                break;
+            }
+            std::string_view head(conn.in.data() + pos, headEnd - pos);
+            if (!parseHead(head, request)) {
+                writeError(conn, 400);
+                break;
+            }
+            if (!request.header("Transfer-Encoding").empty()) {
+                request.keepAlive = false;
+                writeResponse(conn, request, errorResponse(501));
+                break;
+            }
+            std::string_view lengthText = request.header("Content-Length");
+            size_t length = 0;
+            for (char c : lengthText) {
+                if (c < '0' || c > '9' || length > MAX_BODY_SIZE) {
+                    length = MAX_BODY_SIZE + 1;
+                    break;
+                }
+                length = length * 10 + static_cast<size_t>(c - '0');
+            }
+            if (length > MAX_BODY_SIZE) {
+                request.keepAlive = false;
+                writeResponse(conn, request, errorResponse(413));
+                break;
+            }
+            size_t bodyStart = headEnd + 4;
+            if (conn.in.size() - bodyStart < length) break; // body still arriving
+            request.body = std::string_view(conn.in.data() + bodyStart, length);
+
+            Response response;
+            size_t id;
+            request.params.clear();
+            if (router.find(request.method, request.path, request.params, id)) {
+                try {
+                    response = handler(id, request);
+                } catch (const std::exception&) {
+                    response = errorResponse(500);
+                }
+            } else if ((request.method != Method::GET && request.method != Method::HEAD) ||
+                       !serveStatic(mounts, request.path, response)) {
+                response = errorResponse(404);
+            }
+            writeResponse(conn, request, std::move(response));
+            pos = bodyStart + length;
+        }
+        conn.in.erase(0, pos);
+    };
+
+    while (!stopping) {
+        int n = poller.wait(events, tick ? TICK_MS : 1000);
+        if (n < 0 && errno != EINTR) {
+            error = std::strerror(errno);
+            break;
+        }
+
+        std::vector<Connection*> finished;
+        for (int i = 0; i < n; i++) {
+            if (!events[i].data) {
+                // Edge-triggered: drain the accept queue
+                while (true) {
+#ifdef AZALEA_HTTP_EPOLL
+                    int fd = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+                    int fd = accept(listener, nullptr, nullptr);
+                    if (fd >= 0) {
+                        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+                        fcntl(fd, F_SETFD, FD_CLOEXEC);
+                        int noSigPipe = 1;
+                        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+                    }
+#endif
+                    if (fd < 0) break;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+                    auto conn = std::make_unique<Connection>(fd);
+                    if (poller.add(fd, conn.get())) {
+                        connections[fd] = std::move(conn);
+                    }
+                }
+                continue;
+            }
+
+            Connection& conn = *static_cast<Connection*>(events[i].data);
+            if (conn.dead) continue;
+            conn.lastActive = std::chrono::steady_clock::now();
+
+            bool ok = true;
+            if (events[i].readable) {
+                bool eof = false;
+                while (true) {
+                    ssize_t got = recv(conn.fd, buffer.data(), buffer.size(), 0);
+                    if (got > 0) {
+                        conn.in.append(buffer.data(), static_cast<size_t>(got));
+                        continue;
+                    }
+                    if (got == 0) {
+                        eof = true;
+                    } else if (errno == EINTR) {
+                        continue;
+                    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        ok = false;
+                    }
+                    break;
+                }
+                if (ok) process(conn);
+                if (eof) conn.closing = true;
+            }
+            if (ok) ok = flush(conn);
+            if (!ok || (conn.closing && conn.out.empty())) {
+                conn.dead = true;
+                finished.push_back(&conn);
+            }
+        }
+
+        // Closed after the batch: later events may still name these
+        auto now = std::chrono::steady_clock::now();
+        if (now - lastSweep >= std::chrono::seconds(1)) {
+            lastSweep = now;
+            for (auto& [fd, conn] : connections) {
+                if (!conn->dead && conn->out.empty() && now - conn->lastActive > IDLE_TIMEOUT) {
+                    conn->dead = true;
+                    finished.push_back(conn.get());
+                }
+            }
+        }
+        for (Connection* conn : finished) {
+            connections.erase(conn->fd);
+        }
+        if (tick && now - lastTick >= std::chrono::milliseconds(TICK_MS)) {
+            lastTick = now;
+            tick();
+        }
+    }
+
+    connections.clear();
+    close(listener);
+    return error.empty();
+}
+
+#else
+
+bool Server::run(int, const Handler&, std::string& error) {
+    error = "HTTP serving is not available on this platform";
+    return false;
+}
+
+#endif
+
+} // namespace http
+} // namespace azalea
@@ -0,0 +1,118 @@
+#ifndef AZALEA_HTTP_H
+#define AZALEA_HTTP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The event loop needs epoll (Linux) or kqueue (macOS/BSD); elsewhere,
+// including the browser build, routes still register but nothing listens
+#if !defined(__EMSCRIPTEN__) && defined(__linux__)
+#define AZALEA_HTTP_EPOLL 1
+#elif !defined(__EMSCRIPTEN__) && (defined(__APPLE__) || defined(__FreeBSD__))
+#define AZALEA_HTTP_KQUEUE 1
+#endif
+#if defined(AZALEA_HTTP_EPOLL) || defined(AZALEA_HTTP_KQUEUE)
+#define AZALEA_HTTP_SERVER 1
+#endif
+
+namespace azalea {
+namespace http {
+
+enum class Method : uint8_t {
+    GET, HEAD, POST, PUT, DELETE, PATCH, OPTIONS, OTHER
+};
+constexpr size_t METHOD_COUNT = static_cast<size_t>(Method::OTHER) + 1;
+
+Method methodFromName(std::string_view name);
+const char* methodName(Method method);
+
+using Params = std::vector<std::pair<std::string_view, std::string_view>>;
+
+// A parsed request. Every view points into the connection's input buffer
+// and is only valid while the request is being handled.
+struct Request {
+    Method method = Method::OTHER;
+    std::string_view methodText;
+    std::string_view path;
+    std::string_view query;
+    std::string_view body;
+    std::vector<std::pair<std::string_view, std::string_view>> headers;
+    Params params; // filled from the matched route pattern
+    bool keepAlive = true;
+
+    std::string_view header(std::string_view name) const; // case-insensitive, "" if absent
+};
+
+struct Response {
+    int status = 200;
+    std::string contentType = "text/html; charset=utf-8";
+    std::string body;
+    std::string file; // when set, the body is this file, sent with sendfile
+};
+
+// Radix tree over route patterns. Static runs are compressed into single
+// edges; ":name" matches one path segment and "*name" the rest of the path.
+// Lookups try static edges first, then the parameter, then the wildcard.
+class Router {
+private:
+    struct Node {
+        std::string prefix;
+        std::vector<std::unique_ptr<Node>> children; // static edges, distinct first bytes
+        std::unique_ptr<Node> param;
+        std::unique_ptr<Node> wildcard;
+        std::string paramName;
+        int handlers[METHOD_COUNT];
+
+        Node() { std::fill(std::begin(handlers), std::end(handlers), -1); }
+    };
+    Node root;
+
+    bool match(const Node& node, std::string_view path, Method method, Params& params, size_t& handler) const;
+
+public:
+    void add(Method method, std::string_view pattern, size_t handler);
+    // Handler id for method and path, with params filled; false if no route
+    bool find(Method method, std::string_view path, Params& params, size_t& handler) const;
+};
+
+// URL prefix served from a directory; .md files are rendered to HTML
+struct StaticMount {
+    std::string prefix;
+    std::string directory;
+};
+
+// Non-blocking HTTP/1.1 server with keep-alive and pipelining, driven by
+// an edge-triggered epoll (Linux) or kqueue (macOS/BSD) loop on the calling
+// thread. Handlers run on that thread, one request at a time.
+class Server {
+public:
+    using Handler = std::function<Response(size_t handler, const Request& request)>;
+
+    Router router;
+    std::vector<StaticMount> mounts;
+    // Called between batches of events every TICK_MS or so while serving,
+    // if set (a file watcher, say)
+    std::function<void()> tick;
+    static constexpr int TICK_MS = 250;
+
+    // Binds the port and serves until stop(); false with error set if the
+    // port cannot be opened
+    bool run(int port, const Handler& handler, std::string& error);
+    void stop() { stopping = true; }
+
+private:
+    bool stopping = false;
+};
+
+} // namespace http
+} // namespace azalea
+
+#endif // AZALEA_HTTP_H
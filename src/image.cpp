@@ -0,0 +1,373 @@
+#include "image.h"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace azalea {
+
+namespace {
+
+constexpr char MAGIC[4] = {'A', 'Z', 'C', '1'};
+constexpr uint32_t VERSION = 3;
+constexpr uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+constexpr size_t OPCODE_COUNT = static_cast<size_t>(OpCode::RET) + 1;
+
+// Calls f on every operand of instr that holds a variable slot, letting it
+// rewrite the slot in place
+template <typename F>
+void forEachSlot(Instr& instr, F f) {
+    switch (instr.op) {
+        case OpCode::GETVAR:
+        case OpCode::SETVAR:
+        case OpCode::STEP:
+            f(instr.b);
+            break;
+        case OpCode::PARLOOP:
+            f(instr.d);
+            break;
+        case OpCode::SAY:
+            if (instr.c) { // slot + 1; 0 means the say binds nothing
+                uint32_t slot = instr.c - 1;
+                f(slot);
+                instr.c = slot + 1;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void putU32(std::string& out, uint32_t v) {
+    char bytes[4];
+    std::memcpy(bytes, &v, 4);
+    out.append(bytes, 4);
+}
+
+void putString(std::string& out, std::string_view text) {
+    putU32(out, static_cast<uint32_t>(text.size()));
+    out.append(text.data(), text.size());
+}
+
+class ImageWriter {
+private:
+    std::vector<std::string_view> slotNames; // runtime slot -> variable name
+    std::vector<uint32_t> slotIndex;         // runtime slot -> image name index
+
+public:
+    std::vector<std::string_view> names; // image name table
+
+    ImageWriter(const SymbolTable& symbols, const std::vector<size_t>& symbolSlots) {
+        for (size_t symbol = 0; symbol < symbolSlots.size(); symbol++) {
+            size_t slot = symbolSlots[symbol];
+            if (slot == static_cast<size_t>(-1)) continue;
+            if (slot >= slotNames.size()) slotNames.resize(slot + 1);
+            slotNames[slot] = symbols.name(static_cast<Symbol>(symbol));
+        }
+        slotIndex.assign(slotNames.size(), NO_INDEX);
+    }
+
+    uint32_t nameFor(size_t slot) {
+        if (slot >= slotIndex.size()) throw std::runtime_error("Cannot compile: unknown variable slot");
+        if (slotIndex[slot] == NO_INDEX) {
+            slotIndex[slot] = static_cast<uint32_t>(names.size());
+            names.push_back(slotNames[slot]);
+        }
+        return slotIndex[slot];
+    }
+
+    void chunk(std::string& out, const Chunk& chunk) {
+        putU32(out, static_cast<uint32_t>(chunk.numRegs));
+
+        putU32(out, static_cast<uint32_t>(chunk.code.size()));
+        for (Instr instr : chunk.code) {
+            forEachSlot(instr, [this](uint32_t& slot) { slot = nameFor(slot); });
+            char bytes[16] = {};
+            bytes[0] = static_cast<char>(instr.op);
+            std::memcpy(bytes + 2, &instr.a, 2);
+            std::memcpy(bytes + 4, &instr.b, 4);
+            std::memcpy(bytes + 8, &instr.c, 4);
+            std::memcpy(bytes + 12, &instr.d, 4);
+            out.append(bytes, sizeof(bytes));
+        }
+
+        putU32(out, static_cast<uint32_t>(chunk.constants.size()));
+        for (const Value& constant : chunk.constants) {
+            out.push_back(static_cast<char>(constant.type));
+            switch (constant.type) {
+                case ValueType::NUM: {
+                    char bytes[8];
+                    std::memcpy(bytes, &constant.num, 8);
+                    out.append(bytes, 8);
+                    break;
+                }
+                case ValueType::BOOL:
+                    out.push_back(constant.boolean ? 1 : 0);
+                    break;
+                case ValueType::VOID:
+                    break;
+                case ValueType::TEXT:
+                    putString(out, constant.asText());
+                    break;
+                default:
+                    throw std::runtime_error("Cannot compile: constant of unsupported type");
+            }
+        }
+
+        putU32(out, static_cast<uint32_t>(chunk.names.size()));
+        for (const std::string& name : chunk.names) {
+            putString(out, name);
+        }
+
+        // Each site is a call with a fixed argument count, in its CALLMOD
+        std::vector<uint32_t> argc(chunk.modules.size(), 0);
+        for (const Instr& instr : chunk.code) {
+            if (instr.op == OpCode::CALLMOD && instr.b < argc.size()) argc[instr.b] = instr.d;
+        }
+        putU32(out, static_cast<uint32_t>(chunk.modules.size()));
+        for (size_t i = 0; i < chunk.modules.size(); i++) {
+            putString(out, chunk.modules[i].module->getName());
+            putString(out, chunk.modules[i].method);
+            putU32(out, argc[i]);
+        }
+
+        putU32(out, static_cast<uint32_t>(chunk.functions.size()));
+        for (const auto& proto : chunk.functions) {
+            putString(out, proto->name);
+            putU32(out, static_cast<uint32_t>(proto->params.size()));
+            for (size_t slot : proto->params) {
+                putU32(out, nameFor(slot));
+            }
+            this->chunk(out, proto->chunk);
+        }
+    }
+};
+
+class ImageReader {
+private:
+    const char* p;
+    const char* end;
+    uint64_t isolate;
+    const FlatMap<ModulePtr>* modules = nullptr;
+    std::vector<size_t> slots; // image name index -> runtime slot
+
+    [[noreturn]] static void malformed() {
+        throw std::runtime_error("Malformed compiled program");
+    }
+
+    void need(size_t bytes) {
+        if (static_cast<size_t>(end - p) < bytes) malformed();
+    }
+
+    uint8_t u8() {
+        need(1);
+        return static_cast<uint8_t>(*p++);
+    }
+
+    uint32_t u32() {
+        need(4);
+        uint32_t v;
+        std::memcpy(&v, p, 4);
+        p += 4;
+        return v;
+    }
+
+    // Element count of a table whose entries take at least minBytes each,
+    // so a corrupt count fails before anything is allocated for it
+    uint32_t items(size_t minBytes) {
+        uint32_t count = u32();
+        need(size_t(count) * minBytes);
+        return count;
+    }
+
+    std::string_view string() {
+        uint32_t size = u32();
+        need(size);
+        std::string_view text(p, size);
+        p += size;
+        return text;
+    }
+
+    uint32_t slot(uint32_t name) {
+        if (name >= slots.size()) malformed();
+        return static_cast<uint32_t>(slots[name]);
+    }
+
+    // Every operand must stay inside its chunk, so a bad image fails here
+    // rather than in the VM. What registers hold depends on the path taken
+    // to them, so the loop opcodes check their operands' types themselves
+    void check(const Chunk& chunk) {
+        size_t regs = chunk.numRegs;
+        size_t size = chunk.code.size();
+        if (size == 0 || chunk.code.back().op != OpCode::RET) malformed();
+        for (const Instr& instr : chunk.code) {
+            auto reg = [regs](uint32_t r) { return r < regs; };
+            bool ok = reg(instr.a);
+            switch (instr.op) {
+                case OpCode::LOADK: ok = ok && instr.b < chunk.constants.size(); break;
+                case OpCode::MOVE:
+                case OpCode::TONUM: ok = ok && reg(instr.b); break;
+                case OpCode::ADD: case OpCode::SUB: case OpCode::MUL: case OpCode::DIV:
+                case OpCode::MOD: case OpCode::POW: case OpCode::GT: case OpCode::LT:
+                case OpCode::GE: case OpCode::LE: case OpCode::EQ: case OpCode::NE:
+                case OpCode::AND: case OpCode::OR:
+                    ok = ok && reg(instr.b) && reg(instr.c);
+                    break;
+                case OpCode::JMP:
+                case OpCode::JMPIFNOT: ok = ok && instr.b < size; break;
+                case OpCode::FORTEST: ok = ok && instr.b < size && reg(instr.c); break;
+                case OpCode::DEFFN: ok = ok && instr.b < chunk.functions.size(); break;
+                case OpCode::PARLOOP: ok = ok && instr.b < chunk.functions.size() && reg(instr.c); break;
+                case OpCode::CALLFN:
+                case OpCode::TAILCALL:
+                    ok = ok && instr.b < chunk.names.size() && size_t(instr.c) + instr.d <= regs;
+                    break;
+                case OpCode::CALLMOD:
+                    ok = ok && instr.b < chunk.modules.size() && size_t(instr.c) + instr.d <= regs;
+                    break;
+                default:
+                    break;
+            }
+            if (!ok) malformed();
+        }
+    }
+
+public:
+    ImageReader(const char* data, size_t size, uint64_t owner)
+        : p(data), end(data + size), isolate(owner) {}
+
+    template <typename BindSlot>
+    void header(BindSlot bindSlot) {
+        need(sizeof(MAGIC));
+        if (std::memcmp(p, MAGIC, sizeof(MAGIC)) != 0) malformed();
+        p += sizeof(MAGIC);
+        if (u32() != VERSION) throw std::runtime_error("Compiled program is from another version of Azalea");
+        uint32_t count = items(4);
+        slots.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            slots.push_back(bindSlot(string()));
+        }
+    }
+
+    // Binding slots can copy the runtime's state, so modules are looked up
+    // afterwards
+    void useModules(const FlatMap<ModulePtr>& registered) { modules = &registered; }
+
+    void chunk(Chunk& chunk) {
+        chunk.numRegs = u32();
+        if (chunk.numRegs == 0 || chunk.numRegs > 0xFFFF) malformed();
+
+        uint32_t count = items(16);
+        chunk.code.resize(count);
+        for (Instr& instr : chunk.code) {
+            if (static_cast<uint8_t>(p[0]) >= OPCODE_COUNT) malformed();
+            instr.op = static_cast<OpCode>(p[0]);
+            std::memcpy(&instr.a, p + 2, 2);
+            std::memcpy(&instr.b, p + 4, 4);
+            std::memcpy(&instr.c, p + 8, 4);
+            std::memcpy(&instr.d, p + 12, 4);
+            p += 16;
+            forEachSlot(instr, [this](uint32_t& name) { name = slot(name); });
+        }
+
+        count = items(1);
+        chunk.constants.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            switch (static_cast<ValueType>(u8())) {
+                case ValueType::NUM: {
+                    need(8);
+                    double num;
+                    std::memcpy(&num, p, 8);
+                    p += 8;
+                    chunk.constants.emplace_back(num);
+                    break;
+                }
+                case ValueType::BOOL:
+                    chunk.constants.emplace_back(u8() != 0);
+                    break;
+                case ValueType::VOID:
+                    chunk.constants.emplace_back();
+                    break;
+                case ValueType::TEXT:
+                    chunk.constants.emplace_back(string());
+                    break;
+                default:
+                    malformed();
+            }
+        }
+
+        count = items(4);
+        chunk.names.reserve(count);
+        chunk.nameSites.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            chunk.names.emplace_back(string());
+            chunk.nameSites.push_back(NameSite{hashKey(chunk.names.back()), {}});
+        }
+
+        count = items(12);
+        chunk.modules.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            std::string name(string());
+            std::string method(string());
+            uint32_t argc = u32();
+            auto moduleIt = modules->find(name);
+            if (moduleIt == modules->end()) {
+                throw std::runtime_error("Compiled program calls unknown module " + name);
+            }
+            ModuleMethod handler = moduleIt->second->resolve(method, argc);
+            chunk.modules.push_back({moduleIt->second, std::move(method), handler});
+        }
+
+        count = items(8);
+        chunk.functions.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            auto proto = std::make_shared<FunctionProto>();
+            proto->name = std::string(string());
+            uint32_t params = items(4);
+            for (uint32_t j = 0; j < params; j++) {
+                proto->params.push_back(slot(u32()));
+            }
+            this->chunk(proto->chunk);
+            chunk.functions.push_back(std::move(proto));
+        }
+
+        chunk.isolate = isolate;
+        check(chunk);
+    }
+
+    bool done() const { return p == end; }
+};
+
+} // namespace
+
+bool ProgramImage::isImage(const char* data, size_t size) {
+    return size >= sizeof(MAGIC) && std::memcmp(data, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+std::string ProgramImage::write(const Runtime& runtime, const Chunk& chunk) {
+    ImageWriter writer(runtime.state->symbols, runtime.state->symbolSlots);
+    std::string body;
+    writer.chunk(body, chunk);
+
+    std::string out(MAGIC, sizeof(MAGIC));
+    putU32(out, VERSION);
+    putU32(out, static_cast<uint32_t>(writer.names.size()));
+    for (std::string_view name : writer.names) {
+        putString(out, name);
+    }
+    out += body;
+    return out;
+}
+
+std::shared_ptr<Chunk> ProgramImage::read(Runtime& runtime, const char* data, size_t size) {
+    ImageReader reader(data, size, runtime.isolate);
+    reader.header([&runtime](std::string_view name) {
+        return runtime.slotFor(runtime.own().symbols.intern(name));
+    });
+    reader.useModules(runtime.state->modules);
+    auto chunk = std::make_shared<Chunk>();
+    reader.chunk(*chunk);
+    if (!reader.done()) throw std::runtime_error("Malformed compiled program");
+    return chunk;
+}
+
+} // namespace azalea
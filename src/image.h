@@ -0,0 +1,38 @@
+#ifndef AZALEA_IMAGE_H
+#define AZALEA_IMAGE_H
+
+#include "vm.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace azalea {
+
+// Compiled programs on disk (.azc), written by `azalea --compile`. An
+// image is a program's chunk tree plus the names behind the variable
+// slots and module calls it uses. Loading binds those names in the
+// target runtime, so code runs without the Lexer, Parser or Resolver.
+//
+// Layout, little-endian; strings are a u32 length and the bytes:
+//   "AZC1" u32 version
+//   u32 n, n strings            variable names, one per slot the code uses
+//   chunk:
+//     u32 registers
+//     u32 n, n x 16 bytes       instructions: u8 op, u8 0, u16 a, u32 b c d;
+//                               slot operands index the name table
+//     u32 n, n constants        u8 ValueType, then f64 / u8 / string
+//     u32 n, n strings          act names called
+//     u32 n, n module sites     string module, string method, u32 argc
+//     u32 n, n functions        string name, u32 k, k slot names, chunk
+class ProgramImage {
+public:
+    static bool isImage(const char* data, size_t size);
+    static std::string write(const Runtime& runtime, const Chunk& chunk);
+    // Chunk bound to runtime's slots and modules; throws std::runtime_error
+    // if the image is malformed or names a module runtime lacks
+    static std::shared_ptr<Chunk> read(Runtime& runtime, const char* data, size_t size);
+};
+
+} // namespace azalea
+
+#endif // AZALEA_IMAGE_H
@@ -0,0 +1,242 @@
+// The kernels over one instruction set's vectors. kernels.cpp includes
+// this once per set, each time in a namespace that first defines Lanes:
+//   V, N              a vector and the doubles in it
+//   load, store, set  (unaligned)
+//   add, sub, mul     lane by lane
+//   div               lane by lane, and zero where the divisor is
+//   lesser(x, acc)    x < acc ? x : acc, per lane; greater likewise
+//   eq .. ge          bit j set where lane j compares true (ordered)
+// and, for instruction sets other than the compiler's default, inside a
+// region compiled for that set. Hence no include guard.
+
+template <Arith Op>
+Lanes::V apply(Lanes::V a, Lanes::V b) {
+    if constexpr (Op == Arith::ADD) return Lanes::add(a, b);
+    if constexpr (Op == Arith::SUB) return Lanes::sub(a, b);
+    if constexpr (Op == Arith::MUL) return Lanes::mul(a, b);
+    if constexpr (Op == Arith::DIV) return Lanes::div(a, b);
+}
+
+template <Compare Op>
+unsigned test(Lanes::V x, Lanes::V c) {
+    if constexpr (Op == Compare::EQ) return Lanes::eq(x, c);
+    if constexpr (Op == Compare::NE) return Lanes::lt(x, c) | Lanes::gt(x, c);
+    if constexpr (Op == Compare::LT) return Lanes::lt(x, c);
+    if constexpr (Op == Compare::LE) return Lanes::le(x, c);
+    if constexpr (Op == Compare::GT) return Lanes::gt(x, c);
+    if constexpr (Op == Compare::GE) return Lanes::ge(x, c);
+}
+
+double sum(const double* x, size_t n) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V a = Lanes::set(0), b = Lanes::set(0);
+    size_t i = 0;
+    for (; i + 2 * N <= n; i += 2 * N) {
+        a = Lanes::add(a, Lanes::load(x + i));
+        b = Lanes::add(b, Lanes::load(x + i + N));
+    }
+    if (i + N <= n) {
+        a = Lanes::add(a, Lanes::load(x + i));
+        i += N;
+    }
+    double lanes[N];
+    Lanes::store(lanes, Lanes::add(a, b));
+    double total = 0;
+    for (size_t j = 0; j < N; j++) total += lanes[j];
+    for (; i < n; i++) total += x[i];
+    return total;
+}
+
+double min(const double* x, size_t n) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V acc = Lanes::set(x[0]);
+    size_t i = 0;
+    for (; i + N <= n; i += N) acc = Lanes::lesser(Lanes::load(x + i), acc);
+    double lanes[N];
+    Lanes::store(lanes, acc);
+    double least = lanes[0];
+    for (size_t j = 1; j < N; j++) least = lanes[j] < least ? lanes[j] : least;
+    for (; i < n; i++) least = x[i] < least ? x[i] : least;
+    return least;
+}
+
+double max(const double* x, size_t n) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V acc = Lanes::set(x[0]);
+    size_t i = 0;
+    for (; i + N <= n; i += N) acc = Lanes::greater(Lanes::load(x + i), acc);
+    double lanes[N];
+    Lanes::store(lanes, acc);
+    double most = lanes[0];
+    for (size_t j = 1; j < N; j++) most = lanes[j] > most ? lanes[j] : most;
+    for (; i < n; i++) most = x[i] > most ? x[i] : most;
+    return most;
+}
+
+template <Arith Op>
+void mapWith(const double* x, size_t n, double operand, double* out) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V c = Lanes::set(operand);
+    size_t i = 0;
+    for (; i + N <= n; i += N) Lanes::store(out + i, apply<Op>(Lanes::load(x + i), c));
+    for (; i < n; i++) out[i] = arith<Op>(x[i], operand);
+}
+
+void map(const double* x, size_t n, Arith op, double operand, double* out) {
+    switch (op) {
+        case Arith::ADD: mapWith<Arith::ADD>(x, n, operand, out); break;
+        case Arith::SUB: mapWith<Arith::SUB>(x, n, operand, out); break;
+        case Arith::MUL: mapWith<Arith::MUL>(x, n, operand, out); break;
+        case Arith::DIV: mapWith<Arith::DIV>(x, n, operand, out); break;
+    }
+}
+
+template <Arith Op>
+void zipWith(const double* x, const double* y, size_t n, double* out) {
+    constexpr size_t N = Lanes::N;
+    size_t i = 0;
+    for (; i + N <= n; i += N) Lanes::store(out + i, apply<Op>(Lanes::load(x + i), Lanes::load(y + i)));
+    for (; i < n; i++) out[i] = arith<Op>(x[i], y[i]);
+}
+
+void zip(const double* x, const double* y, size_t n, Arith op, double* out) {
+    switch (op) {
+        case Arith::ADD: zipWith<Arith::ADD>(x, y, n, out); break;
+        case Arith::SUB: zipWith<Arith::SUB>(x, y, n, out); break;
+        case Arith::MUL: zipWith<Arith::MUL>(x, y, n, out); break;
+        case Arith::DIV: zipWith<Arith::DIV>(x, y, n, out); break;
+    }
+}
+
+template <Compare Op>
+size_t compareWith(const double* x, size_t n, double operand, uint8_t* out) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V c = Lanes::set(operand);
+    size_t i = 0, found = 0;
+    for (; i + N <= n; i += N) {
+        unsigned bits = test<Op>(Lanes::load(x + i), c);
+        for (size_t j = 0; j < N; j++) out[i + j] = (bits >> j) & 1;
+        found += static_cast<size_t>(__builtin_popcount(bits));
+    }
+    for (; i < n; i++) {
+        out[i] = holds<Op>(x[i], operand);
+        found += out[i];
+    }
+    return found;
+}
+
+size_t compare(const double* x, size_t n, Compare op, double operand, uint8_t* out) {
+    switch (op) {
+        case Compare::EQ: return compareWith<Compare::EQ>(x, n, operand, out);
+        case Compare::NE: return compareWith<Compare::NE>(x, n, operand, out);
+        case Compare::LT: return compareWith<Compare::LT>(x, n, operand, out);
+        case Compare::LE: return compareWith<Compare::LE>(x, n, operand, out);
+        case Compare::GT: return compareWith<Compare::GT>(x, n, operand, out);
+        case Compare::GE: return compareWith<Compare::GE>(x, n, operand, out);
+    }
+    return 0;
+}
+
+// Every item is stored and the end moved past the ones kept, so there is
+// no branch to mispredict
+template <Compare Op>
+size_t filterWith(const double* x, size_t n, double operand, double* out) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V c = Lanes::set(operand);
+    size_t i = 0, kept = 0;
+    for (; i + N <= n; i += N) {
+        unsigned bits = test<Op>(Lanes::load(x + i), c);
+        for (size_t j = 0; j < N; j++) {
+            out[kept] = x[i + j];
+            kept += (bits >> j) & 1;
+        }
+    }
+    for (; i < n; i++) {
+        out[kept] = x[i];
+        kept += holds<Op>(x[i], operand);
+    }
+    return kept;
+}
+
+size_t filter(const double* x, size_t n, Compare op, double operand, double* out) {
+    switch (op) {
+        case Compare::EQ: return filterWith<Compare::EQ>(x, n, operand, out);
+        case Compare::NE: return filterWith<Compare::NE>(x, n, operand, out);
+        case Compare::LT: return filterWith<Compare::LT>(x, n, operand, out);
+        case Compare::LE: return filterWith<Compare::LE>(x, n, operand, out);
+        case Compare::GT: return filterWith<Compare::GT>(x, n, operand, out);
+        case Compare::GE: return filterWith<Compare::GE>(x, n, operand, out);
+    }
+    return 0;
+}
+
+size_t select(const double* x, const uint8_t* flags, size_t n, double* out) {
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        out[kept] = x[i];
+        kept += flags[i] != 0;
+    }
+    return kept;
+}
+
+size_t count(const uint8_t* flags, size_t n) {
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) total += flags[i] != 0;
+    return total;
+}
+
+void advance(double* x, const double* v, size_t n, double dt) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V step = Lanes::set(dt);
+    size_t i = 0;
+    for (; i + N <= n; i += N) {
+        Lanes::store(x + i, Lanes::add(Lanes::load(x + i), Lanes::mul(Lanes::load(v + i), step)));
+    }
+    for (; i < n; i++) x[i] += v[i] * dt;
+}
+
+void lerp(const double* a, const double* b, size_t n, double t, double* out) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V by = Lanes::set(t);
+    size_t i = 0;
+    for (; i + N <= n; i += N) {
+        Lanes::V from = Lanes::load(a + i);
+        Lanes::store(out + i, Lanes::add(from, Lanes::mul(Lanes::sub(Lanes::load(b + i), from), by)));
+    }
+    for (; i < n; i++) out[i] = a[i] + (b[i] - a[i]) * t;
+}
+
+// Few items are ever outside, so the vectors only find them and scalar
+// code moves them. (No std::min here: an instantiation made inside the
+// AVX2 region could be the one the rest of the program links to.)
+inline bool reflect(double& x, double& v, double low, double high) {
+    if (x < low) {
+        x = low + (low - x);
+        x = x > high ? high : x;
+        v = v < 0 ? -v : v;
+        return true;
+    }
+    if (x > high) {
+        x = high - (x - high);
+        x = x < low ? low : x;
+        v = v > 0 ? -v : v;
+        return true;
+    }
+    return false;
+}
+
+size_t bounce(double* x, double* v, size_t n, double low, double high) {
+    constexpr size_t N = Lanes::N;
+    Lanes::V lo = Lanes::set(low), hi = Lanes::set(high);
+    size_t i = 0, out = 0;
+    for (; i + N <= n; i += N) {
+        Lanes::V at = Lanes::load(x + i);
+        unsigned bits = Lanes::lt(at, lo) | Lanes::gt(at, hi);
+        for (; bits; bits &= bits - 1) {
+            size_t j = i + static_cast<size_t>(__builtin_ctz(bits));
+            out += reflect(x[j], v[j], low, high);
+        }
+    }
+    for (; i < n; i++) out += reflect(x[i], v[i], low, high);
+    return out;
+}
@@ -0,0 +1,287 @@
+#include "kernels.h"
+#include <unordered_map>
+
+#if defined(__AVX2__) || (defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)))
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+#if defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// x86 builds for a CPU without AVX2 carry an AVX2 copy of the kernels too,
+// picked at startup if the CPU running them has it
+#if !defined(__AVX2__) && defined(__SSE2__) && defined(__GNUC__)
+#define AZALEA_KERNELS_AVX2_DISPATCH 1
+#endif
+
+namespace azalea {
+namespace kernels {
+
+namespace {
+
+// The scalar forms, for the items left over after the last full vector
+template <Arith Op>
+inline double arith(double a, double b) {
+    if constexpr (Op == Arith::ADD) return a + b;
+    if constexpr (Op == Arith::SUB) return a - b;
+    if constexpr (Op == Arith::MUL) return a * b;
+    if constexpr (Op == Arith::DIV) return b == 0.0 ? 0.0 : a / b;
+}
+
+template <Compare Op>
+inline uint8_t holds(double x, double c) {
+    if constexpr (Op == Compare::EQ) return x == c;
+    if constexpr (Op == Compare::NE) return x < c || x > c;
+    if constexpr (Op == Compare::LT) return x < c;
+    if constexpr (Op == Compare::LE) return x <= c;
+    if constexpr (Op == Compare::GT) return x > c;
+    if constexpr (Op == Compare::GE) return x >= c;
+}
+
+// Every instruction set's kernels, as one table
+struct Table {
+    const char* name;
+    double (*sum)(const double*, size_t);
+    double (*min)(const double*, size_t);
+    double (*max)(const double*, size_t);
+    void (*map)(const double*, size_t, Arith, double, double*);
+    void (*zip)(const double*, const double*, size_t, Arith, double*);
+    size_t (*compare)(const double*, size_t, Compare, double, uint8_t*);
+    size_t (*filter)(const double*, size_t, Compare, double, double*);
+    size_t (*select)(const double*, const uint8_t*, size_t, double*);
+    size_t (*count)(const uint8_t*, size_t);
+    void (*advance)(double*, const double*, size_t, double);
+    void (*lerp)(const double*, const double*, size_t, double, double*);
+    size_t (*bounce)(double*, double*, size_t, double, double);
+};
+
+#define AZALEA_KERNEL_TABLE(set) AZALEA_KERNEL_TABLE_OF(set)
+#define AZALEA_KERNEL_TABLE_OF(set) \
+    Table{#set, set::sum, set::min, set::max, set::map, set::zip, \
+          set::compare, set::filter, set::select, set::count, \
+          set::advance, set::lerp, set::bounce}
+
+#if defined(__AVX2__) || defined(AZALEA_KERNELS_AVX2_DISPATCH)
+#if defined(AZALEA_KERNELS_AVX2_DISPATCH)
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#endif
+#endif
+namespace avx2 {
+struct Lanes {
+    using V = __m256d;
+    static constexpr size_t N = 4;
+    static V load(const double* p) { return _mm256_loadu_pd(p); }
+    static void store(double* p, V v) { _mm256_storeu_pd(p, v); }
+    static V set(double x) { return _mm256_set1_pd(x); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V div(V a, V b) {
+        return _mm256_andnot_pd(_mm256_cmp_pd(b, _mm256_setzero_pd(), _CMP_EQ_OQ), _mm256_div_pd(a, b));
+    }
+    static V lesser(V x, V acc) { return _mm256_min_pd(x, acc); }
+    static V greater(V x, V acc) { return _mm256_max_pd(x, acc); }
+    static unsigned eq(V a, V b) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_EQ_OQ))); }
+    static unsigned lt(V a, V b) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LT_OQ))); }
+    static unsigned le(V a, V b) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_LE_OQ))); }
+    static unsigned gt(V a, V b) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GT_OQ))); }
+    static unsigned ge(V a, V b) { return static_cast<unsigned>(_mm256_movemask_pd(_mm256_cmp_pd(a, b, _CMP_GE_OQ))); }
+};
+#include "kernel_loops.h"
+} // namespace avx2
+#if defined(AZALEA_KERNELS_AVX2_DISPATCH)
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+#endif
+
+#if defined(__SSE2__) && !defined(__AVX2__)
+namespace sse2 {
+struct Lanes {
+    using V = __m128d;
+    static constexpr size_t N = 2;
+    static V load(const double* p) { return _mm_loadu_pd(p); }
+    static void store(double* p, V v) { _mm_storeu_pd(p, v); }
+    static V set(double x) { return _mm_set1_pd(x); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm_andnot_pd(_mm_cmpeq_pd(b, _mm_setzero_pd()), _mm_div_pd(a, b)); }
+    static V lesser(V x, V acc) { return _mm_min_pd(x, acc); }
+    static V greater(V x, V acc) { return _mm_max_pd(x, acc); }
+    static unsigned eq(V a, V b) { return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpeq_pd(a, b))); }
+    static unsigned lt(V a, V b) { return static_cast<unsigned>(_mm_movemask_pd(_mm_cmplt_pd(a, b))); }
+    static unsigned le(V a, V b) { return static_cast<unsigned>(_mm_movemask_pd(_mm_cmple_pd(a, b))); }
+    static unsigned gt(V a, V b) { return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpgt_pd(a, b))); }
+    static unsigned ge(V a, V b) { return static_cast<unsigned>(_mm_movemask_pd(_mm_cmpge_pd(a, b))); }
+};
+#include "kernel_loops.h"
+} // namespace sse2
+#define AZALEA_KERNELS_DEFAULT sse2
+
+#elif defined(__aarch64__)
+namespace neon {
+struct Lanes {
+    using V = float64x2_t;
+    static constexpr size_t N = 2;
+    static V load(const double* p) { return vld1q_f64(p); }
+    static void store(double* p, V v) { vst1q_f64(p, v); }
+    static V set(double x) { return vdupq_n_f64(x); }
+    static V add(V a, V b) { return vaddq_f64(a, b); }
+    static V sub(V a, V b) { return vsubq_f64(a, b); }
+    static V mul(V a, V b) { return vmulq_f64(a, b); }
+    static V div(V a, V b) {
+        V zero = vdupq_n_f64(0);
+        return vbslq_f64(vceqq_f64(b, zero), zero, vdivq_f64(a, b));
+    }
+    // vminq_f64 gives NaN if either lane is; these skip NaNs as scalars do
+    static V lesser(V x, V acc) { return vbslq_f64(vcltq_f64(x, acc), x, acc); }
+    static V greater(V x, V acc) { return vbslq_f64(vcgtq_f64(x, acc), x, acc); }
+    static unsigned bits(uint64x2_t mask) {
+        return static_cast<unsigned>((vgetq_lane_u64(mask, 0) & 1) | ((vgetq_lane_u64(mask, 1) & 1) << 1));
+    }
+    static unsigned eq(V a, V b) { return bits(vceqq_f64(a, b)); }
+    static unsigned lt(V a, V b) { return bits(vcltq_f64(a, b)); }
+    static unsigned le(V a, V b) { return bits(vcleq_f64(a, b)); }
+    static unsigned gt(V a, V b) { return bits(vcgtq_f64(a, b)); }
+    static unsigned ge(V a, V b) { return bits(vcgeq_f64(a, b)); }
+};
+#include "kernel_loops.h"
+} // namespace neon
+#define AZALEA_KERNELS_DEFAULT neon
+
+#elif defined(__wasm_simd128__)
+namespace simd128 {
+struct Lanes {
+    using V = v128_t;
+    static constexpr size_t N = 2;
+    static V load(const double* p) { return wasm_v128_load(p); }
+    static void store(double* p, V v) { wasm_v128_store(p, v); }
+    static V set(double x) { return wasm_f64x2_splat(x); }
+    static V add(V a, V b) { return wasm_f64x2_add(a, b); }
+    static V sub(V a, V b) { return wasm_f64x2_sub(a, b); }
+    static V mul(V a, V b) { return wasm_f64x2_mul(a, b); }
+    static V div(V a, V b) { return wasm_v128_andnot(wasm_f64x2_div(a, b), wasm_f64x2_eq(b, wasm_f64x2_splat(0))); }
+    // pmin(a, b) is b < a ? b : a
+    static V lesser(V x, V acc) { return wasm_f64x2_pmin(acc, x); }
+    static V greater(V x, V acc) { return wasm_f64x2_pmax(acc, x); }
+    static unsigned eq(V a, V b) { return wasm_i64x2_bitmask(wasm_f64x2_eq(a, b)); }
+    static unsigned lt(V a, V b) { return wasm_i64x2_bitmask(wasm_f64x2_lt(a, b)); }
+    static unsigned le(V a, V b) { return wasm_i64x2_bitmask(wasm_f64x2_le(a, b)); }
+    static unsigned gt(V a, V b) { return wasm_i64x2_bitmask(wasm_f64x2_gt(a, b)); }
+    static unsigned ge(V a, V b) { return wasm_i64x2_bitmask(wasm_f64x2_ge(a, b)); }
+};
+#include "kernel_loops.h"
+} // namespace simd128
+#define AZALEA_KERNELS_DEFAULT simd128
+
+#elif !defined(__AVX2__)
+namespace scalar {
+struct Lanes {
+    using V = double;
+    static constexpr size_t N = 1;
+    static V load(const double* p) { return *p; }
+    static void store(double* p, V v) { *p = v; }
+    static V set(double x) { return x; }
+    static V add(V a, V b) { return a + b; }
+    static V sub(V a, V b) { return a - b; }
+    static V mul(V a, V b) { return a * b; }
+    static V div(V a, V b) { return arith<Arith::DIV>(a, b); }
+    static V lesser(V x, V acc) { return x < acc ? x : acc; }
+    static V greater(V x, V acc) { return x > acc ? x : acc; }
+    static unsigned eq(V a, V b) { return a == b; }
+    static unsigned lt(V a, V b) { return a < b; }
+    static unsigned le(V a, V b) { return a <= b; }
+    static unsigned gt(V a, V b) { return a > b; }
+    static unsigned ge(V a, V b) { return a >= b; }
+};
+#include "kernel_loops.h"
+} // namespace scalar
+#define AZALEA_KERNELS_DEFAULT scalar
+#endif
+
+const Table& table() {
+#if defined(__AVX2__)
+    static const Table chosen = AZALEA_KERNEL_TABLE(avx2);
+#elif defined(AZALEA_KERNELS_AVX2_DISPATCH)
+    static const Table chosen = __builtin_cpu_supports("avx2") ? AZALEA_KERNEL_TABLE(avx2)
+                                                               : AZALEA_KERNEL_TABLE(AZALEA_KERNELS_DEFAULT);
+#else
+    static const Table chosen = AZALEA_KERNEL_TABLE(AZALEA_KERNELS_DEFAULT);
+#endif
+    return chosen;
+}
+
+} // namespace
+
+bool arithFrom(std::string_view name, Arith& op) {
+    static const std::unordered_map<std::string_view, Arith> names = {
+        {"+", Arith::ADD}, {"plus", Arith::ADD}, {"add", Arith::ADD},
+        {"-", Arith::SUB}, {"minus", Arith::SUB}, {"subtract", Arith::SUB},
+        {"*", Arith::MUL}, {"times", Arith::MUL}, {"multiply", Arith::MUL},
+        {"/", Arith::DIV}, {"div", Arith::DIV}, {"divide", Arith::DIV},
+    };
+    auto found = names.find(name);
+    if (found == names.end()) return false;
+    op = found->second;
+    return true;
+}
+
+bool compareFrom(std::string_view name, Compare& op) {
+    static const std::unordered_map<std::string_view, Compare> names = {
+        {"=", Compare::EQ}, {"==", Compare::EQ}, {"is", Compare::EQ}, {"equals", Compare::EQ},
+        {"same", Compare::EQ}, {"!=", Compare::NE}, {"not", Compare::NE},
+        {"<", Compare::LT}, {"less", Compare::LT}, {"under", Compare::LT}, {"below", Compare::LT},
+        {"<=", Compare::LE}, {">", Compare::GT}, {"greater", Compare::GT}, {"over", Compare::GT},
+        {"above", Compare::GT}, {">=", Compare::GE},
+    };
+    auto found = names.find(name);
+    if (found == names.end()) return false;
+    op = found->second;
+    return true;
+}
+
+const char* isa() { return table().name; }
+
+double sum(const double* x, size_t n) { return table().sum(x, n); }
+double min(const double* x, size_t n) { return table().min(x, n); }
+double max(const double* x, size_t n) { return table().max(x, n); }
+
+void map(const double* x, size_t n, Arith op, double operand, double* out) {
+    table().map(x, n, op, operand, out);
+}
+void zip(const double* x, const double* y, size_t n, Arith op, double* out) {
+    table().zip(x, y, n, op, out);
+}
+size_t compare(const double* x, size_t n, Compare op, double operand, uint8_t* out) {
+    return table().compare(x, n, op, operand, out);
+}
+size_t filter(const double* x, size_t n, Compare op, double operand, double* out) {
+    return table().filter(x, n, op, operand, out);
+}
+size_t select(const double* x, const uint8_t* flags, size_t n, double* out) {
+    return table().select(x, flags, n, out);
+}
+size_t count(const uint8_t* flags, size_t n) { return table().count(flags, n); }
+
+void advance(double* x, const double* v, size_t n, double dt) { table().advance(x, v, n, dt); }
+void lerp(const double* a, const double* b, size_t n, double t, double* out) { table().lerp(a, b, n, t, out); }
+size_t bounce(double* x, double* v, size_t n, double low, double high) {
+    return table().bounce(x, v, n, low, high);
+}
+
+} // namespace kernels
+} // namespace azalea
@@ -0,0 +1,62 @@
+#ifndef AZALEA_KERNELS_H
+#define AZALEA_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace azalea {
+namespace kernels {
+
+// Loops over packed lists (arrays of doubles, and of truth values one byte
+// each) behind the list module. They run on the widest vectors the machine
+// has: AVX2 when the CPU reports it, else SSE2 on x86, NEON on ARM64 and
+// SIMD128 in a WASM build made with -msimd128, falling back to plain
+// loops. Sums add the lanes separately, so they may round differently
+// from adding the numbers one by one.
+
+enum class Arith : uint8_t { ADD, SUB, MUL, DIV };
+// plus, minus, times, over, the symbols and the other spellings the
+// language uses; false if name is none of them
+bool arithFrom(std::string_view name, Arith& op);
+
+// Numbers compare exactly, as query filters do; NaN matches nothing
+enum class Compare : uint8_t { EQ, NE, LT, LE, GT, GE };
+bool compareFrom(std::string_view name, Compare& op);
+
+// The instruction set the kernels run with: avx2, sse2, neon, simd128 or
+// scalar
+const char* isa();
+
+double sum(const double* x, size_t n);
+// n must be at least 1. NaNs are skipped unless x[0] is one
+double min(const double* x, size_t n);
+double max(const double* x, size_t n);
+
+// out[i] = x[i] op operand; out may be x. As in the language, dividing by
+// zero gives zero
+void map(const double* x, size_t n, Arith op, double operand, double* out);
+// out[i] = x[i] op y[i]
+void zip(const double* x, const double* y, size_t n, Arith op, double* out);
+// out[i] = 1 where x[i] op operand holds, else 0; gives how many held
+size_t compare(const double* x, size_t n, Compare op, double operand, uint8_t* out);
+// The x[i] for which x[i] op operand holds, in order, into out (room for
+// n); gives how many
+size_t filter(const double* x, size_t n, Compare op, double operand, double* out);
+// The x[i] whose flags[i] is set, in order, into out (room for n)
+size_t select(const double* x, const uint8_t* flags, size_t n, double* out);
+// How many flags are set
+size_t count(const uint8_t* flags, size_t n);
+
+// x[i] += v[i] * dt
+void advance(double* x, const double* v, size_t n, double dt);
+// out[i] = a[i] + (b[i] - a[i]) * t; out may be a or b
+void lerp(const double* a, const double* b, size_t n, double t, double* out);
+// Each x[i] outside [low, high] is reflected back inside and v[i] turned
+// around to head in; gives how many were. high must not be below low
+size_t bounce(double* x, double* v, size_t n, double low, double high);
+
+} // namespace kernels
+} // namespace azalea
+
+#endif // AZALEA_KERNELS_H
@@ -5,84 +5,281 @@
 #include <cstring>
 
 #ifdef __EMSCRIPTEN__
+#include "dom.h"
+#include "embed.h"
 #include <emscripten.h>
 #include <cstdlib>
+#else
+#include "image.h"
+#include "mapped_file.h"
+#include "profile.h"
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
 #endif
 
 using namespace azalea;
 
 #ifdef __EMSCRIPTEN__
 
-// Global runtime instance
-static Runtime* g_runtime = nullptr;
+// Set by azalea_prepare: requests then run in runtimes recycled from it
+static RuntimePool* g_pool = nullptr;
+
+// The last tree azalea_view returned, which the page is now showing
+static dom::Tree* g_view = nullptr;
+
+static char* toCString(const std::string& text) {
+    char* output = (char*)malloc(text.length() + 1);
+    strcpy(output, text.c_str());
+    return output;
+}
 
 extern "C" {
     EMSCRIPTEN_KEEPALIVE
     char* azalea_execute(const char* source) {
-        if (!g_runtime) {
-            g_runtime = new Runtime();
+        try {
+            Value value;
+            if (g_pool) {
+                // A fresh copy of the prepared program per call; whatever
+                // this source defines is dropped with the lease
+                RuntimePool::Lease runtime = g_pool->acquire();
+                value = runtime->execute(source);
+            } else {
+                value = embed::runtime().execute(source);
+            }
+            return toCString(value.toString());
+        } catch (const std::exception& e) {
+            return toCString(std::string("Error: ") + e.what());
         }
-        
+    }
+
+    // Evaluates source (such as the site's script) once and freezes the
+    // result; later azalea_execute calls start from it instead of from
+    // scratch. Calling it again replaces the snapshot.
+    EMSCRIPTEN_KEEPALIVE
+    char* azalea_prepare(const char* source) {
         try {
-            ValuePtr value = g_runtime->execute(source);
-            std::string result = value->toString();
-            
-            // Allocate memory for the result string
-            char* output = (char*)malloc(result.length() + 1);
-            strcpy(output, result.c_str());
-            return output;
+            Runtime runtime;
+            runtime.setOutput(embed::ring()); // and so every runtime in the pool
+            Value value = runtime.execute(source);
+            delete g_pool;
+            g_pool = new RuntimePool(runtime.snapshot());
+            return toCString(value.toString());
         } catch (const std::exception& e) {
-            std::string error = std::string("Error: ") + e.what();
-            char* output = (char*)malloc(error.length() + 1);
-            strcpy(output, error.c_str());
-            return output;
+            return toCString(std::string("Error: ") + e.what());
         }
     }
     
+    // Evaluates source to a view component. Returns {"html": ...} to
+    // mount, or, when mounted is nonzero and the page still shows the last
+    // component, {"patches": [...]} turning that DOM into this one's
+    // (see dom.h)
+    EMSCRIPTEN_KEEPALIVE
+    char* azalea_view(const char* source, int mounted) {
+        try {
+            Value value;
+            if (g_pool) {
+                RuntimePool::Lease runtime = g_pool->acquire();
+                value = runtime->execute(source);
+            } else {
+                value = embed::runtime().execute(source);
+            }
+            dom::Tree* tree = new dom::Tree(value);
+            ValueMap result;
+            if (g_view && mounted) {
+                result["patches"] = dom::patchesValue(dom::diff(*g_view, *tree));
+            } else {
+                std::string html;
+                dom::render(tree->root(), html);
+                result["html"] = Value(std::move(html));
+            }
+            delete g_view;
+            g_view = tree;
+            std::string json;
+            appendJson(json, Value(std::move(result)));
+            return toCString(json);
+        } catch (const std::exception& e) {
+            std::string json;
+            appendJson(json, Value(ValueMap{{"error", Value(e.what())}}));
+            return toCString(json);
+        }
+    }
+
+    // Everything said since the last call, one line per say, copied out
+    // of the ring (azalea_output_ring reads it in place); the caller frees
+    // it like the other results
+    EMSCRIPTEN_KEEPALIVE
+    char* azalea_output() {
+        return toCString(embed::ring()->take());
+    }
+
     EMSCRIPTEN_KEEPALIVE
     void azalea_print(const char* msg) {
         // In browser, we'll capture this via Module.print
         printf("%s\n", msg);
     }
 }
-#endif
 #else
 // Native CLI
+static void usage() {
+    std::cout << "Azalea Interpreter v1.0" << std::endl;
+    std::cout << "Usage: azalea [--engine=tree|vm[-noopt]] [--no-serve] [--watch] <file.az|file.azc>" << std::endl;
+    std::cout << "   or: azalea [--engine=tree|vm[-noopt]] [--no-serve] -e \"code\"" << std::endl;
+    std::cout << "   or: azalea --compile <file.az> [-o file.azc]" << std::endl;
+    std::cout << "  --engine    tree-walking or bytecode (default vm); -noopt skips constant folding" << std::endl;
+    std::cout << "              and loop-invariant hoisting" << std::endl;
+    std::cout << "  --no-serve  exit after the script instead of starting its server" << std::endl;
+    std::cout << "  --watch     while serving, reload the acts of file.az whenever it is saved" << std::endl;
+    std::cout << "  --compile   write the compiled program; .azc files run without parsing" << std::endl;
+    std::cout << "  --profile[=count|sample]  write PREFIX.folded (flamegraph stacks) and PREFIX.json;" << std::endl;
+    std::cout << "              count times every act and module call and counts every node," << std::endl;
+    std::cout << "              sample only records the act/module stack on a CPU timer" << std::endl;
+    std::cout << "  --profile-out=PREFIX  (default azalea-profile)  --profile-hz=N  (default "
+              << profile::DEFAULT_HZ << ")" << std::endl;
+}
+
+// Stops the recorder and writes its stacks and summary
+static bool writeProfile(profile::Recorder& recorder, const std::string& prefix) {
+    recorder.stop();
+    std::ofstream folded(prefix + ".folded", std::ios::binary);
+    folded << recorder.folded();
+    std::ofstream summary(prefix + ".json", std::ios::binary);
+    summary << recorder.summary() << '\n';
+    if (!folded || !summary) {
+        std::cerr << "Error: Cannot write profile " << prefix << ".folded/.json" << std::endl;
+        return false;
+    }
+    std::cerr << "Profile written to " << prefix << ".folded and " << prefix << ".json" << std::endl;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cout << "Azalea Interpreter v1.0" << std::endl;
-        std::cout << "Usage: azalea <file.az>" << std::endl;
-        std::cout << "   or: azalea -e \"code\"" << std::endl;
+    Runtime runtime;
+    bool serve = true;
+    bool watch = false;
+    bool compile = false;
+    bool profiling = false;
+    profile::Mode profileMode = profile::Mode::COUNT;
+    std::string profileOut = "azalea-profile";
+    int profileHz = profile::DEFAULT_HZ;
+    int argi = 1;
+
+    // Options come before the script
+    while (argi < argc && std::strncmp(argv[argi], "--", 2) == 0) {
+        std::string opt = argv[argi];
+        if (opt == "--engine=tree" || opt == "--engine=tree-noopt") {
+            runtime.setEngine(Engine::TREE);
+            runtime.setOptimize(opt == "--engine=tree");
+        } else if (opt == "--engine=vm" || opt == "--engine=vm-noopt") {
+            runtime.setEngine(Engine::VM);
+            runtime.setOptimize(opt == "--engine=vm");
+        } else if (opt == "--no-serve") {
+            serve = false;
+        } else if (opt == "--watch") {
+            watch = true;
+        } else if (opt == "--compile") {
+            compile = true;
+        } else if (opt == "--profile" || opt == "--profile=count") {
+            profiling = true;
+            profileMode = profile::Mode::COUNT;
+        } else if (opt == "--profile=sample") {
+            profiling = true;
+            profileMode = profile::Mode::SAMPLE;
+        } else if (opt.rfind("--profile-out=", 0) == 0) {
+            profileOut = opt.substr(14);
+        } else if (opt.rfind("--profile-hz=", 0) == 0) {
+            profileHz = std::max(1, std::atoi(opt.c_str() + 13));
+        } else {
+            std::cerr << "Error: Unknown option " << opt << std::endl;
+            usage();
+            return 1;
+        }
+        argi++;
+    }
+
+    if (argi >= argc) {
+        usage();
         return 1;
     }
     
-    Runtime runtime;
     std::string source;
+    MappedFile mapped;
+    bool image = false;
     
-    if (std::string(argv[1]) == "-e" && argc > 2) {
-        source = argv[2];
+    if (std::string(argv[argi]) == "-e" && argi + 1 < argc) {
+        source = argv[argi + 1];
     } else {
-        std::ifstream file(argv[1]);
-        if (!file.is_open()) {
-            std::cerr << "Error: Cannot open file " << argv[1] << std::endl;
+        if (!mapped.open(argv[argi])) {
+            std::cerr << "Error: Cannot open file " << argv[argi] << std::endl;
+            return 1;
+        }
+        // Images run straight from the mapping
+        image = ProgramImage::isImage(mapped.data, mapped.size);
+        if (!image) {
+            source.assign(mapped.data ? mapped.data : "", mapped.size);
+        }
+    }
+
+    if (compile) {
+        std::string output;
+        if (argi + 2 < argc && std::string(argv[argi + 1]) == "-o") {
+            output = argv[argi + 2];
+        } else if (std::string(argv[argi]) != "-e") {
+            output = argv[argi];
+            size_t dot = output.rfind('.');
+            if (dot != std::string::npos && output.find('/', dot) == std::string::npos) {
+                output.erase(dot);
+            }
+            output += ".azc";
+        } else {
+            std::cerr << "Error: --compile -e needs -o <file.azc>" << std::endl;
             return 1;
         }
-        std::stringstream buffer;
-        buffer << file.rdbuf();
-        source = buffer.str();
+        if (image) {
+            std::cerr << "Error: " << argv[argi] << " is already compiled" << std::endl;
+            return 1;
+        }
+        try {
+            std::string bytes = runtime.compileImage(source);
+            std::ofstream out(output, std::ios::binary);
+            if (!out.write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+                std::cerr << "Error: Cannot write " << output << std::endl;
+                return 1;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        return 0;
     }
     
+    if (watch && (image || std::string(argv[argi]) == "-e")) {
+        std::cerr << "Error: --watch needs a .az file" << std::endl;
+        return 1;
+    }
+
+    std::unique_ptr<profile::Recorder> recorder;
+    if (profiling) recorder = std::make_unique<profile::Recorder>(profileMode, profileHz);
+    int status = 0;
     try {
-        ValuePtr result = runtime.execute(source);
-        if (result->type != ValueType::VOID) {
-            std::cout << result->toString() << std::endl;
+        Value result = image ? runtime.executeImage(mapped.data, mapped.size)
+                             : runtime.execute(source);
+        if (result.type != ValueType::VOID) {
+            runtime.print(result.toString());
+        }
+        // Like a Node script, one that called `serve on` keeps serving
+        if (serve) {
+            if (watch) runtime.watch(argv[argi], runtime.compile(source));
+            runtime.run();
         }
     } catch (const std::exception& e) {
+        runtime.flush(); // what the script said before it failed comes first
         std::cerr << "Error: " << e.what() << std::endl;
-        return 1;
+        status = 1;
     }
+    runtime.flush();
+    if (recorder && !writeProfile(*recorder, profileOut)) status = 1;
     
-    return 0;
+    return status;
 }
 #endif
-
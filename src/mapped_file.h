@@ -0,0 +1,66 @@
+#ifndef AZALEA_MAPPED_FILE_H
+#define AZALEA_MAPPED_FILE_H
+
+#include <cstddef>
+
+#ifdef __EMSCRIPTEN__
+#include <fstream>
+#include <iterator>
+#include <string>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace azalea {
+
+// Read-only mapping of a whole file. The browser build has no real mmap,
+// so there the file is read into memory instead.
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+#ifdef __EMSCRIPTEN__
+    std::string contents;
+
+    bool open(const char* path, bool = false) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open()) return false;
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = contents.data();
+        size = contents.size();
+        return true;
+    }
+#else
+    // sequential: the file will be read front to back once, so the kernel
+    // can read ahead aggressively
+    bool open(const char* path, bool sequential = false) {
+        int fd = ::open(path, O_RDONLY);
+        if (fd < 0) return false;
+        struct stat info;
+        bool ok = fstat(fd, &info) == 0;
+        size = ok ? static_cast<size_t>(info.st_size) : 0;
+        if (ok && size > 0) {
+            void* mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            ok = mapped != MAP_FAILED;
+            data = ok ? static_cast<const char*>(mapped) : nullptr;
+            if (ok && sequential) madvise(mapped, size, MADV_SEQUENTIAL);
+        }
+        ::close(fd);
+        return ok;
+    }
+    ~MappedFile() {
+        if (data) munmap(const_cast<char*>(data), size);
+    }
+#endif
+};
+
+} // namespace azalea
+
+#endif // AZALEA_MAPPED_FILE_H
@@ -0,0 +1,151 @@
+#include "markdown.h"
+#include <fstream>
+#include <vector>
+
+namespace azalea {
+
+namespace {
+
+struct LineRule {
+    std::string_view prefix;
+    const char* open;
+    const char* close;
+};
+
+// Longest prefix first so "## " is not taken for "# "
+constexpr LineRule lineRules[] = {
+    {"### ", "<h3>", "</h3>"}, {"## ", "<h2>", "</h2>"}, {"# ", "<h1>", "</h1>"},
+    {"big ", "<h1>", "</h1>"}, {"BIG ", "<h1>", "</h1>"},
+    {"medium ", "<h2>", "</h2>"}, {"MEDIUM ", "<h2>", "</h2>"},
+    {"small ", "<h3>", "</h3>"}, {"SMALL ", "<h3>", "</h3>"},
+    {"- ", "<li>", "</li>"}, {"* ", "<li>", "</li>"}
+};
+
+constexpr std::string_view FENCE = "```";
+constexpr size_t FILE_CHUNK_SIZE = 64 * 1024;
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.substr(0, prefix.size()) == prefix;
+}
+
+} // namespace
+
+void MarkdownRenderer::renderInline(std::string_view text) {
+    size_t pos = 0;
+    while (true) {
+        size_t open = text.find("**", pos);
+        if (open == std::string_view::npos) break;
+        size_t close = text.find("**", open + 2);
+        if (close == std::string_view::npos) break;
+        out.append(text.substr(pos, open - pos));
+        out += "<strong>";
+        out.append(text.substr(open + 2, close - open - 2));
+        out += "</strong>";
+        pos = close + 2;
+    }
+    out.append(text.substr(pos));
+}
+
+void MarkdownRenderer::renderLine(std::string_view line, bool newline) {
+    // Keep CRLF line endings outside the generated tags
+    bool cr = !line.empty() && line.back() == '\r';
+    if (cr) line.remove_suffix(1);
+
+    if (inCode) {
+        if (startsWith(line, FENCE)) {
+            out += "</code></pre>";
+            inCode = false;
+        } else {
+            out.append(line);
+        }
+    } else if (startsWith(line, FENCE)) {
+        std::string_view rest = line.substr(FENCE.size());
+        size_t close = rest.find(FENCE);
+        out += "<pre><code>";
+        if (close == std::string_view::npos) {
+            // Block fence: the rest of the line is a language tag, and the
+            // code starts on the next line
+            inCode = true;
+            return;
+        }
+        out.append(rest.substr(0, close));
+        out += "</code></pre>";
+        renderInline(rest.substr(close + FENCE.size()));
+    } else {
+        const LineRule* rule = nullptr;
+        if (!line.empty()) {
+            for (const LineRule& candidate : lineRules) {
+                if (candidate.prefix[0] == line[0] && startsWith(line, candidate.prefix)) {
+                    rule = &candidate;
+                    break;
+                }
+            }
+        }
+        if (rule) {
+            out += rule->open;
+            renderInline(line.substr(rule->prefix.size()));
+            out += rule->close;
+        } else {
+            renderInline(line);
+        }
+    }
+
+    if (cr) out += '\r';
+    if (newline) out += '\n';
+}
+
+void MarkdownRenderer::feed(std::string_view chunk) {
+    size_t start = 0;
+    size_t nl;
+    while ((nl = chunk.find('\n', start)) != std::string_view::npos) {
+        if (pending.empty()) {
+            renderLine(chunk.substr(start, nl - start), true);
+        } else {
+            pending.append(chunk.substr(start, nl - start));
+            renderLine(pending, true);
+            pending.clear();
+        }
+        start = nl + 1;
+    }
+    pending.append(chunk.substr(start));
+}
+
+void MarkdownRenderer::finish() {
+    if (!pending.empty()) {
+        renderLine(pending, false);
+        pending.clear();
+    }
+    if (inCode) {
+        out += "</code></pre>";
+        inCode = false;
+    }
+}
+
+std::string renderMarkdown(std::string_view markdown) {
+    std::string html;
+    html.reserve(markdown.size() + markdown.size() / 8 + 64);
+    MarkdownRenderer renderer(html);
+    renderer.feed(markdown);
+    renderer.finish();
+    return html;
+}
+
+bool renderMarkdownFile(const std::string& path, std::string& out) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    std::streamoff size = file.tellg();
+    file.seekg(0);
+    if (size > 0) {
+        out.reserve(out.size() + static_cast<size_t>(size) + static_cast<size_t>(size) / 8);
+    }
+
+    MarkdownRenderer renderer(out);
+    std::vector<char> buffer(FILE_CHUNK_SIZE);
+    while (file.read(buffer.data(), buffer.size()) || file.gcount() > 0) {
+        renderer.feed(std::string_view(buffer.data(), static_cast<size_t>(file.gcount())));
+    }
+    renderer.finish();
+    return true;
+}
+
+} // namespace azalea
@@ -0,0 +1,43 @@
+#ifndef AZALEA_MARKDOWN_H
+#define AZALEA_MARKDOWN_H
+
+#include <string>
+#include <string_view>
+
+namespace azalea {
+
+// Single-pass renderer for Azalea's simple markdown. Input can arrive in
+// arbitrary chunks; every completed line is rendered straight onto the
+// end of `out`, so a caller may drain `out` between feeds.
+//
+// Line starts:  big / BIG / #       <h1>
+//               medium / MEDIUM / ## <h2>
+//               small / SMALL / ###  <h3>
+//               - item / * item      <li>
+//               ```                  opens or closes <pre><code>
+// Inline:       **bold**             <strong>
+// Other text is copied unchanged, newlines included.
+class MarkdownRenderer {
+private:
+    std::string& out;
+    std::string pending; // partial line carried between feeds
+    bool inCode = false;
+
+    void renderLine(std::string_view line, bool newline);
+    void renderInline(std::string_view text);
+
+public:
+    explicit MarkdownRenderer(std::string& output) : out(output) {}
+    void feed(std::string_view chunk);
+    void finish(); // renders a trailing partial line, closes an open code block
+};
+
+std::string renderMarkdown(std::string_view markdown);
+
+// Streams a file through the renderer in fixed-size chunks; false if it
+// cannot be opened
+bool renderMarkdownFile(const std::string& path, std::string& out);
+
+} // namespace azalea
+
+#endif // AZALEA_MARKDOWN_H
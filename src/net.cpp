@@ -0,0 +1,725 @@
+#include "net.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef AZALEA_NET_SOCKETS
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+#ifdef AZALEA_NET_TLS
+#include <openssl/err.h>
+#include <openssl/ssl.h>
+#endif
+#ifdef AZALEA_NET_FETCH
+#include <emscripten/fetch.h>
+#endif
+
+namespace azalea {
+namespace net {
+
+namespace {
+
+std::string lower(std::string_view text) {
+    std::string out(text);
+    for (char& c : out) c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    return out;
+}
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t' || text.back() == '\r')) text.remove_suffix(1);
+    return text;
+}
+
+// "Name: value" into headers; anything else is ignored
+void addHeaderLine(std::string_view line, Headers& headers) {
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos || colon == 0) return;
+    headers.emplace_back(lower(trim(line.substr(0, colon))), std::string(trim(line.substr(colon + 1))));
+}
+
+bool hasHeader(const Headers& headers, std::string_view name) {
+    return std::any_of(headers.begin(), headers.end(),
+                       [&](const auto& header) { return lower(header.first) == name; });
+}
+
+} // namespace
+
+std::string_view Response::header(std::string_view name) const {
+    for (const auto& entry : headers) {
+        if (entry.first == name) return entry.second;
+    }
+    return {};
+}
+
+#ifdef AZALEA_NET_SOCKETS
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+constexpr size_t READ_CHUNK = 64 * 1024;
+
+struct Url {
+    bool tls = false;
+    std::string host; // without IPv6 brackets
+    std::string port;
+    std::string target;     // path and query
+    std::string hostHeader; // host, and the port if it is not the default
+};
+
+bool parseUrl(const std::string& text, Url& url, std::string& error) {
+    size_t rest;
+    if (text.compare(0, 7, "http://") == 0) {
+        rest = 7;
+    } else if (text.compare(0, 8, "https://") == 0) {
+        url.tls = true;
+        rest = 8;
+    } else {
+        error = "not an http or https URL: " + text;
+        return false;
+    }
+    size_t end = text.find_first_of("/?#", rest);
+    std::string authority = text.substr(rest, end == std::string::npos ? std::string::npos : end - rest);
+    size_t at = authority.rfind('@');
+    if (at != std::string::npos) authority.erase(0, at + 1); // credentials are not sent
+    url.port = url.tls ? "443" : "80";
+    if (!authority.empty() && authority[0] == '[') {
+        size_t close = authority.find(']');
+        if (close == std::string::npos) {
+            error = "bad host in " + text;
+            return false;
+        }
+        url.host = authority.substr(1, close - 1);
+        if (close + 1 < authority.size() && authority[close + 1] == ':') url.port = authority.substr(close + 2);
+    } else {
+        size_t colon = authority.rfind(':');
+        url.host = authority.substr(0, colon);
+        if (colon != std::string::npos) url.port = authority.substr(colon + 1);
+    }
+    if (url.host.empty() || url.port.empty() ||
+        url.port.find_first_not_of("0123456789") != std::string::npos) {
+        error = "bad host in " + text;
+        return false;
+    }
+    url.hostHeader = url.host.find(':') != std::string::npos ? "[" + url.host + "]" : url.host;
+    if (url.port != (url.tls ? "443" : "80")) url.hostHeader += ":" + url.port;
+
+    url.target = end == std::string::npos ? "/" : text.substr(end);
+    size_t fragment = url.target.find('#');
+    if (fragment != std::string::npos) url.target.resize(fragment);
+    if (url.target.empty() || url.target[0] != '/') url.target.insert(0, "/");
+    return true;
+}
+
+// Location header against the URL it came from
+std::string resolveUrl(const Url& url, const std::string& location) {
+    if (location.compare(0, 7, "http://") == 0 || location.compare(0, 8, "https://") == 0) return location;
+    std::string origin = (url.tls ? "https://" : "http://") + url.hostHeader;
+    if (location.compare(0, 2, "//") == 0) return (url.tls ? "https:" : "http:") + location;
+    if (!location.empty() && location[0] == '/') return origin + location;
+    std::string path = url.target.substr(0, url.target.find('?'));
+    return origin + path.substr(0, path.rfind('/') + 1) + location;
+}
+
+#ifdef AZALEA_NET_TLS
+SSL_CTX* tlsContext(std::string& error) {
+    static std::once_flag once;
+    static SSL_CTX* context = nullptr;
+    std::call_once(once, [] {
+        std::signal(SIGPIPE, SIG_IGN); // OpenSSL writes with plain write()
+        context = SSL_CTX_new(TLS_client_method());
+        if (!context) return;
+        SSL_CTX_set_min_proto_version(context, TLS1_2_VERSION);
+        SSL_CTX_set_default_verify_paths(context);
+        SSL_CTX_set_verify(context, SSL_VERIFY_PEER, nullptr);
+        SSL_CTX_set_mode(context, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+        SSL_CTX_set_options(context, SSL_OP_IGNORE_UNEXPECTED_EOF); // bodies that run until close
+#endif
+    });
+    if (!context) error = "cannot set up TLS";
+    return context;
+}
+#endif
+
+// One connection to a host, plain or TLS, with its unread input
+class Connection {
+public:
+    int fd = -1;
+#ifdef AZALEA_NET_TLS
+    SSL* ssl = nullptr;
+#endif
+    std::string in;
+    size_t consumed = 0;
+    Clock::time_point idleSince;
+
+    ~Connection() {
+#ifdef AZALEA_NET_TLS
+        if (ssl) SSL_free(ssl);
+#endif
+        if (fd >= 0) ::close(fd);
+    }
+
+    size_t buffered() const { return in.size() - consumed; }
+    std::string_view unread() const { return std::string_view(in).substr(consumed); }
+
+    bool send(std::string_view data, std::string& error) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n;
+            bool writable = true;
+#ifdef AZALEA_NET_TLS
+            if (ssl) {
+                n = SSL_write(ssl, data.data() + sent, static_cast<int>(std::min<size_t>(data.size() - sent, 1 << 30)));
+                if (n <= 0 && !retry(n, writable, error)) return false;
+            } else
+#endif
+            {
+#ifdef MSG_NOSIGNAL
+                n = ::send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+#else
+                n = ::send(fd, data.data() + sent, data.size() - sent, 0);
+#endif
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    error = std::string("send: ") + std::strerror(errno);
+                    return false;
+                }
+            }
+            if (n > 0) {
+                sent += static_cast<size_t>(n);
+            } else if (!Scheduler::instance().waitFd(fd, writable, TIMEOUT_MS)) {
+                error = "timed out sending";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // More bytes into `in`; false once the peer has closed (error empty)
+    // or on failure
+    bool fill(std::string& error) {
+        if (consumed > 0 && consumed * 2 >= in.size()) {
+            in.erase(0, consumed);
+            consumed = 0;
+        }
+        size_t size = in.size();
+        in.resize(size + READ_CHUNK);
+        while (true) {
+            ssize_t n;
+            bool writable = false;
+#ifdef AZALEA_NET_TLS
+            if (ssl) {
+                int got = SSL_read(ssl, &in[size], static_cast<int>(READ_CHUNK));
+                if (got > 0) {
+                    n = got;
+                } else if (SSL_get_error(ssl, got) == SSL_ERROR_ZERO_RETURN) {
+                    n = 0;
+                } else if (retry(got, writable, error)) {
+                    n = -1;
+                } else {
+                    n = error.empty() ? 0 : -2; // a bare close reads as the end
+                }
+            } else
+#endif
+            {
+                n = recv(fd, &in[size], READ_CHUNK, 0);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                    error = std::string("recv: ") + std::strerror(errno);
+                    n = -2;
+                }
+            }
+            if (n > 0) {
+                in.resize(size + static_cast<size_t>(n));
+                return true;
+            }
+            if (n == 0 || n == -2) {
+                in.resize(size);
+                return false;
+            }
+            if (!Scheduler::instance().waitFd(fd, writable, TIMEOUT_MS)) {
+                in.resize(size);
+                error = "timed out waiting for the server";
+                return false;
+            }
+        }
+    }
+
+    // At least n bytes buffered; false if the connection ended first
+    bool need(size_t n, std::string& error) {
+        while (buffered() < n) {
+            if (!fill(error)) return false;
+        }
+        return true;
+    }
+
+    // The next CRLF-terminated line, without it
+    bool line(std::string& out, std::string& error) {
+        size_t end;
+        while ((end = unread().find("\r\n")) == std::string_view::npos) {
+            if (!fill(error)) return false;
+        }
+        out.assign(in, consumed, end);
+        consumed += end + 2;
+        return true;
+    }
+
+#ifdef AZALEA_NET_TLS
+    // After an SSL call returned n: true if it only has to wait, with
+    // writable saying for what
+    bool retry(ssize_t n, bool& writable, std::string& error) {
+        int code = SSL_get_error(ssl, static_cast<int>(n));
+        if (code == SSL_ERROR_WANT_READ) {
+            writable = false;
+            return true;
+        }
+        if (code == SSL_ERROR_WANT_WRITE) {
+            writable = true;
+            return true;
+        }
+        unsigned long failure = ERR_get_error();
+        if (failure) {
+            char text[256];
+            ERR_error_string_n(failure, text, sizeof(text));
+            error = text;
+        } else if (code == SSL_ERROR_SYSCALL && errno) {
+            error = std::string("TLS: ") + std::strerror(errno);
+        }
+        ERR_clear_error();
+        return false;
+    }
+
+    bool handshake(const Url& url, std::string& error) {
+        SSL_CTX* context = tlsContext(error);
+        if (!context) return false;
+        ssl = SSL_new(context);
+        SSL_set_fd(ssl, fd);
+        SSL_set_tlsext_host_name(ssl, url.host.c_str());
+        SSL_set1_host(ssl, url.host.c_str());
+        while (true) {
+            int n = SSL_connect(ssl);
+            if (n == 1) return true;
+            bool writable = false;
+            if (!retry(n, writable, error)) {
+                long verified = SSL_get_verify_result(ssl);
+                if (verified != X509_V_OK) error = X509_verify_cert_error_string(verified);
+                if (error.empty()) error = "TLS handshake failed";
+                return false;
+            }
+            if (!Scheduler::instance().waitFd(fd, writable, TIMEOUT_MS)) {
+                error = "timed out in the TLS handshake";
+                return false;
+            }
+        }
+    }
+#endif
+};
+
+struct Address {
+    sockaddr_storage storage;
+    socklen_t size;
+};
+
+struct Lookup {
+    std::vector<Address> addresses;
+    Clock::time_point expires;
+};
+
+// Cached lookups and kept-alive connections, shared by every runtime.
+// Never destroyed: the connections' TLS state must not outlive OpenSSL's
+// own cleanup at exit.
+struct Hosts {
+    std::mutex mutex;
+    std::unordered_map<std::string, Lookup> lookups;
+    std::unordered_map<std::string, std::vector<std::unique_ptr<Connection>>> idle;
+
+    static Hosts& instance() {
+        static Hosts* hosts = new Hosts();
+        return *hosts;
+    }
+};
+
+bool resolve(const Url& url, std::vector<Address>& addresses, std::string& error) {
+    Hosts& hosts = Hosts::instance();
+    std::string key = url.host + " " + url.port;
+    {
+        std::lock_guard<std::mutex> lock(hosts.mutex);
+        auto found = hosts.lookups.find(key);
+        if (found != hosts.lookups.end() && found->second.expires > Clock::now()) {
+            addresses = found->second.addresses;
+            return true;
+        }
+    }
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* results = nullptr;
+    int failed = getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &results);
+    if (failed != 0 || !results) {
+        error = "cannot resolve " + url.host + ": " + gai_strerror(failed);
+        return false;
+    }
+    addresses.clear();
+    for (addrinfo* result = results; result; result = result->ai_next) {
+        Address address = {};
+        std::memcpy(&address.storage, result->ai_addr, result->ai_addrlen);
+        address.size = result->ai_addrlen;
+        addresses.push_back(address);
+    }
+    freeaddrinfo(results);
+    std::lock_guard<std::mutex> lock(hosts.mutex);
+    hosts.lookups[key] = {addresses, Clock::now() + std::chrono::seconds(DNS_TTL_SECONDS)};
+    return true;
+}
+
+std::unique_ptr<Connection> open(const Url& url, std::string& error) {
+    std::vector<Address> addresses;
+    if (!resolve(url, addresses, error)) return nullptr;
+    auto conn = std::make_unique<Connection>();
+    for (const Address& address : addresses) {
+        int fd = socket(address.storage.ss_family, SOCK_STREAM, 0);
+        if (fd < 0) continue;
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        int connected = ::connect(fd, reinterpret_cast<const sockaddr*>(&address.storage), address.size);
+        if (connected < 0 && errno == EINPROGRESS) {
+            int failure = ETIMEDOUT;
+            if (Scheduler::instance().waitFd(fd, true, TIMEOUT_MS)) {
+                socklen_t size = sizeof(failure);
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &failure, &size);
+            }
+            connected = failure == 0 ? 0 : -1;
+            errno = failure;
+        }
+        if (connected < 0) {
+            error = "cannot connect to " + url.hostHeader + ": " + std::strerror(errno);
+            ::close(fd);
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+#ifdef SO_NOSIGPIPE
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+        conn->fd = fd;
+        break;
+    }
+    if (conn->fd < 0) return nullptr;
+    if (url.tls) {
+#ifdef AZALEA_NET_TLS
+        if (!conn->handshake(url, error)) return nullptr;
+#else
+        error = "https is not available in this build";
+        return nullptr;
+#endif
+    }
+    error.clear();
+    return conn;
+}
+
+// A kept-alive connection to key that still looks open, or nullptr
+std::unique_ptr<Connection> takeIdle(const std::string& key) {
+    Hosts& hosts = Hosts::instance();
+    std::lock_guard<std::mutex> lock(hosts.mutex);
+    auto found = hosts.idle.find(key);
+    if (found == hosts.idle.end()) return nullptr;
+    auto& list = found->second;
+    Clock::time_point oldest = Clock::now() - std::chrono::seconds(IDLE_SECONDS);
+    while (!list.empty()) {
+        std::unique_ptr<Connection> conn = std::move(list.back());
+        list.pop_back();
+        // Closed by the server, or sent something nobody asked for
+        char byte;
+        ssize_t peeked = recv(conn->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        bool quiet = peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+        if (quiet && conn->idleSince > oldest && conn->buffered() == 0) return conn;
+    }
+    return nullptr;
+}
+
+void keepIdle(const std::string& key, std::unique_ptr<Connection> conn) {
+    Hosts& hosts = Hosts::instance();
+    conn->idleSince = Clock::now();
+    std::lock_guard<std::mutex> lock(hosts.mutex);
+    auto& list = hosts.idle[key];
+    if (list.size() >= MAX_IDLE) list.erase(list.begin());
+    list.push_back(std::move(conn));
+}
+
+std::string requestHead(const Url& url, const Request& request) {
+    std::string head = request.method + " " + url.target + " HTTP/1.1\r\nHost: " + url.hostHeader + "\r\n";
+    if (!hasHeader(request.headers, "user-agent")) head += "User-Agent: azalea\r\n";
+    if (!hasHeader(request.headers, "accept")) head += "Accept: */*\r\n";
+    for (const auto& header : request.headers) {
+        head += header.first + ": " + header.second + "\r\n";
+    }
+    bool hasBody = !request.body.empty() || request.method == "POST" || request.method == "PUT" ||
+                   request.method == "PATCH";
+    if (hasBody && !hasHeader(request.headers, "content-length")) {
+        head += "Content-Length: " + std::to_string(request.body.size()) + "\r\n";
+    }
+    return head + "\r\n";
+}
+
+bool isRedirect(int status) {
+    return status == 301 || status == 302 || status == 303 || status == 307 || status == 308;
+}
+
+// Reads the body framed by the response head into sink; clears reusable
+// when the connection cannot carry another request afterwards
+bool readBody(Connection& conn, const std::string& method, Response& response, const Chunk& sink,
+              bool& reusable) {
+    std::string& error = response.error;
+    if (method == "HEAD" || response.status == 204 || response.status == 304) return true;
+
+    auto pass = [&](size_t n) {
+        std::string_view data = conn.unread().substr(0, n);
+        conn.consumed += data.size();
+        if (sink(data)) return true;
+        reusable = false;
+        return false;
+    };
+
+    if (lower(response.header("transfer-encoding")).find("chunked") != std::string::npos) {
+        std::string line;
+        while (true) {
+            if (!conn.line(line, error)) return false;
+            char* end = nullptr;
+            unsigned long long size = std::strtoull(line.c_str(), &end, 16);
+            if (end == line.c_str()) {
+                error = "malformed chunked body";
+                return false;
+            }
+            if (size == 0) break;
+            while (size > 0) {
+                if (conn.buffered() == 0 && !conn.fill(error)) return false;
+                size_t n = static_cast<size_t>(std::min<unsigned long long>(size, conn.buffered()));
+                if (!pass(n)) return true;
+                size -= n;
+            }
+            if (!conn.need(2, error)) return false;
+            conn.consumed += 2;
+        }
+        // Trailers, up to the empty line
+        do {
+            if (!conn.line(line, error)) return false;
+        } while (!line.empty());
+        return true;
+    }
+
+    std::string_view length = response.header("content-length");
+    if (!length.empty()) {
+        unsigned long long left = std::strtoull(std::string(length).c_str(), nullptr, 10);
+        while (left > 0) {
+            if (conn.buffered() == 0 && !conn.fill(error)) {
+                if (error.empty()) error = "connection closed mid-body";
+                return false;
+            }
+            size_t n = static_cast<size_t>(std::min<unsigned long long>(left, conn.buffered()));
+            if (!pass(n)) return true;
+            left -= n;
+        }
+        return true;
+    }
+
+    // Neither: the body runs until the server closes
+    reusable = false;
+    while (true) {
+        if (conn.buffered() > 0 && !pass(conn.buffered())) return true;
+        if (!conn.fill(error)) return error.empty();
+    }
+}
+
+// One exchange on conn. started says whether any of the response came,
+// since a kept-alive connection the server closed meanwhile fails before
+// that and can be retried on a new one.
+bool exchange(Connection& conn, const Url& url, const Request& request, Response& response,
+              const Chunk& chunk, bool followRedirect, bool& reusable, bool& started) {
+    std::string& error = response.error;
+    std::string head = requestHead(url, request);
+    if (!request.body.empty() && request.body.size() < 16 * 1024) {
+        if (!conn.send(head + request.body, error)) return false;
+    } else if (!conn.send(head, error) || !conn.send(request.body, error)) {
+        return false;
+    }
+
+    std::string line;
+    do {
+        // Interim 1xx responses come before the real one
+        response.headers.clear();
+        if (conn.buffered() == 0 && !conn.fill(error)) return false;
+        started = true;
+        if (!conn.line(line, error)) return false;
+        if (line.compare(0, 5, "HTTP/") != 0 || line.size() < 12) {
+            error = "malformed response from " + url.hostHeader;
+            return false;
+        }
+        response.status = std::atoi(line.c_str() + 9);
+        bool http10 = line.compare(5, 3, "1.0") == 0;
+        while (true) {
+            std::string header;
+            if (!conn.line(header, error)) return false;
+            if (header.empty()) break;
+            addHeaderLine(header, response.headers);
+        }
+        std::string connection = lower(response.header("connection"));
+        reusable = http10 ? connection.find("keep-alive") != std::string::npos
+                          : connection.find("close") == std::string::npos;
+    } while (response.status >= 100 && response.status < 200);
+
+    bool redirecting = followRedirect && isRedirect(response.status) && !response.header("location").empty();
+    Chunk collect = [&](std::string_view data) {
+        response.body.append(data);
+        return true;
+    };
+    Chunk discard = [](std::string_view) { return true; };
+    bool read = readBody(conn, request.method, response, redirecting ? discard : chunk ? chunk : collect, reusable);
+    if (!read) reusable = false;
+    return read;
+}
+
+// request against url, on a kept-alive connection when there is one
+bool perform(const Url& url, const Request& request, Response& response, const Chunk& chunk,
+             bool followRedirect) {
+    std::string key = (url.tls ? "https://" : "http://") + url.host + " " + url.port;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        std::unique_ptr<Connection> conn = attempt == 0 ? takeIdle(key) : nullptr;
+        bool reused = conn != nullptr;
+        if (!conn) {
+            conn = open(url, response.error);
+            if (!conn) return false;
+        }
+        bool reusable = false, started = false;
+        if (exchange(*conn, url, request, response, chunk, followRedirect, reusable, started)) {
+            if (reusable) keepIdle(key, std::move(conn));
+            return true;
+        }
+        if (!reused || started) {
+            if (response.error.empty()) response.error = "connection closed by " + url.hostHeader;
+            return false;
+        }
+        response.error.clear();
+    }
+    return false;
+}
+
+// Removes the headers for which drop(lower-cased name) is true
+template <typename Drop>
+void dropHeaders(Headers& headers, Drop drop) {
+    headers.erase(std::remove_if(headers.begin(), headers.end(),
+                                 [&drop](const auto& header) { return drop(lower(header.first)); }),
+                  headers.end());
+}
+
+bool sameOrigin(const Url& a, const Url& b) {
+    return a.tls == b.tls && a.port == b.port && lower(a.host) == lower(b.host);
+}
+
+} // namespace
+
+Response fetch(const Request& request, const Chunk& chunk) {
+    Request current = request;
+    for (int redirects = 0;; redirects++) {
+        Response response;
+        response.url = current.url;
+        Url url;
+        if (!parseUrl(current.url, url, response.error)) return response;
+        bool follow = redirects < MAX_REDIRECTS;
+        if (!perform(url, current, response, chunk, follow)) {
+            response.status = 0;
+            return response;
+        }
+        if (!follow || !isRedirect(response.status) || response.header("location").empty()) return response;
+
+        current.url = resolveUrl(url, std::string(response.header("location")));
+        // 303, and 301/302 after a POST as every browser does, become GETs
+        if (response.status == 303 || ((response.status == 301 || response.status == 302) && current.method == "POST")) {
+            current.method = "GET";
+            current.body.clear();
+            dropHeaders(current.headers, [](const std::string& name) {
+                return name == "content-type" || name == "content-length";
+            });
+        }
+        // Credentials are only for the origin they were given to
+        Url next;
+        std::string ignored;
+        if (!parseUrl(current.url, next, ignored) || !sameOrigin(url, next)) {
+            dropHeaders(current.headers, [](const std::string& name) {
+                return name == "authorization" || name == "cookie" || name == "proxy-authorization";
+            });
+        }
+    }
+}
+
+#endif // AZALEA_NET_SOCKETS
+
+#ifdef AZALEA_NET_FETCH
+
+// The page's fetch, synchronously: without threads the caller cannot be
+// parked, so redirects, pooling and caching are the browser's
+Response fetch(const Request& request, const Chunk& chunk) {
+    Response response;
+    response.url = request.url;
+    emscripten_fetch_attr_t attr;
+    emscripten_fetch_attr_init(&attr);
+    std::snprintf(attr.requestMethod, sizeof(attr.requestMethod), "%s", request.method.c_str());
+    attr.attributes = EMSCRIPTEN_FETCH_LOAD_TO_MEMORY | EMSCRIPTEN_FETCH_SYNCHRONOUS;
+    std::vector<const char*> headers;
+    for (const auto& header : request.headers) {
+        headers.push_back(header.first.c_str());
+        headers.push_back(header.second.c_str());
+    }
+    headers.push_back(nullptr);
+    attr.requestHeaders = headers.data();
+    attr.requestData = request.body.data();
+    attr.requestDataSize = request.body.size();
+
+    emscripten_fetch_t* fetched = emscripten_fetch(&attr, request.url.c_str());
+    if (!fetched) {
+        response.error = "fetch failed";
+        return response;
+    }
+    response.status = fetched->status;
+    if (response.status == 0) response.error = fetched->statusText[0] ? fetched->statusText : "fetch failed";
+    size_t length = emscripten_fetch_get_response_headers_length(fetched);
+    std::string raw(length + 1, '\0');
+    emscripten_fetch_get_response_headers(fetched, &raw[0], raw.size());
+    raw.resize(length);
+    for (size_t start = 0; start < raw.size();) {
+        size_t end = raw.find('\n', start);
+        if (end == std::string::npos) end = raw.size();
+        addHeaderLine(std::string_view(raw).substr(start, end - start), response.headers);
+        start = end + 1;
+    }
+    std::string_view body(fetched->data, static_cast<size_t>(fetched->numBytes));
+    if (chunk) {
+        chunk(body);
+    } else {
+        response.body.assign(body);
+    }
+    emscripten_fetch_close(fetched);
+    return response;
+}
+
+#endif // AZALEA_NET_FETCH
+
+std::vector<Response> fetchAll(const std::vector<Request>& requests) {
+    std::vector<Response> responses(requests.size());
+    Scheduler::instance().parallel(requests.size(), [&](size_t i) { responses[i] = fetch(requests[i]); });
+    return responses;
+}
+
+} // namespace net
+} // namespace azalea
@@ -0,0 +1,69 @@
+#ifndef AZALEA_NET_H
+#define AZALEA_NET_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// The browser build hands requests to the page's fetch; native builds
+// speak HTTP/1.1 over their own sockets, with TLS from OpenSSL when its
+// headers are installed (the Makefile links it on the same condition)
+#if defined(__EMSCRIPTEN__)
+#define AZALEA_NET_FETCH 1
+#else
+#define AZALEA_NET_SOCKETS 1
+#if defined(__has_include)
+#if __has_include(<openssl/ssl.h>)
+#define AZALEA_NET_TLS 1
+#endif
+#endif
+#endif
+
+namespace azalea {
+namespace net {
+
+constexpr int MAX_REDIRECTS = 5;
+constexpr size_t MAX_IDLE = 8;      // kept-alive connections per host
+constexpr int TIMEOUT_MS = 30000;   // for connecting and for each read or write
+constexpr int IDLE_SECONDS = 30;    // before a kept-alive connection is dropped
+constexpr int DNS_TTL_SECONDS = 60; // for cached lookups
+
+using Headers = std::vector<std::pair<std::string, std::string>>;
+
+struct Request {
+    std::string method = "GET";
+    std::string url;
+    Headers headers;
+    std::string body;
+};
+
+struct Response {
+    int status = 0;  // 0 when no response came, with error saying why
+    Headers headers; // names lowercased, in the order received
+    std::string body;
+    std::string url; // the one finally answered, after redirects
+    std::string error;
+
+    bool ok() const { return status >= 200 && status < 300; }
+    std::string_view header(std::string_view name) const; // lowercase name; "" if absent
+};
+
+// Body bytes as they arrive, instead of being collected into the body.
+// Returning false stops the transfer.
+using Chunk = std::function<bool(std::string_view data)>;
+
+// One request, following redirects. Connections are kept alive and reused
+// per host, and lookups are cached; a task waiting on the network parks,
+// leaving its worker to other tasks.
+Response fetch(const Request& request, const Chunk& chunk = nullptr);
+// Every request at once, each in its own task, so their waits overlap.
+// Responses come back in request order.
+std::vector<Response> fetchAll(const std::vector<Request>& requests);
+
+} // namespace net
+} // namespace azalea
+
+#endif // AZALEA_NET_H
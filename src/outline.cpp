@@ -0,0 +1,247 @@
+#include "outline.h"
+#include <algorithm>
+#include <cctype>
+#include <numeric>
+#include <unordered_set>
+
+namespace azalea {
+
+namespace {
+
+using Moved = std::vector<std::pair<const ASTNode*, const ASTNode*>>; // ACT nodes, and their copies
+
+// Whether node has a loop still marked `in parallel`
+bool hasParallel(const ASTNode* node) {
+    if (!node) return false;
+    if (node->type == NodeType::LOOP && node->parallel) return true;
+    for (const ASTNode* child : node->children) {
+        if (hasParallel(child)) return true;
+    }
+    return false;
+}
+
+void actsIn(const ASTNode* node, std::vector<const ASTNode*>& acts) {
+    if (!node) return;
+    if (node->type == NodeType::ACT && !node->children.empty()) acts.push_back(node);
+    for (const ASTNode* child : node->children) {
+        actsIn(child, acts);
+    }
+}
+
+// node without its children, in arena. Names are the symbol table's, but
+// texts are in the arena node came from.
+ASTNode* copyNode(const ASTNode& node, Arena& arena) {
+    ASTNode* copy = arena.make<ASTNode>(node);
+    copy->children = Span<ASTNode*>();
+    copy->cache = MapCache();
+    if (node.symbol == NO_SYMBOL) copy->value = arena.copy(node.value);
+    return copy;
+}
+
+// A copy of node and everything under it in arena, lines later by lines
+ASTNode* relocate(const ASTNode* node, Arena& arena, int64_t lines, Moved& moved, std::vector<const ASTNode*>& acts) {
+    if (!node) return nullptr;
+    ASTNode* copy = copyNode(*node, arena);
+    copy->line = static_cast<uint32_t>(node->line + lines);
+    if (!node->children.empty()) {
+        copy->children.items = arena.allocArray<ASTNode*>(node->children.size());
+        copy->children.count = node->children.count;
+        for (size_t i = 0; i < node->children.size(); i++) {
+            copy->children[i] = relocate(node->children[i], arena, lines, moved, acts);
+        }
+    }
+    if (node->type == NodeType::ACT && !node->children.empty()) {
+        moved.emplace_back(node, copy);
+        acts.push_back(copy);
+    }
+    return copy;
+}
+
+Lexer::Mark shifted(Lexer::Mark mark, int64_t shift, int64_t lines) {
+    mark.pos = static_cast<uint32_t>(mark.pos + shift);
+    mark.line = static_cast<uint32_t>(mark.line + lines);
+    return mark;
+}
+
+} // namespace
+
+void Outline::parse(Runtime& runtime, const std::string& source, const ProgramCache::Entry* base) {
+    // Marks hold 32-bit offsets
+    if (base && base->outline && std::max(source.size(), base->source.size()) < UINT32_MAX) {
+        parseEdit(runtime, source, base->source, *base->outline);
+        return;
+    }
+    auto piece = std::make_shared<Program>();
+    Lexer lexer(source);
+    Parser parser(lexer, *piece, runtime.own().symbols);
+    ASTNode* root = parser.begin();
+    parseFrom(parser, piece, nullptr, 0, 0, 0);
+    std::vector<size_t> fresh(statements.size());
+    std::iota(fresh.begin(), fresh.end(), 0);
+    finish(runtime, *piece, root, fresh);
+    piece->root = root;
+    program = piece;
+}
+
+size_t Outline::parseFrom(Parser& parser, const std::shared_ptr<Program>& piece, const Outline* prior, size_t next,
+                          size_t edited, int64_t shift) {
+    size_t count = prior ? prior->statements.size() : 0;
+    auto startOf = [&](size_t i) { return static_cast<int64_t>(prior->statements[i].start.pos) + shift; };
+    while (!parser.done()) {
+        Lexer::Mark here = parser.mark();
+        // Past the edit the text is the old text, so from the start of a
+        // statement there the parser would go the way it went before
+        if (here.pos >= edited) {
+            while (next < count && startOf(next) < here.pos) next++;
+            if (next < count && startOf(next) == here.pos && prior->statements[next].start.col == here.col) {
+                return next;
+            }
+        }
+        if (ASTNode* node = parser.parseTopLevel()) {
+            statements.push_back({node, piece, here, parser.mark(), parser.scanned(), hasParallel(node), {}});
+        }
+    }
+    return count;
+}
+
+void Outline::parseEdit(Runtime& runtime, const std::string& source, const std::string& before, const Outline& prior) {
+    // The edit replaced what lies between the longest common prefix and
+    // suffix
+    size_t limit = std::min(source.size(), before.size());
+    size_t prefix = 0;
+    while (prefix < limit && source[prefix] == before[prefix]) prefix++;
+    size_t suffix = 0;
+    while (suffix < limit - prefix && source[source.size() - 1 - suffix] == before[before.size() - 1 - suffix]) suffix++;
+    size_t edited = source.size() - suffix;
+    int64_t shift = static_cast<int64_t>(source.size()) - static_cast<int64_t>(before.size());
+
+    // Statements whose lexer read nothing the edit changed stay as they are
+    const std::vector<Statement>& old = prior.statements;
+    size_t first = 0;
+    while (first < old.size() && old[first].scanned < prefix) first++;
+    statements.assign(old.begin(), old.begin() + first);
+
+    auto piece = std::make_shared<Program>();
+    SymbolTable& symbols = runtime.own().symbols;
+    Lexer lexer(source, first > 0 ? old[first - 1].end : Lexer::Mark());
+    Parser parser(lexer, *piece, symbols);
+    ASTNode* root = first > 0 ? copyNode(*prior.program->root, piece->arena) : parser.begin();
+    size_t resume = parseFrom(parser, piece, &prior, first, edited, shift);
+    std::vector<size_t> fresh(statements.size() - first);
+    std::iota(fresh.begin(), fresh.end(), first);
+
+    Moved moved;
+    if (resume < old.size()) {
+        int64_t lines = static_cast<int64_t>(parser.mark().line) - old[resume].start.line;
+        for (size_t i = resume; i < old.size(); i++) {
+            Statement statement = old[i];
+            statement.start = shifted(statement.start, shift, lines);
+            statement.end = shifted(statement.end, shift, lines);
+            statement.scanned = static_cast<uint32_t>(statement.scanned + shift);
+            if (lines != 0) {
+                statement.acts.clear();
+                statement.node = relocate(statement.node, piece->arena, lines, moved, statement.acts);
+                statement.piece = piece;
+            }
+            statements.push_back(std::move(statement));
+        }
+    }
+
+    // The Resolver kept a loop `in parallel` by what the acts it calls do,
+    // so once acts change the kept statements with such loops are parsed
+    // again, to be checked again
+    bool actsChanged = false;
+    for (size_t i = first; i < resume && i < old.size(); i++) actsChanged = actsChanged || !old[i].acts.empty();
+    for (size_t i : fresh) {
+        std::vector<const ASTNode*> acts;
+        actsIn(statements[i].node, acts);
+        actsChanged = actsChanged || !acts.empty();
+    }
+    size_t parsed = fresh.size();
+    if (actsChanged) {
+        for (size_t i = 0; i < statements.size(); i++) {
+            Statement& statement = statements[i];
+            if (!statement.parallel || (i >= first && i < first + parsed)) continue;
+            Lexer again(source, statement.start);
+            Parser reparser(again, *piece, symbols);
+            if (ASTNode* node = reparser.parseTopLevel()) {
+                statement.node = node;
+                statement.piece = piece;
+                statement.acts.clear();
+                fresh.push_back(i);
+            }
+        }
+        std::sort(fresh.begin(), fresh.end());
+    }
+
+    // The compiled acts of the statements kept
+    for (const Statement& statement : statements) {
+        if (statement.piece == piece) continue;
+        for (const ASTNode* act : statement.acts) {
+            auto found = prior.protos.find(act);
+            if (found != prior.protos.end()) protos.insert(*found);
+        }
+    }
+    // and of those moved, which only have lines in them when profiled
+    for (const auto& [from, to] : moved) {
+        auto found = prior.protos.find(from);
+        if (found != prior.protos.end() && found->second->chunk.profileNodes.empty()) protos.emplace(to, found->second);
+    }
+
+    finish(runtime, *piece, root, fresh);
+    if (fresh.size() == statements.size()) {
+        piece->root = root;
+        program = piece;
+        return;
+    }
+    program = std::make_shared<Program>();
+    program->root = root;
+    program->parts.push_back(piece);
+    std::unordered_set<const Program*> held{piece.get()};
+    for (const Statement& statement : statements) {
+        if (held.insert(statement.piece.get()).second) program->parts.push_back(statement.piece);
+    }
+}
+
+void Outline::finish(Runtime& runtime, Program& piece, ASTNode* root, const std::vector<size_t>& fresh) {
+    // The passes load runs over a whole program, here over the statements
+    // just parsed, which are the only ones not done yet
+    Resolver resolver(runtime);
+    for (size_t i : fresh) resolver.resolve(statements[i].node);
+    if (!statements.empty()) {
+        root->children.items = piece.arena.allocArray<ASTNode*>(statements.size());
+        root->children.count = static_cast<uint32_t>(statements.size());
+        for (size_t i = 0; i < statements.size(); i++) root->children[i] = statements[i].node;
+    }
+    for (size_t i : fresh) {
+        resolver.checkParallel(statements[i].node, root);
+        resolver.markTailCalls(statements[i].node);
+    }
+    if (runtime.optimizing) {
+        Optimizer optimizer(runtime, piece);
+        for (size_t i : fresh) root->children[i] = statements[i].node = optimizer.optimize(statements[i].node);
+    }
+    for (size_t i : fresh) actsIn(statements[i].node, statements[i].acts);
+}
+
+std::string_view Outline::text(const std::string& source, size_t i) const {
+    const Statement& statement = statements[i];
+    size_t from = statement.start.pos;
+    size_t to = std::min<size_t>(statement.end.pos, source.size());
+    // Past what the lexer skipped before the first token
+    while (from < to) {
+        if (std::isspace(static_cast<unsigned char>(source[from]))) {
+            from++;
+        } else if (source.compare(from, 2, "//") == 0) {
+            from = std::min(source.find('\n', from), to);
+        } else if (source.compare(from, 2, "/*") == 0) {
+            size_t close = source.find("*/", from + 2);
+            from = close == std::string::npos ? to : std::min(close + 2, to);
+        } else {
+            break;
+        }
+    }
+    return std::string_view(source).substr(from, to - from);
+}
+
+} // namespace azalea
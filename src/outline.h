@@ -0,0 +1,65 @@
+#ifndef AZALEA_OUTLINE_H
+#define AZALEA_OUTLINE_H
+
+#include "azalea.h"
+#include "vm.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace azalea {
+
+// The top-level statements of a loaded program: where each one's source
+// starts and ends, and how far the lexer had read once it was parsed. An
+// edited version of the source is lexed and parsed again from the first
+// statement the edit reaches, and only until the parser is back at the
+// start of a statement after the edit; the statements around it are kept
+// with their passes done, and so are their compiled acts for the VM.
+// Statements after an edit that added or removed lines are copied with
+// their lines moved, as the profiler reports nodes by line.
+//
+// Statements are allocated in pieces: the Program of the load that parsed
+// them, which has no parts of its own. A version's Program holds the
+// pieces its statements are in, so a piece is freed with the last version
+// that still has one of its statements.
+class Outline {
+public:
+    struct Statement {
+        ASTNode* node;                  // as both engines run it
+        std::shared_ptr<Program> piece; // that allocated node
+        Lexer::Mark start;              // lexing its first token began here
+        Lexer::Mark end;                // and lexing the next token here
+        uint32_t scanned;               // how far the lexer had read then
+        bool parallel;                  // it has a loop written `in parallel`
+        std::vector<const ASTNode*> acts; // the ACT nodes in it
+    };
+
+    std::vector<Statement> statements;
+    std::shared_ptr<Program> program; // the version: a root over the statements
+    ActProtos protos;                 // VM: its compiled acts (see Compiler::reuseActs)
+
+    // Parses source for runtime and runs the Resolver's and Optimizer's
+    // passes over it, reusing what the edit from base (a program runtime
+    // loaded before, or nullptr) left alone
+    void parse(Runtime& runtime, const std::string& source, const ProgramCache::Entry* base);
+    // Statement i's source, from its first token to the end of its last
+    std::string_view text(const std::string& source, size_t i) const;
+
+private:
+    // Parses from where parser is on, appending the statements to
+    // piece, until the end or until it is at the start of one of prior's
+    // statements from next on at or after edited (an offset in the new
+    // source, shift bytes on from the old); gives that statement's index,
+    // or the number of them if it never was
+    size_t parseFrom(Parser& parser, const std::shared_ptr<Program>& piece, const Outline* prior, size_t next,
+                     size_t edited, int64_t shift);
+    void parseEdit(Runtime& runtime, const std::string& source, const std::string& before, const Outline& prior);
+    // Gives root the statements and runs the passes over the fresh ones
+    void finish(Runtime& runtime, Program& piece, ASTNode* root, const std::vector<size_t>& fresh);
+};
+
+} // namespace azalea
+
+#endif // AZALEA_OUTLINE_H
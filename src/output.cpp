@@ -0,0 +1,135 @@
+#include "output.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace azalea {
+namespace output {
+
+Stream::Stream(int fd) : fd(fd), interactive(isatty(fd) == 1) {
+    buffer.reserve(BUFFER);
+}
+
+Stream::~Stream() {
+    flush();
+}
+
+void Stream::write(std::string_view extra) {
+    iovec parts[2] = {{buffer.data(), buffer.size()}, {const_cast<char*>(extra.data()), extra.size()}};
+    iovec* part = parts;
+    int count = extra.empty() ? 1 : 2;
+    while (count > 0) {
+        if (part->iov_len == 0) {
+            part++;
+            count--;
+            continue;
+        }
+        ssize_t n = ::writev(fd, part, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break; // stdout is gone; what was said is dropped, as with a closed pipe
+        }
+        // Short writes resume where they stopped
+        size_t done = static_cast<size_t>(n);
+        while (count > 0 && done >= part->iov_len) {
+            done -= part->iov_len;
+            part++;
+            count--;
+        }
+        if (count > 0) {
+            part->iov_base = static_cast<char*>(part->iov_base) + done;
+            part->iov_len -= done;
+        }
+    }
+    buffer.clear();
+}
+
+void Stream::line(std::string_view text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (text.size() >= DIRECT) {
+        write(text); // after the lines already buffered, so the order holds
+        buffer += '\n';
+    } else {
+        if (buffer.size() + text.size() + 1 > BUFFER) write({});
+        buffer.append(text.data(), text.size());
+        buffer += '\n';
+    }
+    if (interactive || buffer.size() >= BUFFER) write({});
+}
+
+void Stream::flush() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!buffer.empty()) write({});
+}
+
+void Capture::line(std::string_view line) {
+    std::lock_guard<std::mutex> lock(mutex);
+    text.append(line.data(), line.size());
+    text += '\n';
+}
+
+std::string Capture::take() {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string out;
+    out.swap(text);
+    return out;
+}
+
+Ring::Ring(size_t capacity) {
+    size_t size = 64;
+    while (size < capacity && size < (size_t(1) << 31)) size <<= 1;
+    memory.reset(new char[sizeof(Header) + size]);
+    header() = Header{static_cast<uint32_t>(size), 0, 0, 0};
+}
+
+void Ring::append(std::string_view bytes) {
+    Header& ring = header();
+    uint32_t unread = std::min(ring.written - ring.read, ring.capacity);
+    if (bytes.size() > ring.capacity) { // only its end fits, over everything unread
+        uint32_t skip = static_cast<uint32_t>(bytes.size() - ring.capacity);
+        ring.dropped += unread + skip;
+        ring.written += skip;
+        unread = 0;
+        bytes.remove_prefix(skip);
+    }
+    uint32_t size = static_cast<uint32_t>(bytes.size());
+    if (unread + size > ring.capacity) {
+        uint32_t lost = unread + size - ring.capacity;
+        ring.dropped += lost;
+        unread -= lost;
+    }
+    ring.read = ring.written - unread;
+    uint32_t at = ring.written & (ring.capacity - 1);
+    uint32_t first = std::min(size, ring.capacity - at);
+    std::memcpy(data() + at, bytes.data(), first);
+    std::memcpy(data(), bytes.data() + first, size - first);
+    ring.written += size;
+}
+
+void Ring::line(std::string_view text) {
+    std::lock_guard<std::mutex> lock(mutex);
+    append(text);
+    append("\n");
+}
+
+std::string Ring::take() {
+    std::lock_guard<std::mutex> lock(mutex);
+    Header& ring = header();
+    uint32_t unread = std::min(ring.written - ring.read, ring.capacity);
+    uint32_t at = (ring.written - unread) & (ring.capacity - 1);
+    uint32_t first = std::min(unread, ring.capacity - at);
+    std::string out(data() + at, first);
+    out.append(data(), unread - first);
+    ring.read = ring.written;
+    return out;
+}
+
+std::shared_ptr<Sink> standard() {
+    static std::shared_ptr<Sink> out = std::make_shared<Stream>(STDOUT_FILENO);
+    return out;
+}
+
+} // namespace output
+} // namespace azalea
@@ -0,0 +1,99 @@
+#ifndef AZALEA_OUTPUT_H
+#define AZALEA_OUTPUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+namespace azalea {
+namespace output {
+
+constexpr size_t BUFFER = 64 * 1024; // bytes held before a write
+constexpr size_t DIRECT = 16 * 1024; // lines this long go out with the buffer in one writev, uncopied
+
+// Where Runtime::print sends what a script says. Runtimes forked for
+// tasks share their parent's sink, so sinks take lines from any thread.
+class Sink {
+public:
+    virtual ~Sink() = default;
+    virtual void line(std::string_view text) = 0; // text and a newline
+    virtual void flush() {}
+};
+
+// Lines buffered and written to a file descriptor BUFFER bytes at a time,
+// or at each flush. On a terminal every line is flushed as it is said.
+class Stream : public Sink {
+private:
+    int fd;
+    bool interactive;
+    std::mutex mutex;
+    std::string buffer;
+
+    void write(std::string_view extra); // the buffer, then extra, in one writev
+
+public:
+    explicit Stream(int fd);
+    ~Stream() override; // flushes
+    Stream(const Stream&) = delete;
+    Stream& operator=(const Stream&) = delete;
+
+    void line(std::string_view text) override;
+    void flush() override;
+};
+
+// Lines kept in memory, for embedders that return output instead of
+// printing it (the WASM exports)
+class Capture : public Sink {
+private:
+    std::mutex mutex;
+    std::string text;
+
+public:
+    void line(std::string_view text) override;
+    std::string take(); // everything since the last take
+};
+
+// Lines written into a fixed buffer that a reader in the same address
+// space drains in place, as JS does from WASM memory. The header counts
+// bytes ever written and read; the unread ones run from data[read %
+// capacity] to data[written % capacity], wrapping at the end. The reader
+// consumes them by storing written into read. A reader that falls more
+// than capacity behind loses the oldest bytes, counted in dropped.
+class Ring : public Sink {
+public:
+    struct Header {
+        uint32_t capacity; // a power of two, so the counters wrap cleanly
+        uint32_t written;
+        uint32_t read;
+        uint32_t dropped;
+    };
+
+private:
+    std::mutex mutex;
+    std::unique_ptr<char[]> memory; // Header, then capacity bytes
+
+    Header& header() { return *reinterpret_cast<Header*>(memory.get()); }
+    char* data() { return memory.get() + sizeof(Header); }
+    void append(std::string_view bytes);
+
+public:
+    explicit Ring(size_t capacity); // rounded up to a power of two
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    void line(std::string_view text) override;
+    // Stable for the ring's life; the data follows the header
+    const Header* shared() const { return reinterpret_cast<const Header*>(memory.get()); }
+    std::string take(); // the unread bytes, now read
+};
+
+// The process's stdout, shared by every runtime that was not given a sink
+std::shared_ptr<Sink> standard();
+
+} // namespace output
+} // namespace azalea
+
+#endif // AZALEA_OUTPUT_H
@@ -0,0 +1,139 @@
+#include "play.h"
+#include "kernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace azalea {
+namespace play {
+
+uint32_t World::add(double atX, double atY, double width, double height, uint32_t withTexture) {
+    uint32_t id = static_cast<uint32_t>(slots.size());
+    slots.push_back(static_cast<uint32_t>(ids.size()));
+    x.push_back(atX);
+    y.push_back(atY);
+    lastX.push_back(atX);
+    lastY.push_back(atY);
+    vx.push_back(0);
+    vy.push_back(0);
+    w.push_back(width);
+    h.push_back(height);
+    texture.push_back(withTexture);
+    ids.push_back(id);
+    return id;
+}
+
+uint32_t World::slot(uint32_t id) const {
+    return id < slots.size() ? slots[id] : NONE;
+}
+
+bool World::remove(uint32_t id) {
+    uint32_t at = slot(id);
+    if (at == NONE) return false;
+    size_t last = ids.size() - 1;
+    auto moveLast = [at, last](auto& column) {
+        column[at] = column[last];
+        column.pop_back();
+    };
+    moveLast(x);
+    moveLast(y);
+    moveLast(lastX);
+    moveLast(lastY);
+    moveLast(vx);
+    moveLast(vy);
+    moveLast(w);
+    moveLast(h);
+    moveLast(texture);
+    moveLast(ids);
+    if (at < ids.size()) slots[ids[at]] = at;
+    slots[id] = NONE;
+    return true;
+}
+
+void World::clear() {
+    for (auto* column : {&x, &y, &lastX, &lastY, &vx, &vy, &w, &h}) column->clear();
+    texture.clear();
+    ids.clear();
+    slots.clear();
+    right = bottom = 0;
+}
+
+void World::bounds(double width, double height) {
+    right = width > 0 ? width : 0;
+    bottom = height > 0 ? height : 0;
+}
+
+void World::step(double dt) {
+    size_t n = size();
+    std::copy(x.begin(), x.end(), lastX.begin());
+    std::copy(y.begin(), y.end(), lastY.begin());
+    kernels::advance(x.data(), vx.data(), n, dt);
+    kernels::advance(y.data(), vy.data(), n, dt);
+    if (right > 0 || bottom > 0) {
+        kernels::bounce(x.data(), vx.data(), n, 0, right);
+        kernels::bounce(y.data(), vy.data(), n, 0, bottom);
+    }
+}
+
+void World::render(double alpha, Frame& frame) {
+    size_t n = size();
+    frame.alpha = alpha;
+    drawX.resize(n);
+    drawY.resize(n);
+    kernels::lerp(lastX.data(), x.data(), n, alpha, drawX.data());
+    kernels::lerp(lastY.data(), y.data(), n, alpha, drawY.data());
+
+    // A counting sort by texture, which stays in order within each
+    uint32_t most = 0;
+    for (uint32_t t : texture) most = std::max(most, t);
+    counts.assign(n > 0 ? most + 1 : 0, 0);
+    for (uint32_t t : texture) counts[t]++;
+    frame.batches.clear();
+    uint32_t first = 0;
+    for (uint32_t t = 0; t < counts.size(); t++) {
+        uint32_t count = counts[t];
+        counts[t] = first;
+        if (count > 0) frame.batches.push_back({t, first, count});
+        first += count;
+    }
+    frame.instances.resize(n * 4);
+    float* out = frame.instances.data();
+    for (size_t i = 0; i < n; i++) {
+        float* instance = out + size_t(counts[texture[i]]++) * 4;
+        instance[0] = static_cast<float>(drawX[i]);
+        instance[1] = static_cast<float>(drawY[i]);
+        instance[2] = static_cast<float>(w[i]);
+        instance[3] = static_cast<float>(h[i]);
+    }
+}
+
+static uint64_t nowNs() {
+    auto since = std::chrono::steady_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(since).count());
+}
+
+void Clock::reset() {
+    behind = 0;
+    last = nowNs();
+}
+
+double Clock::elapsed() {
+    uint64_t now = nowNs();
+    double seconds = last == 0 ? 0 : static_cast<double>(now - last) / 1e9;
+    last = now;
+    return seconds;
+}
+
+int Clock::advance(double seconds) {
+    if (seconds > 0) behind += seconds; // and not NaN
+    // Within rounding of a whole number of steps counts as one, so ticks
+    // of exactly one step each run one step each
+    double due = std::floor(behind / step + 1e-9);
+    int steps = due > MAX_STEPS ? MAX_STEPS : static_cast<int>(due);
+    behind = std::max(0.0, behind - steps * step);
+    if (behind >= step) behind = std::fmod(behind, step);
+    return steps;
+}
+
+} // namespace play
+} // namespace azalea
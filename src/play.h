@@ -0,0 +1,95 @@
+#ifndef AZALEA_PLAY_H
+#define AZALEA_PLAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace azalea {
+namespace play {
+
+// The play module's game state. Sprites are kept as columns, one array
+// per component with slot i of each the same sprite, so a step moves all
+// of them with a few passes of the list kernels (kernels.h) and nothing is
+// allocated per sprite or per frame once the arrays have grown. Removing a
+// sprite moves the last one into its slot; ids stay the same.
+
+constexpr uint32_t NONE = UINT32_MAX;
+
+// Instances [first, first + count) of a frame, all drawn with texture
+struct Batch {
+    uint32_t texture;
+    uint32_t first;
+    uint32_t count;
+};
+
+// A render: x, y, width and height per sprite as floats, grouped by
+// texture in increasing order, one Batch per texture drawn. The WASM page
+// draws each batch with one instanced draw call (see azalea_play_frame)
+struct Frame {
+    std::vector<float> instances;
+    std::vector<Batch> batches;
+    double alpha = 0; // how far from the step before last to the last one
+};
+
+class World {
+public:
+    // The columns
+    std::vector<double> x, y;         // where the last step left each sprite
+    std::vector<double> lastX, lastY; // and where the one before did
+    std::vector<double> vx, vy;       // units per second
+    std::vector<double> w, h;
+    std::vector<uint32_t> texture; // 0 for none
+    std::vector<uint32_t> ids;
+
+    // A new sprite's id. Ids are not reused, so one kept after its sprite
+    // was removed finds nothing
+    uint32_t add(double atX, double atY, double width, double height, uint32_t withTexture);
+    bool remove(uint32_t id);
+    uint32_t slot(uint32_t id) const; // NONE if no sprite has the id
+    size_t size() const { return ids.size(); }
+    void clear();
+
+    // Sprites bounce off the edges of [0, width] x [0, height]; 0 by 0 for
+    // no edges
+    void bounds(double width, double height);
+    // Moves every sprite by its velocity over dt seconds
+    void step(double dt);
+    // Draws every sprite alpha of the way from where the step before last
+    // left it to where the last one did
+    void render(double alpha, Frame& frame);
+
+private:
+    std::vector<uint32_t> slots; // by id
+    double right = 0, bottom = 0;
+    std::vector<double> drawX, drawY;
+    std::vector<uint32_t> counts; // sprites per texture, then where each starts
+};
+
+// Runs a game in fixed steps whatever time frames take, so it moves the
+// same at any frame rate; frames are drawn between the last two steps by
+// how much of the next one has passed
+class Clock {
+public:
+    // Steps run for one frame at most; a frame later than that drops the
+    // time rather than falling further behind
+    static constexpr int MAX_STEPS = 8;
+
+    double step = 1.0 / 60;
+
+    void reset();
+    // Seconds since the last call, or since reset
+    double elapsed();
+    // Adds seconds of game time; gives how many steps are now due
+    int advance(double seconds);
+    double alpha() const { return behind / step; }
+
+private:
+    double behind = 0; // time short of a whole step
+    uint64_t last = 0; // nanoseconds, on the monotonic clock
+};
+
+} // namespace play
+} // namespace azalea
+
+#endif // AZALEA_PLAY_H
@@ -0,0 +1,228 @@
+#include "process.h"
+
+#ifdef AZALEA_PROCESS_SPAWN
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <utility>
+
+extern char** environ;
+#endif
+
+namespace azalea {
+namespace process {
+
+Command shell(const std::string& line) {
+    return Command{{"/bin/sh", "-c", line}};
+}
+
+#ifdef AZALEA_PROCESS_SPAWN
+
+namespace {
+
+struct Child {
+    size_t index = 0;
+    pid_t pid = -1;
+    int fds[2] = {-1, -1}; // read ends of its stdout and stderr
+};
+
+// Close-on-exec, so children started meanwhile do not keep the other end open
+bool openPipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) != 0) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+// We ignore SIGPIPE for our sockets; children get it back, so that
+// `producer | head` ends the producer as it would from a shell
+struct Attributes {
+    posix_spawnattr_t attributes;
+
+    Attributes() {
+        posix_spawnattr_init(&attributes);
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGPIPE);
+        posix_spawnattr_setsigdefault(&attributes, &signals);
+        posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSIGDEF);
+    }
+    ~Attributes() { posix_spawnattr_destroy(&attributes); }
+};
+
+std::vector<char*> argvOf(const Command& command) {
+    std::vector<char*> argv;
+    for (const std::string& arg : command.argv) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+    return argv;
+}
+
+// Starts the command with its output going to new pipes; false, with the
+// reason in error, if it cannot start
+bool spawn(const Command& command, Child& child, std::string& error) {
+    if (command.argv.empty()) {
+        error = "empty command";
+        return false;
+    }
+    int out[2], err[2];
+    if (!openPipe(out)) {
+        error = std::strerror(errno);
+        return false;
+    }
+    if (!openPipe(err)) {
+        error = std::strerror(errno);
+        ::close(out[0]);
+        ::close(out[1]);
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, out[1], 1);
+    posix_spawn_file_actions_adddup2(&actions, err[1], 2);
+    std::vector<char*> argv = argvOf(command);
+    Attributes attributes;
+    int failed = posix_spawnp(&child.pid, argv[0], &actions, &attributes.attributes, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    ::close(out[1]);
+    ::close(err[1]);
+    if (failed != 0) {
+        ::close(out[0]);
+        ::close(err[0]);
+        error = command.argv[0] + ": " + std::strerror(failed);
+        return false;
+    }
+    child.fds[0] = out[0];
+    child.fds[1] = err[0];
+    return true;
+}
+
+int reap(pid_t pid) {
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return NOT_STARTED;
+    }
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return status;
+}
+
+} // namespace
+
+std::vector<int> runAll(const std::vector<Command>& commands, size_t jobs, const Output& output) {
+    std::vector<int> statuses(commands.size(), NOT_STARTED);
+    std::vector<Child> running;
+    std::vector<pollfd> polls;
+    std::vector<std::pair<size_t, int>> owners; // child and stream of each poll entry
+    std::vector<char> buffer(READ_BUFFER);
+    jobs = std::max<size_t>(jobs, 1);
+    size_t next = 0;
+
+    while (next < commands.size() || !running.empty()) {
+        while (running.size() < jobs && next < commands.size()) {
+            Child child;
+            child.index = next++;
+            std::string error;
+            if (spawn(commands[child.index], child, error)) {
+                running.push_back(child);
+            } else if (output) {
+                error += '\n';
+                output(child.index, Stream::ERR, error);
+            }
+        }
+        if (running.empty()) continue;
+
+        polls.clear();
+        owners.clear();
+        for (size_t i = 0; i < running.size(); i++) {
+            for (int stream = 0; stream < 2; stream++) {
+                if (running[i].fds[stream] < 0) continue;
+                polls.push_back({running[i].fds[stream], POLLIN, 0});
+                owners.emplace_back(i, stream);
+            }
+        }
+        if (poll(polls.data(), polls.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        for (size_t p = 0; p < polls.size(); p++) {
+            if (polls[p].revents == 0) continue;
+            Child& child = running[owners[p].first];
+            int& fd = child.fds[owners[p].second];
+            if (fd < 0) continue; // output just stopped the command
+            ssize_t n = ::read(fd, buffer.data(), buffer.size());
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+            if (n <= 0) {
+                ::close(fd);
+                fd = -1;
+                continue;
+            }
+            if (!output) continue;
+            Stream stream = owners[p].second == 0 ? Stream::OUT : Stream::ERR;
+            if (!output(child.index, stream, std::string_view(buffer.data(), static_cast<size_t>(n)))) {
+                // Closing the pipes too ends anything the command started
+                // that is still writing to them, with SIGPIPE
+                kill(child.pid, SIGTERM);
+                for (int& open : child.fds) {
+                    if (open >= 0) ::close(open);
+                    open = -1;
+                }
+            }
+        }
+        // A child is done once both of its pipes are closed
+        for (auto it = running.begin(); it != running.end();) {
+            if (it->fds[0] >= 0 || it->fds[1] >= 0) {
+                ++it;
+                continue;
+            }
+            statuses[it->index] = reap(it->pid);
+            it = running.erase(it);
+        }
+    }
+
+    for (Child& child : running) { // only if poll itself failed
+        for (int fd : child.fds) {
+            if (fd >= 0) ::close(fd);
+        }
+        kill(child.pid, SIGTERM);
+        statuses[child.index] = reap(child.pid);
+    }
+    return statuses;
+}
+
+int system(const Command& command) {
+    if (command.argv.empty()) return NOT_STARTED;
+    std::vector<char*> argv = argvOf(command);
+    Attributes attributes;
+    pid_t pid;
+    if (posix_spawnp(&pid, argv[0], nullptr, &attributes.attributes, argv.data(), environ) != 0) return NOT_STARTED;
+    return reap(pid);
+}
+
+#else
+
+std::vector<int> runAll(const std::vector<Command>& commands, size_t, const Output& output) {
+    for (size_t i = 0; i < commands.size() && output; i++) {
+        output(i, Stream::ERR, "processes are not available in the browser\n");
+    }
+    return std::vector<int>(commands.size(), NOT_STARTED);
+}
+
+int system(const Command&) {
+    return NOT_STARTED;
+}
+
+#endif // AZALEA_PROCESS_SPAWN
+
+} // namespace process
+} // namespace azalea
@@ -0,0 +1,47 @@
+#ifndef AZALEA_PROCESS_H
+#define AZALEA_PROCESS_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The browser build has no processes; there every command fails to start
+#if !defined(__EMSCRIPTEN__)
+#define AZALEA_PROCESS_SPAWN 1
+#endif
+
+namespace azalea {
+namespace process {
+
+constexpr size_t READ_BUFFER = 64 * 1024; // per read from a child's pipe
+constexpr int NOT_STARTED = 127;          // status of a command that could not start, as sh gives it
+
+enum class Stream { OUT, ERR };
+
+// argv[0] is looked up on PATH
+struct Command {
+    std::vector<std::string> argv;
+};
+
+// line run by /bin/sh -c
+Command shell(const std::string& line);
+
+// Given each piece of a command's stdout or stderr as it arrives; false
+// stops the command (SIGTERM) and drops the rest of its output
+using Output = std::function<bool(size_t index, Stream stream, std::string_view data)>;
+
+// Runs every command with stdin from /dev/null and stdout and stderr
+// piped back, keeping up to jobs of them running at once and waiting on
+// all of their pipes with one poll. Exit statuses, in order; a command
+// killed by a signal gives 128 plus the signal, as in sh.
+std::vector<int> runAll(const std::vector<Command>& commands, size_t jobs, const Output& output);
+
+// Runs the command sharing this process's stdin, stdout and stderr
+int system(const Command& command);
+
+} // namespace process
+} // namespace azalea
+
+#endif // AZALEA_PROCESS_H
@@ -0,0 +1,313 @@
+#include "profile.h"
+#include "azalea.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+
+#ifdef AZALEA_PROFILE_SAMPLING
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+namespace azalea {
+namespace profile {
+
+thread_local Recorder* current = nullptr;
+std::atomic<int> countingRecorders{0};
+
+namespace {
+
+// The signal handler may run on any thread, so all it touches is the
+// context the profiled thread is in and one counter per context
+std::atomic<uint32_t> sampledContext{0};
+std::atomic<uint32_t> sampleCounts[SAMPLE_CONTEXTS];
+std::atomic<uint64_t> samplesDropped{0};
+
+#ifdef AZALEA_PROFILE_SAMPLING
+struct sigaction previousAction;
+
+void onSample(int) {
+    uint32_t context = sampledContext.load(std::memory_order_relaxed);
+    if (context < SAMPLE_CONTEXTS) {
+        sampleCounts[context].fetch_add(1, std::memory_order_relaxed);
+    } else {
+        samplesDropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void setTimer(int hz) {
+    itimerval timer = {};
+    if (hz > 0) {
+        long us = std::max(1L, 1000000L / hz);
+        timer.it_interval.tv_sec = us / 1000000;
+        timer.it_interval.tv_usec = us % 1000000;
+        timer.it_value = timer.it_interval;
+    }
+    setitimer(ITIMER_PROF, &timer, nullptr);
+}
+#endif
+
+const char* nodeTypeName(uint8_t type) {
+    switch (static_cast<NodeType>(type)) {
+        case NodeType::PROGRAM: return "program";
+        case NodeType::FORM: return "form";
+        case NodeType::ACT: return "act";
+        case NodeType::CALL: return "call";
+        case NodeType::IF: return "if";
+        case NodeType::LOOP: return "loop";
+        case NodeType::GIVE: return "give";
+        case NodeType::SAY: return "say";
+        case NodeType::PUT: return "put";
+        case NodeType::BINARY_OP: return "binary";
+        case NodeType::UNARY_OP: return "unary";
+        case NodeType::IDENTIFIER: return "identifier";
+        case NodeType::LITERAL: return "literal";
+        case NodeType::BLOCK: return "block";
+        case NodeType::LIST_LIT: return "list";
+        case NodeType::MAP_LIT: return "map";
+        case NodeType::CONSTANT: return "constant";
+    }
+    return "node";
+}
+
+double milliseconds(uint64_t ns) {
+    return static_cast<double>(ns) / 1e6;
+}
+
+// flamegraph.pl splits on ';' and the last space
+std::string foldedName(const std::string& name) {
+    std::string out = name;
+    for (char& c : out) {
+        if (c == ';' || c == ' ' || c == '\n') c = '_';
+    }
+    return out;
+}
+
+} // namespace
+
+Recorder::Recorder(Mode mode, int hz) : mode(mode), hz(hz), started(std::chrono::steady_clock::now()) {
+    // Not interned, so an act called main stays apart from the program
+    frames.push_back(Frame{"main", false});
+    contexts.emplace_back(0, 0);
+    contexts[0].calls = 1;
+    current = this;
+    if (mode == Mode::COUNT) countingRecorders.fetch_add(1);
+#ifdef AZALEA_PROFILE_SAMPLING
+    if (mode == Mode::SAMPLE) {
+        for (auto& count : sampleCounts) count.store(0, std::memory_order_relaxed);
+        samplesDropped.store(0);
+        sampledContext.store(0);
+        struct sigaction action = {};
+        action.sa_handler = onSample;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &previousAction);
+        setTimer(hz);
+    }
+#endif
+}
+
+Recorder::~Recorder() {
+    stop();
+}
+
+void Recorder::stop() {
+    if (stopped) return;
+    stopped = true;
+    if (current == this) current = nullptr;
+    if (mode == Mode::COUNT) countingRecorders.fetch_sub(1);
+    while (!stack.empty()) leave();
+    contexts[0].inclusiveNs = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - started).count());
+#ifdef AZALEA_PROFILE_SAMPLING
+    if (mode == Mode::SAMPLE) {
+        setTimer(0);
+        sigaction(SIGPROF, &previousAction, nullptr);
+        for (size_t i = 0; i < contexts.size() && i < SAMPLE_CONTEXTS; i++) {
+            contexts[i].samples = sampleCounts[i].load(std::memory_order_relaxed);
+        }
+        dropped = samplesDropped.load();
+    }
+#endif
+}
+
+uint32_t Recorder::intern(std::string name, bool module) {
+    auto found = framesByName.find(name);
+    if (found != framesByName.end()) return found->second;
+    uint32_t id = static_cast<uint32_t>(frames.size());
+    framesByName.emplace(name, id);
+    frames.push_back(Frame{std::move(name), module});
+    return id;
+}
+
+uint32_t Recorder::frame(const void* site, std::string_view act) {
+    auto found = framesBySite.find(site);
+    if (found != framesBySite.end()) return found->second;
+    uint32_t id = intern(std::string(act), false);
+    framesBySite.emplace(site, id);
+    return id;
+}
+
+uint32_t Recorder::frame(const void* site, const Module& module, const std::string& method) {
+    auto found = framesBySite.find(site);
+    if (found != framesBySite.end()) return found->second;
+    std::string name = module.getName();
+    name += '.';
+    name += method;
+    uint32_t id = intern(std::move(name), true);
+    framesBySite.emplace(site, id);
+    return id;
+}
+
+void Recorder::enter(uint32_t frame) {
+    uint32_t parent = stack.empty() ? 0 : stack.back().context;
+    uint32_t context = 0;
+    for (const auto& child : contexts[parent].children) {
+        if (child.first == frame) {
+            context = child.second;
+            break;
+        }
+    }
+    if (context == 0) {
+        context = static_cast<uint32_t>(contexts.size());
+        contexts.emplace_back(parent, frame);
+        contexts[parent].children.emplace_back(frame, context);
+    }
+    contexts[context].calls++;
+    if (mode == Mode::SAMPLE) {
+        stack.push_back({context, {}});
+        sampledContext.store(context, std::memory_order_relaxed);
+        return;
+    }
+    stack.push_back({context, std::chrono::steady_clock::now()});
+}
+
+void Recorder::leave() {
+    if (stack.empty()) return; // a task started on this thread finished elsewhere
+    Active active = stack.back();
+    stack.pop_back();
+    uint32_t parent = stack.empty() ? 0 : stack.back().context;
+    if (mode == Mode::SAMPLE) {
+        sampledContext.store(parent, std::memory_order_relaxed);
+        return;
+    }
+    uint64_t ns = static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - active.start).count());
+    Context& context = contexts[active.context];
+    context.inclusiveNs += ns;
+    contexts[parent].childNs += ns;
+    Frame& frame = frames[context.frame];
+    if (frame.module) {
+        size_t bucket = 0;
+        for (uint64_t us = ns / 1000; us > 0 && bucket + 1 < HISTOGRAM_BUCKETS; us >>= 1) bucket++;
+        frame.histogram[bucket]++;
+    }
+}
+
+std::string Recorder::folded() const {
+    std::string out;
+    std::vector<std::string> paths(contexts.size());
+    for (size_t i = 0; i < contexts.size(); i++) {
+        const Context& context = contexts[i];
+        // Parents come before their children, so their paths are ready
+        paths[i] = i == 0 ? foldedName(frames[context.frame].name)
+                          : paths[context.parent] + ';' + foldedName(frames[context.frame].name);
+        uint64_t weight = mode == Mode::SAMPLE
+            ? context.samples
+            : (context.inclusiveNs - std::min(context.inclusiveNs, context.childNs)) / 1000;
+        if (weight == 0) continue;
+        out += paths[i];
+        out += ' ';
+        out += std::to_string(weight);
+        out += '\n';
+    }
+    return out;
+}
+
+std::string Recorder::summary() const {
+    struct Totals {
+        uint64_t calls = 0, inclusiveNs = 0, exclusiveNs = 0, samples = 0;
+    };
+    std::vector<Totals> totals(frames.size());
+    uint64_t samples = 0;
+    for (size_t i = 0; i < contexts.size(); i++) {
+        const Context& context = contexts[i];
+        Totals& total = totals[context.frame];
+        total.calls += context.calls;
+        total.exclusiveNs += context.inclusiveNs - std::min(context.inclusiveNs, context.childNs);
+        total.samples += context.samples;
+        samples += context.samples;
+        // A recursive act's time is already in its outermost call
+        bool nested = false;
+        if (i != 0) {
+            for (uint32_t up = context.parent; up != 0 && !nested; up = contexts[up].parent) {
+                nested = contexts[up].frame == context.frame;
+            }
+        }
+        if (!nested) total.inclusiveNs += context.inclusiveNs;
+    }
+
+    std::vector<size_t> order(frames.size());
+    for (size_t i = 0; i < order.size(); i++) order[i] = i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return mode == Mode::SAMPLE ? totals[a].samples > totals[b].samples
+                                    : totals[a].exclusiveNs > totals[b].exclusiveNs;
+    });
+
+    std::vector<Value> functions, modules;
+    for (size_t i : order) {
+        const Frame& frame = frames[i];
+        ValueMap entry;
+        entry["name"] = Value(frame.name);
+        entry["calls"] = Value(static_cast<double>(totals[i].calls));
+        if (mode == Mode::SAMPLE) {
+            entry["samples"] = Value(static_cast<double>(totals[i].samples));
+        } else {
+            entry["inclusive_ms"] = Value(milliseconds(totals[i].inclusiveNs));
+            entry["exclusive_ms"] = Value(milliseconds(totals[i].exclusiveNs));
+        }
+        if (frame.module && mode == Mode::COUNT) {
+            std::vector<Value> histogram; // [upper bound in microseconds, calls]
+            for (size_t bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++) {
+                if (frame.histogram[bucket] == 0) continue;
+                double bound = bucket + 1 < HISTOGRAM_BUCKETS ? static_cast<double>(1ull << bucket) : -1;
+                histogram.emplace_back(std::vector<Value>{Value(bound), Value(static_cast<double>(frame.histogram[bucket]))});
+            }
+            entry["histogram_us"] = Value(std::move(histogram));
+        }
+        (frame.module ? modules : functions).emplace_back(std::move(entry));
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> hits(nodes.begin(), nodes.end());
+    std::sort(hits.begin(), hits.end(), [](const auto& a, const auto& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+    });
+    std::vector<Value> nodeList;
+    for (const auto& [key, count] : hits) {
+        ValueMap entry;
+        entry["line"] = Value(static_cast<double>(key >> 32));
+        entry["col"] = Value(static_cast<double>((key >> 8) & 0xffffff));
+        entry["type"] = Value(nodeTypeName(static_cast<uint8_t>(key & 0xff)));
+        entry["hits"] = Value(static_cast<double>(count));
+        nodeList.emplace_back(std::move(entry));
+    }
+
+    ValueMap result;
+    result["mode"] = Value(mode == Mode::SAMPLE ? "sample" : "count");
+    result["duration_ms"] = Value(milliseconds(contexts[0].inclusiveNs));
+    result["functions"] = Value(std::move(functions));
+    result["modules"] = Value(std::move(modules));
+    if (mode == Mode::SAMPLE) {
+        result["hz"] = Value(static_cast<double>(hz));
+        result["samples"] = Value(static_cast<double>(samples));
+        result["dropped"] = Value(static_cast<double>(dropped));
+    } else {
+        result["nodes"] = Value(std::move(nodeList));
+    }
+    std::string json;
+    appendJson(json, Value(std::move(result)));
+    return json;
+}
+
+} // namespace profile
+} // namespace azalea
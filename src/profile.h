@@ -0,0 +1,142 @@
+#ifndef AZALEA_PROFILE_H
+#define AZALEA_PROFILE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Sampling runs off SIGPROF from an interval timer, which the browser
+// build does not have
+#if !defined(__EMSCRIPTEN__)
+#define AZALEA_PROFILE_SAMPLING 1
+#endif
+
+namespace azalea {
+
+class Module;
+
+namespace profile {
+
+constexpr int DEFAULT_HZ = 997;            // samples per CPU second; prime, so it does not beat with loops
+constexpr size_t SAMPLE_CONTEXTS = 1 << 16; // distinct stacks sampling keeps apart; deeper ones count as dropped
+constexpr size_t HISTOGRAM_BUCKETS = 24;   // module call latencies: [0, 1us), [1us, 2us), ... doubling
+
+enum class Mode {
+    COUNT,  // every node, act and module call counted and timed
+    SAMPLE, // only the stack of acts and module calls, read by a timer signal
+};
+
+// Nodes are told apart by source position, so both engines count the same
+// node under the same key
+inline uint64_t nodeKey(uint32_t line, uint32_t col, uint8_t type) {
+    return (static_cast<uint64_t>(line) << 32) | (static_cast<uint64_t>(col & 0xffffff) << 8) | type;
+}
+
+// Everything profiled on the thread that created it: a calling-context
+// tree of acts and module calls with their calls, times and samples, and
+// hits per node. One recorder at a time.
+class Recorder {
+private:
+    struct Context {
+        uint32_t parent;
+        uint32_t frame;
+        uint64_t calls = 0;
+        uint64_t inclusiveNs = 0;
+        uint64_t childNs = 0;
+        uint64_t samples = 0;
+        std::vector<std::pair<uint32_t, uint32_t>> children; // frame -> context
+
+        Context(uint32_t parent, uint32_t frame) : parent(parent), frame(frame) {}
+    };
+    struct Frame {
+        std::string name;
+        bool module;
+        uint64_t histogram[HISTOGRAM_BUCKETS] = {};
+    };
+    struct Active {
+        uint32_t context;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    Mode mode;
+    int hz;
+    std::chrono::steady_clock::time_point started;
+    std::vector<Context> contexts; // 0 is the whole program
+    std::vector<Frame> frames;
+    std::unordered_map<std::string, uint32_t> framesByName;
+    std::unordered_map<const void*, uint32_t> framesBySite;
+    std::vector<Active> stack;
+    std::unordered_map<uint64_t, uint64_t> nodes;
+    uint64_t dropped = 0;
+    bool stopped = false;
+
+    uint32_t intern(std::string name, bool module);
+
+public:
+    explicit Recorder(Mode mode, int hz = DEFAULT_HZ);
+    ~Recorder();
+    Recorder(const Recorder&) = delete;
+    Recorder& operator=(const Recorder&) = delete;
+
+    bool counting() const { return mode == Mode::COUNT; }
+    void hit(uint64_t key) { nodes[key]++; }
+
+    // Frame for an act, or for a module method, cached by call site
+    uint32_t frame(const void* site, std::string_view act);
+    uint32_t frame(const void* site, const Module& module, const std::string& method);
+    void enter(uint32_t frame);
+    void leave();
+
+    void stop();
+    // One line per stack, as flamegraph.pl reads them: "main;act;net.get
+    // 1234", in microseconds of exclusive time, or in samples
+    std::string folded() const;
+    // JSON: acts and module calls with calls and inclusive and exclusive
+    // time, module call latency histograms, and hits per node
+    std::string summary() const;
+};
+
+// The recorder profiling this thread, if any
+extern thread_local Recorder* current;
+// Recorders counting on any thread; a plain load, so that an unprofiled
+// run does not reach for the thread-local on every node
+extern std::atomic<int> countingRecorders;
+
+// One act or module call, recorded if this thread is being profiled
+class Scope {
+private:
+    Recorder* recorder;
+
+public:
+    Scope(const void* site, std::string_view act) : recorder(current) {
+        if (recorder) recorder->enter(recorder->frame(site, act));
+    }
+    Scope(const void* site, const Module& module, const std::string& method) : recorder(current) {
+        if (recorder) recorder->enter(recorder->frame(site, module, method));
+    }
+    ~Scope() {
+        if (recorder) recorder->leave();
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+};
+
+// Counts a node when this thread is counting
+inline void hit(uint32_t line, uint32_t col, uint8_t type) {
+    if (countingRecorders.load(std::memory_order_relaxed) == 0) return;
+    Recorder* recorder = current;
+    if (recorder && recorder->counting()) recorder->hit(nodeKey(line, col, type));
+}
+
+inline bool counting() {
+    return countingRecorders.load(std::memory_order_relaxed) != 0 && current && current->counting();
+}
+
+} // namespace profile
+} // namespace azalea
+
+#endif // AZALEA_PROFILE_H
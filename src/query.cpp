@@ -0,0 +1,642 @@
+#include "query.h"
+#include "hash.h"
+#include "scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+
+namespace azalea {
+namespace query {
+
+namespace {
+
+constexpr uint32_t NO_ROW = static_cast<uint32_t>(-1);
+constexpr unsigned RADIX_BITS = 11;
+constexpr size_t RADIX = size_t(1) << RADIX_BITS;
+
+Column makeColumn(std::string name, Value list) {
+    Column column;
+    column.name = std::move(name);
+    column.list = std::move(list);
+    column.numbers = column.list.asNumbers();
+    if (!column.numbers) column.values = &column.list.asList();
+    return column;
+}
+
+// A list of values packed if every one is a number; lists already packed
+// are kept as they are
+Value packed(Value list) {
+    if (list.asNumbers()) return list;
+    const std::vector<Value>& items = list.asList();
+    std::vector<double> numbers;
+    numbers.reserve(items.size());
+    for (const Value& item : items) {
+        if (item.type != ValueType::NUM) return list;
+        numbers.push_back(item.num);
+    }
+    return Value::numbers(std::move(numbers));
+}
+
+size_t columnSize(const Column& column) {
+    return column.numbers ? column.numbers->size() : column.values->size();
+}
+
+// Morsels worth splitting rows into: one per worker once there are enough
+// rows, if the work can run off this thread at all
+size_t partsFor(size_t rows, bool shareable) {
+    size_t workers = Scheduler::instance().workerCount();
+    if (!shareable || rows < PARALLEL_ROWS || workers < 2) return 1;
+    return std::min(workers, rows / (PARALLEL_ROWS / 4));
+}
+
+// body(part, begin, end) over rows split into parts, on the workers when
+// there is more than one
+void split(size_t rows, size_t parts, const std::function<void(size_t, size_t, size_t)>& body) {
+    if (parts <= 1) {
+        body(0, 0, rows);
+        return;
+    }
+    Scheduler::instance().parallel(parts, [&](size_t part) {
+        body(part, rows * part / parts, rows * (part + 1) / parts);
+    });
+}
+
+// Selections found per part, joined in row order
+Selection concat(std::vector<Selection>& parts) {
+    if (parts.size() == 1) return std::move(parts[0]);
+    size_t total = 0;
+    for (const Selection& part : parts) total += part.size();
+    Selection out;
+    out.reserve(total);
+    for (const Selection& part : parts) out.insert(out.end(), part.begin(), part.end());
+    return out;
+}
+
+// Whether workers can read the column: packed, or only flat text, numbers,
+// truth values and voids, whose reads touch no reference counts. Ropes are
+// flattened here, on this thread.
+bool shareable(const Column& column, size_t rows) {
+    if (column.numbers) return true;
+    for (size_t row = 0; row < rows; row++) {
+        const Value& value = (*column.values)[row];
+        if (value.type == ValueType::TEXT) {
+            value.asText();
+        } else if (value.isHeap()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Filters
+
+struct Operand {
+    bool numeric = false;
+    double number = 0;
+    std::string text;
+};
+
+// The whole of text as a number
+bool wholeNumber(const std::string& text, double& out) {
+    if (text.empty()) return false;
+    char* end = nullptr;
+    out = std::strtod(text.c_str(), &end);
+    return end == text.c_str() + text.size();
+}
+
+Operand operandFrom(const Value& value, Compare op) {
+    Operand operand;
+    operand.text = value.toString();
+    if (op != Compare::CONTAINS) {
+        if (value.type == ValueType::NUM || value.type == ValueType::BOOL) {
+            operand.numeric = true;
+            operand.number = value.toNumber();
+        } else if (value.type == ValueType::TEXT) {
+            operand.numeric = wholeNumber(operand.text, operand.number);
+        }
+    }
+    return operand;
+}
+
+// NaN fails every test, != included
+bool numberTest(double x, Compare op, double operand) {
+    switch (op) {
+        case Compare::EQ: return x == operand;
+        case Compare::NE: return x != operand && x == x;
+        case Compare::LT: return x < operand;
+        case Compare::LE: return x <= operand;
+        case Compare::GT: return x > operand;
+        case Compare::GE: return x >= operand;
+        case Compare::CONTAINS: break;
+    }
+    return false;
+}
+
+bool textTest(std::string_view text, Compare op, std::string_view operand) {
+    switch (op) {
+        case Compare::EQ: return text == operand;
+        case Compare::NE: return text != operand;
+        case Compare::LT: return text < operand;
+        case Compare::LE: return text <= operand;
+        case Compare::GT: return text > operand;
+        case Compare::GE: return text >= operand;
+        case Compare::CONTAINS: return text.find(operand) != std::string_view::npos;
+    }
+    return false;
+}
+
+bool valueTest(const Value& value, Compare op, const Operand& operand) {
+    if (operand.numeric) {
+        double x;
+        switch (value.type) {
+            case ValueType::NUM: x = value.num; break;
+            case ValueType::BOOL: x = value.boolean ? 1.0 : 0.0; break;
+            case ValueType::TEXT:
+                if (!wholeNumber(value.asText(), x)) return false;
+                break;
+            default: return false;
+        }
+        return numberTest(x, op, operand.number);
+    }
+    switch (value.type) {
+        case ValueType::VOID: return false;
+        case ValueType::NUM:
+            if (value.num != value.num) return false;
+            return textTest(value.toString(), op, operand.text);
+        case ValueType::TEXT: return textTest(value.asText(), op, operand.text);
+        default: return textTest(value.toString(), op, operand.text);
+    }
+}
+
+// Appends the rows of x[begin, end) that pass, a batch at a time: every
+// row is written to the selection vector and the cursor only moves past
+// the ones that pass, so there is no branch to mispredict
+template <class Test>
+void selectNumbers(const double* x, size_t begin, size_t end, Test test, Selection& out) {
+    uint32_t batch[BATCH];
+    for (size_t start = begin; start < end; start += BATCH) {
+        size_t count = std::min(BATCH, end - start);
+        const double* p = x + start;
+        size_t passed = 0;
+        for (size_t i = 0; i < count; i++) {
+            batch[passed] = static_cast<uint32_t>(start + i);
+            passed += test(p[i]) ? 1 : 0;
+        }
+        out.insert(out.end(), batch, batch + passed);
+    }
+}
+
+void selectNumbers(const double* x, size_t begin, size_t end, Compare op, double v, Selection& out) {
+    switch (op) {
+        case Compare::EQ: selectNumbers(x, begin, end, [v](double n) { return n == v; }, out); break;
+        case Compare::NE: selectNumbers(x, begin, end, [v](double n) { return n != v && n == n; }, out); break;
+        case Compare::LT: selectNumbers(x, begin, end, [v](double n) { return n < v; }, out); break;
+        case Compare::LE: selectNumbers(x, begin, end, [v](double n) { return n <= v; }, out); break;
+        case Compare::GT: selectNumbers(x, begin, end, [v](double n) { return n > v; }, out); break;
+        case Compare::GE: selectNumbers(x, begin, end, [v](double n) { return n >= v; }, out); break;
+        case Compare::CONTAINS: break;
+    }
+}
+
+// Sorting
+
+// Doubles as unsigned keys in the same order: positives get the sign bit
+// set, negatives are flipped whole. NaN is last both ways.
+uint64_t sortKey(double x, bool descending) {
+    if (x != x) return UINT64_MAX;
+    if (x == 0) x = 0; // -0 sorts with 0
+    uint64_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    bits = (bits >> 63) ? ~bits : bits | (uint64_t(1) << 63);
+    return descending ? ~bits : bits;
+}
+
+// Stable LSD radix sort of rows by keys[i], the key of rows[i],
+// RADIX_BITS at a time; digits every key shares are skipped
+void radixSort(Selection& rows, std::vector<uint64_t>& keys) {
+    size_t count = rows.size();
+    std::vector<uint64_t> keysOut(count);
+    Selection rowsOut(count);
+    std::vector<size_t> offsets(RADIX);
+    for (unsigned shift = 0; shift < 64; shift += RADIX_BITS) {
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (uint64_t key : keys) offsets[(key >> shift) & (RADIX - 1)]++;
+        if (offsets[(keys[0] >> shift) & (RADIX - 1)] == count) continue;
+        size_t sum = 0;
+        for (size_t& offset : offsets) {
+            size_t n = offset;
+            offset = sum;
+            sum += n;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t at = offsets[(keys[i] >> shift) & (RADIX - 1)]++;
+            keysOut[at] = keys[i];
+            rowsOut[at] = rows[i];
+        }
+        keys.swap(keysOut);
+        rows.swap(rowsOut);
+    }
+}
+
+// Keys for a column of only text and voids: each distinct text's rank
+// among them, so repeated values are compared once. False if the column
+// holds anything else.
+bool textKeys(const Selection& rows, const std::vector<Value>& values, bool descending,
+              std::vector<uint64_t>& keys) {
+    std::unordered_map<std::string_view, uint32_t> index;
+    std::vector<std::string_view> distinct;
+    keys.resize(rows.size());
+    for (size_t i = 0; i < rows.size(); i++) {
+        const Value& value = values[rows[i]];
+        if (value.type == ValueType::VOID) {
+            keys[i] = UINT64_MAX;
+            continue;
+        }
+        if (value.type != ValueType::TEXT) return false;
+        auto found = index.emplace(value.asText(), static_cast<uint32_t>(distinct.size()));
+        if (found.second) distinct.push_back(found.first->first);
+        keys[i] = found.first->second;
+    }
+    std::vector<uint32_t> byText(distinct.size());
+    std::iota(byText.begin(), byText.end(), 0u);
+    std::sort(byText.begin(), byText.end(), [&](uint32_t a, uint32_t b) { return distinct[a] < distinct[b]; });
+    std::vector<uint64_t> rank(distinct.size());
+    for (size_t r = 0; r < byText.size(); r++) {
+        rank[byText[r]] = descending ? byText.size() - 1 - r : r;
+    }
+    for (uint64_t& key : keys) {
+        if (key != UINT64_MAX) key = rank[key];
+    }
+    return true;
+}
+
+// Numbers, then text, then other values, then voids and NaN
+int sortClass(const Value& value) {
+    switch (value.type) {
+        case ValueType::NUM: return value.num == value.num ? 0 : 3;
+        case ValueType::BOOL: return 0;
+        case ValueType::TEXT: return 1;
+        case ValueType::VOID: return 3;
+        default: return 2;
+    }
+}
+
+bool sortsBefore(const Value& a, const Value& b, bool descending) {
+    int classA = sortClass(a);
+    int classB = sortClass(b);
+    if (classA != classB) return classA < classB;
+    int order = 0;
+    switch (classA) {
+        case 0: {
+            double x = a.toNumber(), y = b.toNumber();
+            order = x < y ? -1 : (x > y ? 1 : 0);
+            break;
+        }
+        case 1: order = a.asText().compare(b.asText()); break;
+        case 2: order = a.toString().compare(b.toString()); break;
+        default: return false;
+    }
+    return descending ? order > 0 : order < 0;
+}
+
+// Joining
+
+struct Key {
+    enum Kind : uint8_t { NONE, NUMBER, TEXT } kind = NONE; // NONE never matches
+    double number = 0;
+    std::string_view text;
+};
+
+Key keyAt(const Column& column, size_t row) {
+    Key key;
+    if (column.numbers) {
+        key.number = (*column.numbers)[row];
+        if (key.number == key.number) key.kind = Key::NUMBER;
+        return key;
+    }
+    const Value& value = (*column.values)[row];
+    if (value.type == ValueType::NUM || value.type == ValueType::BOOL) {
+        key.number = value.toNumber();
+        if (key.number == key.number) key.kind = Key::NUMBER;
+    } else if (value.type == ValueType::TEXT) {
+        key.kind = Key::TEXT;
+        key.text = value.asText();
+    }
+    return key;
+}
+
+uint64_t hashKey(const Key& key) {
+    if (key.kind == Key::TEXT) return hashBytes(key.text.data(), key.text.size(), 1);
+    double number = key.number == 0 ? 0 : key.number;
+    return hashBytes(&number, sizeof(number));
+}
+
+bool sameKey(const Key& a, const Key& b) {
+    if (a.kind != b.kind) return false;
+    return a.kind == Key::NUMBER ? a.number == b.number : a.text == b.text;
+}
+
+} // namespace
+
+// Table
+
+const Column* Table::find(std::string_view name) const {
+    for (const Column& column : columns) {
+        if (column.name == name) return &column;
+    }
+    return nullptr;
+}
+
+Value Table::toValue() const {
+    if (shape == Shape::ROWS) {
+        std::vector<Value> list;
+        list.reserve(rows);
+        for (size_t row = 0; row < rows; row++) {
+            ValueMap fields;
+            for (const Column& column : columns) {
+                Value value = column.value(row);
+                if (value.type != ValueType::VOID) fields.emplace(column.name, std::move(value));
+            }
+            list.emplace_back(std::move(fields));
+        }
+        return Value(std::move(list));
+    }
+    ValueMap data;
+    for (const Column& column : columns) {
+        data.emplace(column.name, column.list);
+    }
+    if (shape == Shape::COLUMNS) return Value(std::move(data));
+    std::vector<Value> names;
+    for (const Column& column : columns) {
+        names.emplace_back(column.name);
+    }
+    ValueMap table;
+    table["columns"] = Value(std::move(names));
+    table["rows"] = Value(static_cast<double>(rows));
+    table["data"] = Value(std::move(data));
+    return Value(std::move(table));
+}
+
+bool readTable(const Value& value, Table& table) {
+    table = Table();
+    if (value.type == ValueType::LIST) {
+        table.shape = Table::Shape::ROWS;
+        if (value.asNumbers()) return false;
+        const std::vector<Value>& rows = value.asList();
+        std::vector<std::string> names;
+        std::vector<std::vector<Value>> columns;
+        std::unordered_map<std::string, size_t> index;
+        for (size_t row = 0; row < rows.size(); row++) {
+            if (rows[row].type != ValueType::MAP) return false;
+            for (const auto& [name, field] : rows[row].asMap()) {
+                auto found = index.find(name);
+                if (found == index.end()) {
+                    found = index.emplace(name, names.size()).first;
+                    names.push_back(name);
+                    columns.emplace_back(rows.size());
+                }
+                columns[found->second][row] = field;
+            }
+        }
+        for (size_t i = 0; i < names.size(); i++) {
+            table.columns.push_back(makeColumn(names[i], packed(Value(std::move(columns[i])))));
+        }
+        table.rows = rows.size();
+        return true;
+    }
+    if (value.type != ValueType::MAP) return false;
+    const ValueMap& map = value.asMap();
+    auto columns = map.find("columns");
+    auto data = map.find("data");
+    if (columns != map.end() && data != map.end() &&
+        columns->second.type == ValueType::LIST && data->second.type == ValueType::MAP) {
+        const ValueMap& lists = data->second.asMap();
+        for (const Value& name : columns->second.asList()) {
+            auto list = lists.find(name.toString());
+            if (list == lists.end() || list->second.type != ValueType::LIST) return false;
+            table.columns.push_back(makeColumn(list->first, packed(list->second)));
+        }
+    } else {
+        table.shape = Table::Shape::COLUMNS;
+        for (const auto& [name, list] : map) {
+            if (list.type != ValueType::LIST) return false;
+            table.columns.push_back(makeColumn(name, packed(list)));
+        }
+        if (table.columns.empty()) return false;
+    }
+    // Ragged columns are cut to the shortest
+    table.rows = table.columns.empty() ? 0 : SIZE_MAX;
+    for (const Column& column : table.columns) {
+        table.rows = std::min(table.rows, columnSize(column));
+    }
+    return true;
+}
+
+bool select(const Table& table, const std::vector<std::string>& names, Table& out) {
+    out = Table();
+    out.shape = table.shape;
+    out.rows = table.rows;
+    for (const std::string& name : names) {
+        const Column* column = table.find(name);
+        if (!column) return false;
+        out.columns.push_back(*column);
+    }
+    return true;
+}
+
+bool compareFrom(std::string_view name, Compare& op) {
+    static const std::unordered_map<std::string_view, Compare> names = {
+        {"=", Compare::EQ}, {"==", Compare::EQ}, {"is", Compare::EQ}, {"equals", Compare::EQ},
+        {"same", Compare::EQ}, {"!=", Compare::NE}, {"not", Compare::NE},
+        {"<", Compare::LT}, {"less", Compare::LT}, {"under", Compare::LT}, {"below", Compare::LT},
+        {"<=", Compare::LE}, {">", Compare::GT}, {"greater", Compare::GT}, {"over", Compare::GT},
+        {"above", Compare::GT}, {">=", Compare::GE}, {"contains", Compare::CONTAINS},
+        {"has", Compare::CONTAINS},
+    };
+    auto found = names.find(name);
+    if (found == names.end()) return false;
+    op = found->second;
+    return true;
+}
+
+// Filters
+
+Selection filter(const Table& table, const Column& column, Compare op, const Value& operand) {
+    Operand value = operandFrom(operand, op);
+    size_t parts = partsFor(table.rows, shareable(column, table.rows));
+    std::vector<Selection> found(parts);
+    split(table.rows, parts, [&](size_t part, size_t begin, size_t end) {
+        Selection& out = found[part];
+        if (column.numbers && value.numeric) {
+            selectNumbers(column.numbers->data(), begin, end, op, value.number, out);
+            return;
+        }
+        for (size_t row = begin; row < end; row++) {
+            bool pass = column.numbers ? valueTest(Value((*column.numbers)[row]), op, value)
+                                       : valueTest((*column.values)[row], op, value);
+            if (pass) out.push_back(static_cast<uint32_t>(row));
+        }
+    });
+    return concat(found);
+}
+
+Selection filter(const Table& table, const std::string& source, Runtime& runtime) {
+    std::vector<std::string> names;
+    for (const Column& column : table.columns) {
+        names.push_back(column.name);
+    }
+    Runtime::Expression expression = runtime.compileExpression(source, names);
+
+    // Pure expressions over packed columns touch nothing shared, so each
+    // worker can run one on a fork of its own
+    std::vector<size_t> used;
+    bool packedOnly = true;
+    for (size_t i = 0; i < names.size(); i++) {
+        if (!expression.uses(i)) continue;
+        used.push_back(i);
+        packedOnly = packedOnly && table.columns[i].packed();
+    }
+    bool shareable = runtime.getEngine() == Engine::VM && expression.code->pure && packedOnly;
+    size_t parts = partsFor(table.rows, shareable);
+    std::vector<std::unique_ptr<Runtime>> forks;
+    if (parts > 1) {
+        for (size_t part = 0; part < parts; part++) {
+            forks.push_back(runtime.fork(expression));
+        }
+    }
+
+    std::vector<Selection> found(parts);
+    split(table.rows, parts, [&](size_t part, size_t begin, size_t end) {
+        Runtime& evaluator = parts > 1 ? *forks[part] : runtime;
+        std::vector<Value> values(names.size());
+        for (size_t row = begin; row < end; row++) {
+            for (size_t i : used) {
+                values[i] = table.columns[i].value(row);
+            }
+            if (evaluator.evaluate(expression, values.data()).toBool()) {
+                found[part].push_back(static_cast<uint32_t>(row));
+            }
+        }
+    });
+    return concat(found);
+}
+
+Selection filter(const Table& table, const Function& predicate,
+                 const std::vector<const Column*>& arguments, Runtime& runtime) {
+    Selection out;
+    std::vector<Value> args(arguments.size());
+    for (size_t row = 0; row < table.rows; row++) {
+        for (size_t i = 0; i < arguments.size(); i++) {
+            args[i] = arguments[i]->value(row);
+        }
+        if (predicate(args, runtime).toBool()) out.push_back(static_cast<uint32_t>(row));
+    }
+    return out;
+}
+
+Table gather(const Table& table, const Selection& rows) {
+    Table out;
+    out.shape = table.shape;
+    out.rows = rows.size();
+    for (const Column& column : table.columns) {
+        if (column.numbers) {
+            const double* from = column.numbers->data();
+            std::vector<double> numbers(rows.size());
+            split(rows.size(), partsFor(rows.size(), true), [&](size_t, size_t begin, size_t end) {
+                for (size_t i = begin; i < end; i++) numbers[i] = from[rows[i]];
+            });
+            out.columns.push_back(makeColumn(column.name, Value::numbers(std::move(numbers))));
+        } else {
+            std::vector<Value> values;
+            values.reserve(rows.size());
+            for (uint32_t row : rows) values.push_back((*column.values)[row]);
+            out.columns.push_back(makeColumn(column.name, Value(std::move(values))));
+        }
+    }
+    return out;
+}
+
+Selection order(const Table& table, const std::vector<SortKey>& keys) {
+    Selection rows(table.rows);
+    std::iota(rows.begin(), rows.end(), 0u);
+    if (rows.empty()) return rows;
+    // Least significant key first; every pass is stable
+    for (auto key = keys.rbegin(); key != keys.rend(); ++key) {
+        const Column& column = *key->column;
+        bool descending = key->descending;
+        std::vector<uint64_t> sortKeys;
+        if (column.numbers) {
+            sortKeys.resize(rows.size());
+            for (size_t i = 0; i < rows.size(); i++) {
+                sortKeys[i] = sortKey((*column.numbers)[rows[i]], descending);
+            }
+            radixSort(rows, sortKeys);
+            continue;
+        }
+        const std::vector<Value>& values = *column.values;
+        if (textKeys(rows, values, descending, sortKeys)) {
+            radixSort(rows, sortKeys);
+            continue;
+        }
+        std::stable_sort(rows.begin(), rows.end(), [&](uint32_t a, uint32_t b) {
+            return sortsBefore(values[a], values[b], descending);
+        });
+    }
+    return rows;
+}
+
+Table join(const Table& left, const Table& right, const Column& leftKey, const Column& rightKey) {
+    // Build: chains of right rows per bucket, in row order
+    size_t buckets = 1;
+    while (buckets < right.rows * 2) buckets <<= 1;
+    std::vector<uint32_t> heads(buckets, NO_ROW);
+    std::vector<uint32_t> next(right.rows, NO_ROW);
+    for (size_t row = right.rows; row-- > 0;) {
+        Key key = keyAt(rightKey, row);
+        if (key.kind == Key::NONE) continue;
+        uint32_t& head = heads[hashKey(key) & (buckets - 1)];
+        next[row] = head;
+        head = static_cast<uint32_t>(row);
+    }
+
+    // Probe with the left rows, a morsel per worker. Workers read both key
+    // columns, so both must be shareable
+    bool both = shareable(leftKey, left.rows) && shareable(rightKey, right.rows);
+    size_t parts = partsFor(left.rows, both);
+    std::vector<Selection> leftRows(parts), rightRows(parts);
+    split(left.rows, parts, [&](size_t part, size_t begin, size_t end) {
+        for (size_t row = begin; row < end; row++) {
+            Key key = keyAt(leftKey, row);
+            if (key.kind == Key::NONE) continue;
+            for (uint32_t match = heads[hashKey(key) & (buckets - 1)]; match != NO_ROW; match = next[match]) {
+                if (!sameKey(key, keyAt(rightKey, match))) continue;
+                leftRows[part].push_back(static_cast<uint32_t>(row));
+                rightRows[part].push_back(match);
+            }
+        }
+    });
+
+    Table out = gather(left, concat(leftRows));
+    Table others;
+    for (const Column& column : right.columns) {
+        if (&column != &rightKey) others.columns.push_back(column);
+    }
+    Table matched = gather(others, concat(rightRows));
+    for (Column& column : matched.columns) {
+        std::string name = column.name;
+        for (size_t n = 2; out.find(name); n++) {
+            name = column.name + "_" + std::to_string(n);
+        }
+        column.name = std::move(name);
+        out.columns.push_back(std::move(column));
+    }
+    return out;
+}
+
+} // namespace query
+} // namespace azalea
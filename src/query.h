@@ -0,0 +1,93 @@
+#ifndef AZALEA_QUERY_H
+#define AZALEA_QUERY_H
+
+#include "azalea.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace azalea {
+namespace query {
+
+// Columnar query engine behind the query module. Operators work a batch
+// of rows at a time: filters produce selection vectors (the indices of the
+// rows that passed), which gather then turns into new columns. Inputs of
+// at least PARALLEL_ROWS rows are split into morsels run on the scheduler's
+// workers whenever the columns involved can be read from other threads.
+constexpr size_t BATCH = 1024;
+constexpr size_t PARALLEL_ROWS = 65536;
+
+using Selection = std::vector<uint32_t>;
+
+// One column. Packed numbers are read straight from the list's array;
+// anything else is a list of values
+struct Column {
+    std::string name;
+    Value list; // keeps the storage alive
+    const std::vector<double>* numbers = nullptr;
+    const std::vector<Value>* values = nullptr;
+
+    bool packed() const { return numbers != nullptr; }
+    Value value(size_t row) const { return numbers ? Value((*numbers)[row]) : (*values)[row]; }
+};
+
+class Table {
+public:
+    // The shape a table came in as, which results go back out as
+    enum class Shape : uint8_t {
+        TABLE,   // {columns: [names], rows: n, data: {name: list}}, as csv reads
+        COLUMNS, // {name: list}
+        ROWS,    // [{name: value}]
+    };
+    Shape shape = Shape::TABLE;
+    std::vector<Column> columns;
+    size_t rows = 0;
+
+    const Column* find(std::string_view name) const; // nullptr if none
+    Value toValue() const;
+};
+
+// Columns from any of the shapes; lists holding only numbers are packed.
+// False if value is none of them.
+bool readTable(const Value& value, Table& table);
+
+// Only the named columns, in that order; false if one is missing
+bool select(const Table& table, const std::vector<std::string>& names, Table& out);
+
+enum class Compare : uint8_t { EQ, NE, LT, LE, GT, GE, CONTAINS };
+// =, is, not, over, under, >=, contains and the other spellings the
+// language uses; false if name is none of them
+bool compareFrom(std::string_view name, Compare& op);
+
+// Rows where column op operand holds. Numbers compare exactly, text
+// compares as text, and void or NaN fields never match.
+Selection filter(const Table& table, const Column& column, Compare op, const Value& operand);
+// Rows where the expression is true, with each column's value bound to
+// its name. It is compiled once, and runs per row on the VM.
+Selection filter(const Table& table, const std::string& source, Runtime& runtime);
+// Rows for which the act returns true, given the columns' values
+Selection filter(const Table& table, const Function& predicate,
+                 const std::vector<const Column*>& arguments, Runtime& runtime);
+
+// The selected rows of every column, in selection order
+Table gather(const Table& table, const Selection& rows);
+
+struct SortKey {
+    const Column* column;
+    bool descending = false;
+};
+// Row order sorting by the keys in turn; stable, with void and NaN last.
+// Packed and text keys are radix sorted (text by the rank of each distinct
+// value), others compared.
+Selection order(const Table& table, const std::vector<SortKey>& keys);
+
+// Inner hash join on left.leftKey = right.rightKey: the left columns, then
+// the right ones but its key, renamed name_2 if they clash. Keys match when
+// they are the same number or the same text.
+Table join(const Table& left, const Table& right, const Column& leftKey, const Column& rightKey);
+
+} // namespace query
+} // namespace azalea
+
+#endif // AZALEA_QUERY_H
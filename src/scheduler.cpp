@@ -0,0 +1,490 @@
+#if defined(__APPLE__) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 700 // ucontext on macOS
+#endif
+#include "scheduler.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <stdexcept>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+
+#ifdef AZALEA_TASK_THREADS
+#include <pthread.h>
+#include <sys/mman.h>
+#include <ucontext.h>
+#endif
+
+namespace azalea {
+
+WorkDeque::WorkDeque() : ring(nullptr) {
+    rings.push_back(std::make_unique<Ring>(64));
+    ring.store(rings.back().get(), std::memory_order_relaxed);
+}
+
+void WorkDeque::push(Task* task) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    Ring* r = ring.load(std::memory_order_relaxed);
+    if (b - t > r->capacity - 1) {
+        auto grown = std::make_unique<Ring>(r->capacity * 2);
+        for (int64_t i = t; i < b; i++) {
+            grown->put(i, r->get(i));
+        }
+        r = grown.get();
+        rings.push_back(std::move(grown));
+        ring.store(r, std::memory_order_release);
+    }
+    r->put(b, task);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+}
+
+Task* WorkDeque::pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    Ring* r = ring.load(std::memory_order_relaxed);
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    Task* task = r->get(b);
+    if (t == b) {
+        // Last task: race the thieves for it
+        if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+            task = nullptr;
+        }
+        bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+}
+
+Task* WorkDeque::steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) return nullptr;
+    Task* task = ring.load(std::memory_order_acquire)->get(t);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    return task;
+}
+
+#ifdef AZALEA_TASK_THREADS
+
+namespace {
+
+constexpr size_t TASK_STACK_SIZE = 1024 * 1024;
+constexpr size_t MAX_FREE_STACKS = 64;
+// Left to what runs at the deepest act call: module methods, and the
+// runtime unwinding the error
+constexpr size_t STACK_RESERVE = 128 * 1024;
+constexpr auto IDLE_POLL = std::chrono::milliseconds(50);
+
+} // namespace
+
+struct Task {
+    ucontext_t context;
+    std::function<void()> body;
+    void* stack = nullptr;
+    bool finished = false;
+};
+
+struct Worker {
+    WorkDeque deque;
+    std::thread thread;
+    ucontext_t context;          // the worker loop, switched back to by tasks
+    Task* current = nullptr;
+    std::mutex* unlockAfterSwitch = nullptr; // released once a parked task is off its stack
+    unsigned seed;
+};
+
+namespace {
+
+thread_local Worker* threadWorker = nullptr;
+
+// Tasks can resume on a different thread than they parked on, so the
+// thread-local is always re-read through a call rather than cached
+__attribute__((noinline)) Worker* currentWorker() {
+    return threadWorker;
+}
+
+// The lowest address of the calling thread's own stack
+const char* threadStackEnd() {
+#ifdef __APPLE__
+    pthread_t self = pthread_self();
+    return static_cast<const char*>(pthread_get_stackaddr_np(self)) - pthread_get_stacksize_np(self);
+#else
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) != 0) return nullptr;
+    void* end = nullptr;
+    size_t size = 0;
+    pthread_attr_getstack(&attr, &end, &size);
+    pthread_attr_destroy(&attr);
+    return static_cast<const char*>(end);
+#endif
+}
+
+void taskEntry() {
+    Task* task = currentWorker()->current;
+    try {
+        task->body();
+    } catch (...) {
+        // Bodies report their own errors; nothing may unwind off this stack
+    }
+    task->body = nullptr;
+    task->finished = true;
+    swapcontext(&task->context, &currentWorker()->context);
+}
+
+} // namespace
+
+Scheduler& Scheduler::instance() {
+    // Never destroyed: workers are detached and may still be parked at exit
+    static Scheduler* scheduler = new Scheduler();
+    return *scheduler;
+}
+
+Scheduler::Scheduler() {
+    size_t count = std::thread::hardware_concurrency();
+    if (const char* env = std::getenv("AZALEA_THREADS")) {
+        count = static_cast<size_t>(std::max(1, std::atoi(env)));
+    }
+    if (count == 0) count = 1;
+
+    for (size_t i = 0; i < count; i++) {
+        workers.push_back(std::make_unique<Worker>());
+        workers.back()->seed = static_cast<unsigned>(i * 2654435761u + 1);
+    }
+    for (auto& worker : workers) {
+        Worker* self = worker.get();
+        self->thread = std::thread([this, self] { work(*self); });
+        self->thread.detach();
+    }
+}
+
+void* Scheduler::allocateStack() {
+    {
+        std::lock_guard<std::mutex> lock(stackMutex);
+        if (!freeStacks.empty()) {
+            void* stack = freeStacks.back();
+            freeStacks.pop_back();
+            return stack;
+        }
+    }
+    // Untouched pages cost nothing, and the lowest one is a guard page so
+    // an overflow faults instead of corrupting the neighbouring stack
+    void* stack = mmap(nullptr, TASK_STACK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (stack == MAP_FAILED) throw std::runtime_error("Cannot allocate a task stack");
+    mprotect(stack, static_cast<size_t>(sysconf(_SC_PAGESIZE)), PROT_NONE);
+    return stack;
+}
+
+void Scheduler::releaseStack(void* stack) {
+    std::lock_guard<std::mutex> lock(stackMutex);
+    if (freeStacks.size() < MAX_FREE_STACKS) {
+        freeStacks.push_back(stack);
+    } else {
+        munmap(stack, TASK_STACK_SIZE);
+    }
+}
+
+void Scheduler::spawn(std::function<void()> body) {
+    Task* task = new Task();
+    task->body = std::move(body);
+    schedule(task);
+}
+
+void Scheduler::schedule(Task* task) {
+    Worker* worker = currentWorker();
+    if (worker) {
+        worker->deque.push(task);
+    } else {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        injected.push_back(task);
+        injectedCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    // Pairs with the fence in work(): either a sleeper sees this task, or
+    // this sees the sleeper and wakes it
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleeping.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(idleMutex);
+        idle.notify_one();
+    }
+}
+
+void Scheduler::wait(Waiter& waiter, std::unique_lock<std::mutex>& lock) {
+    Worker* worker = currentWorker();
+    if (!worker || !worker->current) {
+        waiter.cv.wait(lock, [&] { return waiter.woken; });
+        lock.unlock();
+        return;
+    }
+    // The worker unlocks only after this task's context is saved, so a
+    // waker cannot reschedule it while it is still on its stack
+    Task* task = worker->current;
+    waiter.task = task;
+    std::mutex* mutex = lock.release();
+    worker->unlockAfterSwitch = mutex;
+    swapcontext(&task->context, &worker->context);
+    // Back unlocked, as on a plain thread, but still holding the mutex for
+    // the caller to lock again
+    lock = std::unique_lock<std::mutex>(*mutex, std::defer_lock);
+}
+
+void Scheduler::wake(Waiter& waiter) {
+    waiter.woken = true;
+    if (waiter.task) {
+        schedule(waiter.task);
+    } else {
+        waiter.cv.notify_one();
+    }
+}
+
+bool Scheduler::hasWork() const {
+    if (injectedCount.load(std::memory_order_relaxed) > 0) return true;
+    for (const auto& worker : workers) {
+        if (!worker->deque.empty()) return true;
+    }
+    return false;
+}
+
+Task* Scheduler::find(Worker& self) {
+    if (Task* task = self.deque.pop()) return task;
+    if (injectedCount.load(std::memory_order_relaxed) > 0) {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        if (!injected.empty()) {
+            Task* task = injected.front();
+            injected.pop_front();
+            injectedCount.fetch_sub(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    // Steal, starting from a random victim so thieves spread out
+    size_t count = workers.size();
+    self.seed = self.seed * 1103515245u + 12345u;
+    size_t start = (self.seed >> 16) % count;
+    for (size_t i = 0; i < count; i++) {
+        Worker& victim = *workers[(start + i) % count];
+        if (&victim == &self) continue;
+        if (Task* task = victim.deque.steal()) return task;
+    }
+    return nullptr;
+}
+
+void Scheduler::finish(Task* task) {
+    releaseStack(task->stack);
+    delete task;
+}
+
+void Scheduler::work(Worker& self) {
+    threadWorker = &self;
+    while (true) {
+        Task* task = find(self);
+        if (!task) {
+            std::unique_lock<std::mutex> lock(idleMutex);
+            sleeping.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (!hasWork()) {
+                idle.wait_for(lock, IDLE_POLL);
+            }
+            sleeping.fetch_sub(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Stacks are taken when a task first runs, so queued tasks hold
+        // none and short tasks keep reusing the same few
+        if (!task->stack) {
+            task->stack = allocateStack();
+            getcontext(&task->context);
+            task->context.uc_stack.ss_sp = task->stack;
+            task->context.uc_stack.ss_size = TASK_STACK_SIZE;
+            task->context.uc_link = nullptr;
+            makecontext(&task->context, taskEntry, 0);
+        }
+        self.current = task;
+        swapcontext(&self.context, &task->context);
+        self.current = nullptr;
+        if (self.unlockAfterSwitch) {
+            self.unlockAfterSwitch->unlock();
+            self.unlockAfterSwitch = nullptr;
+        }
+        if (task->finished) finish(task);
+    }
+}
+
+namespace {
+
+bool pollOne(int fd, short events, int timeoutMs) {
+    pollfd entry = {fd, events, 0};
+    int ready;
+    while ((ready = ::poll(&entry, 1, timeoutMs)) < 0 && errno == EINTR) {}
+    return ready != 0;
+}
+
+} // namespace
+
+bool Scheduler::stackLow() {
+    char here;
+    const char* end;
+    Worker* worker = currentWorker();
+    if (worker && worker->current) {
+        end = static_cast<const char*>(worker->current->stack);
+    } else {
+        thread_local const char* threadEnd = threadStackEnd();
+        end = threadEnd;
+    }
+    return end && &here < end + STACK_RESERVE;
+}
+
+bool Scheduler::waitFd(int fd, bool writable, int timeoutMs) {
+    short events = writable ? POLLOUT : POLLIN;
+    Worker* worker = currentWorker();
+    if (!worker || !worker->current) {
+        // A plain thread has nothing else to run, so it just polls
+        return pollOne(fd, events, timeoutMs);
+    }
+    auto deadline = timeoutMs < 0 ? std::chrono::steady_clock::time_point::max()
+                                  : std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+    Waiter waiter;
+    bool ready = false;
+    std::unique_lock<std::mutex> lock(pollMutex);
+    if (!polling) {
+        if (pipe(pollWake) != 0) throw std::runtime_error("Cannot start the I/O poller");
+        fcntl(pollWake[0], F_SETFL, O_NONBLOCK);
+        fcntl(pollWake[1], F_SETFL, O_NONBLOCK);
+        std::thread([this] { poll(); }).detach();
+        polling = true;
+    }
+    fdWaits.push_back({fd, events, deadline, &waiter, &ready});
+    char byte = 0;
+    ssize_t written = write(pollWake[1], &byte, 1); // full: a wakeup is pending anyway
+    (void)written;
+    wait(waiter, lock);
+    return ready;
+}
+
+void Scheduler::poll() {
+    using Clock = std::chrono::steady_clock;
+    std::vector<pollfd> entries;
+    while (true) {
+        Clock::time_point next = Clock::time_point::max();
+        {
+            std::lock_guard<std::mutex> lock(pollMutex);
+            entries.assign(1, pollfd{pollWake[0], POLLIN, 0});
+            for (const FdWait& entry : fdWaits) {
+                entries.push_back({entry.fd, entry.events, 0});
+                next = std::min(next, entry.deadline);
+            }
+        }
+        int timeout = -1;
+        if (next != Clock::time_point::max()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(next - Clock::now()).count();
+            timeout = static_cast<int>(std::max<int64_t>(0, std::min<int64_t>(left + 1, INT32_MAX)));
+        }
+        if (::poll(entries.data(), entries.size(), timeout) < 0) continue;
+        if (entries[0].revents) {
+            char drain[64];
+            while (read(pollWake[0], drain, sizeof(drain)) > 0) {}
+        }
+        // Only this thread removes waits, so the ones polled are still at
+        // the front, in order
+        Clock::time_point now = Clock::now();
+        std::lock_guard<std::mutex> lock(pollMutex);
+        for (size_t i = entries.size(); i-- > 1;) {
+            FdWait& entry = fdWaits[i - 1];
+            if (!entries[i].revents && entry.deadline > now) continue;
+            *entry.ready = entries[i].revents != 0;
+            wake(*entry.waiter);
+            fdWaits.erase(fdWaits.begin() + static_cast<ptrdiff_t>(i - 1));
+        }
+    }
+}
+
+#else
+
+struct Task {};
+struct Worker {};
+
+Scheduler& Scheduler::instance() {
+    static Scheduler scheduler;
+    return scheduler;
+}
+
+Scheduler::Scheduler() {}
+
+void Scheduler::spawn(std::function<void()> body) {
+    try {
+        body();
+    } catch (...) {
+    }
+}
+
+void Scheduler::wait(Waiter& waiter, std::unique_lock<std::mutex>& lock) {
+    if (!waiter.woken) {
+        lock.unlock();
+        throw std::runtime_error("Deadlock: nothing else can run while this waits");
+    }
+    lock.unlock();
+}
+
+void Scheduler::wake(Waiter& waiter) {
+    waiter.woken = true;
+}
+
+bool Scheduler::stackLow() {
+    return false;
+}
+
+bool Scheduler::waitFd(int fd, bool writable, int timeoutMs) {
+    pollfd entry = {fd, static_cast<short>(writable ? POLLOUT : POLLIN), 0};
+    int ready;
+    while ((ready = ::poll(&entry, 1, timeoutMs)) < 0 && errno == EINTR) {}
+    return ready != 0;
+}
+
+#endif
+
+void Scheduler::parallel(size_t count, const std::function<void(size_t)>& body) {
+    if (count == 1) {
+        body(0);
+        return;
+    }
+    // Shared so the last task can still unlock it after the caller returns
+    struct Join {
+        std::mutex mutex;
+        Waiter waiter;
+        size_t remaining;
+        std::exception_ptr error;
+    };
+    auto join = std::make_shared<Join>();
+    join->remaining = count;
+    for (size_t i = 0; i < count; i++) {
+        spawn([this, join, &body, i] {
+            std::exception_ptr error;
+            try {
+                body(i);
+            } catch (...) {
+                error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(join->mutex);
+            if (error && !join->error) join->error = error;
+            if (--join->remaining == 0) wake(join->waiter);
+        });
+    }
+    std::unique_lock<std::mutex> lock(join->mutex);
+    if (join->remaining > 0) {
+        wait(join->waiter, lock);
+    } else {
+        lock.unlock();
+    }
+    if (join->error) std::rethrow_exception(join->error);
+}
+
+} // namespace azalea
@@ -0,0 +1,123 @@
+#ifndef AZALEA_SCHEDULER_H
+#define AZALEA_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tasks need threads and switchable stacks; the browser build has neither,
+// so there every task runs to completion as soon as it is spawned
+#if !defined(__EMSCRIPTEN__) || defined(__EMSCRIPTEN_PTHREADS__)
+#define AZALEA_TASK_THREADS 1
+#endif
+
+namespace azalea {
+
+struct Task;
+struct Worker;
+
+// A task or thread blocked until another one calls Scheduler::wake on it
+struct Waiter {
+    Task* task = nullptr; // nullptr: a plain thread, blocked on cv
+    bool woken = false;
+    std::condition_variable cv;
+};
+
+// Chase-Lev work-stealing deque. The owning worker pushes and pops at the
+// bottom; other workers steal from the top.
+class WorkDeque {
+private:
+    struct Ring {
+        int64_t capacity;
+        std::unique_ptr<std::atomic<Task*>[]> slots;
+
+        explicit Ring(int64_t size) : capacity(size), slots(new std::atomic<Task*>[size]) {}
+        Task* get(int64_t i) const { return slots[i & (capacity - 1)].load(std::memory_order_relaxed); }
+        void put(int64_t i, Task* task) { slots[i & (capacity - 1)].store(task, std::memory_order_relaxed); }
+    };
+
+    std::atomic<int64_t> top{0};
+    std::atomic<int64_t> bottom{0};
+    std::atomic<Ring*> ring;
+    std::vector<std::unique_ptr<Ring>> rings; // outgrown rings stay alive for late thieves
+
+public:
+    WorkDeque();
+    void push(Task* task); // owner only
+    Task* pop();           // owner only
+    Task* steal();
+    bool empty() const {
+        return bottom.load(std::memory_order_relaxed) <= top.load(std::memory_order_relaxed);
+    }
+};
+
+// M:N scheduler: lightweight tasks with their own stacks run on a fixed
+// pool of worker threads. Each worker has a WorkDeque; idle workers steal.
+// A task that waits parks, handing its worker back to other tasks.
+class Scheduler {
+public:
+    static Scheduler& instance(); // started on first use, lives until exit
+
+    void spawn(std::function<void()> body);
+    // Blocks the caller until wake(waiter). `lock` guards the waiter; it is
+    // released while waiting and not held on return.
+    void wait(Waiter& waiter, std::unique_lock<std::mutex>& lock);
+    // Caller holds the lock the waiter is waiting under
+    void wake(Waiter& waiter);
+    // Runs body(0) .. body(count - 1) as tasks and returns once all of them
+    // have finished, rethrowing the first exception any of them threw
+    void parallel(size_t count, const std::function<void(size_t)>& body);
+    // Parks the caller until fd is readable (or, with writable, writable)
+    // or has failed; false if timeoutMs (-1: no limit) passed first. A task
+    // hands its worker to other tasks meanwhile; a poller thread, started
+    // on first use, wakes it.
+    bool waitFd(int fd, bool writable, int timeoutMs = -1);
+    size_t workerCount() const { return workers.size(); }
+    // Whether the caller, in a task or on a plain thread, is close to the
+    // end of its stack. Recursion only the stack bounds (the tree engine's
+    // act calls) checks it, to fail with an error rather than fault
+    static bool stackLow();
+
+private:
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex injectMutex; // tasks submitted from outside the pool
+    std::deque<Task*> injected;
+    std::atomic<size_t> injectedCount{0};
+    std::mutex idleMutex;
+    std::condition_variable idle;
+    std::atomic<int> sleeping{0};
+    std::mutex stackMutex;
+    std::vector<void*> freeStacks;
+    struct FdWait {
+        int fd;
+        short events;
+        std::chrono::steady_clock::time_point deadline;
+        Waiter* waiter;
+        bool* ready; // set before the waiter is woken
+    };
+    std::mutex pollMutex; // guards the waits and their waiters
+    std::vector<FdWait> fdWaits;
+    int pollWake[2] = {-1, -1}; // pipe that interrupts the poller's poll()
+    bool polling = false;
+
+    Scheduler();
+    void schedule(Task* task);
+    void work(Worker& self);
+    Task* find(Worker& self);
+    bool hasWork() const;
+    void finish(Task* task);
+    void* allocateStack();
+    void releaseStack(void* stack);
+    void poll();
+};
+
+} // namespace azalea
+
+#endif // AZALEA_SCHEDULER_H
@@ -0,0 +1,737 @@
+#include "vm.h"
+#include "profile.h"
+#include <cmath>
+
+#if defined(__GNUC__) || defined(__clang__)
+#define AZALEA_COMPUTED_GOTO 1
+#else
+#define AZALEA_COMPUTED_GOTO 0
+#endif
+
+namespace azalea {
+
+// Resolve operator spellings once, at compile time
+static bool resolveBinaryOp(std::string_view op, OpCode& out) {
+    if (op == "plus" || op == "add" || op == "+") out = OpCode::ADD;
+    else if (op == "minus" || op == "subtract" || op == "-") out = OpCode::SUB;
+    else if (op == "times" || op == "multiply" || op == "*") out = OpCode::MUL;
+    else if (op == "div" || op == "divide" || op == "/") out = OpCode::DIV;
+    else if (op == "mod" || op == "%") out = OpCode::MOD;
+    else if (op == "power" || op == "^" || op == "**") out = OpCode::POW;
+    else if (op == "over" || op == "greater" || op == ">") out = OpCode::GT;
+    else if (op == "under" || op == "less" || op == "<") out = OpCode::LT;
+    else if (op == ">=") out = OpCode::GE;
+    else if (op == "<=") out = OpCode::LE;
+    else if (op == "same" || op == "equals" || op == "is" ||
+             op == "are" || op == "==" || op == "=") out = OpCode::EQ;
+    else if (op == "not" || op == "notequal" || op == "!=") out = OpCode::NE;
+    else if (op == "and" || op == "andalso" || op == "&&") out = OpCode::AND;
+    else if (op == "or" || op == "orelse" || op == "||") out = OpCode::OR;
+    else return false;
+    return true;
+}
+
+// Compiler implementation
+Compiler::Compiler(Runtime& rt) : runtime(rt), chunk(nullptr), top(0), profiling(profile::counting()) {}
+
+uint16_t Compiler::allocReg() {
+    uint16_t reg = static_cast<uint16_t>(top++);
+    if (top > chunk->numRegs) chunk->numRegs = top;
+    return reg;
+}
+
+void Compiler::freeReg(uint16_t reg) {
+    top = reg;
+}
+
+size_t Compiler::emit(OpCode op, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
+    chunk->code.push_back({op, static_cast<uint16_t>(a), b, c, d});
+    if (profiling) {
+        chunk->profileNodes.push_back(std::move(pendingNodes));
+        pendingNodes.clear();
+    }
+    return chunk->code.size() - 1;
+}
+
+void Compiler::patch(size_t at, size_t target) {
+    chunk->code[at].b = static_cast<uint32_t>(target);
+}
+
+uint32_t Compiler::addConstant(Value value) {
+    chunk->constants.push_back(value);
+    return static_cast<uint32_t>(chunk->constants.size() - 1);
+}
+
+uint32_t Compiler::addName(const std::string& name) {
+    for (size_t i = 0; i < chunk->names.size(); i++) {
+        if (chunk->names[i] == name) return static_cast<uint32_t>(i);
+    }
+    chunk->names.push_back(name);
+    chunk->nameSites.push_back(NameSite{hashKey(name), {}});
+    return static_cast<uint32_t>(chunk->names.size() - 1);
+}
+
+std::shared_ptr<Chunk> Compiler::compile(ASTNode* program) {
+    auto out = std::make_shared<Chunk>();
+    compileBody(program, *out);
+    return out;
+}
+
+void Compiler::compileBody(ASTNode* node, Chunk& out) {
+    Chunk* savedChunk = chunk;
+    size_t savedTop = top;
+    std::vector<uint64_t> savedNodes = std::move(pendingNodes); // they start in the enclosing chunk
+    pendingNodes.clear();
+    chunk = &out;
+    chunk->isolate = runtime.isolate;
+    top = 0;
+
+    uint16_t result = allocReg();
+    compileNode(node, result);
+    emit(OpCode::RET, result);
+
+    chunk = savedChunk;
+    top = savedTop;
+    pendingNodes = std::move(savedNodes);
+}
+
+void Compiler::compileSequence(ASTNode* node, uint16_t dst) {
+    emit(OpCode::LOADVOID, dst);
+    for (auto& child : node->children) {
+        compileNode(child, dst);
+    }
+}
+
+void Compiler::compileNode(ASTNode* node, uint16_t dst) {
+    if (!node) {
+        emit(OpCode::LOADVOID, dst);
+        return;
+    }
+    // A node is hit whenever its first instruction runs
+    if (profiling) pendingNodes.push_back(profile::nodeKey(node->line, node->col, static_cast<uint8_t>(node->type)));
+
+    auto& children = node->children;
+    switch (node->type) {
+        case NodeType::PROGRAM:
+            compileSequence(node, dst);
+            return;
+
+        case NodeType::BLOCK:
+            emit(OpCode::PUSHSCOPE);
+            compileSequence(node, dst);
+            emit(OpCode::POPSCOPE);
+            return;
+
+        case NodeType::FORM:
+            if (children.size() >= 2) {
+                if (children.size() > 2) {
+                    compileNode(children[2], dst);
+                } else {
+                    emit(OpCode::LOADVOID, dst);
+                }
+                emit(OpCode::SETVAR, dst, static_cast<uint32_t>(children[1]->slot));
+                return;
+            }
+            break;
+
+        case NodeType::ACT:
+            if (!children.empty()) {
+                compileAct(node, dst);
+                return;
+            }
+            break;
+
+        case NodeType::CALL:
+            if (!children.empty()) {
+                compileCall(node, dst);
+                return;
+            }
+            break;
+
+        case NodeType::IF:
+            if (children.size() >= 2) {
+                uint16_t cond = allocReg();
+                compileNode(children[0], cond);
+                size_t jumpElse = emit(OpCode::JMPIFNOT, cond);
+                freeReg(cond);
+                compileNode(children[1], dst);
+                size_t jumpEnd = emit(OpCode::JMP);
+                patch(jumpElse, chunk->code.size());
+                if (children.size() > 2) {
+                    compileNode(children[2], dst);
+                } else {
+                    emit(OpCode::LOADVOID, dst);
+                }
+                patch(jumpEnd, chunk->code.size());
+                return;
+            }
+            break;
+
+        case NodeType::LOOP:
+            if (children.size() >= 2) {
+                compileLoop(node, dst);
+                return;
+            }
+            break;
+
+        case NodeType::GIVE:
+            if (!children.empty()) {
+                compileNode(children[0], dst);
+                return;
+            }
+            break;
+
+        case NodeType::SAY:
+            if (!children.empty()) {
+                compileNode(children[0], dst);
+                int repeatCount = 1;
+                if (children.size() > 1 && children[1]->type == NodeType::LITERAL) {
+                    Value count;
+                    repeatCount = literalValue(*children[1], count) ? static_cast<int>(count.toNumber()) : 0;
+                }
+                uint32_t slot = node->value.empty() ? 0 : static_cast<uint32_t>(node->slot) + 1;
+                emit(OpCode::SAY, dst, static_cast<uint32_t>(repeatCount), slot);
+                return;
+            }
+            break;
+
+        case NodeType::PUT:
+            if (children.size() >= 2) {
+                compileNode(children[0], dst);
+                if (children[1]->type == NodeType::IDENTIFIER) {
+                    emit(OpCode::SETVAR, dst, static_cast<uint32_t>(children[1]->slot));
+                }
+                return;
+            } else if (children.size() == 1) {
+                compileNode(children[0], dst);
+                return;
+            }
+            break;
+
+        case NodeType::BINARY_OP:
+            if (children.size() >= 2) {
+                uint16_t left = allocReg();
+                uint16_t right = allocReg();
+                compileNode(children[0], left);
+                compileNode(children[1], right);
+                OpCode op;
+                if (resolveBinaryOp(node->value, op)) {
+                    emit(op, dst, left, right);
+                } else {
+                    emit(OpCode::LOADVOID, dst);
+                }
+                freeReg(left);
+                return;
+            }
+            break;
+
+        case NodeType::IDENTIFIER:
+            emit(OpCode::GETVAR, dst, static_cast<uint32_t>(node->slot));
+            return;
+
+        case NodeType::LITERAL: {
+            Value value;
+            if (literalValue(*node, value)) {
+                emit(OpCode::LOADK, dst, addConstant(value));
+            } else {
+                emit(OpCode::GETVAR, dst, static_cast<uint32_t>(node->slot));
+            }
+            return;
+        }
+
+        case NodeType::CONSTANT:
+            emit(OpCode::LOADK, dst, addConstant(node->constantValue()));
+            return;
+
+        default:
+            break;
+    }
+
+    emit(OpCode::LOADVOID, dst);
+}
+
+void Compiler::compileAct(ASTNode* node, uint16_t dst) {
+    auto& children = node->children;
+    std::shared_ptr<FunctionProto> proto;
+    if (protos) {
+        auto found = protos->find(node);
+        if (found != protos->end() && found->second->chunk.profileNodes.empty() != profiling) proto = found->second;
+    }
+    if (!proto) {
+        proto = std::make_shared<FunctionProto>();
+        if (children[0]->type == NodeType::IDENTIFIER) proto->name = std::string(children[0]->value);
+
+        size_t bodyIdx = children.size() - 1;
+        for (size_t i = 1; i < children.size(); i++) {
+            if (children[i]->type == NodeType::BLOCK) {
+                bodyIdx = i;
+                break;
+            }
+            proto->params.push_back(children[i]->slot);
+        }
+
+        compileBody(children[bodyIdx], proto->chunk);
+        if (protos) (*protos)[node] = proto;
+    }
+    chunk->functions.push_back(proto);
+    emit(OpCode::DEFFN, dst, static_cast<uint32_t>(chunk->functions.size() - 1));
+    // An act without a name (its first child is the body) binds nothing
+    if (children[0]->type == NodeType::IDENTIFIER) {
+        emit(OpCode::SETVAR, dst, static_cast<uint32_t>(children[0]->slot));
+    }
+}
+
+void Compiler::compileCall(ASTNode* node, uint16_t dst) {
+    auto& children = node->children;
+    std::string name(children[0]->value);
+
+    // Module calls are resolved against the registered modules up front
+    if (children.size() > 1) {
+        auto moduleIt = runtime.state->modules.find(name);
+        if (moduleIt != runtime.state->modules.end()) {
+            std::string method(children[1]->value);
+            ModuleMethod handler = moduleIt->second->resolve(method, children.size() - 2);
+            chunk->modules.push_back({moduleIt->second, std::move(method), handler});
+            uint32_t site = static_cast<uint32_t>(chunk->modules.size() - 1);
+            uint16_t base = static_cast<uint16_t>(top);
+            for (size_t i = 2; i < children.size(); i++) {
+                compileNode(children[i], allocReg());
+            }
+            emit(OpCode::CALLMOD, dst, site, base, static_cast<uint32_t>(children.size() - 2));
+            freeReg(base);
+            return;
+        }
+    }
+
+    uint16_t base = static_cast<uint16_t>(top);
+    for (size_t i = 1; i < children.size(); i++) {
+        compileNode(children[i], allocReg());
+    }
+    emit(node->tail ? OpCode::TAILCALL : OpCode::CALLFN, dst, addName(name), base,
+         static_cast<uint32_t>(children.size() - 1));
+    freeReg(base);
+}
+
+void Compiler::compileLoop(ASTNode* node, uint16_t dst) {
+    auto& children = node->children;
+    if (node->parallel) {
+        // The body is a chunk of its own, run once per iteration by
+        // Runtime::loopParallel on whichever runtime takes the iteration
+        auto proto = std::make_shared<FunctionProto>();
+        proto->name = "loop";
+        compileBody(children[1], proto->chunk);
+        chunk->functions.push_back(proto);
+        uint16_t limit = allocReg();
+        compileNode(children[0], limit);
+        emit(OpCode::TONUM, limit, limit);
+        emit(OpCode::PARLOOP, dst, static_cast<uint32_t>(chunk->functions.size() - 1), limit,
+             static_cast<uint32_t>(node->slot));
+        freeReg(limit);
+        return;
+    }
+    uint16_t limit = allocReg();
+    uint16_t counter = allocReg();
+    compileNode(children[0], limit);
+    emit(OpCode::TONUM, limit, limit);
+    emit(OpCode::FORPREP, counter);
+    emit(OpCode::LOADVOID, dst);
+
+    size_t loopStart = emit(OpCode::FORTEST, counter, 0, limit);
+    emit(OpCode::PUSHSCOPE);
+    emit(OpCode::STEP, counter, static_cast<uint32_t>(node->slot));
+    compileNode(children[1], dst);
+    emit(OpCode::POPSCOPE);
+    emit(OpCode::FORINC, counter);
+    size_t jumpBack = emit(OpCode::JMP);
+    patch(jumpBack, loopStart);
+    patch(loopStart, chunk->code.size());
+    freeReg(limit);
+}
+
+// VM implementation
+namespace {
+
+// Restores the value stack even if a module throws
+struct StackFrame {
+    std::vector<Value>& stack;
+    size_t base;
+    StackFrame(std::vector<Value>& s, size_t size) : stack(s), base(s.size()) {
+        stack.resize(base + size);
+    }
+    ~StackFrame() { stack.resize(base); }
+};
+
+inline double num(const Value& v) {
+    return v.type == ValueType::NUM ? v.num : v.toNumber();
+}
+
+inline bool textEqual(const Value& l, const Value& r) {
+    return l.asText() == r.asText();
+}
+
+// Whether the loop for chunk counts nodes
+inline bool profiled(const Chunk& chunk) {
+    return !chunk.profileNodes.empty() && profile::counting();
+}
+
+} // namespace
+
+Value VM::run(Runtime& rt, const Chunk& chunk) {
+    if (profiled(chunk)) return loop<true>(rt, chunk, nullptr, nullptr, 0);
+    return loop<false>(rt, chunk, nullptr, nullptr, 0);
+}
+
+Value VM::call(Runtime& rt, const Act& act, const Value* args, size_t count) {
+    if (profiled(*act.code)) return loop<true>(rt, *act.code, &act, args, count);
+    return loop<false>(rt, *act.code, &act, args, count);
+}
+
+template <bool Profiled>
+Value VM::loop(Runtime& rt, const Chunk& entry, const Act* act, const Value* args, size_t count) {
+    // Frames above bottom are acts this loop runs: act, if given, and the
+    // compiled acts they call, which run here rather than in loops of their
+    // own as long as their chunks are profiled the same way
+    size_t bottom = rt.frames.size();
+    struct Unwind {
+        Runtime& rt;
+        size_t bottom;
+        ~Unwind() {
+            // Only when something threw; otherwise every frame has returned
+            while (rt.frames.size() > bottom) {
+                Runtime::CallFrame& top = rt.frames.back();
+                if (top.recorder) top.recorder->leave();
+                rt.running = top.running;
+                rt.frames.pop_back();
+            }
+        }
+    } unwind{rt, bottom};
+    auto runsHere = [](const Act& callee) {
+        return callee.code && profiled(*callee.code) == Profiled;
+    };
+    if (act) {
+        // Bound before the registers below are added, as they may move args
+        rt.frames.push_back({nullptr, nullptr, 0, rt.scopeMarks.size(), rt.running, nullptr, profile::current});
+        rt.enterAct(*act, args, count);
+        rt.running = act;
+        if (profile::Recorder* recorder = profile::current) recorder->enter(recorder->frame(act, act->name));
+    }
+    StackFrame registers(rt.stack, entry.numRegs);
+    const Chunk* chunk = &entry;
+    size_t base = registers.base;
+    Value* R = rt.stack.data() + base;
+    const Instr* code = chunk->code.data();
+    const Instr* ip = code;
+    std::vector<Value> moduleArgs;
+
+    // Only the profiled instantiation counts the nodes each instruction starts
+#define VM_PROFILE() \
+    if constexpr (Profiled) { \
+        for (uint64_t key : chunk->profileNodes[ip - code]) profile::current->hit(key); \
+    }
+
+#if AZALEA_COMPUTED_GOTO
+    static const void* dispatchTable[] = {
+#define AZALEA_OPCODE_LABEL(name) &&L_##name,
+        AZALEA_OPCODES(AZALEA_OPCODE_LABEL)
+#undef AZALEA_OPCODE_LABEL
+    };
+#define VM_DISPATCH() { VM_PROFILE(); goto *dispatchTable[static_cast<size_t>(ip->op)]; }
+#define VM_CASE(name) L_##name:
+#define VM_NEXT() do { ++ip; VM_DISPATCH() } while (0)
+#define VM_JUMP(target) do { ip = code + (target); VM_DISPATCH() } while (0)
+#else
+#define VM_DISPATCH() VM_PROFILE(); switch (ip->op)
+#define VM_CASE(name) case OpCode::name:
+#define VM_NEXT() do { ++ip; goto dispatch; } while (0)
+#define VM_JUMP(target) do { ip = code + (target); goto dispatch; } while (0)
+dispatch:
+#endif
+
+    VM_DISPATCH() {
+        VM_CASE(LOADK) {
+            // Constants are only shared within the isolate that compiled
+            // them; a task running a closure from its parent gets a copy
+            if (chunk->isolate == rt.isolate) {
+                R[ip->a] = chunk->constants[ip->b];
+            } else {
+                R[ip->a] = chunk->constants[ip->b].clone();
+            }
+            VM_NEXT();
+        }
+        VM_CASE(LOADVOID) {
+            R[ip->a] = Value();
+            VM_NEXT();
+        }
+        VM_CASE(MOVE) {
+            R[ip->a] = R[ip->b];
+            VM_NEXT();
+        }
+        VM_CASE(GETVAR) {
+            R[ip->a] = rt.getSlot(ip->b);
+            VM_NEXT();
+        }
+        VM_CASE(SETVAR) {
+            rt.setSlot(ip->b, R[ip->a]);
+            VM_NEXT();
+        }
+        VM_CASE(PUSHSCOPE) {
+            rt.pushScope();
+            VM_NEXT();
+        }
+        VM_CASE(POPSCOPE) {
+            rt.popScope();
+            VM_NEXT();
+        }
+        VM_CASE(ADD) {
+            R[ip->a] = Value(num(R[ip->b]) + num(R[ip->c]));
+            VM_NEXT();
+        }
+        VM_CASE(SUB) {
+            R[ip->a] = Value(num(R[ip->b]) - num(R[ip->c]));
+            VM_NEXT();
+        }
+        VM_CASE(MUL) {
+            R[ip->a] = Value(num(R[ip->b]) * num(R[ip->c]));
+            VM_NEXT();
+        }
+        VM_CASE(DIV) {
+            double rnum = num(R[ip->c]);
+            R[ip->a] = Value(rnum == 0.0 ? 0.0 : num(R[ip->b]) / rnum);
+            VM_NEXT();
+        }
+        VM_CASE(MOD) {
+            double rnum = num(R[ip->c]);
+            R[ip->a] = Value(rnum == 0.0 ? 0.0 : std::fmod(num(R[ip->b]), rnum));
+            VM_NEXT();
+        }
+        VM_CASE(POW) {
+            R[ip->a] = Value(std::pow(num(R[ip->b]), num(R[ip->c])));
+            VM_NEXT();
+        }
+        VM_CASE(GT) {
+            R[ip->a] = Value(num(R[ip->b]) > num(R[ip->c]));
+            VM_NEXT();
+        }
+        VM_CASE(LT) {
+            R[ip->a] = Value(num(R[ip->b]) < num(R[ip->c]));
+            VM_NEXT();
+        }
+        VM_CASE(GE) {
+            R[ip->a] = Value(num(R[ip->b]) >= num(R[ip->c]));
+            VM_NEXT();
+        }
+        VM_CASE(LE) {
+            R[ip->a] = Value(num(R[ip->b]) <= num(R[ip->c]));
+            VM_NEXT();
+        }
+        VM_CASE(EQ) {
+            const Value& l = R[ip->b];
+            const Value& r = R[ip->c];
+            if (l.type == ValueType::TEXT && r.type == ValueType::TEXT) {
+                R[ip->a] = Value(textEqual(l, r));
+            } else {
+                R[ip->a] = Value(std::abs(num(l) - num(r)) < 0.0001);
+            }
+            VM_NEXT();
+        }
+        VM_CASE(NE) {
+            const Value& l = R[ip->b];
+            const Value& r = R[ip->c];
+            if (l.type == ValueType::TEXT && r.type == ValueType::TEXT) {
+                R[ip->a] = Value(!textEqual(l, r));
+            } else {
+                R[ip->a] = Value(std::abs(num(l) - num(r)) >= 0.0001);
+            }
+            VM_NEXT();
+        }
+        VM_CASE(AND) {
+            R[ip->a] = Value(R[ip->b].toBool() && R[ip->c].toBool());
+            VM_NEXT();
+        }
+        VM_CASE(OR) {
+            R[ip->a] = Value(R[ip->b].toBool() || R[ip->c].toBool());
+            VM_NEXT();
+        }
+        VM_CASE(JMP) {
+            VM_JUMP(ip->b);
+        }
+        VM_CASE(JMPIFNOT) {
+            if (!R[ip->a].toBool()) VM_JUMP(ip->b);
+            VM_NEXT();
+        }
+        VM_CASE(TONUM) {
+            R[ip->a] = Value(R[ip->b].toNumber());
+            VM_NEXT();
+        }
+        VM_CASE(FORPREP) {
+            R[ip->a] = Value(0.0);
+            VM_NEXT();
+        }
+        // The compiler keeps numbers in counter and limit registers, but a
+        // loaded image (image.h) only has its operands bounds-checked
+        VM_CASE(FORTEST) {
+            if (!(num(R[ip->a]) < num(R[ip->c]))) {
+                VM_JUMP(ip->b);
+            }
+            VM_NEXT();
+        }
+        VM_CASE(FORINC) {
+            Value& counter = R[ip->a];
+            if (counter.type == ValueType::NUM) {
+                counter.num += 1;
+            } else {
+                counter = Value(counter.toNumber() + 1);
+            }
+            VM_NEXT();
+        }
+        VM_CASE(STEP) {
+            rt.setSlot(ip->b, Value(num(R[ip->a])));
+            VM_NEXT();
+        }
+        VM_CASE(SAY) {
+            const Value& value = R[ip->a];
+            int repeatCount = static_cast<int>(static_cast<int32_t>(ip->b));
+            if (repeatCount > 0) {
+                std::string text = value.toString();
+                for (int i = 0; i < repeatCount; i++) {
+                    rt.print(text);
+                }
+            }
+            if (ip->c) {
+                rt.setSlot(ip->c - 1, value);
+            }
+            VM_NEXT();
+        }
+        VM_CASE(DEFFN) {
+            // A computed goto out of a block skips its destructors, so
+            // locals that own memory end before VM_NEXT
+            {
+                const std::shared_ptr<FunctionProto>& proto = chunk->functions[ip->b];
+                if (!proto->name.empty()) rt.own().functions[proto->name] = proto;
+                R[ip->a] = Value(ActPtr(proto));
+            }
+            VM_NEXT();
+        }
+        VM_CASE(CALLFN) callAct: {
+            const NameSite& site = chunk->nameSites[ip->b];
+            const ActPtr* found = rt.state->functions.lookup(MapKey(chunk->names[ip->b], site.hash), site.cache);
+            if (!found) {
+                R[ip->a] = Value();
+                VM_NEXT();
+            }
+            if (runsHere(**found)) {
+                // The callee's registers go above the caller's, which
+                // hold its arguments until they are bound
+                const Act* callee = found->get();
+                {
+                    profile::Recorder* recorder = profile::current;
+                    rt.frames.push_back({chunk, ip, base, rt.scopeMarks.size(), rt.running, *found, recorder});
+                    rt.enterAct(*callee, R + ip->c, ip->d);
+                    rt.running = callee;
+                    if (recorder) recorder->enter(recorder->frame(callee, callee->name));
+                }
+                chunk = callee->code;
+                base = rt.stack.size();
+                rt.stack.resize(base + chunk->numRegs);
+                R = rt.stack.data() + base;
+                code = chunk->code.data();
+                VM_JUMP(0);
+            }
+            {
+                ActPtr callee = *found; // the call may redefine it
+                Value result = rt.call(*callee, R + ip->c, ip->d);
+                // Nested calls may have grown (and moved) the value stack
+                R = rt.stack.data() + base;
+                R[ip->a] = std::move(result);
+            }
+            VM_NEXT();
+        }
+        VM_CASE(TAILCALL) {
+            // The caller's frame becomes the callee's: its scopes are
+            // popped, the callee's parameters bound from the arguments
+            // still in the registers, and the registers reused
+            const NameSite& site = chunk->nameSites[ip->b];
+            const ActPtr* found = rt.state->functions.lookup(MapKey(chunk->names[ip->b], site.hash), site.cache);
+            if (!found || rt.frames.size() == bottom || !runsHere(**found) ||
+                !Runtime::reusesFrame(rt.running, **found, ip->d)) {
+                goto callAct;
+            }
+            const Act* callee = found->get();
+            {
+                Runtime::CallFrame& top = rt.frames.back();
+                while (rt.scopeMarks.size() > top.scopeMark) rt.popScope();
+                rt.enterAct(*callee, R + ip->c, ip->d);
+                rt.running = callee;
+                if (top.recorder) {
+                    top.recorder->leave();
+                    top.recorder->enter(top.recorder->frame(callee, callee->name));
+                }
+                top.act = *found; // the caller's chunk is not used after this
+            }
+            chunk = callee->code;
+            rt.stack.resize(base);
+            rt.stack.resize(base + chunk->numRegs);
+            R = rt.stack.data() + base;
+            code = chunk->code.data();
+            VM_JUMP(0);
+        }
+        VM_CASE(CALLMOD) {
+            const ModuleSite& site = chunk->modules[ip->b];
+            moduleArgs.assign(R + ip->c, R + ip->c + ip->d);
+            Value result;
+            {
+                profile::Scope scope(&site, *site.module, site.method);
+                result = site.handler
+                    ? site.handler(MethodCall{*site.module, site.method, moduleArgs, rt})
+                    : site.module->getUnhandled();
+            }
+            R = rt.stack.data() + base;
+            R[ip->a] = std::move(result);
+            VM_NEXT();
+        }
+        VM_CASE(PARLOOP) {
+            {
+                const Chunk& body = chunk->functions[ip->b]->chunk;
+                Value result = rt.loopParallel(num(R[ip->c]), ip->d, [&body](Runtime& runtime) {
+                    return VM::run(runtime, body);
+                });
+                R = rt.stack.data() + base;
+                R[ip->a] = std::move(result);
+            }
+            VM_NEXT();
+        }
+        VM_CASE(RET) {
+            if (rt.frames.size() == bottom) return R[ip->a];
+            {
+                Runtime::CallFrame& top = rt.frames.back();
+                Value result = std::move(R[ip->a]);
+                while (rt.scopeMarks.size() > top.scopeMark) rt.popScope();
+                if (top.recorder) top.recorder->leave();
+                rt.running = top.running;
+                if (!top.chunk) {
+                    rt.frames.pop_back();
+                    return result;
+                }
+                size_t calleeBase = base;
+                chunk = top.chunk;
+                ip = top.ip;
+                base = top.base;
+                rt.frames.pop_back();
+                rt.stack.resize(calleeBase);
+                R = rt.stack.data() + base;
+                R[ip->a] = std::move(result);
+            }
+            code = chunk->code.data();
+            VM_NEXT();
+        }
+    }
+
+#undef VM_PROFILE
+#undef VM_DISPATCH
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_JUMP
+    return Value();
+}
+
+} // namespace azalea
@@ -0,0 +1,127 @@
+#ifndef AZALEA_VM_H
+#define AZALEA_VM_H
+
+#include "azalea.h"
+#include <cstdint>
+
+namespace azalea {
+
+// Opcode list - keeps the enum and the VM dispatch table in sync
+#define AZALEA_OPCODES(X) \
+    X(LOADK) X(LOADVOID) X(MOVE) \
+    X(GETVAR) X(SETVAR) X(PUSHSCOPE) X(POPSCOPE) \
+    X(ADD) X(SUB) X(MUL) X(DIV) X(MOD) X(POW) \
+    X(GT) X(LT) X(GE) X(LE) X(EQ) X(NE) X(AND) X(OR) \
+    X(JMP) X(JMPIFNOT) \
+    X(TONUM) X(FORPREP) X(FORTEST) X(FORINC) X(STEP) \
+    X(SAY) X(DEFFN) X(CALLFN) X(TAILCALL) X(CALLMOD) X(PARLOOP) X(RET)
+
+enum class OpCode : uint8_t {
+#define AZALEA_OPCODE_ENUM(name) name,
+    AZALEA_OPCODES(AZALEA_OPCODE_ENUM)
+#undef AZALEA_OPCODE_ENUM
+};
+
+// Fixed-width instruction: a is the destination register, b/c/d are
+// registers, variable slots, constant/name indices or jump targets
+// depending on the opcode
+struct Instr {
+    OpCode op;
+    uint16_t a;
+    uint32_t b;
+    uint32_t c;
+    uint32_t d;
+};
+
+struct FunctionProto;
+
+// Module call site, resolved to its handler when compiled
+struct ModuleSite {
+    ModulePtr module;
+    std::string method;
+    ModuleMethod handler; // nullptr: no handler accepts this call
+};
+
+// Where an act name in the chunk was last looked up in the functions table
+struct NameSite {
+    uint32_t hash; // hashKey of the name
+    mutable MapCache cache;
+};
+
+// Compiled code for the program or a single act body
+struct Chunk {
+    std::vector<Instr> code;
+    std::vector<Value> constants;
+    std::vector<std::string> names;
+    std::vector<NameSite> nameSites; // parallel to names
+    std::vector<ModuleSite> modules;
+    std::vector<std::shared_ptr<FunctionProto>> functions;
+    size_t numRegs = 1;
+    uint64_t isolate = 0; // of the runtime whose values the constants are
+    // Per instruction, the nodes (profile::nodeKey) whose code starts there;
+    // only filled in when compiled while profiling
+    std::vector<std::vector<uint64_t>> profileNodes;
+};
+
+// A compiled act, or the body of a parallel loop
+struct FunctionProto : Act {
+    Chunk chunk;
+    FunctionProto() { code = &chunk; }
+    FunctionProto(const FunctionProto&) = delete;
+    FunctionProto& operator=(const FunctionProto&) = delete;
+};
+
+// Compiled acts by the ACT node they were compiled from (see Outline)
+using ActProtos = std::unordered_map<const ASTNode*, std::shared_ptr<FunctionProto>>;
+
+// Lowers an AST into bytecode
+class Compiler {
+private:
+    Runtime& runtime;
+    Chunk* chunk;
+    size_t top;
+    bool profiling;
+    std::vector<uint64_t> pendingNodes; // entered, but no code emitted for them yet
+    ActProtos* protos = nullptr;
+
+    uint16_t allocReg();
+    void freeReg(uint16_t reg);
+    size_t emit(OpCode op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0, uint32_t d = 0);
+    void patch(size_t at, size_t target);
+    uint32_t addConstant(Value value);
+    uint32_t addName(const std::string& name);
+
+    void compileNode(ASTNode* node, uint16_t dst);
+    void compileSequence(ASTNode* node, uint16_t dst);
+    void compileAct(ASTNode* node, uint16_t dst);
+    void compileCall(ASTNode* node, uint16_t dst);
+    void compileLoop(ASTNode* node, uint16_t dst);
+    void compileBody(ASTNode* node, Chunk& out);
+
+public:
+    explicit Compiler(Runtime& rt);
+    std::shared_ptr<Chunk> compile(ASTNode* program);
+    // Acts found in protos are not compiled again, unless they were
+    // compiled for profiling and this compile is not or the other way
+    // round; the ones compiled are added
+    void reuseActs(ActProtos* acts) { protos = acts; }
+};
+
+// Register VM - runs compiled chunks on the runtime's value stack. Calls
+// from one compiled act to another stay in the dispatch loop, with a
+// Runtime::CallFrame instead of a C++ frame, so deep recursion only grows
+// the value stack; TAILCALL reuses the caller's frame.
+class VM {
+private:
+    template <bool Profiled>
+    static Value loop(Runtime& runtime, const Chunk& chunk, const Act* act, const Value* args, size_t count);
+
+public:
+    static Value run(Runtime& runtime, const Chunk& chunk);
+    // Runs a compiled act (act.code) for Runtime::call
+    static Value call(Runtime& runtime, const Act& act, const Value* args, size_t count);
+};
+
+} // namespace azalea
+
+#endif // AZALEA_VM_H